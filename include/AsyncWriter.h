@@ -0,0 +1,41 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs tasks one after another on its own thread in the order they were submitted, so that the caller goes on
+// while e.g. a snapshot of an image is written. The first exception thrown by a task is rethrown by Wait,
+// the tasks after it still run. The destructor waits for the tasks that are left.
+class AsyncWriter {
+public:
+    AsyncWriter();
+
+    AsyncWriter(const AsyncWriter &) = delete;
+
+    AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+    ~AsyncWriter();
+
+    void Submit(std::function<void()> task);
+
+    // Returns when every submitted task is done.
+    void Wait();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::function<void()> > tasks_;
+    bool busy_ = false;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+    std::thread thread_;
+
+    void Work();
+};
+
+#endif  // ASYNC_WRITER_H
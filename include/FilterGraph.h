@@ -0,0 +1,62 @@
+#ifndef FILTER_GRAPH_H
+#define FILTER_GRAPH_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Pipeline.h"
+#include "PlanarImage.h"
+#include "SharedPicture.h"
+
+// Several filter chains applied to one image, one output each, e.g. a sharpened copy, a gray preview and
+// an edge map of the same file. The optimized chains are kept as a tree: a filter sequence that several
+// chains start with is one edge of the tree and is applied once, and the image it gives is shared by
+// the branches below it, each of which copies it only if another one still needs it. In float precision
+// the image goes from node to node as a PlanarImage and is quantized only for the outputs, so every output is
+// the same as its chain gives on its own.
+class FilterGraph {
+public:
+    // Called for every output as soon as its image is ready. The sink may change the image through
+    // SharedPicture::Mutable, which copies it only if a branch still needs it.
+    using Sink = std::function<void(size_t output, SharedPicture picture)>;
+
+    // Adds a chain and returns the index of its output.
+    size_t AddOutput(const std::vector<std::string> &args);
+
+    size_t AddOutput(std::vector<FilterSpec> specs);
+
+    size_t Outputs() const {
+        return outputs_;
+    }
+
+    // Filters applied by one run, the ones shared by several chains are counted once.
+    size_t Stages() const;
+
+    // Filters that every chain starts with.
+    std::vector<FilterSpec> SharedPrefix() const;
+
+    void Run(PictureInfo picture_info, const Sink &sink, Precision precision = Precision::Channel) const;
+
+private:
+    struct Node {
+        std::vector<FilterSpec> specs;
+        Pipeline pipeline;
+        std::vector<size_t> children;
+        std::vector<size_t> outputs;
+    };
+
+    // nodes_[0] is the image itself, with no filters.
+    std::vector<Node> nodes_ = {Node{}};
+    size_t outputs_ = 0;
+
+    void Split(size_t node, size_t length);
+
+    void RunNode(size_t node, SharedPicture picture, const Sink &sink, Precision precision) const;
+
+    // shell has the headers of the outputs and no rows.
+    void RunPlanarNode(size_t node, PlanarImage image, const PictureInfo &shell, const Sink &sink) const;
+};
+
+#endif  // FILTER_GRAPH_H
@@ -1,7 +1,10 @@
 #ifndef FILTERS_H
 #define FILTERS_H
 
+#include <memory>
+
 #include "PictureInfo.h"
+#include "PlanarImage.h"
 
 constexpr int MaxColorValint = 255;
 constexpr double MaxColorValdouble = 255.0;
@@ -12,42 +15,148 @@ constexpr int SizeOfKernel = 6;
 constexpr double PI = 3.1415;
 constexpr double EXP = 2.7182;
 
+using PixelMatrix = std::vector<std::vector<Pixel> >;
+
+// Memory layout a filter runs best on: packed pixels of PictureInfo or the planes of PlanarImage.
+// Any means the filter is as fast on both, so it runs on whichever the image is in.
+enum class Layout { Any, Packed, Planar };
+
+// Halo of filters whose result depends on the position of a pixel in the whole image (crop, pixelize).
+constexpr LONG WholeImage = -1;
+
+// Filters work on 8-bit and on 16-bit images (see PictureInfo::Deep) with the same template kernels.
 struct Filter {
 
     Filter() = default;
 
-    virtual void Apply(PictureInfo &picture_info) = 0;
+    virtual void Apply(PictureInfo &picture_info) const = 0;
+
+    // Same as Apply, but neighbourhood filters keep their intermediate copy in buffer,
+    // so a chain of filters can reuse one allocation between stages of 8-bit images.
+    virtual void Apply(PictureInfo &picture_info, PixelMatrix & /*buffer*/) const {
+        Apply(picture_info);
+    }
+
+    // The filter on planes: on channel levels it gives the same image as on PictureInfo, otherwise
+    // it neither rounds nor clamps (see PlanarImage::rounded).
+    virtual void Apply(PlanarImage &image) const = 0;
+
+    // The pipeline converts the image between layouts only where this changes from one filter to the next.
+    virtual Layout PreferredLayout() const {
+        return Layout::Packed;
+    }
+
+    // How many rows and columns around a pixel the filter reads to compute it, so that it gives a part of
+    // the image exactly from that part widened by the halo, or WholeImage.
+    virtual LONG Halo() const {
+        return WholeImage;
+    }
 
     virtual ~Filter() = default;
 };
 
-struct NegativeFilter : public Filter {
-    using Filter::Filter;
+// Filters whose result for a pixel depends only on that pixel. Every filter has a row function
+// for both channel widths, generated from one template kernel.
+struct PointFilter : public Filter {
+    using Filter::Apply;
 
-    void Apply(PictureInfo &picture_info) override;
+    void Apply(PictureInfo &picture_info) const override;
+
+    Layout PreferredLayout() const override {
+        return Layout::Any;
+    }
+
+    LONG Halo() const override {
+        return 0;
+    }
+
+    virtual void ApplyToRow(Pixel *row, LONG width) const = 0;
+
+    virtual void ApplyToRow(Pixel16 *row, LONG width) const = 0;
 };
 
-struct GrayScaleFilter : public Filter {
-    using Filter::Filter;
+struct NegativeFilter : public PointFilter {
+    using PointFilter::PointFilter;
+    using PointFilter::Apply;
+
+    void Apply(PlanarImage &image) const override;
+
+    void ApplyToRow(Pixel *row, LONG width) const override;
+
+    void ApplyToRow(Pixel16 *row, LONG width) const override;
+};
+
+struct GrayScaleFilter : public PointFilter {
+    using PointFilter::PointFilter;
+    using PointFilter::Apply;
+
+    void Apply(PlanarImage &image) const override;
+
+    void ApplyToRow(Pixel *row, LONG width) const override;
+
+    void ApplyToRow(Pixel16 *row, LONG width) const override;
+};
+
+// Several point filters applied row by row in one pass over the image.
+class PointChainFilter : public PointFilter {
+private:
+    std::vector<std::shared_ptr<const PointFilter> > filters_;
+
+public:
+    explicit PointChainFilter(std::vector<std::shared_ptr<const PointFilter> > filters)
+        : PointFilter(), filters_(std::move(filters)) {
+    }
+
+    using PointFilter::Apply;
+
+    void Apply(PlanarImage &image) const override;
 
-    void Apply(PictureInfo &picture_info) override;
+    void ApplyToRow(Pixel *row, LONG width) const override;
+
+    void ApplyToRow(Pixel16 *row, LONG width) const override;
 };
 
-class EdgeDetectionFilter : public GrayScaleFilter {
+class EdgeDetectionFilter : public Filter {
 private:
     double threshold_;
 
 public:
-    explicit EdgeDetectionFilter(double threshold) : GrayScaleFilter(), threshold_(threshold) {
+    explicit EdgeDetectionFilter(double threshold) : Filter(), threshold_(threshold) {
+    }
+
+    void Apply(PictureInfo &picture_info) const override;
+
+    void Apply(PictureInfo &picture_info, PixelMatrix &buffer) const override;
+
+    void Apply(PlanarImage &image) const override;
+
+    // A 3x3 stencil is as fast on packed pixels as on planes with the conversion, so it runs where the image is.
+    Layout PreferredLayout() const override {
+        return Layout::Any;
     }
 
-    void Apply(PictureInfo &picture_info) override;
+    LONG Halo() const override {
+        return 1;
+    }
 };
 
 struct SharpeningFilter : public Filter {
     using Filter::Filter;
 
-    void Apply(PictureInfo &picture_info) override;
+    void Apply(PictureInfo &picture_info) const override;
+
+    void Apply(PictureInfo &picture_info, PixelMatrix &buffer) const override;
+
+    void Apply(PlanarImage &image) const override;
+
+    // A 3x3 stencil is as fast on packed pixels as on planes with the conversion, so it runs where the image is.
+    Layout PreferredLayout() const override {
+        return Layout::Any;
+    }
+
+    LONG Halo() const override {
+        return 1;
+    }
 };
 
 class GaussianBlurFilter : public Filter {
@@ -56,14 +165,30 @@ private:
     LONG kernel_size_;
     std::vector<double> kernel_;
 
-    void CreateGaussianKernel();
+    static std::vector<double> CreateGaussianKernel(double sigma, LONG kernel_size);
 
 public:
     explicit GaussianBlurFilter(double sigma)
-        : Filter(), sigma_(sigma), kernel_size_(SizeOfKernel * static_cast<int>(sigma_) + 1) {
+        : Filter(),
+          sigma_(sigma),
+          kernel_size_(SizeOfKernel * static_cast<int>(sigma_) + 1),
+          kernel_(CreateGaussianKernel(sigma_, kernel_size_)) {
+    }
+
+    void Apply(PictureInfo &picture_info) const override;
+
+    void Apply(PictureInfo &picture_info, PixelMatrix &buffer) const override;
+
+    void Apply(PlanarImage &image) const override;
+
+    // Each pass of the blur is a sum of whole rows on planes, which is vectorized.
+    Layout PreferredLayout() const override {
+        return Layout::Planar;
     }
 
-    void Apply(PictureInfo &picture_info) override;
+    LONG Halo() const override {
+        return kernel_size_ / 2;
+    }
 };
 
 class CropFilter : public Filter {
@@ -75,7 +200,15 @@ public:
     CropFilter(LONG x_crop, LONG y_crop) : Filter(), x_crop_(x_crop), y_crop_(y_crop) {
     }
 
-    void Apply(PictureInfo &picture_info) override;
+    using Filter::Apply;
+
+    void Apply(PictureInfo &picture_info) const override;
+
+    void Apply(PlanarImage &image) const override;
+
+    Layout PreferredLayout() const override {
+        return Layout::Any;
+    }
 };
 
 class PixelizeFilter : public Filter {
@@ -86,7 +219,15 @@ public:
     explicit PixelizeFilter(int block_size) : Filter(), block_size_(block_size) {
     }
 
-    void Apply(PictureInfo &picture_info) override;
+    using Filter::Apply;
+
+    void Apply(PictureInfo &picture_info) const override;
+
+    void Apply(PlanarImage &image) const override;
+
+    Layout PreferredLayout() const override {
+        return Layout::Any;
+    }
 };
 
 #endif  // FILTERS_H
@@ -0,0 +1,43 @@
+#ifndef LAZY_IMAGE_H
+#define LAZY_IMAGE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Pipeline.h"
+
+// An image with filters applied lazily, for library users who build a chain step by step: Apply only records
+// the filter and returns a new expression, and nothing runs until the image is read with Get, e.g. to save it.
+// Then the filters recorded since the nearest image that has been computed are compiled as one Pipeline and
+// run with Pipeline::ApplyInStrips: point filters in a row are one loop over the pixels, and neighbourhood
+// filters in a row go through the image strip by strip. The result is the same as Pipeline::Run of the chain.
+// Expressions are immutable and share their common part. The image of an expression is computed once and kept,
+// and expressions made from it start from it; Get may be called from several threads.
+class LazyImage {
+public:
+    // 0 threads means one per core.
+    explicit LazyImage(PictureInfo picture_info, size_t threads = 0);
+
+    // The image with one more filter; the filter is validated right away.
+    LazyImage Apply(const FilterSpec &spec) const;
+
+    // The image with filters in command line form, e.g. {"-crop", "800", "600", "-blur", "2"}.
+    LazyImage Apply(const std::vector<std::string> &args) const;
+
+    // Applies the filters that haven't run yet.
+    const PictureInfo &Get() const;
+
+    // Filters that Get would apply now, 0 once the image is computed.
+    size_t Pending() const;
+
+private:
+    struct Node;
+
+    std::shared_ptr<Node> node_;
+
+    explicit LazyImage(std::shared_ptr<Node> node);
+};
+
+#endif  // LAZY_IMAGE_H
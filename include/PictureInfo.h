@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstdlib>
 
 using WORD = uint16_t;
 using DWORD = uint32_t;
@@ -11,13 +12,56 @@ using BYTE = unsigned char;
 
 constexpr DWORD DefaultBisize = 40;
 constexpr DWORD DefaultBfsize = 14;
+constexpr BYTE MaxAlpha = 255;
+constexpr BYTE MaxColor = 255;
+constexpr WORD TrueColorAlphaBits = 32;
 
-struct Pixel {
-    BYTE blue;
-    BYTE green;
-    BYTE red;
+constexpr WORD DeepColorBits = 48;
+constexpr WORD DeepColorAlphaBits = 64;
+
+// Range and packed form of one channel type: 8 bits for the usual images, 16 for deep ones.
+template <typename T>
+struct ChannelTraits;
+
+template <>
+struct ChannelTraits<BYTE> {
+    static constexpr BYTE Max = 255;
+    // A whole pixel as one integer, for filters that work on all channels at once.
+    using Packed = uint32_t;
+    static constexpr Packed ColorMask = 0x00ffffff;
 };
 
+template <>
+struct ChannelTraits<WORD> {
+    static constexpr WORD Max = 65535;
+    using Packed = uint64_t;
+    static constexpr Packed ColorMask = 0x0000ffffffffffff;
+};
+
+// Same channel order as a 32-bit BMP pixel. Four aligned channels let vector code load
+// a whole number of pixels per register; 24-bit images just keep alpha opaque.
+template <typename T>
+struct alignas(4 * sizeof(T)) BasicPixel {
+    T blue;
+    T green;
+    T red;
+    T alpha = ChannelTraits<T>::Max;
+};
+
+using Pixel = BasicPixel<BYTE>;
+// 16 bits per channel: 48-bit and 64-bit BMP, 16-bit Netpbm images.
+using Pixel16 = BasicPixel<WORD>;
+
+template <typename T>
+using BasicPixelMatrix = std::vector<std::vector<BasicPixel<T> > >;
+
+static_assert(sizeof(Pixel) == 4);
+static_assert(sizeof(Pixel16) == 8);
+
+constexpr bool IsDeepBitCount(WORD bit_count) {
+    return bit_count == DeepColorBits || bit_count == DeepColorAlphaBits;
+}
+
 #pragma pack(push, 1)
 using BmpFileHeader = struct BmpFileHeader {
     WORD bfType;
@@ -44,18 +88,59 @@ using BmpInfoHeader = struct BmpInfoHeader {
 };
 #pragma pack(pop)
 
+// Rows are kept in file order: pixels[0] is the bottom row of a bottom-up image and the top row of a
+// top-down one (negative biHeight in the file). bmi_header.biHeight is always the positive row count,
+// the orientation lives in top_down, so filters that care about up and down have to look at it.
+// Images with 16 bits per channel (biBitCount 48 or 64) keep their rows in deep_pixels and leave pixels empty,
+// filters work on whichever of the two is used.
 struct PictureInfo {
     BmpFileHeader bmf_header;
     BmpInfoHeader bmi_header;
     std::vector<std::vector<Pixel> > pixels;
+    bool top_down = false;
+    std::vector<std::vector<Pixel16> > deep_pixels;
 
     PictureInfo(BmpFileHeader &bmf_header, BmpInfoHeader &bmi_header, std::vector<std::vector<Pixel> > &pixels)
-        : bmf_header(bmf_header), bmi_header(bmi_header), pixels(pixels) {
+        : bmf_header(bmf_header), bmi_header(bmi_header), pixels(pixels), top_down(bmi_header.biHeight < 0) {
+        this->bmi_header.biHeight = std::abs(bmi_header.biHeight);
+    }
+
+    bool Deep() const {
+        return !deep_pixels.empty();
     }
 
-    Pixel CheckingBorders(LONG x, LONG y, PictureInfo &picture_info);
+    // pixels or deep_pixels by the channel type.
+    template <typename T>
+    BasicPixelMatrix<T> &Rows();
+
+    template <typename T>
+    const BasicPixelMatrix<T> &Rows() const;
+
+    // Converts the rows between 8 and 16 bits per channel (v * 257 one way, rounded v / 257 the other)
+    // and moves the bit count to the matching one: 24 <-> 48, 32 <-> 64.
+    void SetDeep(bool deep);
 
     void Sync();
 };
 
+template <>
+inline BasicPixelMatrix<BYTE> &PictureInfo::Rows<BYTE>() {
+    return pixels;
+}
+
+template <>
+inline BasicPixelMatrix<WORD> &PictureInfo::Rows<WORD>() {
+    return deep_pixels;
+}
+
+template <>
+inline const BasicPixelMatrix<BYTE> &PictureInfo::Rows<BYTE>() const {
+    return pixels;
+}
+
+template <>
+inline const BasicPixelMatrix<WORD> &PictureInfo::Rows<WORD>() const {
+    return deep_pixels;
+}
+
 #endif  // PICTURE_INFO_H
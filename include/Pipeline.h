@@ -0,0 +1,113 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Filters.h"
+#include "TileScheduler.h"
+
+// One filter from the command line, e.g. {"-crop", {800, 600}}.
+struct FilterSpec {
+    std::string name;
+    std::vector<double> params;
+
+    bool operator==(const FilterSpec &other) const = default;
+};
+
+// Channel: every filter rounds and clamps its result to the channels of the image, like a single filter does,
+// on the layout it prefers (see Layouts), which doesn't change the result.
+// Float: the image is converted to PlanarImage once, the whole chain runs on it and the result is quantized once.
+enum class Precision { Channel, Float };
+
+// A filter chain that is parsed, validated and optimized once and then can be
+// applied to any number of images, also from several threads at once.
+class Pipeline {
+public:
+    Pipeline() = default;
+
+    static Pipeline Compile(const std::vector<std::string> &args);
+
+    static Pipeline Compile(std::vector<FilterSpec> specs);
+
+    static std::vector<FilterSpec> Parse(const std::vector<std::string> &args);
+
+    PictureInfo Run(PictureInfo picture_info, Precision precision = Precision::Channel) const;
+
+    void Apply(PictureInfo &picture_info, Precision precision = Precision::Channel) const;
+
+    // The chain on planes that are neither rounded nor clamped, which is what Apply does in float precision
+    // between the two conversions.
+    void Apply(PlanarImage &image) const;
+
+    // Same as Apply in channel precision, but every run of neighbourhood filters between the ones that need
+    // the whole image is applied strip by strip on the scheduler: a strip widened by the halo of the run goes
+    // through all of its filters while it is in cache, and only the rows of the strip itself are kept.
+    // strip_rows 0 picks the strip height by StripPixels.
+    void ApplyInStrips(PictureInfo &picture_info, const TileScheduler &scheduler, LONG strip_rows = 0) const;
+
+    // Recomputes the tiles of output, the result of the chain in channel precision on an image of the size and
+    // channel type of input, from input: each tile from the tile widened by Halo(), so it comes out the same as in
+    // a run on the whole image; a tile whose widened area has one color is filled (see ApplyInTiles).
+    // Tiles count rows like PictureInfo does, see TileScheduler::Grid.
+    // Throws FilterException for chains that need the whole image.
+    void ApplyToTiles(const PictureInfo &input, PictureInfo &output, const std::vector<TileRect> &tiles,
+                      const TileScheduler &scheduler) const;
+
+    // Same as Apply in channel precision, for images with large flat areas, e.g. flags and diagrams: the image
+    // is computed tile by tile as in ApplyToTiles, and a tile whose pixels and halo all have one color is filled
+    // with the result of the chain on that color, computed once per color, instead of being filtered.
+    // Images where the tiles that aren't filled, widened by the halo, have more than 1 / MinTileSaving of the pixels
+    // of the image are applied with ApplyInStrips.
+    void ApplyInTiles(PictureInfo &picture_info, const TileScheduler &scheduler, LONG tile_size = TileSize) const;
+
+    bool Empty() const {
+        return stages_.empty();
+    }
+
+    size_t Size() const {
+        return stages_.size();
+    }
+
+    const std::vector<FilterSpec> &Specs() const {
+        return specs_;
+    }
+
+    // Layout every stage runs on in channel precision: filters that run on any layout keep the one of the stage
+    // before them, so the image is converted only where a filter needs the other one.
+    const std::vector<Layout> &Layouts() const {
+        return layouts_;
+    }
+
+    // The whole chain as one point filter if it has only point filters, so it can be applied to any part
+    // of an image separately, e.g. to every tile right after it is read; nullptr otherwise.
+    const PointFilter *PointStage() const;
+
+    // Sum of the halos of the filters (see Filter::Halo), WholeImage if any of them needs the whole image.
+    LONG Halo() const;
+
+    // Pixels of a strip without its halo in ApplyInStrips, about what fits in the cache with the filter buffers.
+    static constexpr LONG StripPixels = 1 << 18;
+
+    static constexpr LONG TileSize = 64;
+    static constexpr uint64_t MinTileSaving = 2;
+
+private:
+    std::vector<FilterSpec> specs_;
+    std::vector<std::shared_ptr<const Filter> > stages_;
+    std::vector<Layout> layouts_;
+
+    static void Validate(const FilterSpec &spec);
+
+    static std::vector<FilterSpec> Optimize(std::vector<FilterSpec> specs);
+
+    static std::shared_ptr<const Filter> MakeFilter(const FilterSpec &spec);
+
+    void ApplyStages(PictureInfo &picture_info, size_t begin, size_t end, Precision precision) const;
+
+    void ApplyStrips(PictureInfo &picture_info, size_t begin, size_t end, LONG halo, const TileScheduler &scheduler,
+                     LONG strip_rows) const;
+};
+
+#endif  // PIPELINE_H
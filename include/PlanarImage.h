@@ -0,0 +1,47 @@
+#ifndef PLANAR_IMAGE_H
+#define PLANAR_IMAGE_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "PictureInfo.h"
+
+// Planes of a PlanarImage, in the channel order of Pixel.
+enum class Plane { Blue = 0, Green = 1, Red = 2, Alpha = 3 };
+
+// The image as separate planes of blue, green, red and alpha floats, in the units of the channels it came from
+// (0..max). Filters that work on one channel at a time run their loops over whole planes.
+// Rows are kept in the order of PictureInfo rows, top_down tells which of them is the top one.
+// With rounded set, filters keep the values on the channel levels and give exactly what they give on
+// PictureInfo; without it nothing is rounded or clamped until ToPicture, which is the float working format
+// of long chains.
+struct PlanarImage {
+    LONG width = 0;
+    LONG height = 0;
+    bool top_down = false;
+    float max = MaxColor;
+    bool rounded = true;
+    std::array<std::vector<float>, 4> planes;
+
+    static constexpr size_t ColorPlanes = 3;
+
+    static PlanarImage FromPicture(const PictureInfo &picture_info, bool rounded = true);
+
+    // Rounds and clamps the planes into the rows of picture_info, of the channel type they came from (8 or 16 bits,
+    // see max), so picture_info may have no rows at all.
+    void ToPicture(PictureInfo &picture_info) const;
+
+    float *Row(Plane plane, LONG y) {
+        return planes[static_cast<size_t>(plane)].data() + static_cast<size_t>(y) * width;
+    }
+
+    const float *Row(Plane plane, LONG y) const {
+        return planes[static_cast<size_t>(plane)].data() + static_cast<size_t>(y) * width;
+    }
+
+    // Sets the size and allocates the planes, the values are zeros.
+    void Resize(LONG new_width, LONG new_height);
+};
+
+#endif  // PLANAR_IMAGE_H
@@ -0,0 +1,39 @@
+#ifndef SHARED_PICTURE_H
+#define SHARED_PICTURE_H
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "PictureInfo.h"
+
+// An image that several readers hold at once, e.g. the branches of a filter graph. Copies of SharedPicture
+// share one PictureInfo, and the pixels are copied only when a holder changes them while others still
+// hold them: the last holder changes the image in place.
+class SharedPicture {
+public:
+    explicit SharedPicture(PictureInfo picture_info)
+        : picture_(std::make_shared<PictureInfo>(std::move(picture_info))) {
+    }
+
+    const PictureInfo &Get() const {
+        return *picture_;
+    }
+
+    // The image to change, copied first if anyone else holds it. Holders may live on other threads,
+    // e.g. an asynchronous writer: once the count is 1 nobody else can get the image again, and the fence
+    // orders the writes after whatever the last other holder read before it let go.
+    PictureInfo &Mutable() {
+        if (picture_.use_count() > 1) {
+            picture_ = std::make_shared<PictureInfo>(*picture_);
+        } else {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *picture_;
+    }
+
+private:
+    std::shared_ptr<PictureInfo> picture_;
+};
+
+#endif  // SHARED_PICTURE_H
@@ -0,0 +1,39 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "PictureInfo.h"
+
+// A rectangle of an image: x and y of its top left pixel, counted from the top left corner.
+struct TileRect {
+    LONG x;
+    LONG y;
+    LONG width;
+    LONG height;
+};
+
+// Runs a task for each of count tiles on several threads. Every worker takes the next tile that nobody has
+// taken yet, so a slow tile (a cold disk read, say) doesn't hold the others up and no tile list is split
+// in advance. The first exception thrown by a task is rethrown by Run after all workers are done.
+class TileScheduler {
+public:
+    // 0 threads means one per core.
+    explicit TileScheduler(size_t threads = 0);
+
+    void Run(size_t count, const std::function<void(size_t)> &task) const;
+
+    size_t Threads() const {
+        return threads_;
+    }
+
+    // Tiles of tile_width x tile_height covering the image row by row; the last ones in a row or column are cut.
+    static std::vector<TileRect> Grid(LONG width, LONG height, LONG tile_width, LONG tile_height);
+
+private:
+    size_t threads_;
+};
+
+#endif  // TILE_SCHEDULER_H
@@ -0,0 +1,30 @@
+#ifndef BMP_INSPECTOR_H
+#define BMP_INSPECTOR_H
+
+#include <string>
+#include <vector>
+
+#include "PictureInfo.h"
+
+// What a dispatcher needs to know about a BMP file without decoding it.
+struct BmpSummary {
+    std::string path;
+    LONG width = 0;
+    LONG height = 0;
+    WORD bit_count = 0;
+    DWORD compression = 0;
+    bool top_down = false;
+    size_t file_size = 0;
+    std::string error;
+};
+
+struct BmpInspector {
+    static BmpSummary InspectFile(const std::string &file_path);
+
+    // Inspects every .bmp file in the directory tree on all cores, broken files get their error set.
+    static std::vector<BmpSummary> InspectDirectory(const std::string &directory_path);
+
+    static std::string ToJson(const BmpSummary &summary);
+};
+
+#endif  // BMP_INSPECTOR_H
@@ -0,0 +1,24 @@
+#ifndef CHECKSUMS_H
+#define CHECKSUMS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "PictureInfo.h"
+
+// Checksums used by the compressed formats. Both can be computed piece by piece
+// by passing the result for the previous pieces.
+struct Checksums {
+    // CRC-32 as in PNG and zip.
+    static DWORD Crc32(std::span<const std::byte> data, DWORD previous = 0);
+
+    // Adler-32 as in zlib streams.
+    static DWORD Adler32(std::span<const std::byte> data, DWORD previous = 1);
+
+    // A fast 64-bit hash for cache keys, not used by any format. previous mixes in the hash of other data,
+    // so that e.g. a file and a filter chain give one key; unlike the checksums it doesn't continue a hash.
+    static uint64_t Hash64(std::span<const std::byte> data, uint64_t previous = 0);
+};
+
+#endif  // CHECKSUMS_H
@@ -1,9 +1,79 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
 #include <utility>
 
 #include "Input_OutputProcessing.h"
+#include "ResultCache.h"
+#include "TileHashes.h"
+#include "FilterGraph.h"
+#include "Pipeline.h"
+
+// image_processor --info path... prints the headers of BMP files (or of all BMP files in directories) as JSON lines.
+const std::string InfoOption = "--info";
+// --depth auto|1|8|24|32|48|64 sets the bit count of the saved BMP, auto picks the smallest lossless one.
+// 48 and 64 keep 16 bits per channel.
+const std::string DepthOption = "--depth";
+// --compress rle|none turns RLE compression of 4-bit and 8-bit output on or off.
+const std::string CompressOption = "--compress";
+// --format bmp|qoi|pgm|ppm|pam|png|tif|pyr sets the output format instead of the output extension, e.g. for stdout.
+const std::string FormatOption = "--format";
+// --level 0-9 sets the PNG compression level: 0 stores the data, 1 is the fastest and 9 the smallest.
+const std::string LevelOption = "--level";
+// --scale 1|2|4|8 decodes JPEG input at 1/scale of its size, e.g. for thumbnails; pyramids read the level
+// of that size.
+const std::string ScaleOption = "--scale";
+// --tile N writes TIFF output in N x N tiles, N is a multiple of 16; 0 (the default) writes strips.
+// For pyramid output it sets the tile size, 0 means 256.
+const std::string TileOption = "--tile";
+// --precision channel|float: channel (the default) rounds the image after every filter, float runs the whole
+// chain on float planes and rounds once before saving.
+const std::string PrecisionOption = "--precision";
+// image_processor in out1 filters... --output out2 filters... saves one more output made from the same decoded
+// image with its own filters; filters that several outputs start with are applied once.
+const std::string OutputOption = "--output";
+// -save path among the filters saves the image as it is at that point, e.g. after -crop, and the chain goes on
+// without running the filters before it again; the snapshot is written while the rest of the chain runs.
+const std::string SaveFilter = "-save";
+// --cache dir copies outputs made before from the same input file with the same filters and options from dir
+// instead of making them again, and keeps the new ones there.
+const std::string CacheOption = "--cache";
+// --cache-limit N caps the cache at N megabytes (1024 by default); the entries unused longest are removed first.
+const std::string CacheLimitOption = "--cache-limit";
+// --profile prints the time of every step and the cache counters to stderr as a JSON line.
+const std::string ProfileOption = "--profile";
+// --incremental keeps tile hashes of the input next to the output (path + ".tiles"); a later run with the same
+// filters on an edited input recomputes only the tiles near the changes and patches them into the output.
+// Chains with -crop or -pix, float precision and --depth auto|1|8 are always computed in full.
+const std::string IncrementalOption = "--incremental";
+const std::string TileHashesSuffix = ".tiles";
+// Options that take one value and may stand anywhere after the program name.
+const std::vector<std::string> ValueOptions = {DepthOption, CompressOption, FormatOption, LevelOption, ScaleOption,
+                                                TileOption, PrecisionOption, CacheOption, CacheLimitOption};
+// Options without a value, also anywhere after the program name.
+const std::vector<std::string> FlagOptions = {ProfileOption, IncrementalOption};
+// Options that change how the outputs are made but not the outputs themselves.
+const std::vector<std::string> RunOptions = {CacheOption, CacheLimitOption, ProfileOption, IncrementalOption};
+
+// What --profile prints: milliseconds spent on each step and what the result cache did.
+struct RunProfile {
+    double load_ms = 0;
+    double filters_ms = 0;
+    double save_ms = 0;
+    size_t cache_hits = 0;
+    size_t cache_misses = 0;
+    size_t cache_evictions = 0;
+    // Tiles of an --incremental run and how many of them were computed.
+    size_t tiles = 0;
+    size_t recomputed_tiles = 0;
+
+    std::string ToJson() const;
+};
 
 class ControlParameters {
 public:
@@ -16,6 +86,59 @@ public:
 
 private:
     std::vector<std::string> argv_;
+    std::map<std::string, std::string> options_;
+    std::unique_ptr<ResultCache> cache_;
+    // Keys of the outputs the cache doesn't have, by their paths, to store them once they are saved.
+    std::map<std::string, uint64_t> cache_keys_;
+    RunProfile profile_;
+
+    void Inspect();
+
+    void ExtractOptions();
+
+    void ApplyDepth(PictureInfo &picture_info) const;
+
+    void ApplyCompression(PictureInfo &picture_info) const;
+
+    ImageFormat OutputFormat(const std::string &path) const;
+
+    int CompressionLevel() const;
+
+    LONG TileSize() const;
+
+    Precision WorkingPrecision() const;
+
+    JpegDecodeOptions DecodeOptions(const std::vector<FilterSpec> &specs) const;
+
+    // Whether an option other than RunOptions is given.
+    bool ChangesOutput() const;
+
+    // Output paths with the filter arguments of each of them, snapshots of -save included.
+    std::vector<std::pair<std::string, std::vector<std::string> > > SplitOutputs() const;
+
+    // Everything that the output file depends on besides the input: the optimized filters, the output format
+    // and the options.
+    std::string Recipe(const std::string &path, const std::vector<FilterSpec> &specs) const;
+
+    // Copies the outputs that the cache has and returns the others.
+    std::vector<std::pair<std::string, std::vector<std::string> > > FetchCached(
+        std::vector<std::pair<std::string, std::vector<std::string> > > outputs);
+
+    bool Incremental(const Pipeline &pipeline, const std::string &path) const;
+
+    // Patches the previous output at path where the input has changed since it was made, or applies
+    // the pipeline to the whole image if there is no output to patch; returns the tile hashes of the input.
+    TileHashes ApplyIncrementally(const Pipeline &pipeline, PictureInfo &picture_info, const std::string &path);
+
+    void ControlPipeline(const Pipeline &pipeline, const std::string &path);
+
+    void ControlGraph(const FilterGraph &graph, const std::vector<std::string> &paths);
+
+    // Returns whether the output is saved.
+    bool Save(const std::string &path, SharedPicture picture);
+
+    // Keeps the saved output at path in the cache if the cache didn't have it.
+    void StoreCached(const std::string &path);
 };
 
 #endif  // CONTROLLER_H
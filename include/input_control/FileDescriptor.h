@@ -0,0 +1,30 @@
+#ifndef FILE_DESCRIPTOR_H
+#define FILE_DESCRIPTOR_H
+
+#include <unistd.h>
+
+// Closes the descriptor it owns; a negative descriptor, e.g. a failed open(), is kept as is.
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd) : fd_(fd) {
+    }
+
+    FileDescriptor(const FileDescriptor &) = delete;
+
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    ~FileDescriptor() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    int Get() const {
+        return fd_;
+    }
+
+private:
+    int fd_;
+};
+
+#endif  // FILE_DESCRIPTOR_H
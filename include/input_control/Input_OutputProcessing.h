@@ -1,14 +1,109 @@
 #ifndef INPUT_PROCESSING_H
 #define INPUT_PROCESSING_H
 
+#include <cstddef>
 #include <fstream>
+#include <optional>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include "PictureInfo.h"
+#include "input_control/JpegCodec.h"
+#include "input_control/ZlibCodec.h"
 
 constexpr WORD BM = 19778;
+constexpr DWORD BmpHeadersSize = sizeof(BmpFileHeader) + sizeof(BmpInfoHeader);
+// The largest image any reader accepts, the limit of the QOI specification. It keeps a broken header from
+// allocating gigabytes.
+constexpr uint64_t MaxPixels = 400000000;
+// Path that means stdin for the input image and stdout for the output image.
+constexpr std::string_view StdStreamPath = "-";
+
+// Formats the program reads and writes besides BMP have their own codecs; these functions pick one.
+enum class ImageFormat { Bmp, Qoi, Pgm, Ppm, Pam, Png, Tiff, Pyramid };
+
+// BMP file kept in memory owned by the caller. Nothing is copied except the headers,
+// rows are read straight from the caller's buffer, so it must outlive the view. Row(y) is the y-th row
+// in file order, which is the top one for top-down files (negative biHeight).
+struct BmpView {
+    BmpFileHeader file_header;
+    BmpInfoHeader info_header;
+    std::span<const std::byte> color_table;
+    std::span<const std::byte> pixel_data;
+    size_t row_stride;
+
+    std::span<const std::byte> Row(LONG y) const {
+        return pixel_data.subspan(y * row_stride, (info_header.biWidth * info_header.biBitCount + 7) / 8);
+    }
+};
 
 struct InputOutputProcessing {
+    // Loads an image in any supported format, recognized by its first byte, so stdin works as well.
+    // TIFF files (but not stdin) are read tile by tile in parallel.
+    // JPEG images are only read, jpeg_options lets them be decoded smaller; pyramids take the level and region
+    // from it as well, other formats can't be scaled.
+    static PictureInfo LoadImageFile(const std::string &file_path, const JpegDecodeOptions &jpeg_options = {});
+
+    static PictureInfo LoadImageStream(std::istream &input, const JpegDecodeOptions &jpeg_options = {});
+
+    // level is the compression level of PNG output and tile_size the tile side of TIFF output (0 for strips)
+    // and of pyramids (0 for the default), the other formats ignore them.
+    // 16-bit images are kept by BMP (48 and 64 bits) and Netpbm output, the other formats get them rounded to 8 bits.
+    // Throws InputDataException if the output can't be opened or written, e.g. when the disk is full.
+    static void SaveImageFile(const std::string &file_path, const PictureInfo &picture_info, ImageFormat format,
+                              int level = ZlibCodec::DefaultLevel, LONG tile_size = 0);
+
+    static void SaveImageStream(std::ostream &output, const PictureInfo &picture_info, ImageFormat format,
+                                int level = ZlibCodec::DefaultLevel, LONG tile_size = 0);
+
+    // Output format by the file extension (.qoi, .pgm, .ppm, .pnm, .pam, .png, .tif, .tiff, .pyr),
+    // BMP for everything else including stdout.
+    static ImageFormat FormatFromPath(const std::string &file_path);
+
+    // Format by its name, the same as the extension without the dot: "bmp", "qoi", "pgm", "ppm", "pam", "png",
+    // "tif", "tiff" or "pyr".
+    static std::optional<ImageFormat> FormatFromName(const std::string &name);
+
+    // Blank image with canonical BMP headers, for the readers of the other formats.
+    static PictureInfo CreatePicture(LONG width, LONG height, WORD bit_count, bool top_down);
+
     static PictureInfo LoadBmpFile(const std::string &file_path);
 
-    static void SaveBmpFile(const std::string &file_path, PictureInfo &picture_info);
+    static void SaveBmpFile(const std::string &file_path, const PictureInfo &picture_info);
+
+    // Both stream functions only move forward, so pipes and sockets work as well as files.
+    static PictureInfo LoadBmpStream(std::istream &input);
+
+    static void SaveBmpStream(std::ostream &output, const PictureInfo &picture_info);
+
+    // Saves the input file unchanged without decoding it: the headers are validated and rewritten
+    // only if they are not in canonical form, the pixel data is copied by the kernel.
+    // The copy keeps the header of the source, so a 32-bit BI_RGB file stays BI_RGB with its reserved bytes,
+    // where SaveBmpFile would write a V4 header with opaque alpha; both read back as the same image.
+    // Returns false if the file is not a BMP or can't be copied as is and has to be decoded.
+    static bool CopyBmpFile(const std::string &input_path, const std::string &output_path);
+
+    // Copies a file as it is. Where the file system can, e.g. btrfs or XFS, the copy shares the blocks of
+    // the original (a reflink), otherwise the kernel copies them.
+    static void CopyWholeFile(const std::string &input_path, const std::string &output_path);
+
+    // Reads only the two headers, returns the size of the file.
+    static size_t ReadBmpHeaders(const std::string &file_path, BmpFileHeader &header, BmpInfoHeader &info_header);
+
+    static BmpView WrapBmpMemory(std::span<const std::byte> data);
+
+    static PictureInfo LoadBmpFromMemory(std::span<const std::byte> data);
+
+    static std::vector<std::byte> EncodeBmpToBuffer(const PictureInfo &picture_info);
+
+    static size_t RowStride(LONG width, WORD bit_count);
+
+    // The smallest bit count that stores the image without losses: 1 for black and white images,
+    // 8 for gray ones, 32 if alpha is used and 24 otherwise; 64 or 48 for 16-bit images. The writer uses the bit count
+    // from picture_info.bmi_header, widening it when the image doesn't fit.
+    static WORD ChooseBitCount(const PictureInfo &picture_info);
 };
 #endif  // INPUT_PROCESSING_H
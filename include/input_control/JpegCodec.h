@@ -0,0 +1,31 @@
+#ifndef JPEG_CODEC_H
+#define JPEG_CODEC_H
+
+#include <istream>
+
+#include "PictureInfo.h"
+
+// What the caller is going to do with a decoded JPEG image, so that the decoder can skip work.
+struct JpegDecodeOptions {
+    // 1, 2, 4 or 8: the image is decoded at 1/scale of its size straight from the DCT coefficients,
+    // every 8x8 block becomes an 8/scale block without decoding it at full size first.
+    int scale = 1;
+    // Only the top left max_width x max_height pixels of the scaled image are decoded, 0 means no limit.
+    // Rows below are not read from the stream at all.
+    LONG max_width = 0;
+    LONG max_height = 0;
+};
+
+// Baseline (sequential Huffman, 8-bit) JPEG images, gray or YCbCr with 4:4:4, 4:2:2 or 4:2:0 subsampling.
+// Decoding only: the image is decoded one row of MCUs at a time into the rows of the result.
+struct JpegCodec {
+    // First byte of the SOI marker.
+    static constexpr BYTE MagicStart = 0xff;
+
+    static constexpr int MaxScale = 8;
+
+    // Gray images get 8 bits per pixel, color ones 24. JPEG images are top-down.
+    static PictureInfo Load(std::istream &input, const JpegDecodeOptions &options = {});
+};
+
+#endif  // JPEG_CODEC_H
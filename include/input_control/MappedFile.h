@@ -0,0 +1,56 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Exceptions.h"
+#include "input_control/FileDescriptor.h"
+
+// The whole file mapped read-only into memory and unmapped when destroyed. Pages are read from disk
+// only when they are touched, so a reader that looks at a part of the file pays only for that part.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &file_path) {
+        FileDescriptor fd(open(file_path.c_str(), O_RDONLY));
+        struct stat file_stat {};
+        if (fd.Get() < 0 || fstat(fd.Get(), &file_stat) != 0) {
+            throw InputDataException("Wrong file path");
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ == 0) {
+            return;
+        }
+        // The mapping stays valid after the descriptor is closed.
+        void *address = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd.Get(), 0);
+        if (address == MAP_FAILED) {
+            throw InputDataException("Can't map the file into memory");
+        }
+        data_ = static_cast<const std::byte *>(address);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<std::byte *>(data_), size_);
+        }
+    }
+
+    std::span<const std::byte> Data() const {
+        return {data_, size_};
+    }
+
+private:
+    const std::byte *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif  // MAPPED_FILE_H
@@ -0,0 +1,24 @@
+#ifndef PNG_CODEC_H
+#define PNG_CODEC_H
+
+#include <istream>
+#include <ostream>
+
+#include "PictureInfo.h"
+#include "input_control/ZlibCodec.h"
+
+// PNG images with 8 bits per sample: grayscale, gray with alpha, RGB and RGBA, not interlaced.
+struct PngCodec {
+    // First byte of the PNG signature.
+    static constexpr BYTE MagicStart = 0x89;
+
+    // The image data is inflated into one buffer whose rows are unfiltered in place and
+    // expanded straight into the image rows. PNG images are top-down like the file.
+    static PictureInfo Load(std::istream &input);
+
+    // 32-bit images are saved as RGBA, gray images with a palette bit count as grayscale, the rest as RGB.
+    // Every row gets the filter that makes its bytes smallest, except at level 0.
+    static void Save(std::ostream &output, const PictureInfo &picture_info, int level = ZlibCodec::DefaultLevel);
+};
+
+#endif  // PNG_CODEC_H
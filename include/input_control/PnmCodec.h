@@ -0,0 +1,26 @@
+#ifndef PNM_CODEC_H
+#define PNM_CODEC_H
+
+#include <istream>
+#include <ostream>
+
+#include "PictureInfo.h"
+
+// Binary Netpbm formats, named by their magic numbers.
+enum class PnmKind { Graymap = 5, Pixmap = 6, ArbitraryMap = 7 };
+
+// Netpbm images (P5 graymaps, P6 pixmaps and P7 PAM files with up to 16 bits per sample).
+struct PnmCodec {
+    // First byte of every Netpbm file.
+    static constexpr char MagicStart = 'P';
+
+    // Each row is read with one call into the memory of the image row and expanded to pixels in place.
+    // Netpbm images are top-down, so the rows are not reordered. MAXVAL above 255 makes a 16-bit image.
+    static PictureInfo Load(std::istream &input);
+
+    // Graymaps keep the gray value of each pixel, PAM files keep alpha of 32-bit and 64-bit images.
+    // 16-bit images are written with 2-byte samples and MAXVAL 65535.
+    static void Save(std::ostream &output, const PictureInfo &picture_info, PnmKind kind);
+};
+
+#endif  // PNM_CODEC_H
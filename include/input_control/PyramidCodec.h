@@ -0,0 +1,116 @@
+#ifndef PYRAMID_CODEC_H
+#define PYRAMID_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "PictureInfo.h"
+#include "TileScheduler.h"
+#include "input_control/JpegCodec.h"
+#include "input_control/MappedFile.h"
+
+// One resolution of a pyramid: level 0 is the image itself, every next one is half the size of the previous
+// one (rounded up) and is split into tiles of the same size.
+struct PyramidLevel {
+    LONG width;
+    LONG height;
+    uint32_t tiles_across;
+    uint32_t first_tile;
+};
+
+// The program's own container for images that are processed many times: the image and its reduced levels
+// are stored as uncompressed BGRA tiles with an index and a CRC-32 for every tile. The file is mapped
+// into memory and never decoded as a whole: a region is assembled from the tiles it covers, which are
+// checked when they are read. Layout (little-endian):
+//   header: "TPYR", version, bit count, width, height, tile size, level count, tile count, index offset;
+//   tiles: rows of tile width x 4 bytes, every tile starts at a multiple of 64 bytes, edge tiles are cut;
+//   index: width, height, tiles across and first tile of every level, then offset, size and CRC-32 of every
+//   tile, then the CRC-32 of the index itself.
+class PyramidFile {
+public:
+    explicit PyramidFile(const std::string &file_path);
+
+    // The whole file in memory, e.g. read from stdin.
+    explicit PyramidFile(std::vector<std::byte> data);
+
+    LONG Width() const {
+        return levels_[0].width;
+    }
+
+    LONG Height() const {
+        return levels_[0].height;
+    }
+
+    // Bit count of the saved image, the one its regions get.
+    WORD BitCount() const {
+        return bit_count_;
+    }
+
+    LONG TileSize() const {
+        return tile_size_;
+    }
+
+    size_t LevelCount() const {
+        return levels_.size();
+    }
+
+    const PyramidLevel &Level(size_t level) const {
+        return levels_[level];
+    }
+
+    size_t TileCount(size_t level) const;
+
+    // The part of the level stored in the tile, edge tiles are cut to the level.
+    TileRect Tile(size_t level, size_t index) const;
+
+    // Pixels of the tile, Tile(level, index).width in a row, as bytes of Pixel. Throws if the CRC doesn't match.
+    std::span<const std::byte> TileData(size_t level, size_t index) const;
+
+    // Top-down image of the part of the level, made of the tiles it covers only.
+    PictureInfo ReadRegion(size_t level, LONG x, LONG y, LONG width, LONG height,
+                           const TileScheduler &scheduler = TileScheduler()) const;
+
+private:
+    struct TileEntry {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t crc;
+    };
+
+    std::optional<MappedFile> mapping_;
+    std::vector<std::byte> memory_;
+    std::span<const std::byte> data_;
+    WORD bit_count_ = 0;
+    LONG tile_size_ = 0;
+    std::vector<PyramidLevel> levels_;
+    std::vector<TileEntry> tiles_;
+
+    void ReadIndex();
+};
+
+struct PyramidCodec {
+    // First byte of the "TPYR" signature.
+    static constexpr BYTE MagicStart = 'T';
+
+    static constexpr LONG DefaultTileSize = 256;
+
+    // Levels are built down to 1/8 at least, so every --scale can be read from its own level.
+    static constexpr size_t MinLevels = 4;
+
+    // options.scale picks the level and max_width x max_height the top left region of it,
+    // so only the tiles under that region are touched.
+    static PictureInfo LoadFile(const std::string &file_path, const JpegDecodeOptions &options = {});
+
+    static PictureInfo Load(std::istream &input, const JpegDecodeOptions &options = {});
+
+    // tile_size 0 means DefaultTileSize, otherwise it is a multiple of 16.
+    static void Save(std::ostream &output, const PictureInfo &picture_info, LONG tile_size = 0);
+};
+
+#endif  // PYRAMID_CODEC_H
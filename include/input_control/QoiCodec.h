@@ -0,0 +1,21 @@
+#ifndef QOI_CODEC_H
+#define QOI_CODEC_H
+
+#include <istream>
+#include <ostream>
+
+#include "PictureInfo.h"
+
+// "Quite OK Image" format (https://qoiformat.org): lossless, encoded and decoded in one pass.
+struct QoiCodec {
+    // First byte of a QOI file, enough to tell it from the other supported formats.
+    static constexpr char MagicStart = 'q';
+
+    // Pixels are decoded row by row straight into the image, which is top-down like the file.
+    static PictureInfo Load(std::istream &input);
+
+    // Each row is encoded into a small buffer and written right away. Alpha is kept for 32-bit images only.
+    static void Save(std::ostream &output, const PictureInfo &picture_info);
+};
+
+#endif  // QOI_CODEC_H
@@ -0,0 +1,58 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Output files of earlier runs kept in a directory for jobs that repeat: the same input file with the same
+// filters and output options gives the same file, which is then copied from the cache instead of being made again.
+// An entry is a file named by its key in hex; its modification time is the time it was last used, and when
+// the directory grows over the limit the entries unused for the longest time are removed. Several processes
+// may share the directory: an entry is written to a temporary file and renamed into place.
+class ResultCache {
+public:
+    static constexpr uintmax_t DefaultLimit = uintmax_t{1} << 30;
+
+    // Creates the directory if there is none; limit is in bytes.
+    ResultCache(std::filesystem::path directory, uintmax_t limit);
+
+    // Hash of the input file as it is, so that a hit doesn't decode it.
+    static uint64_t HashFile(const std::string &input_path);
+
+    // Key of the output that recipe, a canonical description of the filters and output options, makes
+    // from the input with the hash input_hash.
+    static uint64_t Key(uint64_t input_hash, const std::string &recipe);
+
+    // Copies the entry to output_path and marks it used; false if there is no entry.
+    bool Fetch(uint64_t key, const std::string &output_path);
+
+    // Keeps a copy of the file made for key and removes old entries if the cache is over its limit.
+    void Store(uint64_t key, const std::string &output_path);
+
+    size_t Hits() const {
+        return hits_;
+    }
+
+    size_t Misses() const {
+        return misses_;
+    }
+
+    size_t Evictions() const {
+        return evictions_;
+    }
+
+private:
+    std::filesystem::path directory_;
+    uintmax_t limit_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+
+    std::filesystem::path EntryPath(uint64_t key) const;
+
+    void Evict();
+};
+
+#endif  // RESULT_CACHE_H
@@ -0,0 +1,33 @@
+#ifndef RLE_CODEC_H
+#define RLE_CODEC_H
+
+#include <cstddef>
+#include <istream>
+#include <span>
+#include <vector>
+
+#include "PictureInfo.h"
+
+// biCompression values.
+constexpr DWORD BiRgb = 0;
+constexpr DWORD BiRle8 = 1;
+constexpr DWORD BiRle4 = 2;
+
+// Run-length encoding of palettized BMP pixel data (BI_RLE8 for 8-bit and BI_RLE4 for 4-bit images).
+struct RleCodec {
+    // Runs are expanded straight into the rows of pixels, which must already have the image size.
+    // Pixels skipped by the delta and end-of-line codes keep the first palette colour.
+    static void Decode(std::span<const std::byte> data, WORD bit_count, const std::vector<Pixel> &palette,
+                       std::vector<std::vector<Pixel> > &pixels);
+
+    // Same as above, but reads the codes from the stream as it goes.
+    static void Decode(std::istream &input, WORD bit_count, const std::vector<Pixel> &palette,
+                       std::vector<std::vector<Pixel> > &pixels);
+
+    // Appends the codes of one row of palette indices followed by an end-of-line code.
+    static void EncodeRow(std::span<const BYTE> indices, WORD bit_count, std::vector<std::byte> &output);
+
+    static void EncodeEnd(std::vector<std::byte> &output);
+};
+
+#endif  // RLE_CODEC_H
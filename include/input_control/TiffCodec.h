@@ -0,0 +1,84 @@
+#ifndef TIFF_CODEC_H
+#define TIFF_CODEC_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Filters.h"
+#include "PictureInfo.h"
+#include "TileScheduler.h"
+#include "input_control/FileDescriptor.h"
+
+// Uncompressed TIFF file with 8-bit samples (gray, gray with alpha, RGB or RGBA) in strips or tiles.
+// Only the header and the first IFD are read when it is opened; the pixel data of every tile is read
+// with pread when asked for, so any number of threads can read their own tiles at once.
+// Strips are handled as tiles as wide as the image.
+class TiffFile {
+public:
+    explicit TiffFile(const std::string &file_path);
+
+    // The whole file in memory, e.g. read from stdin.
+    explicit TiffFile(std::vector<BYTE> data);
+
+    LONG Width() const {
+        return width_;
+    }
+
+    LONG Height() const {
+        return height_;
+    }
+
+    // 8 for gray images, 24 for RGB and 32 if there is alpha.
+    WORD BitCount() const;
+
+    size_t TileCount() const {
+        return offsets_.size();
+    }
+
+    // The part of the image stored in the tile, edge tiles are cut to the image.
+    TileRect Tile(size_t index) const;
+
+    // Reads the tile and writes its pixels to their place in picture_info, a top-down image of Width() x Height().
+    void ReadTile(size_t index, PictureInfo &picture_info) const;
+
+private:
+    FileDescriptor fd_{-1};
+    std::vector<BYTE> data_;
+    bool big_endian_ = false;
+    LONG width_ = 0;
+    LONG height_ = 0;
+    LONG tile_width_ = 0;
+    LONG tile_height_ = 0;
+    int samples_ = 1;
+    bool white_is_zero_ = false;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> byte_counts_;
+
+    void ReadAt(uint64_t offset, size_t size, void *output) const;
+
+    void ReadDirectory();
+};
+
+struct TiffCodec {
+    // First byte of little-endian and big-endian files.
+    static constexpr BYTE MagicLittle = 'I';
+    static constexpr BYTE MagicBig = 'M';
+
+    // Checks the first bytes of the file only, false for stdin and files that can't be opened.
+    static bool IsTiffFile(const std::string &file_path);
+
+    static PictureInfo Load(std::istream &input);
+
+    // Every worker of the scheduler reads its own tiles from the file straight into the result.
+    // A point filter, if given, is applied by the same worker to the tile it has just read.
+    static PictureInfo LoadFile(const std::string &file_path, const TileScheduler &scheduler = TileScheduler(),
+                                const PointFilter *tile_filter = nullptr);
+
+    // tile_size 0 writes strips of about 64 KB, otherwise square tiles of that side, a multiple of 16.
+    static void Save(std::ostream &output, const PictureInfo &picture_info, LONG tile_size = 0);
+};
+
+#endif  // TIFF_CODEC_H
@@ -0,0 +1,46 @@
+#ifndef TILE_HASHES_H
+#define TILE_HASHES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "PictureInfo.h"
+#include "TileScheduler.h"
+
+// Hashes of the tiles of an input image, kept next to the output made from it (--incremental), so that the next
+// run on an edited version of the input recomputes only the tiles around the edit and patches them into
+// the previous output. Tiles are those of TileScheduler::Grid, with y counting rows of PictureInfo.
+struct TileHashes {
+    static constexpr LONG DefaultTileSize = 64;
+
+    // Hash of what the output depends on besides the input, e.g. the filters; outputs of other recipes
+    // can't be patched.
+    uint64_t recipe = 0;
+    LONG width = 0;
+    LONG height = 0;
+    bool deep = false;
+    bool top_down = false;
+    LONG tile_size = DefaultTileSize;
+    std::vector<uint64_t> hashes;
+
+    static TileHashes Compute(const PictureInfo &picture_info, uint64_t recipe, LONG tile_size = DefaultTileSize);
+
+    // nullopt if there is no file or it isn't a tile hash file.
+    static std::optional<TileHashes> Load(const std::string &path);
+
+    void Save(const std::string &path) const;
+
+    std::vector<TileRect> Tiles() const;
+
+    // Whether tiles of previous match these one to one and its output was made the same way.
+    bool Comparable(const TileHashes &previous) const;
+
+    // Indices of the tiles whose result may differ from the one made from previous: the tiles that have changed
+    // and those that have one of them within halo pixels.
+    std::vector<size_t> DirtyTiles(const TileHashes &previous, LONG halo) const;
+};
+
+#endif  // TILE_HASHES_H
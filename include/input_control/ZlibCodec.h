@@ -0,0 +1,21 @@
+#ifndef ZLIB_CODEC_H
+#define ZLIB_CODEC_H
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// zlib streams (RFC 1950) around deflate data (RFC 1951), as stored in PNG files.
+struct ZlibCodec {
+    // 0 stores the data uncompressed, 1 is the fastest and 9 the smallest.
+    static constexpr int MinLevel = 0;
+    static constexpr int MaxLevel = 9;
+    static constexpr int DefaultLevel = 6;
+
+    static std::vector<std::byte> Deflate(std::span<const std::byte> data, int level = DefaultLevel);
+
+    // Throws InputDataException on broken data, a wrong checksum or output longer than max_size.
+    static std::vector<std::byte> Inflate(std::span<const std::byte> data, size_t max_size);
+};
+
+#endif  // ZLIB_CODEC_H
@@ -0,0 +1,61 @@
+#include <utility>
+
+#include "AsyncWriter.h"
+
+AsyncWriter::AsyncWriter() : thread_(&AsyncWriter::Work, this) {
+}
+
+AsyncWriter::~AsyncWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+void AsyncWriter::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    changed_.notify_all();
+}
+
+void AsyncWriter::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return tasks_.empty() && !busy_; });
+    if (error_) {
+        std::exception_ptr error = std::exchange(error_, nullptr);
+        std::rethrow_exception(error);
+    }
+}
+
+void AsyncWriter::Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        changed_.wait(lock, [this]() { return !tasks_.empty() || stopping_; });
+        if (tasks_.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(tasks_.front());
+        tasks_.pop_front();
+        busy_ = true;
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // The task goes before the writer reports it done, so whatever it holds, e.g. a share of an image,
+        // is released by then.
+        task = nullptr;
+        lock.lock();
+        if (error && !error_) {
+            error_ = error;
+        }
+        busy_ = false;
+        changed_.notify_all();
+    }
+}
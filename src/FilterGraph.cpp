@@ -0,0 +1,115 @@
+#include <cstddef>
+#include <utility>
+
+#include "FilterGraph.h"
+
+size_t FilterGraph::AddOutput(const std::vector<std::string> &args) {
+    return AddOutput(Pipeline::Parse(args));
+}
+
+size_t FilterGraph::AddOutput(std::vector<FilterSpec> specs) {
+    // Chains are compared after optimization, so e.g. "-neg -crop 5 5" and "-crop 5 5" share the crop.
+    std::vector<FilterSpec> chain = Pipeline::Compile(std::move(specs)).Specs();
+    size_t node = 0;
+    size_t position = 0;
+    while (position < chain.size()) {
+        size_t next = nodes_.size();
+        for (size_t child : nodes_[node].children) {
+            if (nodes_[child].specs.front() == chain[position]) {
+                next = child;
+            }
+        }
+        if (next == nodes_.size()) {
+            std::vector<FilterSpec> rest(chain.begin() + static_cast<std::ptrdiff_t>(position), chain.end());
+            Pipeline pipeline = Pipeline::Compile(rest);
+            nodes_.push_back(Node{std::move(rest), std::move(pipeline), {}, {}});
+            nodes_[node].children.push_back(next);
+            node = next;
+            break;
+        }
+        size_t common = 0;
+        while (common < nodes_[next].specs.size() && position + common < chain.size() &&
+               nodes_[next].specs[common] == chain[position + common]) {
+            ++common;
+        }
+        if (common < nodes_[next].specs.size()) {
+            Split(next, common);
+        }
+        node = next;
+        position += common;
+    }
+    nodes_[node].outputs.push_back(outputs_);
+    return outputs_++;
+}
+
+// The first length filters stay in the node, the rest of them move to a new child that takes over
+// the children and outputs of the node.
+void FilterGraph::Split(size_t node, size_t length) {
+    std::vector<FilterSpec> tail(nodes_[node].specs.begin() + static_cast<std::ptrdiff_t>(length),
+                                 nodes_[node].specs.end());
+    Pipeline pipeline = Pipeline::Compile(tail);
+    nodes_.push_back(Node{std::move(tail), std::move(pipeline), std::move(nodes_[node].children),
+                          std::move(nodes_[node].outputs)});
+    Node &head = nodes_[node];
+    head.specs.resize(length);
+    head.pipeline = Pipeline::Compile(head.specs);
+    head.children = {nodes_.size() - 1};
+    head.outputs.clear();
+}
+
+size_t FilterGraph::Stages() const {
+    size_t stages = 0;
+    for (const Node &node : nodes_) {
+        stages += node.specs.size();
+    }
+    return stages;
+}
+
+std::vector<FilterSpec> FilterGraph::SharedPrefix() const {
+    const Node &root = nodes_.front();
+    if (root.children.size() != 1 || !root.outputs.empty()) {
+        return {};
+    }
+    return nodes_[root.children.front()].specs;
+}
+
+void FilterGraph::Run(PictureInfo picture_info, const Sink &sink, Precision precision) const {
+    if (precision == Precision::Float) {
+        PlanarImage image = PlanarImage::FromPicture(picture_info, false);
+        picture_info.pixels.clear();
+        picture_info.deep_pixels.clear();
+        RunPlanarNode(0, std::move(image), picture_info, sink);
+        return;
+    }
+    RunNode(0, SharedPicture(std::move(picture_info)), sink, precision);
+}
+
+void FilterGraph::RunNode(size_t node, SharedPicture picture, const Sink &sink, Precision precision) const {
+    const Node &current = nodes_[node];
+    current.pipeline.Apply(picture.Mutable(), precision);
+    // Every reader but the last one gets a share of the image, the last one gets it, so a chain without
+    // branches never copies.
+    for (size_t index = 0; index < current.outputs.size(); ++index) {
+        bool last = index + 1 == current.outputs.size() && current.children.empty();
+        sink(current.outputs[index], last ? std::move(picture) : picture);
+    }
+    for (size_t index = 0; index < current.children.size(); ++index) {
+        bool last = index + 1 == current.children.size();
+        RunNode(current.children[index], last ? std::move(picture) : picture, sink, precision);
+    }
+}
+
+void FilterGraph::RunPlanarNode(size_t node, PlanarImage image, const PictureInfo &shell, const Sink &sink) const {
+    const Node &current = nodes_[node];
+    current.pipeline.Apply(image);
+    for (size_t output : current.outputs) {
+        PictureInfo picture_info = shell;
+        image.ToPicture(picture_info);
+        picture_info.Sync();
+        sink(output, SharedPicture(std::move(picture_info)));
+    }
+    for (size_t index = 0; index < current.children.size(); ++index) {
+        bool last = index + 1 == current.children.size();
+        RunPlanarNode(current.children[index], last ? std::move(image) : image, shell, sink);
+    }
+}
@@ -1,69 +1,104 @@
 #include <cmath>
 #include <algorithm>
+#include <bit>
+#include <cstddef>
 
 #include "Exceptions.h"
 #include "Filters.h"
 
-void NegativeFilter::Apply(PictureInfo &picture_info) {
-    for (LONG y = 0; y < picture_info.bmi_header.biHeight; ++y) {
-        for (LONG x = 0; x < picture_info.bmi_header.biWidth; ++x) {
-            picture_info.pixels[y][x].red =
-                static_cast<BYTE>(std::clamp(MaxColorValint - picture_info.pixels[y][x].red, 0, MaxColorValint));
-            picture_info.pixels[y][x].green =
-                static_cast<BYTE>(std::clamp(MaxColorValint - picture_info.pixels[y][x].green, 0, MaxColorValint));
-            picture_info.pixels[y][x].blue =
-                static_cast<BYTE>(std::clamp(MaxColorValint - picture_info.pixels[y][x].blue, 0, MaxColorValint));
-        }
+namespace {
+template <typename T>
+void PrepareBuffer(BasicPixelMatrix<T> &buffer, const BasicPixelMatrix<T> &rows) {
+    buffer.resize(rows.size());
+    for (size_t y = 0; y < rows.size(); ++y) {
+        buffer[y].resize(rows[y].size());
     }
 }
 
-void GrayScaleFilter::Apply(PictureInfo &picture_info) {
-    for (LONG y = 0; y < picture_info.bmi_header.biHeight; ++y) {
-        for (LONG x = 0; x < picture_info.bmi_header.biWidth; ++x) {
-            double gray_value = GrayRed * picture_info.pixels[y][x].red + GrayGreen * picture_info.pixels[y][x].green +
-                                GrayBlue * picture_info.pixels[y][x].blue;
+// Calls kernel with the rows of the image and a buffer of the same channel type. Only 8-bit images
+// can use the caller's buffer, 16-bit ones get their own.
+template <typename Kernel>
+void WithRows(PictureInfo &picture_info, PixelMatrix &buffer, Kernel kernel) {
+    if (picture_info.Deep()) {
+        BasicPixelMatrix<WORD> deep_buffer;
+        kernel(picture_info.deep_pixels, deep_buffer);
+    } else {
+        kernel(picture_info.pixels, buffer);
+    }
+}
 
-            picture_info.pixels[y][x].red = static_cast<BYTE>(std::clamp(gray_value, 0.0, MaxColorValdouble));
-            picture_info.pixels[y][x].green = picture_info.pixels[y][x].red;
-            picture_info.pixels[y][x].blue = picture_info.pixels[y][x].red;
-        }
+// The pixel at (x, y) with coordinates one step outside the image moved back to its edge.
+template <typename T>
+const BasicPixel<T> &Neighbour(const BasicPixelMatrix<T> &rows, LONG x, LONG y, LONG width, LONG height) {
+    return rows[std::clamp(y, 0, height - 1)][std::clamp(x, 0, width - 1)];
+}
+
+template <typename T>
+void Invert(BasicPixel<T> *row, LONG width) {
+    using Packed = typename ChannelTraits<T>::Packed;
+    // Max - c is c ^ Max, so a whole pixel is inverted with one xor that keeps alpha;
+    // the loop has no cross-pixel dependencies and is vectorized by the compiler.
+    for (LONG x = 0; x < width; ++x) {
+        row[x] = std::bit_cast<BasicPixel<T> >(std::bit_cast<Packed>(row[x]) ^ ChannelTraits<T>::ColorMask);
     }
 }
 
-void EdgeDetectionFilter::Apply(PictureInfo &picture_info) {
-    GrayScaleFilter::Apply(picture_info);
-    std::vector<std::vector<Pixel> > image_copy = picture_info.pixels;
+template <typename T>
+void Gray(BasicPixel<T> *row, LONG width) {
+    constexpr double max = ChannelTraits<T>::Max;
+    for (LONG x = 0; x < width; ++x) {
+        double gray_value = GrayRed * row[x].red + GrayGreen * row[x].green + GrayBlue * row[x].blue;
 
-    for (LONG y = 0; y < picture_info.bmi_header.biHeight; ++y) {
-        for (LONG x = 0; x < picture_info.bmi_header.biWidth; ++x) {
+        row[x].red = static_cast<T>(std::clamp(gray_value, 0.0, max));
+        row[x].green = row[x].red;
+        row[x].blue = row[x].red;
+    }
+}
+
+template <typename T>
+void DetectEdges(PictureInfo &picture_info, BasicPixelMatrix<T> &rows, BasicPixelMatrix<T> &buffer,
+                 double threshold) {
+    constexpr T max = ChannelTraits<T>::Max;
+    PrepareBuffer(buffer, rows);
+    BasicPixelMatrix<T> &image_copy = buffer;
+    LONG width = picture_info.bmi_header.biWidth;
+    LONG height = picture_info.bmi_header.biHeight;
+    // The threshold is given for 8-bit channels.
+    threshold *= max / MaxColorValdouble;
+    // The weights below are not symmetric vertically, so rows are walked upwards in both orientations.
+    const LONG up = picture_info.top_down ? -1 : 1;
+
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
             double color = 0;
 
             const int kernel[3][3] = {{0, -1, 0}, {-1, 4, -1}, {0, -1, 0}};
             for (int row = 0; row < 3; ++row) {
                 for (int col = 0; col < 3; ++col) {
-                    Pixel neighbor = picture_info.CheckingBorders(x - 1 + row, y - 1 + col, picture_info);
+                    const BasicPixel<T> &neighbor = Neighbour(rows, x - 1 + row, y + (col - 1) * up, width, height);
                     color += static_cast<double>(neighbor.red * ((row + 1) * 3 + col + 1)) * kernel[row][col];
                 }
             }
-            color = std::clamp(color, 0.0, MaxColorValdouble);
+            color = std::clamp(color, 0.0, static_cast<double>(max));
 
-            if (color > threshold_) {
-                image_copy[y][x].red = image_copy[y][x].green = image_copy[y][x].blue =
-                    static_cast<BYTE>(MaxColorValint);
-            } else {
-                image_copy[y][x].red = image_copy[y][x].green = image_copy[y][x].blue = 0;
-            }
+            image_copy[y][x].alpha = rows[y][x].alpha;
+            T value = color > threshold ? max : 0;
+            image_copy[y][x].red = image_copy[y][x].green = image_copy[y][x].blue = value;
         }
     }
-    picture_info.pixels = image_copy;
+    rows.swap(image_copy);
 }
 
-void SharpeningFilter::Apply(PictureInfo &picture_info) {
-    std::vector<std::vector<Pixel> > image = picture_info.pixels;
-    std::vector<std::vector<Pixel> > image_copy = picture_info.pixels;
+template <typename T>
+void Sharpen(const PictureInfo &picture_info, BasicPixelMatrix<T> &rows, BasicPixelMatrix<T> &buffer) {
+    constexpr int max = ChannelTraits<T>::Max;
+    PrepareBuffer(buffer, rows);
+    BasicPixelMatrix<T> &image_copy = buffer;
+    LONG width = picture_info.bmi_header.biWidth;
+    LONG height = picture_info.bmi_header.biHeight;
 
-    for (LONG y = 0; y < picture_info.bmi_header.biHeight; ++y) {
-        for (LONG x = 0; x < picture_info.bmi_header.biWidth; ++x) {
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
             int red = 0;
             int green = 0;
             int blue = 0;
@@ -71,134 +106,511 @@ void SharpeningFilter::Apply(PictureInfo &picture_info) {
             const int kernel[3][3] = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
             for (int row = 0; row < 3; ++row) {
                 for (int col = 0; col < 3; ++col) {
-                    Pixel neighbor = picture_info.CheckingBorders(x - 1 + row, y - 1 + col, picture_info);
+                    const BasicPixel<T> &neighbor = Neighbour(rows, x - 1 + row, y - 1 + col, width, height);
                     red += neighbor.red * kernel[row][col];
                     green += neighbor.green * kernel[row][col];
                     blue += neighbor.blue * kernel[row][col];
                 }
             }
-            image_copy[y][x].red = static_cast<BYTE>(std::clamp(red, 0, MaxColorValint));
-            image_copy[y][x].green = static_cast<BYTE>(std::clamp(green, 0, MaxColorValint));
-            image_copy[y][x].blue = static_cast<BYTE>(std::clamp(blue, 0, MaxColorValint));
+            image_copy[y][x].red = static_cast<T>(std::clamp(red, 0, max));
+            image_copy[y][x].green = static_cast<T>(std::clamp(green, 0, max));
+            image_copy[y][x].blue = static_cast<T>(std::clamp(blue, 0, max));
+            image_copy[y][x].alpha = rows[y][x].alpha;
         }
     }
-    picture_info.pixels = image_copy;
+    rows.swap(image_copy);
 }
 
-void CropFilter::Apply(PictureInfo &picture_info) {
-    if (y_crop_ <= 0 || x_crop_ <= 0) {
-        throw InputDataException("Maybe you wanna delete image?");
-    }
-
-    if (y_crop_ < picture_info.bmi_header.biHeight) {
-        std::reverse(picture_info.pixels.begin(), picture_info.pixels.end());
-        picture_info.pixels.resize(y_crop_);
-        picture_info.bmi_header.biHeight = y_crop_;
-        std::reverse(picture_info.pixels.begin(), picture_info.pixels.end());
-    }
-    if (x_crop_ < picture_info.bmi_header.biWidth) {
-        for (std::vector<Pixel> &row : picture_info.pixels) {
-            row.resize(x_crop_);
+template <typename T>
+void Crop(BasicPixelMatrix<T> &rows, bool top_down, LONG width, LONG height) {
+    // The top rows are kept: they are the first ones in a top-down image and the last ones in a bottom-up image.
+    if (height < static_cast<LONG>(rows.size())) {
+        if (top_down) {
+            rows.resize(height);
+        } else {
+            rows.erase(rows.begin(), rows.end() - static_cast<std::ptrdiff_t>(height));
         }
-        picture_info.bmi_header.biWidth = x_crop_;
-    }
-}
-
-void GaussianBlurFilter::CreateGaussianKernel() {
-    int center = kernel_size_ / 2;
-    kernel_ = std::vector<double>(kernel_size_, 0.0);
-    double summat = 0.0;
-    for (int i = 0; i < kernel_size_; ++i) {
-        int dx = i - center;
-        double value = exp(-(dx * dx / (2 * sigma_ * sigma_)));
-        kernel_[i] = value;
-        summat += value;
     }
-
-    for (int i = 0; i < kernel_size_; ++i) {
-        kernel_[i] /= summat;
+    for (std::vector<BasicPixel<T> > &row : rows) {
+        if (width < static_cast<LONG>(row.size())) {
+            row.resize(width);
+        }
     }
 }
 
-void GaussianBlurFilter::Apply(PictureInfo &picture_info) {
-    if (sigma_ <= 0) {
-        throw InputDataException("sigma must be positive");
-    }
-    CreateGaussianKernel();
-
+template <typename T>
+void Blur(const PictureInfo &picture_info, BasicPixelMatrix<T> &rows, BasicPixelMatrix<T> &buffer,
+          const std::vector<double> &kernel) {
+    constexpr LONG max = ChannelTraits<T>::Max;
+    LONG kernel_size = static_cast<LONG>(kernel.size());
     double new_blue = 0.0;
     double new_green = 0.0;
     double new_red = 0.0;
-    int center = kernel_size_ / 2;
-    std::vector<std::vector<Pixel> > image_copy = picture_info.pixels;
-    for (LONG y = 0; y < picture_info.bmi_header.biHeight; ++y) {
-        for (LONG x = 0; x < picture_info.bmi_header.biWidth; ++x) {
+    int center = kernel_size / 2;
+    PrepareBuffer(buffer, rows);
+    BasicPixelMatrix<T> &image_copy = buffer;
+    LONG width = picture_info.bmi_header.biWidth;
+    LONG height = picture_info.bmi_header.biHeight;
+    // Summing from the bottom row up in both orientations gives bit-identical results for them.
+    const int up = picture_info.top_down ? -1 : 1;
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
             new_blue = 0.0;
             new_green = 0.0;
             new_red = 0.0;
-            for (int ky = 0; ky < kernel_size_; ++ky) {
-                int new_y = std::clamp(static_cast<int>(y) + (ky - center), 0,
-                                       static_cast<int>(picture_info.bmi_header.biHeight) - 1);
-                new_blue += picture_info.pixels[new_y][x].blue * kernel_[ky];
-                new_green += picture_info.pixels[new_y][x].green * kernel_[ky];
-                new_red += picture_info.pixels[new_y][x].red * kernel_[ky];
+            for (int ky = 0; ky < kernel_size; ++ky) {
+                int new_y = std::clamp(static_cast<int>(y) + (ky - center) * up, 0, static_cast<int>(height) - 1);
+                new_blue += rows[new_y][x].blue * kernel[ky];
+                new_green += rows[new_y][x].green * kernel[ky];
+                new_red += rows[new_y][x].red * kernel[ky];
             }
-            image_copy[y][x].blue = static_cast<BYTE>(new_blue);
-            image_copy[y][x].green = static_cast<BYTE>(new_green);
-            image_copy[y][x].red = static_cast<BYTE>(new_red);
+            image_copy[y][x].blue = static_cast<T>(new_blue);
+            image_copy[y][x].green = static_cast<T>(new_green);
+            image_copy[y][x].red = static_cast<T>(new_red);
+            image_copy[y][x].alpha = rows[y][x].alpha;
         }
     }
-    for (LONG y = 0; y < picture_info.bmi_header.biHeight; ++y) {
-        for (LONG x = 0; x < picture_info.bmi_header.biWidth; ++x) {
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
             new_blue = 0.0;
             new_green = 0.0;
             new_red = 0.0;
-            for (int ky = 0; ky < kernel_size_; ++ky) {
-                int new_x = std::clamp(static_cast<int>(x) + (ky - center), 0,
-                                       static_cast<int>(picture_info.bmi_header.biWidth) - 1);
-                new_blue += image_copy[y][new_x].blue * kernel_[ky];
-                new_green += image_copy[y][new_x].green * kernel_[ky];
-                new_red += image_copy[y][new_x].red * kernel_[ky];
+            for (int ky = 0; ky < kernel_size; ++ky) {
+                int new_x = std::clamp(static_cast<int>(x) + (ky - center), 0, static_cast<int>(width) - 1);
+                new_blue += image_copy[y][new_x].blue * kernel[ky];
+                new_green += image_copy[y][new_x].green * kernel[ky];
+                new_red += image_copy[y][new_x].red * kernel[ky];
             }
 
-            picture_info.pixels[y][x].blue =
-                static_cast<BYTE>(std::clamp(static_cast<LONG>(new_blue), 0, MaxColorValint));
-            picture_info.pixels[y][x].green =
-                static_cast<BYTE>(std::clamp(static_cast<LONG>(new_green), 0, MaxColorValint));
-            picture_info.pixels[y][x].red =
-                static_cast<BYTE>(std::clamp(static_cast<LONG>(new_red), 0, MaxColorValint));
+            rows[y][x].blue = static_cast<T>(std::clamp(static_cast<LONG>(new_blue), 0, max));
+            rows[y][x].green = static_cast<T>(std::clamp(static_cast<LONG>(new_green), 0, max));
+            rows[y][x].red = static_cast<T>(std::clamp(static_cast<LONG>(new_red), 0, max));
         }
     }
 }
 
-void PixelizeFilter::Apply(PictureInfo &picture_info) {
-    if (block_size_ <= 0) {
-        throw InputDataException("Block size must be positive");
-    }
+template <typename T>
+void Pixelize(const PictureInfo &picture_info, BasicPixelMatrix<T> &rows, int block_size) {
+    // Blocks start at the bottom left corner, so in a top-down image the first block row may be cut.
+    int height = picture_info.bmi_header.biHeight;
+    int width = picture_info.bmi_header.biWidth;
+    int first_row = picture_info.top_down && height % block_size != 0 ? height % block_size - block_size : 0;
 
-    for (int y = 0; y < picture_info.bmi_header.biHeight; y += block_size_) {
-        for (int x = 0; x < picture_info.bmi_header.biWidth; x += block_size_) {
+    for (int y = first_row; y < height; y += block_size) {
+        int block_top = std::max(y, 0);
+        int block_bottom = std::min(y + block_size, height);
+        for (int x = 0; x < width; x += block_size) {
             double avg_red = 0;
             double avg_green = 0;
             double avg_blue = 0;
             int counter = 0;
 
-            for (int dy = 0; dy < block_size_ && y + dy < picture_info.bmi_header.biHeight; ++dy) {
-                for (int dx = 0; dx < block_size_ && x + dx < picture_info.bmi_header.biWidth; ++dx) {
-                    avg_red += picture_info.pixels[y + dy][x + dx].red;
-                    avg_green += picture_info.pixels[y + dy][x + dx].green;
-                    avg_blue += picture_info.pixels[y + dy][x + dx].blue;
+            for (int row = block_top; row < block_bottom; ++row) {
+                for (int dx = 0; dx < block_size && x + dx < width; ++dx) {
+                    avg_red += rows[row][x + dx].red;
+                    avg_green += rows[row][x + dx].green;
+                    avg_blue += rows[row][x + dx].blue;
                     ++counter;
                 }
             }
 
-            for (int dy = 0; dy < block_size_ && y + dy < picture_info.bmi_header.biHeight; ++dy) {
-                for (int dx = 0; dx < block_size_ && x + dx < picture_info.bmi_header.biWidth; ++dx) {
-                    picture_info.pixels[y + dy][x + dx].red = static_cast<BYTE>(avg_red / counter);
-                    picture_info.pixels[y + dy][x + dx].green = static_cast<BYTE>(avg_green / counter);
-                    picture_info.pixels[y + dy][x + dx].blue = static_cast<BYTE>(avg_blue / counter);
+            for (int row = block_top; row < block_bottom; ++row) {
+                for (int dx = 0; dx < block_size && x + dx < width; ++dx) {
+                    rows[row][x + dx].red = static_cast<T>(avg_red / counter);
+                    rows[row][x + dx].green = static_cast<T>(avg_green / counter);
+                    rows[row][x + dx].blue = static_cast<T>(avg_blue / counter);
+                }
+            }
+        }
+    }
+}
+
+// Arithmetic of the planar kernels. On channel levels (PlanarImage::rounded) they repeat the packed kernels
+// exactly: sums in double, truncation and clamping where those have them, so a filter gives the same image
+// in both layouts. Otherwise sums are in float and nothing is rounded or clamped between filters.
+struct LevelArithmetic {
+    using Sum = double;
+
+    static float Truncate(Sum value) {
+        return static_cast<float>(static_cast<LONG>(value));
+    }
+
+    template <typename Value>
+    static Value Clamp(Value value, Value max) {
+        return std::clamp(value, Value{0}, max);
+    }
+};
+
+struct FloatArithmetic {
+    using Sum = float;
+
+    static float Truncate(Sum value) {
+        return value;
+    }
+
+    template <typename Value>
+    static Value Clamp(Value value, Value) {
+        return value;
+    }
+};
+
+template <typename Kernel>
+void WithArithmetic(const PlanarImage &image, Kernel kernel) {
+    if (image.rounded) {
+        kernel(LevelArithmetic{});
+    } else {
+        kernel(FloatArithmetic{});
+    }
+}
+
+// Weights of a 3x3 cross: the pixel, its left and right neighbours and the ones in the previous and
+// the next row of the chain of rows passed to ApplyStencil.
+struct Stencil {
+    float center;
+    float left;
+    float right;
+    float previous;
+    float next;
+};
+
+// One row of the stencil over planes, clamped to 0..max; columns outside the row are moved back to its edge.
+// The weights are small integers, so on channel levels every sum is an integer below 2^24 and float gives
+// it exactly. The inner columns need no clamping of coordinates, so their loop is vectorized.
+template <typename Arithmetic>
+void ApplyStencil(const float *previous, const float *row, const float *next, float *output, LONG width,
+                  const Stencil &stencil, float max) {
+    auto sum = [&](LONG x, LONG left, LONG right) {
+        float value = stencil.center * row[x] + stencil.left * row[left] + stencil.right * row[right] +
+                      stencil.previous * previous[x] + stencil.next * next[x];
+        return Arithmetic::Clamp(value, max);
+    };
+    output[0] = sum(0, 0, std::min(1, width - 1));
+    for (LONG x = 1; x < width - 1; ++x) {
+        float value = stencil.center * row[x] + stencil.left * row[x - 1] + stencil.right * row[x + 1] +
+                      stencil.previous * previous[x] + stencil.next * next[x];
+        output[x] = Arithmetic::Clamp(value, max);
+    }
+    if (width > 1) {
+        output[width - 1] = sum(width - 1, width - 2, width - 1);
+    }
+}
+
+// Applies the stencil to the first planes, previous and next rows are y - step and y + step.
+template <typename Arithmetic>
+void ApplyStencilToPlanes(PlanarImage &image, const Stencil &stencil, LONG step, size_t planes) {
+    std::vector<float> result(static_cast<size_t>(image.width) * image.height);
+    for (size_t plane = 0; plane < planes; ++plane) {
+        Plane name = static_cast<Plane>(plane);
+        for (LONG y = 0; y < image.height; ++y) {
+            const float *previous = image.Row(name, std::clamp(y - step, 0, image.height - 1));
+            const float *next = image.Row(name, std::clamp(y + step, 0, image.height - 1));
+            ApplyStencil<Arithmetic>(previous, image.Row(name, y), next,
+                                     result.data() + static_cast<size_t>(y) * image.width, image.width, stencil,
+                                     image.max);
+        }
+        image.planes[plane].swap(result);
+    }
+}
+
+void InvertPlanes(PlanarImage &image) {
+    for (size_t plane = 0; plane < PlanarImage::ColorPlanes; ++plane) {
+        for (float &value : image.planes[plane]) {
+            value = image.max - value;
+        }
+    }
+}
+
+template <typename Arithmetic>
+void GrayPlanes(PlanarImage &image) {
+    using Sum = typename Arithmetic::Sum;
+    float *blue = image.planes[static_cast<size_t>(Plane::Blue)].data();
+    float *green = image.planes[static_cast<size_t>(Plane::Green)].data();
+    float *red = image.planes[static_cast<size_t>(Plane::Red)].data();
+    size_t size = image.planes[static_cast<size_t>(Plane::Red)].size();
+    for (size_t index = 0; index < size; ++index) {
+        Sum gray_value = static_cast<Sum>(GrayRed) * red[index] + static_cast<Sum>(GrayGreen) * green[index] +
+                         static_cast<Sum>(GrayBlue) * blue[index];
+        float gray = Arithmetic::Truncate(Arithmetic::Clamp(gray_value, static_cast<Sum>(image.max)));
+        blue[index] = gray;
+        green[index] = gray;
+        red[index] = gray;
+    }
+}
+
+template <typename Arithmetic>
+void DetectEdgePlanes(PlanarImage &image, double threshold) {
+    using Sum = typename Arithmetic::Sum;
+    GrayPlanes<Arithmetic>(image);
+    // The weights of DetectEdges, with rows walked upwards in both orientations.
+    ApplyStencilToPlanes<Arithmetic>(image, Stencil{32, -5, -11, -7, -9}, image.top_down ? -1 : 1, 1);
+    // The threshold is given for 8-bit channels, and all colour planes are gray, so the blue one is enough.
+    Sum level = static_cast<Sum>(threshold * (image.max / MaxColorValdouble));
+    float *gray = image.planes[static_cast<size_t>(Plane::Blue)].data();
+    float *green = image.planes[static_cast<size_t>(Plane::Green)].data();
+    float *red = image.planes[static_cast<size_t>(Plane::Red)].data();
+    for (size_t index = 0; index < image.planes[static_cast<size_t>(Plane::Blue)].size(); ++index) {
+        gray[index] = static_cast<Sum>(gray[index]) > level ? image.max : 0.0f;
+        green[index] = gray[index];
+        red[index] = gray[index];
+    }
+}
+
+// Separable blur of the colour planes: a vertical pass that adds whole rows multiplied by the weights,
+// then a horizontal one over a copy of the row padded with its edge values on both sides. Every pixel
+// gets its terms in the same order as in Blur.
+template <typename Arithmetic>
+void BlurPlanes(PlanarImage &image, const std::vector<double> &kernel) {
+    using Sum = typename Arithmetic::Sum;
+    LONG kernel_size = static_cast<LONG>(kernel.size());
+    LONG center = kernel_size / 2;
+    std::vector<Sum> weights(kernel.begin(), kernel.end());
+    LONG up = image.top_down ? -1 : 1;
+    std::vector<float> column_pass(static_cast<size_t>(image.width) * image.height);
+    std::vector<float> padded(static_cast<size_t>(image.width + 2 * center));
+    std::vector<Sum> sums(image.width);
+
+    for (size_t plane = 0; plane < PlanarImage::ColorPlanes; ++plane) {
+        Plane name = static_cast<Plane>(plane);
+        for (LONG y = 0; y < image.height; ++y) {
+            std::fill(sums.begin(), sums.end(), Sum{0});
+            for (LONG ky = 0; ky < kernel_size; ++ky) {
+                const float *source = image.Row(name, std::clamp(y + (ky - center) * up, 0, image.height - 1));
+                Sum weight = weights[ky];
+                for (LONG x = 0; x < image.width; ++x) {
+                    sums[x] += source[x] * weight;
+                }
+            }
+            float *output = column_pass.data() + static_cast<size_t>(y) * image.width;
+            for (LONG x = 0; x < image.width; ++x) {
+                output[x] = Arithmetic::Truncate(sums[x]);
+            }
+        }
+        for (LONG y = 0; y < image.height; ++y) {
+            const float *source = column_pass.data() + static_cast<size_t>(y) * image.width;
+            std::fill(padded.begin(), padded.begin() + center, source[0]);
+            std::copy(source, source + image.width, padded.begin() + center);
+            std::fill(padded.begin() + center + image.width, padded.end(), source[image.width - 1]);
+            std::fill(sums.begin(), sums.end(), Sum{0});
+            for (LONG kx = 0; kx < kernel_size; ++kx) {
+                const float *shifted = padded.data() + kx;
+                Sum weight = weights[kx];
+                for (LONG x = 0; x < image.width; ++x) {
+                    sums[x] += shifted[x] * weight;
+                }
+            }
+            float *output = image.Row(name, y);
+            for (LONG x = 0; x < image.width; ++x) {
+                output[x] = Arithmetic::Clamp(Arithmetic::Truncate(sums[x]), image.max);
+            }
+        }
+    }
+}
+
+void CropPlanes(PlanarImage &image, LONG width, LONG height) {
+    LONG new_width = std::min(image.width, width);
+    LONG new_height = std::min(image.height, height);
+    // Same rows as Crop keeps: the first ones of a top-down image and the last ones of a bottom-up one.
+    LONG first_row = image.top_down ? 0 : image.height - new_height;
+    for (std::vector<float> &plane : image.planes) {
+        std::vector<float> cropped(static_cast<size_t>(new_width) * new_height);
+        for (LONG y = 0; y < new_height; ++y) {
+            const float *source = plane.data() + static_cast<size_t>(first_row + y) * image.width;
+            std::copy(source, source + new_width, cropped.begin() + static_cast<std::ptrdiff_t>(y) * new_width);
+        }
+        plane.swap(cropped);
+    }
+    image.width = new_width;
+    image.height = new_height;
+}
+
+template <typename Arithmetic>
+void PixelizePlanes(PlanarImage &image, LONG block_size) {
+    using Sum = typename Arithmetic::Sum;
+    // The same blocks as Pixelize uses.
+    LONG first_row =
+        image.top_down && image.height % block_size != 0 ? image.height % block_size - block_size : 0;
+    for (size_t plane = 0; plane < PlanarImage::ColorPlanes; ++plane) {
+        Plane name = static_cast<Plane>(plane);
+        for (LONG y = first_row; y < image.height; y += block_size) {
+            LONG block_top = std::max(y, 0);
+            LONG block_bottom = std::min(y + block_size, image.height);
+            for (LONG x = 0; x < image.width; x += block_size) {
+                LONG block_right = std::min(x + block_size, image.width);
+                Sum sum = 0;
+                for (LONG row = block_top; row < block_bottom; ++row) {
+                    const float *values = image.Row(name, row);
+                    for (LONG column = x; column < block_right; ++column) {
+                        sum += values[column];
+                    }
+                }
+                float average =
+                    Arithmetic::Truncate(sum / static_cast<Sum>((block_bottom - block_top) * (block_right - x)));
+                for (LONG row = block_top; row < block_bottom; ++row) {
+                    std::fill(image.Row(name, row) + x, image.Row(name, row) + block_right, average);
                 }
             }
         }
     }
 }
+}  // namespace
+
+void PointFilter::Apply(PictureInfo &picture_info) const {
+    for (LONG y = 0; y < picture_info.bmi_header.biHeight; ++y) {
+        if (picture_info.Deep()) {
+            ApplyToRow(picture_info.deep_pixels[y].data(), picture_info.bmi_header.biWidth);
+        } else {
+            ApplyToRow(picture_info.pixels[y].data(), picture_info.bmi_header.biWidth);
+        }
+    }
+}
+
+void NegativeFilter::ApplyToRow(Pixel *row, LONG width) const {
+    Invert(row, width);
+}
+
+void NegativeFilter::ApplyToRow(Pixel16 *row, LONG width) const {
+    Invert(row, width);
+}
+
+void NegativeFilter::Apply(PlanarImage &image) const {
+    InvertPlanes(image);
+}
+
+void GrayScaleFilter::ApplyToRow(Pixel *row, LONG width) const {
+    Gray(row, width);
+}
+
+void GrayScaleFilter::ApplyToRow(Pixel16 *row, LONG width) const {
+    Gray(row, width);
+}
+
+void GrayScaleFilter::Apply(PlanarImage &image) const {
+    WithArithmetic(image, [&image](auto arithmetic) { GrayPlanes<decltype(arithmetic)>(image); });
+}
+
+void PointChainFilter::ApplyToRow(Pixel *row, LONG width) const {
+    for (const auto &filter : filters_) {
+        filter->ApplyToRow(row, width);
+    }
+}
+
+void PointChainFilter::ApplyToRow(Pixel16 *row, LONG width) const {
+    for (const auto &filter : filters_) {
+        filter->ApplyToRow(row, width);
+    }
+}
+
+void PointChainFilter::Apply(PlanarImage &image) const {
+    for (const auto &filter : filters_) {
+        filter->Apply(image);
+    }
+}
+
+void EdgeDetectionFilter::Apply(PictureInfo &picture_info) const {
+    PixelMatrix buffer;
+    Apply(picture_info, buffer);
+}
+
+void EdgeDetectionFilter::Apply(PictureInfo &picture_info, PixelMatrix &buffer) const {
+    GrayScaleFilter().Apply(picture_info);
+    WithRows(picture_info, buffer,
+             [&](auto &rows, auto &copy) { DetectEdges(picture_info, rows, copy, threshold_); });
+}
+
+void EdgeDetectionFilter::Apply(PlanarImage &image) const {
+    WithArithmetic(image, [&](auto arithmetic) { DetectEdgePlanes<decltype(arithmetic)>(image, threshold_); });
+}
+
+void SharpeningFilter::Apply(PictureInfo &picture_info) const {
+    PixelMatrix buffer;
+    Apply(picture_info, buffer);
+}
+
+void SharpeningFilter::Apply(PictureInfo &picture_info, PixelMatrix &buffer) const {
+    WithRows(picture_info, buffer, [&](auto &rows, auto &copy) { Sharpen(picture_info, rows, copy); });
+}
+
+void SharpeningFilter::Apply(PlanarImage &image) const {
+    Stencil stencil{5, -1, -1, -1, -1};
+    WithArithmetic(image, [&](auto arithmetic) {
+        ApplyStencilToPlanes<decltype(arithmetic)>(image, stencil, 1, PlanarImage::ColorPlanes);
+    });
+}
+
+void CropFilter::Apply(PictureInfo &picture_info) const {
+    if (y_crop_ <= 0 || x_crop_ <= 0) {
+        throw InputDataException("Maybe you wanna delete image?");
+    }
+
+    if (picture_info.Deep()) {
+        Crop(picture_info.deep_pixels, picture_info.top_down, x_crop_, y_crop_);
+    } else {
+        Crop(picture_info.pixels, picture_info.top_down, x_crop_, y_crop_);
+    }
+    picture_info.bmi_header.biHeight = std::min(picture_info.bmi_header.biHeight, y_crop_);
+    picture_info.bmi_header.biWidth = std::min(picture_info.bmi_header.biWidth, x_crop_);
+}
+
+void CropFilter::Apply(PlanarImage &image) const {
+    if (y_crop_ <= 0 || x_crop_ <= 0) {
+        throw InputDataException("Maybe you wanna delete image?");
+    }
+    CropPlanes(image, x_crop_, y_crop_);
+}
+
+std::vector<double> GaussianBlurFilter::CreateGaussianKernel(double sigma, LONG kernel_size) {
+    if (sigma <= 0) {
+        return {};
+    }
+    int center = kernel_size / 2;
+    std::vector<double> kernel(kernel_size, 0.0);
+    double summat = 0.0;
+    for (int i = 0; i < kernel_size; ++i) {
+        int dx = i - center;
+        double value = exp(-(dx * dx / (2 * sigma * sigma)));
+        kernel[i] = value;
+        summat += value;
+    }
+
+    for (int i = 0; i < kernel_size; ++i) {
+        kernel[i] /= summat;
+    }
+    return kernel;
+}
+
+void GaussianBlurFilter::Apply(PictureInfo &picture_info) const {
+    PixelMatrix buffer;
+    Apply(picture_info, buffer);
+}
+
+void GaussianBlurFilter::Apply(PictureInfo &picture_info, PixelMatrix &buffer) const {
+    if (sigma_ <= 0) {
+        throw InputDataException("sigma must be positive");
+    }
+    WithRows(picture_info, buffer, [&](auto &rows, auto &copy) { Blur(picture_info, rows, copy, kernel_); });
+}
+
+void GaussianBlurFilter::Apply(PlanarImage &image) const {
+    if (sigma_ <= 0) {
+        throw InputDataException("sigma must be positive");
+    }
+    WithArithmetic(image, [&](auto arithmetic) { BlurPlanes<decltype(arithmetic)>(image, kernel_); });
+}
+
+void PixelizeFilter::Apply(PictureInfo &picture_info) const {
+    if (block_size_ <= 0) {
+        throw InputDataException("Block size must be positive");
+    }
+    if (picture_info.Deep()) {
+        Pixelize(picture_info, picture_info.deep_pixels, block_size_);
+    } else {
+        Pixelize(picture_info, picture_info.pixels, block_size_);
+    }
+}
+
+void PixelizeFilter::Apply(PlanarImage &image) const {
+    if (block_size_ <= 0) {
+        throw InputDataException("Block size must be positive");
+    }
+    WithArithmetic(image, [&](auto arithmetic) { PixelizePlanes<decltype(arithmetic)>(image, block_size_); });
+}
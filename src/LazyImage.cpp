@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+#include "LazyImage.h"
+
+struct LazyImage::Node {
+    std::shared_ptr<Node> parent;
+    // The filter applied to the image of parent, none for the source image.
+    FilterSpec spec;
+    size_t threads = 0;
+    std::mutex mutex;
+    // Set once the image is computed. Nodes only lock themselves and then their ancestors, never the other way.
+    std::shared_ptr<const PictureInfo> picture;
+
+    std::shared_ptr<const PictureInfo> Computed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return picture;
+    }
+};
+
+LazyImage::LazyImage(PictureInfo picture_info, size_t threads) : node_(std::make_shared<Node>()) {
+    node_->threads = threads;
+    node_->picture = std::make_shared<const PictureInfo>(std::move(picture_info));
+}
+
+LazyImage::LazyImage(std::shared_ptr<Node> node) : node_(std::move(node)) {
+}
+
+LazyImage LazyImage::Apply(const FilterSpec &spec) const {
+    Pipeline::Compile(std::vector<FilterSpec>{spec});
+    auto node = std::make_shared<Node>();
+    node->parent = node_;
+    node->spec = spec;
+    node->threads = node_->threads;
+    return LazyImage(std::move(node));
+}
+
+LazyImage LazyImage::Apply(const std::vector<std::string> &args) const {
+    LazyImage image = *this;
+    for (const FilterSpec &spec : Pipeline::Parse(args)) {
+        image = image.Apply(spec);
+    }
+    return image;
+}
+
+const PictureInfo &LazyImage::Get() const {
+    std::lock_guard<std::mutex> lock(node_->mutex);
+    if (node_->picture) {
+        return *node_->picture;
+    }
+    std::vector<FilterSpec> specs = {node_->spec};
+    Node *source = node_->parent.get();
+    std::shared_ptr<const PictureInfo> start = source->Computed();
+    while (!start) {
+        specs.push_back(source->spec);
+        source = source->parent.get();
+        start = source->Computed();
+    }
+    std::reverse(specs.begin(), specs.end());
+
+    PictureInfo picture_info = *start;
+    Pipeline::Compile(std::move(specs)).ApplyInStrips(picture_info, TileScheduler(node_->threads));
+    node_->picture = std::make_shared<const PictureInfo>(std::move(picture_info));
+    return *node_->picture;
+}
+
+size_t LazyImage::Pending() const {
+    size_t pending = 0;
+    for (Node *node = node_.get(); !node->Computed(); node = node->parent.get()) {
+        ++pending;
+    }
+    return pending;
+}
@@ -1,47 +1,59 @@
 #include <cmath>
 #include "PictureInfo.h"
 
-Pixel PictureInfo::CheckingBorders(LONG x, LONG y, PictureInfo &picture_info) {
-    if (x < 0) {
-        if (y < 0) {
-            return picture_info.pixels[y + 1][x + 1];
-        }
-        if (y >= picture_info.bmi_header.biHeight) {
-            return picture_info.pixels[y - 1][x + 1];
+namespace {
+constexpr WORD TrueColorBits = 24;
+// 65535 / 255: a 16-bit channel value is the 8-bit one repeated in both bytes.
+constexpr DWORD DeepScale = 257;
+
+template <typename From, typename To, typename Convert>
+std::vector<std::vector<To> > ConvertRows(const std::vector<std::vector<From> > &rows, Convert convert) {
+    std::vector<std::vector<To> > result(rows.size());
+    for (size_t y = 0; y < rows.size(); ++y) {
+        result[y].resize(rows[y].size());
+        for (size_t x = 0; x < rows[y].size(); ++x) {
+            result[y][x] = To{convert(rows[y][x].blue), convert(rows[y][x].green), convert(rows[y][x].red),
+                              convert(rows[y][x].alpha)};
         }
-        return picture_info.pixels[y][x + 1];
     }
-    if (x >= picture_info.bmi_header.biWidth) {
-        if (y < 0) {
-            return picture_info.pixels[y + 1][x - 1];
+    return result;
+}
+}  // namespace
+
+void PictureInfo::SetDeep(bool deep) {
+    if (deep && !Deep()) {
+        deep_pixels =
+            ConvertRows<Pixel, Pixel16>(pixels, [](BYTE value) { return static_cast<WORD>(value * DeepScale); });
+        pixels.clear();
+        if (!IsDeepBitCount(bmi_header.biBitCount)) {
+            bmi_header.biBitCount = bmi_header.biBitCount == TrueColorAlphaBits ? DeepColorAlphaBits : DeepColorBits;
         }
-        if (y >= picture_info.bmi_header.biHeight) {
-            return picture_info.pixels[y - 1][x - 1];
+    } else if (!deep && Deep()) {
+        pixels = ConvertRows<Pixel16, Pixel>(
+            deep_pixels, [](WORD value) { return static_cast<BYTE>((value + DeepScale / 2) / DeepScale); });
+        deep_pixels.clear();
+        if (IsDeepBitCount(bmi_header.biBitCount)) {
+            bmi_header.biBitCount = bmi_header.biBitCount == DeepColorAlphaBits ? TrueColorAlphaBits : TrueColorBits;
         }
-        return picture_info.pixels[y][x - 1];
-    }
-    if (y < 0) {
-        return picture_info.pixels[y + 1][x];
-    }
-    if (y >= picture_info.bmi_header.biHeight) {
-        return picture_info.pixels[y - 1][x];
     }
-    return picture_info.pixels[y][x];
 }
 
 void PictureInfo::Sync() {
-    if (pixels.empty() || pixels[0].empty()) {
+    size_t height = Deep() ? deep_pixels.size() : pixels.size();
+    size_t width = Deep() ? deep_pixels[0].size() : pixels.empty() ? 0 : pixels[0].size();
+    if (height == 0 || width == 0) {
         bmi_header.biHeight = 0;
         bmi_header.biWidth = 0;
         bmi_header.biSizeImage = 0;
         bmi_header.biSize = DefaultBisize;
         bmf_header.bfSize = DefaultBfsize;
     } else {
-        int padding = (4 - (bmi_header.biWidth * 3) % 4) % 4;
+        int bit_count = bmi_header.biBitCount == 0 ? 24 : bmi_header.biBitCount;
+        int row_stride = (bmi_header.biWidth * bit_count + 31) / 32 * 4;
 
-        bmi_header.biSizeImage = (bmi_header.biWidth * 3 + padding) * abs(bmi_header.biHeight);
-        bmi_header.biHeight = static_cast<LONG>(pixels.size());
-        bmi_header.biWidth = static_cast<LONG>(pixels[0].size());
+        bmi_header.biSizeImage = row_stride * abs(bmi_header.biHeight);
+        bmi_header.biHeight = static_cast<LONG>(height);
+        bmi_header.biWidth = static_cast<LONG>(width);
         bmi_header.biSize = DefaultBisize;
         bmf_header.bfSize = DefaultBfsize + bmi_header.biSizeImage;
     }
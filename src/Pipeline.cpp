@@ -0,0 +1,427 @@
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+#include "Exceptions.h"
+#include "Pipeline.h"
+#include "PlanarImage.h"
+
+namespace {
+struct FilterSignature {
+    const char *name;
+    size_t params_count;
+    bool integer_params;
+};
+
+constexpr FilterSignature Signatures[] = {
+    {"-gs", 0, false},   {"-neg", 0, false},  {"-sharp", 0, false}, {"-edge", 1, false},
+    {"-blur", 1, false}, {"-crop", 2, true},  {"-pix", 1, true},
+};
+
+bool IsPointSpec(const FilterSpec &spec) {
+    return spec.name == "-gs" || spec.name == "-neg";
+}
+}  // namespace
+
+std::vector<FilterSpec> Pipeline::Parse(const std::vector<std::string> &args) {
+    std::vector<FilterSpec> specs;
+
+    for (size_t ind = 0; ind < args.size(); ++ind) {
+        const FilterSignature *signature = nullptr;
+        for (const FilterSignature &candidate : Signatures) {
+            if (args[ind] == candidate.name) {
+                signature = &candidate;
+            }
+        }
+        if (signature == nullptr) {
+            throw FilterException((args[ind] + ": Unknown filter").c_str());
+        }
+        if (ind + signature->params_count >= args.size()) {
+            throw InputDataException((args[ind] + ": Missing value").c_str());
+        }
+
+        FilterSpec spec{args[ind], {}};
+        for (size_t param = 1; param <= signature->params_count; ++param) {
+            try {
+                if (signature->integer_params) {
+                    spec.params.push_back(std::stoi(args[ind + param]));
+                } else {
+                    spec.params.push_back(std::stod(args[ind + param]));
+                }
+            } catch (std::logic_error &) {
+                throw InputDataException((args[ind] + ": Invalid type of argument").c_str());
+            }
+        }
+        ind += signature->params_count;
+        specs.push_back(spec);
+    }
+    return specs;
+}
+
+void Pipeline::Validate(const FilterSpec &spec) {
+    if (spec.name == "-blur" && spec.params[0] <= 0) {
+        throw InputDataException("sigma must be positive");
+    }
+    if (spec.name == "-crop" && (spec.params[0] <= 0 || spec.params[1] <= 0)) {
+        throw InputDataException("Maybe you wanna delete image?");
+    }
+    if (spec.name == "-pix" && spec.params[0] <= 0) {
+        throw InputDataException("Block size must be positive");
+    }
+}
+
+std::vector<FilterSpec> Pipeline::Optimize(std::vector<FilterSpec> specs) {
+    std::vector<FilterSpec> optimized;
+
+    for (FilterSpec &spec : specs) {
+        if (spec.name == "-crop") {
+            // Cropping commutes with point filters, so it is done first and the point filters see fewer pixels.
+            auto position = optimized.end();
+            while (position != optimized.begin() && IsPointSpec(*(position - 1))) {
+                --position;
+            }
+            if (position != optimized.begin() && (position - 1)->name == "-crop") {
+                FilterSpec &previous = *(position - 1);
+                previous.params[0] = std::min(previous.params[0], spec.params[0]);
+                previous.params[1] = std::min(previous.params[1], spec.params[1]);
+            } else {
+                optimized.insert(position, spec);
+            }
+        } else if (spec.name == "-neg" && !optimized.empty() && optimized.back().name == "-neg") {
+            optimized.pop_back();
+        } else {
+            optimized.push_back(spec);
+        }
+    }
+    return optimized;
+}
+
+std::shared_ptr<const Filter> Pipeline::MakeFilter(const FilterSpec &spec) {
+    if (spec.name == "-gs") {
+        return std::make_shared<GrayScaleFilter>();
+    }
+    if (spec.name == "-neg") {
+        return std::make_shared<NegativeFilter>();
+    }
+    if (spec.name == "-sharp") {
+        return std::make_shared<SharpeningFilter>();
+    }
+    if (spec.name == "-edge") {
+        return std::make_shared<EdgeDetectionFilter>(spec.params[0]);
+    }
+    if (spec.name == "-blur") {
+        return std::make_shared<GaussianBlurFilter>(spec.params[0]);
+    }
+    if (spec.name == "-crop") {
+        return std::make_shared<CropFilter>(static_cast<LONG>(spec.params[0]), static_cast<LONG>(spec.params[1]));
+    }
+    if (spec.name == "-pix") {
+        return std::make_shared<PixelizeFilter>(static_cast<int>(spec.params[0]));
+    }
+    throw FilterException((spec.name + ": Unknown filter").c_str());
+}
+
+Pipeline Pipeline::Compile(const std::vector<std::string> &args) {
+    return Compile(Parse(args));
+}
+
+Pipeline Pipeline::Compile(std::vector<FilterSpec> specs) {
+    for (const FilterSpec &spec : specs) {
+        Validate(spec);
+    }
+
+    Pipeline pipeline;
+    pipeline.specs_ = Optimize(std::move(specs));
+
+    std::vector<std::shared_ptr<const PointFilter> > point_run;
+    auto flush_point_run = [&pipeline, &point_run]() {
+        if (point_run.size() == 1) {
+            pipeline.stages_.push_back(point_run.front());
+        } else if (point_run.size() > 1) {
+            pipeline.stages_.push_back(std::make_shared<PointChainFilter>(point_run));
+        }
+        point_run.clear();
+    };
+
+    for (const FilterSpec &spec : pipeline.specs_) {
+        std::shared_ptr<const Filter> filter = MakeFilter(spec);
+        if (auto point_filter = std::dynamic_pointer_cast<const PointFilter>(filter)) {
+            point_run.push_back(point_filter);
+        } else {
+            flush_point_run();
+            pipeline.stages_.push_back(filter);
+        }
+    }
+    flush_point_run();
+
+    Layout current = Layout::Packed;
+    for (const auto &stage : pipeline.stages_) {
+        if (stage->PreferredLayout() != Layout::Any) {
+            current = stage->PreferredLayout();
+        }
+        pipeline.layouts_.push_back(current);
+    }
+    return pipeline;
+}
+
+const PointFilter *Pipeline::PointStage() const {
+    if (stages_.size() != 1) {
+        return nullptr;
+    }
+    return dynamic_cast<const PointFilter *>(stages_.front().get());
+}
+
+LONG Pipeline::Halo() const {
+    LONG halo = 0;
+    for (const auto &stage : stages_) {
+        if (stage->Halo() == WholeImage) {
+            return WholeImage;
+        }
+        halo += stage->Halo();
+    }
+    return halo;
+}
+
+void Pipeline::Apply(PictureInfo &picture_info, Precision precision) const {
+    ApplyStages(picture_info, 0, stages_.size(), precision);
+}
+
+void Pipeline::Apply(PlanarImage &image) const {
+    for (const std::shared_ptr<const Filter> &stage : stages_) {
+        stage->Apply(image);
+    }
+}
+
+// Stages begin..end of the chain; layouts_ never holds Any, so it tells the layout of a stage in any range.
+void Pipeline::ApplyStages(PictureInfo &picture_info, size_t begin, size_t end, Precision precision) const {
+    PixelMatrix buffer;
+    std::optional<PlanarImage> planar;
+    if (precision == Precision::Float && begin < end) {
+        planar = PlanarImage::FromPicture(picture_info, false);
+    }
+
+    for (size_t index = begin; index < end; ++index) {
+        if (precision == Precision::Float) {
+            stages_[index]->Apply(*planar);
+            continue;
+        }
+        if (layouts_[index] == Layout::Planar && !planar) {
+            planar = PlanarImage::FromPicture(picture_info);
+        } else if (layouts_[index] == Layout::Packed && planar) {
+            planar->ToPicture(picture_info);
+            planar.reset();
+        }
+        if (planar) {
+            stages_[index]->Apply(*planar);
+        } else {
+            stages_[index]->Apply(picture_info, buffer);
+        }
+    }
+    if (planar) {
+        planar->ToPicture(picture_info);
+    }
+    picture_info.Sync();
+}
+
+namespace {
+// A rectangle of the image as an image of its own. Here y counts rows of PictureInfo, whichever of them is the top
+// one, so the part keeps the orientation of the image and filters see its rows in the same order.
+template <typename T>
+PictureInfo CopyRegion(const PictureInfo &picture_info, const TileRect &rect) {
+    BmpFileHeader file_header = picture_info.bmf_header;
+    BmpInfoHeader info_header = picture_info.bmi_header;
+    info_header.biWidth = rect.width;
+    info_header.biHeight = rect.height;
+    std::vector<std::vector<Pixel> > no_rows;
+    PictureInfo part(file_header, info_header, no_rows);
+    part.top_down = picture_info.top_down;
+    const BasicPixelMatrix<T> &rows = picture_info.Rows<T>();
+    BasicPixelMatrix<T> &part_rows = part.Rows<T>();
+    part_rows.resize(rect.height);
+    for (LONG y = 0; y < rect.height; ++y) {
+        auto row = rows[rect.y + y].begin() + rect.x;
+        part_rows[y].assign(row, row + rect.width);
+    }
+    return part;
+}
+
+// The rect widened by halo on every side and cut by the image.
+TileRect Widen(const TileRect &rect, LONG halo, LONG width, LONG height) {
+    LONG left = std::max(rect.x - halo, 0);
+    LONG top = std::max(rect.y - halo, 0);
+    LONG right = std::min(rect.x + rect.width + halo, width);
+    LONG bottom = std::min(rect.y + rect.height + halo, height);
+    return TileRect{left, top, right - left, bottom - top};
+}
+
+template <typename T>
+void ApplyToStrips(PictureInfo &picture_info, LONG halo, const TileScheduler &scheduler, LONG strip_rows,
+                   const std::function<void(PictureInfo &)> &apply) {
+    LONG width = picture_info.bmi_header.biWidth;
+    LONG height = picture_info.bmi_header.biHeight;
+    if (strip_rows == 0) {
+        // Strips much higher than the halo, so that the rows computed twice are a small part of the work.
+        strip_rows = std::max({Pipeline::StripPixels / std::max(width, 1), 16 * halo, 16});
+    }
+    std::vector<TileRect> strips = TileScheduler::Grid(width, height, width, strip_rows);
+    BasicPixelMatrix<T> result(height);
+    scheduler.Run(strips.size(), [&](size_t index) {
+        const TileRect &strip = strips[index];
+        TileRect widened = Widen(strip, halo, width, height);
+        PictureInfo part = CopyRegion<T>(picture_info, widened);
+        apply(part);
+        BasicPixelMatrix<T> &rows = part.Rows<T>();
+        std::move(rows.begin() + (strip.y - widened.y), rows.begin() + (strip.y - widened.y + strip.height),
+                  result.begin() + strip.y);
+    });
+    picture_info.Rows<T>() = std::move(result);
+}
+
+// The color of a rectangle whose pixels are all the same, nullopt otherwise.
+template <typename T>
+std::optional<BasicPixel<T> > UniformColor(const BasicPixelMatrix<T> &rows, const TileRect &rect) {
+    using Packed = typename ChannelTraits<T>::Packed;
+    Packed color = std::bit_cast<Packed>(rows[rect.y][rect.x]);
+    for (LONG y = rect.y; y < rect.y + rect.height; ++y) {
+        const BasicPixel<T> *row = rows[y].data() + rect.x;
+        for (LONG x = 0; x < rect.width; ++x) {
+            if (std::bit_cast<Packed>(row[x]) != color) {
+                return std::nullopt;
+            }
+        }
+    }
+    return rows[rect.y][rect.x];
+}
+
+// The pixels PatchTiles filters for tiles: the widened areas of the tiles it can't fill with one color.
+template <typename T>
+uint64_t TiledPixels(const PictureInfo &picture_info, const std::vector<TileRect> &tiles, LONG halo) {
+    uint64_t pixels = 0;
+    for (const TileRect &tile : tiles) {
+        TileRect widened = Widen(tile, halo, picture_info.bmi_header.biWidth, picture_info.bmi_header.biHeight);
+        if (!UniformColor(picture_info.Rows<T>(), widened)) {
+            pixels += static_cast<uint64_t>(widened.width) * widened.height;
+        }
+    }
+    return pixels;
+}
+
+template <typename T>
+void PatchTiles(const PictureInfo &input, PictureInfo &output, const std::vector<TileRect> &tiles, LONG halo,
+                const TileScheduler &scheduler, const std::function<void(PictureInfo &)> &apply) {
+    using Packed = typename ChannelTraits<T>::Packed;
+    LONG width = input.bmi_header.biWidth;
+    LONG height = input.bmi_header.biHeight;
+    BasicPixelMatrix<T> &rows = output.Rows<T>();
+    // The result of the chain on a one-color area, by the color; flat images have only a few of them.
+    std::map<Packed, BasicPixel<T> > solid_results;
+    std::mutex solid_mutex;
+    // Tiles don't overlap, so the threads write to different pixels of the output.
+    scheduler.Run(tiles.size(), [&](size_t index) {
+        const TileRect &tile = tiles[index];
+        TileRect widened = Widen(tile, halo, width, height);
+        // Every filter reads only the halo around a pixel, so where all of it has one color, each pixel of the tile
+        // comes out as the one pixel of an image of that color, whose edges are clamped to the same color.
+        if (std::optional<BasicPixel<T> > color = UniformColor(input.Rows<T>(), widened)) {
+            std::unique_lock<std::mutex> lock(solid_mutex);
+            auto solid = solid_results.find(std::bit_cast<Packed>(*color));
+            if (solid == solid_results.end()) {
+                lock.unlock();
+                PictureInfo pixel = CopyRegion<T>(input, TileRect{widened.x, widened.y, 1, 1});
+                apply(pixel);
+                lock.lock();
+                solid = solid_results.emplace(std::bit_cast<Packed>(*color), pixel.Rows<T>()[0][0]).first;
+            }
+            BasicPixel<T> result = solid->second;
+            lock.unlock();
+            for (LONG y = tile.y; y < tile.y + tile.height; ++y) {
+                std::fill_n(rows[y].begin() + tile.x, tile.width, result);
+            }
+            return;
+        }
+        PictureInfo part = CopyRegion<T>(input, widened);
+        apply(part);
+        const BasicPixelMatrix<T> &part_rows = part.Rows<T>();
+        for (LONG y = 0; y < tile.height; ++y) {
+            auto source = part_rows[tile.y - widened.y + y].begin() + (tile.x - widened.x);
+            std::copy(source, source + tile.width, rows[tile.y + y].begin() + tile.x);
+        }
+    });
+}
+}  // namespace
+
+void Pipeline::ApplyInStrips(PictureInfo &picture_info, const TileScheduler &scheduler, LONG strip_rows) const {
+    size_t begin = 0;
+    while (begin < stages_.size()) {
+        size_t end = begin + 1;
+        LONG halo = stages_[begin]->Halo();
+        if (halo != WholeImage) {
+            while (end < stages_.size() && stages_[end]->Halo() != WholeImage) {
+                halo += stages_[end++]->Halo();
+            }
+        }
+        // A single filter or a point chain gains nothing from strips.
+        if (end - begin > 1 && halo > 0 && picture_info.bmi_header.biHeight > 0) {
+            ApplyStrips(picture_info, begin, end, halo, scheduler, strip_rows);
+        } else {
+            ApplyStages(picture_info, begin, end, Precision::Channel);
+        }
+        begin = end;
+    }
+    picture_info.Sync();
+}
+
+void Pipeline::ApplyStrips(PictureInfo &picture_info, size_t begin, size_t end, LONG halo,
+                           const TileScheduler &scheduler, LONG strip_rows) const {
+    auto apply = [this, begin, end](PictureInfo &part) { ApplyStages(part, begin, end, Precision::Channel); };
+    if (picture_info.Deep()) {
+        ApplyToStrips<WORD>(picture_info, halo, scheduler, strip_rows, apply);
+    } else {
+        ApplyToStrips<BYTE>(picture_info, halo, scheduler, strip_rows, apply);
+    }
+}
+
+void Pipeline::ApplyToTiles(const PictureInfo &input, PictureInfo &output, const std::vector<TileRect> &tiles,
+                            const TileScheduler &scheduler) const {
+    LONG halo = Halo();
+    if (halo == WholeImage) {
+        throw FilterException("The filters need the whole image");
+    }
+    auto apply = [this](PictureInfo &part) { ApplyStages(part, 0, stages_.size(), Precision::Channel); };
+    if (input.Deep()) {
+        PatchTiles<WORD>(input, output, tiles, halo, scheduler, apply);
+    } else {
+        PatchTiles<BYTE>(input, output, tiles, halo, scheduler, apply);
+    }
+}
+
+void Pipeline::ApplyInTiles(PictureInfo &picture_info, const TileScheduler &scheduler, LONG tile_size) const {
+    LONG width = picture_info.bmi_header.biWidth;
+    LONG height = picture_info.bmi_header.biHeight;
+    if (Halo() == WholeImage || width == 0 || height == 0) {
+        ApplyInStrips(picture_info, scheduler);
+        return;
+    }
+    std::vector<TileRect> tiles = TileScheduler::Grid(width, height, tile_size, tile_size);
+    // Tiles computed one by one filter their halo again, which only flat tiles make up for; with a large halo
+    // a tile filters several times its own pixels, and strips filter about the image once.
+    uint64_t tiled = picture_info.Deep() ? TiledPixels<WORD>(picture_info, tiles, Halo())
+                                         : TiledPixels<BYTE>(picture_info, tiles, Halo());
+    if (tiled * MinTileSaving > static_cast<uint64_t>(width) * height) {
+        ApplyInStrips(picture_info, scheduler);
+        return;
+    }
+    PictureInfo output = picture_info;
+    ApplyToTiles(picture_info, output, tiles, scheduler);
+    picture_info = std::move(output);
+    picture_info.Sync();
+}
+
+PictureInfo Pipeline::Run(PictureInfo picture_info, Precision precision) const {
+    Apply(picture_info, precision);
+    return picture_info;
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include "PlanarImage.h"
+
+namespace {
+template <typename T>
+void SplitRows(const BasicPixelMatrix<T> &rows, PlanarImage &image) {
+    for (LONG y = 0; y < image.height; ++y) {
+        const BasicPixel<T> *row = rows[y].data();
+        float *blue = image.Row(Plane::Blue, y);
+        float *green = image.Row(Plane::Green, y);
+        float *red = image.Row(Plane::Red, y);
+        float *alpha = image.Row(Plane::Alpha, y);
+        for (LONG x = 0; x < image.width; ++x) {
+            blue[x] = row[x].blue;
+            green[x] = row[x].green;
+            red[x] = row[x].red;
+            alpha[x] = row[x].alpha;
+        }
+    }
+}
+
+// The clamped value is never negative, so the conversion, which truncates, rounds it with the 0.5 added;
+// unlike lround it is a single vector instruction.
+template <typename T>
+T ToChannel(float value) {
+    constexpr float max = ChannelTraits<T>::Max;
+    return static_cast<T>(static_cast<int>(std::clamp(value, 0.0f, max) + 0.5f));
+}
+
+template <typename T>
+void MergeRows(const PlanarImage &image, BasicPixelMatrix<T> &rows) {
+    rows.assign(image.height, std::vector<BasicPixel<T> >(image.width));
+    for (LONG y = 0; y < image.height; ++y) {
+        BasicPixel<T> *row = rows[y].data();
+        const float *blue = image.Row(Plane::Blue, y);
+        const float *green = image.Row(Plane::Green, y);
+        const float *red = image.Row(Plane::Red, y);
+        const float *alpha = image.Row(Plane::Alpha, y);
+        for (LONG x = 0; x < image.width; ++x) {
+            row[x] = BasicPixel<T>{ToChannel<T>(blue[x]), ToChannel<T>(green[x]), ToChannel<T>(red[x]),
+                                   ToChannel<T>(alpha[x])};
+        }
+    }
+}
+}  // namespace
+
+void PlanarImage::Resize(LONG new_width, LONG new_height) {
+    width = new_width;
+    height = new_height;
+    for (std::vector<float> &plane : planes) {
+        plane.assign(static_cast<size_t>(width) * height, 0.0f);
+    }
+}
+
+PlanarImage PlanarImage::FromPicture(const PictureInfo &picture_info, bool rounded) {
+    PlanarImage image;
+    image.top_down = picture_info.top_down;
+    image.rounded = rounded;
+    image.max = picture_info.Deep() ? ChannelTraits<WORD>::Max : ChannelTraits<BYTE>::Max;
+    image.Resize(picture_info.bmi_header.biWidth, picture_info.bmi_header.biHeight);
+    if (picture_info.Deep()) {
+        SplitRows(picture_info.deep_pixels, image);
+    } else {
+        SplitRows(picture_info.pixels, image);
+    }
+    return image;
+}
+
+void PlanarImage::ToPicture(PictureInfo &picture_info) const {
+    if (max == ChannelTraits<WORD>::Max) {
+        MergeRows(*this, picture_info.deep_pixels);
+        picture_info.pixels.clear();
+    } else {
+        MergeRows(*this, picture_info.pixels);
+        picture_info.deep_pixels.clear();
+    }
+    picture_info.top_down = top_down;
+    picture_info.bmi_header.biWidth = width;
+    picture_info.bmi_header.biHeight = height;
+}
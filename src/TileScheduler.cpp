@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "TileScheduler.h"
+
+TileScheduler::TileScheduler(size_t threads)
+    : threads_(threads == 0 ? std::max(1U, std::thread::hardware_concurrency()) : threads) {
+}
+
+void TileScheduler::Run(size_t count, const std::function<void(size_t)> &task) const {
+    std::atomic<size_t> next_index = 0;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&task, &next_index, &error, &error_mutex, count]() {
+        for (size_t index = next_index++; index < count; index = next_index++) {
+            try {
+                task(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                // The other workers finish their current tiles and stop.
+                next_index = count;
+            }
+        }
+    };
+
+    size_t threads_count = std::min(threads_, count);
+    std::vector<std::thread> threads;
+    for (size_t thread = 1; thread < threads_count; ++thread) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+std::vector<TileRect> TileScheduler::Grid(LONG width, LONG height, LONG tile_width, LONG tile_height) {
+    std::vector<TileRect> tiles;
+    for (LONG y = 0; y < height; y += tile_height) {
+        for (LONG x = 0; x < width; x += tile_width) {
+            tiles.push_back(TileRect{x, y, std::min(tile_width, width - x), std::min(tile_height, height - y)});
+        }
+    }
+    return tiles;
+}
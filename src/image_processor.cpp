@@ -1,6 +1,10 @@
+#include <iostream>
+
 #include "../include/input_control/ControlParameters.h"
 
 int main(int argc, const char* argv[]) {
+    // Images can come through stdin and go to stdout; C++ streams are much faster when not synced with stdio.
+    std::ios::sync_with_stdio(false);
     ControlParameters bmp(argc, argv);
     bmp.Control();
     return 0;
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
+#include <thread>
+
+#include "Exceptions.h"
+#include "input_control/BmpInspector.h"
+#include "input_control/Input_OutputProcessing.h"
+
+namespace {
+constexpr DWORD MaxCompression = 6;
+constexpr WORD SupportedBitCounts[] = {1, 4, 8, 16, 24, 32, 48, 64};
+const char *const CompressionNames[] = {"BI_RGB",  "BI_RLE8", "BI_RLE4",     "BI_BITFIELDS",
+                                        "BI_JPEG", "BI_PNG",  "BI_ALPHABITFIELDS"};
+
+std::string EscapeJson(const std::string &text) {
+    std::string escaped;
+    for (char symbol : text) {
+        if (symbol == '"' || symbol == '\\') {
+            escaped += '\\';
+            escaped += symbol;
+        } else if (static_cast<unsigned char>(symbol) < ' ') {
+            char code[7];
+            std::snprintf(code, sizeof(code), "\\u%04x", symbol);
+            escaped += code;
+        } else {
+            escaped += symbol;
+        }
+    }
+    return escaped;
+}
+
+bool HasBmpExtension(const std::filesystem::path &path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char symbol) { return std::tolower(symbol); });
+    return extension == ".bmp";
+}
+}  // namespace
+
+BmpSummary BmpInspector::InspectFile(const std::string &file_path) {
+    BmpFileHeader header{};
+    BmpInfoHeader info_header{};
+    size_t file_size = InputOutputProcessing::ReadBmpHeaders(file_path, header, info_header);
+
+    if (header.bfType != BM) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    if (info_header.biSize < DefaultBisize || header.bfOffBits < BmpHeadersSize) {
+        throw InfoHeaderException("Unsupported info header");
+    }
+    if (info_header.biWidth <= 0 || info_header.biHeight == 0 ||
+        info_header.biHeight == std::numeric_limits<LONG>::min()) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    if (info_header.biPlanes != 1 || info_header.biCompression > MaxCompression ||
+        std::find(std::begin(SupportedBitCounts), std::end(SupportedBitCounts), info_header.biBitCount) ==
+            std::end(SupportedBitCounts)) {
+        throw InfoHeaderException("Incorrect image format");
+    }
+
+    BmpSummary summary;
+    summary.path = file_path;
+    summary.width = info_header.biWidth;
+    summary.height = std::abs(info_header.biHeight);
+    summary.bit_count = info_header.biBitCount;
+    summary.compression = info_header.biCompression;
+    summary.top_down = info_header.biHeight < 0;
+    summary.file_size = file_size;
+    return summary;
+}
+
+std::vector<BmpSummary> BmpInspector::InspectDirectory(const std::string &directory_path) {
+    std::vector<BmpSummary> summaries;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(directory_path)) {
+        if (entry.is_regular_file() && HasBmpExtension(entry.path())) {
+            summaries.push_back(BmpSummary{.path = entry.path().string(), .error = {}});
+        }
+    }
+
+    std::atomic<size_t> next_index = 0;
+    auto worker = [&summaries, &next_index]() {
+        for (size_t index = next_index++; index < summaries.size(); index = next_index++) {
+            try {
+                summaries[index] = InspectFile(summaries[index].path);
+            } catch (std::exception &e) {
+                summaries[index].error = e.what();
+            }
+        }
+    };
+
+    size_t threads_count = std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()), summaries.size());
+    std::vector<std::thread> threads;
+    for (size_t thread = 1; thread < threads_count; ++thread) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    return summaries;
+}
+
+std::string BmpInspector::ToJson(const BmpSummary &summary) {
+    std::string json = "{\"path\": \"" + EscapeJson(summary.path) + "\"";
+    if (!summary.error.empty()) {
+        return json + ", \"error\": \"" + EscapeJson(summary.error) + "\"}";
+    }
+    json += ", \"width\": " + std::to_string(summary.width);
+    json += ", \"height\": " + std::to_string(summary.height);
+    json += ", \"bit_count\": " + std::to_string(summary.bit_count);
+    json += ", \"compression\": \"" + std::string(CompressionNames[summary.compression]) + "\"";
+    json += ", \"top_down\": " + std::string(summary.top_down ? "true" : "false");
+    json += ", \"file_size\": " + std::to_string(summary.file_size) + "}";
+    return json;
+}
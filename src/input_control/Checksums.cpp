@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#include "input_control/Checksums.h"
+
+namespace {
+constexpr DWORD CrcPolynomial = 0xedb88320;
+constexpr DWORD AdlerModulo = 65521;
+// The largest number of bytes that can be summed before the 32-bit sums may overflow.
+constexpr size_t AdlerBlock = 5552;
+constexpr int BitsInByte = 8;
+constexpr uint64_t HashMultiplier = 0x9e3779b97f4a7c15;
+constexpr uint64_t HashFinalizer = 0xff51afd7ed558ccd;
+constexpr int HashRotation = 23;
+
+// Four tables let the loop process four bytes per step instead of one.
+constexpr std::array<std::array<DWORD, 256>, 4> MakeCrcTables() {
+    std::array<std::array<DWORD, 256>, 4> tables{};
+    for (DWORD byte = 0; byte < 256; ++byte) {
+        DWORD crc = byte;
+        for (int bit = 0; bit < BitsInByte; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ CrcPolynomial : crc >> 1;
+        }
+        tables[0][byte] = crc;
+    }
+    for (DWORD byte = 0; byte < 256; ++byte) {
+        for (size_t table = 1; table < tables.size(); ++table) {
+            DWORD previous = tables[table - 1][byte];
+            tables[table][byte] = (previous >> BitsInByte) ^ tables[0][previous & 0xff];
+        }
+    }
+    return tables;
+}
+
+constexpr std::array<std::array<DWORD, 256>, 4> CrcTables = MakeCrcTables();
+}  // namespace
+
+DWORD Checksums::Crc32(std::span<const std::byte> data, DWORD previous) {
+    DWORD crc = ~previous;
+    const std::byte *bytes = data.data();
+    size_t size = data.size();
+    for (; size >= 4; size -= 4, bytes += 4) {
+        crc ^= static_cast<DWORD>(bytes[0]) | static_cast<DWORD>(bytes[1]) << 8 | static_cast<DWORD>(bytes[2]) << 16 |
+               static_cast<DWORD>(bytes[3]) << 24;
+        crc = CrcTables[3][crc & 0xff] ^ CrcTables[2][(crc >> 8) & 0xff] ^ CrcTables[1][(crc >> 16) & 0xff] ^
+              CrcTables[0][crc >> 24];
+    }
+    for (; size > 0; --size, ++bytes) {
+        crc = CrcTables[0][(crc ^ static_cast<DWORD>(*bytes)) & 0xff] ^ (crc >> BitsInByte);
+    }
+    return ~crc;
+}
+
+DWORD Checksums::Adler32(std::span<const std::byte> data, DWORD previous) {
+    DWORD low = previous & 0xffff;
+    DWORD high = previous >> 16;
+    while (!data.empty()) {
+        size_t block = std::min(data.size(), AdlerBlock);
+        for (std::byte byte : data.first(block)) {
+            low += static_cast<DWORD>(byte);
+            high += low;
+        }
+        low %= AdlerModulo;
+        high %= AdlerModulo;
+        data = data.subspan(block);
+    }
+    return high << 16 | low;
+}
+
+uint64_t Checksums::Hash64(std::span<const std::byte> data, uint64_t previous) {
+    uint64_t hash = previous ^ (data.size() * HashMultiplier);
+    // One multiplication per eight bytes; the rotation carries the high bits, which the multiplication mixes best,
+    // down to the next word.
+    size_t index = 0;
+    for (; index + sizeof(uint64_t) <= data.size(); index += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, data.data() + index, sizeof(uint64_t));
+        hash = (std::rotl(hash, HashRotation) ^ word) * HashMultiplier;
+    }
+    uint64_t tail = 0;
+    if (index < data.size()) {
+        std::memcpy(&tail, data.data() + index, data.size() - index);
+    }
+    hash = (std::rotl(hash, HashRotation) ^ tail) * HashMultiplier;
+    hash ^= hash >> 33;
+    hash *= HashFinalizer;
+    return hash ^ (hash >> 33);
+}
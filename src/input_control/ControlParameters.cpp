@@ -1,126 +1,516 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
 #include <optional>
-#include <memory>
+#include <span>
+#include <sstream>
 
-#include "Filters.h"
+#include "AsyncWriter.h"
+#include "Pipeline.h"
+#include "input_control/BmpInspector.h"
+#include "input_control/Checksums.h"
 #include "input_control/ControlParameters.h"
+#include "input_control/RleCodec.h"
+#include "input_control/TiffCodec.h"
 #include "Exceptions.h"
 
+namespace {
+// Part of every cache recipe; changing it makes the outputs cached before miss, e.g. when a filter changes.
+constexpr int CacheVersion = 1;
+constexpr uintmax_t BytesInMegabyte = uintmax_t{1} << 20;
+
+bool IsNumber(const std::string &value) {
+    return !value.empty() &&
+           std::all_of(value.begin(), value.end(), [](unsigned char symbol) { return std::isdigit(symbol); });
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs action and prints the error it throws, if any. Errors of the graph come from other threads as well, e.g.
+// from the writer, so anything they throw is reported instead of ending the program; returns whether it succeeded.
+template <typename Action>
+bool ReportErrors(Action action) {
+    try {
+        action();
+        return true;
+    } catch (InputDataException &e) {
+        std::cerr << "InputDataError: " << e.what() << std::endl;
+    } catch (FileHeaderException &e) {
+        std::cerr << "FileHeaderError: " << e.what() << std::endl;
+    } catch (InfoHeaderException &e) {
+        std::cerr << "InfoHeaderError: " << e.what() << std::endl;
+    } catch (std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    return false;
+}
+
+// The tile hashes of an output stand for the input it was made from, so they go whenever the output is written
+// another way; an output that has none is made anew by the next incremental run.
+void RemoveTileHashes(const std::string &path) {
+    if (path == StdStreamPath) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::remove(path + TileHashesSuffix, error);
+}
+}  // namespace
+
+std::string RunProfile::ToJson() const {
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3) << "{\"load_ms\": " << load_ms << ", \"filters_ms\": " << filters_ms
+         << ", \"save_ms\": " << save_ms << ", \"cache_hits\": " << cache_hits << ", \"cache_misses\": " << cache_misses
+         << ", \"cache_evictions\": " << cache_evictions << ", \"tiles\": " << tiles
+         << ", \"recomputed_tiles\": " << recomputed_tiles << "}";
+    return json.str();
+}
+
 ControlParameters::ControlParameters(int argc, const char **argv) {
     for (int i = 0; i < argc; i++) {
         argv_.push_back(static_cast<std::string>(argv[i]));
     }
 }
 
-void ControlParameters::Control() {
-    if (argv_.size() < 3) {
-        std::cerr << "InputDataError: Too few arguments" << std::endl;
+void ControlParameters::Inspect() {
+    for (size_t ind = 2; ind < argv_.size(); ++ind) {
+        try {
+            if (std::filesystem::is_directory(argv_[ind])) {
+                for (const BmpSummary &summary : BmpInspector::InspectDirectory(argv_[ind])) {
+                    std::cout << BmpInspector::ToJson(summary) << '\n';
+                }
+            } else {
+                std::cout << BmpInspector::ToJson(BmpInspector::InspectFile(argv_[ind])) << '\n';
+            }
+        } catch (std::exception &e) {
+            std::cout << BmpInspector::ToJson(BmpSummary{.path = argv_[ind], .error = e.what()}) << '\n';
+        }
+    }
+    std::cout.flush();
+}
+
+void ControlParameters::ExtractOptions() {
+    for (size_t ind = 1; ind < argv_.size();) {
+        if (std::find(FlagOptions.begin(), FlagOptions.end(), argv_[ind]) != FlagOptions.end()) {
+            options_[argv_[ind]] = "";
+            argv_.erase(argv_.begin() + static_cast<std::ptrdiff_t>(ind));
+            continue;
+        }
+        if (std::find(ValueOptions.begin(), ValueOptions.end(), argv_[ind]) == ValueOptions.end()) {
+            ++ind;
+            continue;
+        }
+        if (ind + 1 >= argv_.size()) {
+            throw InputDataException((argv_[ind] + ": Missing value").c_str());
+        }
+        options_[argv_[ind]] = argv_[ind + 1];
+        auto option = argv_.begin() + static_cast<std::ptrdiff_t>(ind);
+        argv_.erase(option, option + 2);
+    }
+
+    if (options_.contains(DepthOption)) {
+        const std::string &depth = options_[DepthOption];
+        if (depth != "auto" && depth != "1" && depth != "8" && depth != "24" && depth != "32" && depth != "48" &&
+            depth != "64") {
+            throw InputDataException((DepthOption + ": Invalid type of argument").c_str());
+        }
+    }
+    if (options_.contains(CompressOption) && options_[CompressOption] != "rle" && options_[CompressOption] != "none") {
+        throw InputDataException((CompressOption + ": Invalid type of argument").c_str());
+    }
+    if (options_.contains(FormatOption) && !InputOutputProcessing::FormatFromName(options_[FormatOption])) {
+        throw InputDataException((FormatOption + ": Invalid type of argument").c_str());
+    }
+    if (options_.contains(ScaleOption)) {
+        const std::string &scale = options_[ScaleOption];
+        if (scale != "1" && scale != "2" && scale != "4" && scale != "8") {
+            throw InputDataException((ScaleOption + ": Invalid type of argument").c_str());
+        }
+    }
+    if (options_.contains(LevelOption)) {
+        const std::string &level = options_[LevelOption];
+        if (level.size() != 1 || level[0] < '0' + ZlibCodec::MinLevel || level[0] > '0' + ZlibCodec::MaxLevel) {
+            throw InputDataException((LevelOption + ": Invalid type of argument").c_str());
+        }
+    }
+    if (options_.contains(TileOption)) {
+        const std::string &tile = options_[TileOption];
+        if (!IsNumber(tile) || tile.size() > 4 || std::stoi(tile) % 16 != 0) {
+            throw InputDataException((TileOption + ": Invalid type of argument").c_str());
+        }
+    }
+    if (options_.contains(PrecisionOption) && options_[PrecisionOption] != "channel" &&
+        options_[PrecisionOption] != "float") {
+        throw InputDataException((PrecisionOption + ": Invalid type of argument").c_str());
+    }
+    if (options_.contains(CacheLimitOption)) {
+        const std::string &limit = options_[CacheLimitOption];
+        if (!IsNumber(limit) || limit.size() > 9) {
+            throw InputDataException((CacheLimitOption + ": Invalid type of argument").c_str());
+        }
+    }
+}
+
+void ControlParameters::ApplyDepth(PictureInfo &picture_info) const {
+    auto depth = options_.find(DepthOption);
+    if (depth == options_.end()) {
         return;
     }
+    if (depth->second == "auto") {
+        picture_info.bmi_header.biBitCount = InputOutputProcessing::ChooseBitCount(picture_info);
+    } else {
+        picture_info.bmi_header.biBitCount = static_cast<WORD>(std::stoi(depth->second));
+    }
+}
 
-    std::optional<PictureInfo> picture_info_opt;
+void ControlParameters::ApplyCompression(PictureInfo &picture_info) const {
+    auto compression = options_.find(CompressOption);
+    if (compression == options_.end()) {
+        return;
+    }
+    if (compression->second == "none") {
+        picture_info.bmi_header.biCompression = BiRgb;
+    } else {
+        // The writer falls back to uncompressed data when the output bit count has no RLE variant.
+        picture_info.bmi_header.biCompression = picture_info.bmi_header.biBitCount == 4 ? BiRle4 : BiRle8;
+    }
+}
+
+ImageFormat ControlParameters::OutputFormat(const std::string &path) const {
+    auto format = options_.find(FormatOption);
+    if (format == options_.end()) {
+        return InputOutputProcessing::FormatFromPath(path);
+    }
+    return *InputOutputProcessing::FormatFromName(format->second);
+}
+
+int ControlParameters::CompressionLevel() const {
+    auto level = options_.find(LevelOption);
+    return level == options_.end() ? ZlibCodec::DefaultLevel : std::stoi(level->second);
+}
+
+LONG ControlParameters::TileSize() const {
+    auto tile = options_.find(TileOption);
+    return tile == options_.end() ? 0 : std::stoi(tile->second);
+}
+
+Precision ControlParameters::WorkingPrecision() const {
+    auto precision = options_.find(PrecisionOption);
+    return precision != options_.end() && precision->second == "float" ? Precision::Float : Precision::Channel;
+}
+
+JpegDecodeOptions ControlParameters::DecodeOptions(const std::vector<FilterSpec> &specs) const {
+    JpegDecodeOptions options;
+    auto scale = options_.find(ScaleOption);
+    if (scale != options_.end()) {
+        options.scale = std::stoi(scale->second);
+    }
+    // The pipeline moves crops before point filters, so a crop at its front means that the rest of the image
+    // is never looked at and doesn't have to be decoded.
+    if (!specs.empty() && specs.front().name == "-crop") {
+        options.max_width = static_cast<LONG>(specs.front().params[0]);
+        options.max_height = static_cast<LONG>(specs.front().params[1]);
+    }
+    return options;
+}
+
+std::vector<std::pair<std::string, std::vector<std::string> > > ControlParameters::SplitOutputs() const {
+    std::vector<std::pair<std::string, std::vector<std::string> > > outputs = {{argv_[2], {}}};
+    // The output whose filters are being read; a snapshot gets a copy of them as they are so far.
+    size_t current = 0;
+    for (size_t ind = 3; ind < argv_.size(); ++ind) {
+        if (argv_[ind] != OutputOption && argv_[ind] != SaveFilter) {
+            outputs[current].second.push_back(argv_[ind]);
+            continue;
+        }
+        if (ind + 1 >= argv_.size()) {
+            throw InputDataException((argv_[ind] + ": Missing value").c_str());
+        }
+        if (argv_[ind] == OutputOption) {
+            outputs.emplace_back(argv_[ind + 1], std::vector<std::string>{});
+            current = outputs.size() - 1;
+        } else {
+            outputs.emplace_back(argv_[ind + 1], outputs[current].second);
+        }
+        ++ind;
+    }
+    return outputs;
+}
+
+bool ControlParameters::ChangesOutput() const {
+    return std::any_of(options_.begin(), options_.end(), [](const auto &option) {
+        return std::find(RunOptions.begin(), RunOptions.end(), option.first) == RunOptions.end();
+    });
+}
 
+std::string ControlParameters::Recipe(const std::string &path, const std::vector<FilterSpec> &specs) const {
+    std::ostringstream recipe;
+    recipe << CacheVersion << ' ' << static_cast<int>(OutputFormat(path));
+    for (const auto &[option, value] : options_) {
+        if (std::find(RunOptions.begin(), RunOptions.end(), option) == RunOptions.end()) {
+            recipe << ' ' << option << '=' << value;
+        }
+    }
+    recipe << std::setprecision(17);
+    for (const FilterSpec &spec : specs) {
+        recipe << ' ' << spec.name;
+        for (double param : spec.params) {
+            recipe << ' ' << param;
+        }
+    }
+    return recipe.str();
+}
+
+std::vector<std::pair<std::string, std::vector<std::string> > > ControlParameters::FetchCached(
+    std::vector<std::pair<std::string, std::vector<std::string> > > outputs) {
+    if (!options_.contains(CacheOption) || argv_[1] == StdStreamPath) {
+        return outputs;
+    }
+    auto limit = options_.find(CacheLimitOption);
+    cache_ = std::make_unique<ResultCache>(
+        options_[CacheOption],
+        limit == options_.end() ? ResultCache::DefaultLimit : std::stoull(limit->second) * BytesInMegabyte);
+    uint64_t input_hash = ResultCache::HashFile(argv_[1]);
+    std::vector<std::pair<std::string, std::vector<std::string> > > missing;
+    for (auto &output : outputs) {
+        if (output.first == StdStreamPath) {
+            missing.push_back(std::move(output));
+            continue;
+        }
+        // Optimized, so that e.g. "-neg -neg -gs" and "-gs" share an entry.
+        uint64_t key = ResultCache::Key(input_hash, Recipe(output.first, Pipeline::Compile(output.second).Specs()));
+        if (cache_->Fetch(key, output.first)) {
+            RemoveTileHashes(output.first);
+        } else {
+            cache_keys_[output.first] = key;
+            missing.push_back(std::move(output));
+        }
+    }
+    return missing;
+}
+
+bool ControlParameters::Save(const std::string &path, SharedPicture picture) {
+    // The options change only the headers, but a shared image is copied for that all the same,
+    // so it is touched only when they are given.
+    if (options_.contains(DepthOption) || options_.contains(CompressOption)) {
+        ApplyDepth(picture.Mutable());
+        ApplyCompression(picture.Mutable());
+    }
+    // Also when the output isn't written: a failed write may leave a part of it.
+    RemoveTileHashes(path);
     try {
-        picture_info_opt = InputOutputProcessing::LoadBmpFile(argv_[1]);
+        InputOutputProcessing::SaveImageFile(path, picture.Get(), OutputFormat(path), CompressionLevel(), TileSize());
     } catch (InputDataException &e) {
         std::cerr << "InputDataError: " << e.what() << std::endl;
-        return;
-    } catch (FileHeaderException &e) {
-        std::cerr << "FileHeaderError: " << e.what() << std::endl;
-        return;
-    } catch (InfoHeaderException &e) {
-        std::cerr << "InfoHeaderError: " << e.what() << std::endl;
+        return false;
+    }
+    StoreCached(path);
+    return true;
+}
+
+void ControlParameters::StoreCached(const std::string &path) {
+    auto key = cache_keys_.find(path);
+    if (key == cache_keys_.end()) {
         return;
     }
+    try {
+        cache_->Store(key->second, path);
+    } catch (InputDataException &) {
+        // The output is saved all the same, the next run just makes it again.
+    }
+}
 
-    if (!picture_info_opt) {
+void ControlParameters::ControlGraph(const FilterGraph &graph, const std::vector<std::string> &paths) {
+    std::optional<PictureInfo> picture_info;
+    auto start = std::chrono::steady_clock::now();
+    if (!ReportErrors([this, &graph, &picture_info]() {
+            picture_info = InputOutputProcessing::LoadImageFile(argv_[1], DecodeOptions(graph.SharedPrefix()));
+        })) {
         return;
     }
 
-    PictureInfo picture_info = *picture_info_opt;
-    std::vector<std::unique_ptr<Filter>> filters;
+    profile_.load_ms = MillisecondsSince(start);
 
-    for (size_t ind = 3; ind < argv_.size(); ++ind) {
-        std::string filter = argv_[ind];
-
-        if (filter == "-gs") {
-            filters.push_back(std::make_unique<GrayScaleFilter>());
-        } else if (filter == "-neg") {
-            filters.push_back(std::make_unique<NegativeFilter>());
-        } else if (filter == "-sharp") {
-            filters.push_back(std::make_unique<SharpeningFilter>());
-        } else if (filter == "-edge") {
-            if (ind + 1 >= argv_.size()) {
-                std::cerr << "InputDataError: " << argv_[ind] << ": Missing value for" << argv_[ind] << std::endl;
-            } else {
-                std::string arg = argv_[ind + 1];
-                try {
-                    double threshold = std::stod(arg);
-                    filters.push_back(std::make_unique<EdgeDetectionFilter>(threshold));
-                    ind++;
-                } catch (std::invalid_argument &) {
-                    std::cerr << "InputDataError: " << argv_[ind] << ": Invalid type of argument" << std::endl;
-                    return;
-                }
+    // The graph goes on while an output is written, and copies the image only if it changes it before that.
+    start = std::chrono::steady_clock::now();
+    AsyncWriter writer;
+    auto sink = [this, &paths, &writer](size_t output, SharedPicture picture) {
+        writer.Submit([this, &paths, output, picture = std::move(picture)]() mutable {
+            Save(paths[output], std::move(picture));
+        });
+    };
+    ReportErrors([this, &graph, &picture_info, &sink]() {
+        graph.Run(std::move(*picture_info), sink, WorkingPrecision());
+    });
+    profile_.filters_ms = MillisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    // Save reports the errors of the outputs it can't write, others are rethrown here.
+    ReportErrors([&writer]() { writer.Wait(); });
+    profile_.save_ms = MillisecondsSince(start);
+}
+
+bool ControlParameters::Incremental(const Pipeline &pipeline, const std::string &path) const {
+    if (!options_.contains(IncrementalOption) || pipeline.Halo() == WholeImage || path == StdStreamPath ||
+        argv_[1] == StdStreamPath || WorkingPrecision() != Precision::Channel) {
+        return false;
+    }
+    // These depths may lose colors that the patched tiles have, so the output can't be patched.
+    auto depth = options_.find(DepthOption);
+    return depth == options_.end() || (depth->second != "auto" && depth->second != "1" && depth->second != "8");
+}
+
+TileHashes ControlParameters::ApplyIncrementally(const Pipeline &pipeline, PictureInfo &picture_info,
+                                                 const std::string &path) {
+    std::string recipe = Recipe(path, pipeline.Specs());
+    TileHashes current = TileHashes::Compute(picture_info, Checksums::Hash64(std::as_bytes(std::span(recipe))));
+    std::optional<TileHashes> previous = TileHashes::Load(path + TileHashesSuffix);
+    std::optional<PictureInfo> output;
+    if (previous && current.Comparable(*previous)) {
+        try {
+            output = InputOutputProcessing::LoadImageFile(path);
+        } catch (std::exception &) {
+            // The output is gone or broken, it is made anew.
+        }
+    }
+    profile_.tiles = current.hashes.size();
+    // Formats like PNG are read top-down whatever orientation the input has, the tiles count rows of the input.
+    if (output && output->top_down != current.top_down) {
+        std::reverse(output->pixels.begin(), output->pixels.end());
+        std::reverse(output->deep_pixels.begin(), output->deep_pixels.end());
+        output->top_down = current.top_down;
+    }
+    if (!output || output->bmi_header.biWidth != current.width || output->bmi_header.biHeight != current.height ||
+        output->Deep() != current.deep) {
+        pipeline.Apply(picture_info);
+        profile_.recomputed_tiles = current.hashes.size();
+        return current;
+    }
+
+    std::vector<TileRect> all_tiles = current.Tiles();
+    std::vector<TileRect> tiles;
+    for (size_t index : current.DirtyTiles(*previous, pipeline.Halo())) {
+        tiles.push_back(all_tiles[index]);
+    }
+    pipeline.ApplyToTiles(picture_info, *output, tiles, TileScheduler());
+    profile_.recomputed_tiles = tiles.size();
+    // The headers of the input, so that the output is saved as a full run would save it.
+    picture_info.pixels = std::move(output->pixels);
+    picture_info.deep_pixels = std::move(output->deep_pixels);
+    picture_info.Sync();
+    return current;
+}
+
+void ControlParameters::ControlPipeline(const Pipeline &pipeline, const std::string &path) {
+    std::optional<PictureInfo> picture_info_opt;
+    // A chain of point filters is applied to every tile of a TIFF input by the thread that has read it.
+    const PointFilter *tile_filter = nullptr;
+    bool incremental = Incremental(pipeline, path);
+    std::optional<TileHashes> tile_hashes;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!ReportErrors([this, &pipeline, &path, &picture_info_opt, &tile_filter, incremental]() {
+            if (pipeline.Empty() && !ChangesOutput() && OutputFormat(path) == ImageFormat::Bmp &&
+                InputOutputProcessing::CopyBmpFile(argv_[1], path)) {
+                return;
             }
-        } else if (filter == "-blur") {
-            if (ind + 1 >= argv_.size()) {
-                std::cerr << "InputDataError: " << ": Missing value for" << argv_[ind] << std::endl;
+            JpegDecodeOptions decode_options = DecodeOptions(pipeline.Specs());
+            // The tiles are filtered in their own channels, so a float chain is applied to the whole image instead.
+            if (!incremental && decode_options.scale == 1 && pipeline.PointStage() != nullptr &&
+                WorkingPrecision() == Precision::Channel && TiffCodec::IsTiffFile(argv_[1])) {
+                tile_filter = pipeline.PointStage();
+                picture_info_opt = TiffCodec::LoadFile(argv_[1], TileScheduler(), tile_filter);
             } else {
-                std::string arg = argv_[ind + 1];
-                try {
-                    double sigma = std::stod(arg);
-                    filters.push_back(std::make_unique<GaussianBlurFilter>(sigma));
-                    ind++;
-                } catch (std::invalid_argument &) {
-                    std::cerr << "InputDataError: " << argv_[ind] << ": Invalid type of argument" << std::endl;
-                    return;
-                }
+                picture_info_opt = InputOutputProcessing::LoadImageFile(argv_[1], decode_options);
             }
-        } else if (filter == "-crop") {
-            if (ind + 1 >= argv_.size()) {
-                std::cerr << "InputDataError: " << ": Missing value for" << argv_[ind] << std::endl;
+        })) {
+        return;
+    }
+    if (!picture_info_opt) {
+        // The file is copied as it is, without decoding.
+        RemoveTileHashes(path);
+        profile_.save_ms = MillisecondsSince(start);
+        StoreCached(path);
+        return;
+    }
+    profile_.load_ms = MillisecondsSince(start);
+
+    PictureInfo picture_info = std::move(*picture_info_opt);
+
+    start = std::chrono::steady_clock::now();
+    if (!ReportErrors([this, &pipeline, &path, &picture_info, &tile_hashes, tile_filter, incremental]() {
+            if (tile_filter != nullptr) {
+                picture_info.Sync();
+            } else if (incremental) {
+                tile_hashes = ApplyIncrementally(pipeline, picture_info, path);
+            } else if (WorkingPrecision() == Precision::Channel) {
+                pipeline.ApplyInTiles(picture_info, TileScheduler());
             } else {
-                std::string arg1 = argv_[ind + 1];
-                std::string arg2 = argv_[ind + 2];
-                try {
-                    LONG x_crop = std::stoi(arg1);
-                    LONG y_crop = std::stoi(arg2);
-                    filters.push_back(std::make_unique<CropFilter>(x_crop, y_crop));
-                    ind += 2;
-                } catch (std::invalid_argument &) {
-                    std::cerr << "InputDataError: " << argv_[ind] << ": Invalid type of argument" << std::endl;
-                    return;
-                }
+                pipeline.Apply(picture_info, WorkingPrecision());
             }
-        } else if (filter == "-pix") {
-            if (ind + 1 >= argv_.size()) {
-                std::cerr << "InputDataError: " << ": Missing value for" << argv_[ind] << std::endl;
-            } else {
-                std::string arg = argv_[ind + 1];
-                try {
-                    int block = std::stoi(arg);
-                    filters.push_back(std::make_unique<PixelizeFilter>(block));
-                    ind++;
-                } catch (std::invalid_argument &) {
-                    std::cerr << "InputDataError: " << argv_[ind] << ": Invalid type of argument" << std::endl;
-                    return;
-                }
+        })) {
+        return;
+    }
+    profile_.filters_ms = MillisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    if (Save(path, SharedPicture(std::move(picture_info))) && tile_hashes) {
+        tile_hashes->Save(path + TileHashesSuffix);
+    }
+    profile_.save_ms = MillisecondsSince(start);
+}
+
+void ControlParameters::Control() {
+    if (argv_.size() >= 2 && argv_[1] == InfoOption) {
+        Inspect();
+        return;
+    }
+    if (argv_.size() < 3) {
+        std::cerr << "InputDataError: Too few arguments" << std::endl;
+        return;
+    }
+
+    std::optional<Pipeline> pipeline;
+    std::optional<FilterGraph> graph;
+    std::vector<std::string> paths;
+
+    try {
+        ExtractOptions();
+        if (argv_.size() < 3) {
+            throw InputDataException("Too few arguments");
+        }
+        auto outputs = FetchCached(SplitOutputs());
+        if (outputs.size() == 1) {
+            pipeline = Pipeline::Compile(outputs.front().second);
+            paths.push_back(outputs.front().first);
+        } else if (outputs.size() > 1) {
+            graph.emplace();
+            for (const auto &[path, args] : outputs) {
+                graph->AddOutput(args);
+                paths.push_back(path);
             }
-        } else {
-            std::cerr << "Error: " << argv_[ind] << ": Unknown filter" << std::endl;
-            return;
         }
+    } catch (InputDataException &e) {
+        std::cerr << "InputDataError: " << e.what() << std::endl;
+        return;
+    } catch (FilterException &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return;
     }
 
-    for (const auto &filter : filters) {
-        try {
-            filter->Apply(picture_info);
-        } catch (InputDataException &e) {
-            std::cerr << "InputDataError: " << e.what() << std::endl;
-            return;
+    if (graph) {
+        ControlGraph(*graph, paths);
+    } else if (pipeline) {
+        ControlPipeline(*pipeline, paths.front());
+    }
+    if (options_.contains(ProfileOption)) {
+        if (cache_) {
+            profile_.cache_hits = cache_->Hits();
+            profile_.cache_misses = cache_->Misses();
+            profile_.cache_evictions = cache_->Evictions();
         }
+        std::cerr << profile_.ToJson() << std::endl;
     }
-    picture_info.Sync();
-    InputOutputProcessing::SaveBmpFile(argv_[2], picture_info);
 }
@@ -1,64 +1,866 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
 #include <vector>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "Exceptions.h"
+#include "input_control/FileDescriptor.h"
 #include "input_control/Input_OutputProcessing.h"
+#include "input_control/JpegCodec.h"
+#include "input_control/PngCodec.h"
+#include "input_control/PnmCodec.h"
+#include "input_control/PyramidCodec.h"
+#include "input_control/QoiCodec.h"
+#include "input_control/RleCodec.h"
+#include "input_control/TiffCodec.h"
+
+namespace {
+constexpr WORD MonochromeBits = 1;
+constexpr WORD PaletteBits4 = 4;
+constexpr WORD GrayBits = 8;
+constexpr WORD TrueColorBits = 24;
+constexpr DWORD BiBitfields = 3;
+constexpr DWORD BgraMasks[] = {0x00ff0000, 0x0000ff00, 0x000000ff};
+constexpr DWORD AlphaMask = 0xff000000;
+constexpr DWORD LcsSrgb = 0x73524742;
+constexpr size_t PaletteEntrySize = 4;
+constexpr DWORD V4Bisize = 108;
+constexpr DWORD V5Bisize = 124;
+constexpr size_t MaxPaletteColors = 256;
+// The largest gap between the standard headers and the pixel data that a supported file needs: the rest of
+// a V5 header, the colour masks and a full palette.
+constexpr size_t MaxHeaderGap = (V5Bisize - DefaultBisize) + 4 * sizeof(DWORD) + MaxPaletteColors * PaletteEntrySize;
+constexpr size_t CopyChunkSize = 1 << 16;
+constexpr int BitsInByte = 8;
+
+struct FormatName {
+    const char *name;
+    ImageFormat format;
+};
+
+constexpr FormatName FormatNames[] = {
+    {"bmp", ImageFormat::Bmp}, {"qoi", ImageFormat::Qoi}, {"pgm", ImageFormat::Pgm},
+    {"ppm", ImageFormat::Ppm}, {"pnm", ImageFormat::Ppm}, {"pam", ImageFormat::Pam}, {"png", ImageFormat::Png},
+    {"tif", ImageFormat::Tiff}, {"tiff", ImageFormat::Tiff}, {"pyr", ImageFormat::Pyramid},
+};
+
+bool IsRle(DWORD compression) {
+    return compression == BiRle8 || compression == BiRle4;
+}
+
+bool IsPaletteBitCount(WORD bit_count) {
+    return bit_count == MonochromeBits || bit_count == PaletteBits4 || bit_count == GrayBits;
+}
+
+// How pixels of one row are stored in the file: directly as BGR(A) or as indices into a palette.
+struct PixelFormat {
+    WORD bit_count = TrueColorBits;
+    std::vector<Pixel> palette;
+    // Whether the fourth byte of 32-bit pixels is alpha, otherwise it is reserved and the pixels are opaque.
+    bool alpha = false;
+
+    void Unpack(const std::byte *row, std::vector<Pixel> &pixels) const {
+        if (bit_count == TrueColorAlphaBits) {
+            std::memcpy(pixels.data(), row, pixels.size() * sizeof(Pixel));
+            if (!alpha) {
+                for (Pixel &pixel : pixels) {
+                    pixel.alpha = MaxAlpha;
+                }
+            }
+        } else if (bit_count == TrueColorBits) {
+            for (size_t x = 0; x < pixels.size(); ++x) {
+                pixels[x].blue = static_cast<BYTE>(row[x * 3]);
+                pixels[x].green = static_cast<BYTE>(row[x * 3 + 1]);
+                pixels[x].red = static_cast<BYTE>(row[x * 3 + 2]);
+                pixels[x].alpha = MaxAlpha;
+            }
+        } else {
+            int pixels_per_byte = BitsInByte / bit_count;
+            BYTE mask = static_cast<BYTE>((1 << bit_count) - 1);
+            for (size_t x = 0; x < pixels.size(); ++x) {
+                int shift = BitsInByte - bit_count * (1 + static_cast<int>(x % pixels_per_byte));
+                pixels[x] = palette[(static_cast<BYTE>(row[x / pixels_per_byte]) >> shift) & mask];
+            }
+        }
+    }
+
+    // 48-bit and 64-bit rows: little-endian 16-bit channels in BGR(A) order.
+    void Unpack(const std::byte *row, std::vector<Pixel16> &pixels) const {
+        if (bit_count == DeepColorAlphaBits) {
+            std::memcpy(pixels.data(), row, pixels.size() * sizeof(Pixel16));
+            return;
+        }
+        for (size_t x = 0; x < pixels.size(); ++x) {
+            WORD channels[3];
+            std::memcpy(channels, row + x * sizeof(channels), sizeof(channels));
+            pixels[x] = Pixel16{channels[0], channels[1], channels[2]};
+        }
+    }
+
+    // Palette formats written by this program are gray ramps, so the index is the scaled red channel.
+    BYTE Index(const Pixel &pixel) const {
+        return static_cast<BYTE>(pixel.red * (palette.size() - 1) / MaxColor);
+    }
+
+    void Indices(const std::vector<Pixel> &pixels, std::vector<BYTE> &indices) const {
+        indices.resize(pixels.size());
+        for (size_t x = 0; x < pixels.size(); ++x) {
+            indices[x] = Index(pixels[x]);
+        }
+    }
+
+    void Pack(const std::vector<Pixel> &pixels, std::byte *row) const {
+        if (bit_count == TrueColorAlphaBits) {
+            std::memcpy(row, pixels.data(), pixels.size() * sizeof(Pixel));
+        } else if (bit_count == TrueColorBits) {
+            for (size_t x = 0; x < pixels.size(); ++x) {
+                row[x * 3] = static_cast<std::byte>(pixels[x].blue);
+                row[x * 3 + 1] = static_cast<std::byte>(pixels[x].green);
+                row[x * 3 + 2] = static_cast<std::byte>(pixels[x].red);
+            }
+        } else if (bit_count == GrayBits) {
+            for (size_t x = 0; x < pixels.size(); ++x) {
+                row[x] = static_cast<std::byte>(pixels[x].red);
+            }
+        } else {
+            int pixels_per_byte = BitsInByte / bit_count;
+            std::fill(row, row + (pixels.size() + pixels_per_byte - 1) / pixels_per_byte, std::byte{0});
+            for (size_t x = 0; x < pixels.size(); ++x) {
+                int shift = BitsInByte - bit_count * (1 + static_cast<int>(x % pixels_per_byte));
+                row[x / pixels_per_byte] |= static_cast<std::byte>(Index(pixels[x]) << shift);
+            }
+        }
+    }
+
+    void Pack(const std::vector<Pixel16> &pixels, std::byte *row) const {
+        if (bit_count == DeepColorAlphaBits) {
+            std::memcpy(row, pixels.data(), pixels.size() * sizeof(Pixel16));
+            return;
+        }
+        for (size_t x = 0; x < pixels.size(); ++x) {
+            WORD channels[3] = {pixels[x].blue, pixels[x].green, pixels[x].red};
+            std::memcpy(row + x * sizeof(channels), channels, sizeof(channels));
+        }
+    }
+};
+
+void ValidateHeaders(const BmpFileHeader &header, const BmpInfoHeader &info_header) {
+    if (header.bfType != BM) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    // The height of a top-down file is negated, so the smallest LONG has no positive height.
+    if (info_header.biHeight == 0 || info_header.biHeight == std::numeric_limits<LONG>::min() ||
+        info_header.biWidth <= 0) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    // RLE data is decoded into rows allocated up front, so a small file could otherwise ask for gigabytes.
+    if (static_cast<uint64_t>(info_header.biWidth) * std::abs(info_header.biHeight) > MaxPixels) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    if (info_header.biBitCount != TrueColorBits && info_header.biBitCount != TrueColorAlphaBits &&
+        !IsPaletteBitCount(info_header.biBitCount) && !IsDeepBitCount(info_header.biBitCount)) {
+        throw InfoHeaderException("Only 1, 4, 8, 24, 32, 48 and 64-bit images are supported");
+    }
+    if (info_header.biCompression != BiRgb &&
+        !(info_header.biCompression == BiBitfields && info_header.biBitCount == TrueColorAlphaBits) &&
+        !(info_header.biCompression == BiRle8 && info_header.biBitCount == GrayBits) &&
+        !(info_header.biCompression == BiRle4 && info_header.biBitCount == PaletteBits4)) {
+        throw InfoHeaderException("Unsupported compression");
+    }
+    if (IsRle(info_header.biCompression) && info_header.biHeight < 0) {
+        throw InfoHeaderException("Compressed images can't be top-down");
+    }
+    if (info_header.biSize < DefaultBisize || header.bfOffBits < BmpHeadersSize) {
+        throw FileHeaderException("Incorrect pixel data offset");
+    }
+}
+
+// extra holds the bytes between the standard headers and the pixel data. With BI_BITFIELDS
+// it starts with the red, green and blue masks, both after a 40-byte header and inside V4/V5 headers,
+// which have the alpha mask after them; after a 40-byte header an alpha mask may follow as a fourth one.
+// A palette follows the full info header.
+PixelFormat ReadPixelFormat(const BmpInfoHeader &info_header, std::span<const std::byte> extra) {
+    PixelFormat format{info_header.biBitCount, {}};
+
+    if (info_header.biCompression == BiBitfields) {
+        DWORD masks[3];
+        if (extra.size() < sizeof(masks)) {
+            throw InfoHeaderException("Missing color masks");
+        }
+        std::memcpy(masks, extra.data(), sizeof(masks));
+        if (!std::equal(std::begin(masks), std::end(masks), std::begin(BgraMasks))) {
+            throw InfoHeaderException("Only BGRA color masks are supported");
+        }
+    }
+    if (info_header.biBitCount == TrueColorAlphaBits && extra.size() >= sizeof(BgraMasks) + sizeof(DWORD)) {
+        // The fourth byte of 32-bit pixels is reserved and usually 0, in BI_RGB files as well as in XRGB ones
+        // with only three masks, so it is alpha only with an alpha mask.
+        DWORD alpha_mask = 0;
+        std::memcpy(&alpha_mask, extra.data() + sizeof(BgraMasks), sizeof(alpha_mask));
+        if (info_header.biSize >= V4Bisize) {
+            if (alpha_mask != 0 && alpha_mask != AlphaMask) {
+                throw InfoHeaderException("Only BGRA color masks are supported");
+            }
+            format.alpha = alpha_mask != 0;
+        } else if (info_header.biCompression == BiBitfields) {
+            // Whatever follows the three masks may be a gap before the pixel data rather than a mask.
+            format.alpha = alpha_mask == AlphaMask;
+        }
+    }
+    if (IsPaletteBitCount(info_header.biBitCount)) {
+        size_t max_colors = size_t{1} << info_header.biBitCount;
+        size_t colors = info_header.biClrUsed == 0 ? max_colors : info_header.biClrUsed;
+        size_t palette_offset = info_header.biSize - DefaultBisize;
+        if (colors > max_colors || palette_offset + colors * PaletteEntrySize > extra.size()) {
+            throw InfoHeaderException("Incorrect palette");
+        }
+        // Indices past the end of a short palette decode as black instead of reading out of bounds.
+        format.palette.assign(max_colors, Pixel{0, 0, 0});
+        for (size_t color = 0; color < colors; ++color) {
+            const std::byte *entry = extra.data() + palette_offset + color * PaletteEntrySize;
+            format.palette[color] = Pixel{static_cast<BYTE>(entry[0]), static_cast<BYTE>(entry[1]),
+                                          static_cast<BYTE>(entry[2])};
+        }
+    }
+    return format;
+}
+
+// Gray ramps for 8-bit and 4-bit output, black and white for 1-bit output.
+PixelFormat WritePixelFormat(WORD bit_count) {
+    PixelFormat format{bit_count, {}};
+    if (IsPaletteBitCount(bit_count)) {
+        size_t colors = size_t{1} << bit_count;
+        for (size_t color = 0; color < colors; ++color) {
+            BYTE value = static_cast<BYTE>(color * MaxColor / (colors - 1));
+            format.palette.push_back(Pixel{value, value, value});
+        }
+    }
+    return format;
+}
+
+// Whether every pixel is a gray that the gray ramp palette of the given bit count contains.
+bool IsGray(const PictureInfo &picture_info, WORD bit_count) {
+    int step = MaxColor / ((1 << bit_count) - 1);
+    for (const std::vector<Pixel> &row : picture_info.pixels) {
+        for (const Pixel &pixel : row) {
+            if (pixel.red != pixel.green || pixel.red != pixel.blue || pixel.red % step != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The bit count from the image header if the image fits into it without losses, a wider one otherwise.
+WORD OutputBitCount(const PictureInfo &picture_info) {
+    WORD bit_count = picture_info.bmi_header.biBitCount;
+    if (bit_count == TrueColorAlphaBits || IsDeepBitCount(bit_count)) {
+        return bit_count;
+    }
+    if (bit_count == MonochromeBits && IsGray(picture_info, MonochromeBits)) {
+        return MonochromeBits;
+    }
+    if (bit_count == PaletteBits4 && IsGray(picture_info, PaletteBits4)) {
+        return PaletteBits4;
+    }
+    if (IsPaletteBitCount(bit_count) && IsGray(picture_info, GrayBits)) {
+        return GrayBits;
+    }
+    return TrueColorBits;
+}
+
+// RLE is kept if the image header asks for it and the output bit count allows it.
+DWORD OutputCompression(const PictureInfo &picture_info, WORD bit_count) {
+    DWORD compression = picture_info.bmi_header.biCompression;
+    if ((compression == BiRle8 && bit_count == GrayBits) || (compression == BiRle4 && bit_count == PaletteBits4)) {
+        return compression;
+    }
+    return bit_count == TrueColorAlphaBits ? BiBitfields : BiRgb;
+}
+
+// Rewrites the fields that describe the pixel data layout, keeps resolution and reserved fields.
+// A negative height means a top-down image, compressed_size is the size of the RLE data for compressed images.
+void NormalizeHeaders(BmpFileHeader &header, BmpInfoHeader &info_header, LONG width, LONG height, WORD bit_count,
+                      DWORD compression = BiRgb, DWORD compressed_size = 0) {
+    DWORD image_size = IsRle(compression) ? compressed_size
+                                          : InputOutputProcessing::RowStride(width, bit_count) * std::abs(height);
+    DWORD colors = IsPaletteBitCount(bit_count) ? DWORD{1} << bit_count : 0;
+    // Alpha is written with a V4 header, whose masks follow the 40 bytes of BmpInfoHeader.
+    DWORD header_tail = compression == BiBitfields ? V4Bisize - DefaultBisize : 0;
+
+    header.bfType = BM;
+    header.bfOffBits = BmpHeadersSize + header_tail + colors * PaletteEntrySize;
+    header.bfSize = header.bfOffBits + image_size;
+    info_header.biSize = DefaultBisize + header_tail;
+    info_header.biWidth = width;
+    info_header.biHeight = height;
+    info_header.biPlanes = 1;
+    info_header.biBitCount = bit_count;
+    info_header.biCompression = compression;
+    info_header.biSizeImage = image_size;
+    info_header.biClrUsed = colors;
+    info_header.biClrImportant = 0;
+}
+
+std::vector<std::byte> EncodePalette(const PixelFormat &format) {
+    std::vector<std::byte> palette(format.palette.size() * PaletteEntrySize, std::byte{0});
+    for (size_t color = 0; color < format.palette.size(); ++color) {
+        palette[color * PaletteEntrySize] = static_cast<std::byte>(format.palette[color].blue);
+        palette[color * PaletteEntrySize + 1] = static_cast<std::byte>(format.palette[color].green);
+        palette[color * PaletteEntrySize + 2] = static_cast<std::byte>(format.palette[color].red);
+    }
+    return palette;
+}
+
+// The part of a V4 header after BmpInfoHeader: the BGRA masks and the sRGB colour space.
+std::vector<std::byte> EncodeV4HeaderTail() {
+    std::vector<std::byte> tail(V4Bisize - DefaultBisize, std::byte{0});
+    const DWORD fields[] = {BgraMasks[0], BgraMasks[1], BgraMasks[2], AlphaMask, LcsSrgb};
+    std::memcpy(tail.data(), fields, sizeof(fields));
+    return tail;
+}
+
+// Everything the writer has to know before the first byte is written; RLE data is encoded
+// up front because its size goes into the headers. color_table is what goes between BmpInfoHeader and
+// the pixel data: a palette or the rest of a V4 header.
+struct OutputLayout {
+    BmpFileHeader header;
+    BmpInfoHeader info_header;
+    PixelFormat format;
+    std::vector<std::byte> color_table;
+    std::vector<std::byte> compressed;
+};
+
+// The writers take rows of the width the output bit count needs; an image that has the other one is converted.
+std::optional<PictureInfo> MatchOutputDepth(const PictureInfo &picture_info) {
+    bool deep = IsDeepBitCount(picture_info.bmi_header.biBitCount);
+    if (deep == picture_info.Deep()) {
+        return std::nullopt;
+    }
+    PictureInfo converted = picture_info;
+    converted.SetDeep(deep);
+    return converted;
+}
+
+OutputLayout PrepareOutput(const PictureInfo &picture_info) {
+    OutputLayout layout{picture_info.bmf_header, picture_info.bmi_header, {}, {}, {}};
+    WORD bit_count = OutputBitCount(picture_info);
+    DWORD compression = OutputCompression(picture_info, bit_count);
+    layout.format = WritePixelFormat(bit_count);
+    layout.color_table = compression == BiBitfields ? EncodeV4HeaderTail() : EncodePalette(layout.format);
+
+    LONG width = picture_info.bmi_header.biWidth;
+    LONG height = picture_info.bmi_header.biHeight;
+    if (!picture_info.Deep()) {
+        width = static_cast<LONG>(picture_info.pixels.empty() ? 0 : picture_info.pixels[0].size());
+        height = static_cast<LONG>(picture_info.pixels.size());
+    }
+
+    if (IsRle(compression)) {
+        // RLE data is always bottom-up, so a top-down image is encoded starting from its last row.
+        std::vector<BYTE> indices;
+        for (LONG y = 0; y < height; ++y) {
+            layout.format.Indices(picture_info.pixels[picture_info.top_down ? height - 1 - y : y], indices);
+            RleCodec::EncodeRow(indices, bit_count, layout.compressed);
+        }
+        RleCodec::EncodeEnd(layout.compressed);
+    } else if (picture_info.top_down) {
+        height = -height;
+    }
+    NormalizeHeaders(layout.header, layout.info_header, width, height, bit_count, compression,
+                     static_cast<DWORD>(layout.compressed.size()));
+    return layout;
+}
+
+// Copies count bytes between descriptors inside the kernel when it can, with plain read/write as a fallback.
+void CopyFileRange(int input_fd, off_t input_offset, int output_fd, size_t count) {
+    off_t output_offset = lseek(output_fd, 0, SEEK_CUR);
+    while (count > 0) {
+        ssize_t copied = copy_file_range(input_fd, &input_offset, output_fd, &output_offset, count, 0);
+        if (copied <= 0) {
+            break;
+        }
+        count -= copied;
+    }
+    lseek(output_fd, output_offset, SEEK_SET);
+    while (count > 0) {
+        ssize_t copied = sendfile(output_fd, input_fd, &input_offset, count);
+        if (copied <= 0) {
+            break;
+        }
+        count -= copied;
+    }
+    std::vector<char> buffer(CopyChunkSize);
+    while (count > 0) {
+        ssize_t copied = pread(input_fd, buffer.data(), std::min(count, buffer.size()), input_offset);
+        if (copied <= 0 || write(output_fd, buffer.data(), copied) != copied) {
+            throw InputDataException("Unexpected end of file");
+        }
+        input_offset += copied;
+        count -= copied;
+    }
+}
+
+}  // namespace
+
+WORD InputOutputProcessing::ChooseBitCount(const PictureInfo &picture_info) {
+    if (picture_info.Deep()) {
+        for (const std::vector<Pixel16> &row : picture_info.deep_pixels) {
+            for (const Pixel16 &pixel : row) {
+                if (pixel.alpha != ChannelTraits<WORD>::Max) {
+                    return DeepColorAlphaBits;
+                }
+            }
+        }
+        return DeepColorBits;
+    }
+    if (picture_info.bmi_header.biBitCount == TrueColorAlphaBits) {
+        for (const std::vector<Pixel> &row : picture_info.pixels) {
+            for (const Pixel &pixel : row) {
+                if (pixel.alpha != MaxAlpha) {
+                    return TrueColorAlphaBits;
+                }
+            }
+        }
+    }
+    if (IsGray(picture_info, MonochromeBits)) {
+        return MonochromeBits;
+    }
+    return IsGray(picture_info, GrayBits) ? GrayBits : TrueColorBits;
+}
+
+size_t InputOutputProcessing::RowStride(LONG width, WORD bit_count) {
+    return (static_cast<size_t>(width) * bit_count + 31) / 32 * 4;
+}
+
+PictureInfo InputOutputProcessing::LoadImageFile(const std::string &file_path, const JpegDecodeOptions &jpeg_options) {
+    if (file_path == StdStreamPath) {
+        return LoadImageStream(std::cin, jpeg_options);
+    }
+    std::ifstream infile(file_path, std::ios::binary);
+    if (!infile.is_open()) {
+        throw InputDataException("Wrong file path");
+    }
+    std::istream::int_type first = infile.peek();
+    if (first == PyramidCodec::MagicStart) {
+        // Only the tiles of the level and region asked for are read from the mapped file.
+        return PyramidCodec::LoadFile(file_path, jpeg_options);
+    }
+    if ((first == TiffCodec::MagicLittle || first == TiffCodec::MagicBig) && jpeg_options.scale == 1) {
+        // Tiles are read by several threads straight from the file instead of through the stream.
+        return TiffCodec::LoadFile(file_path);
+    }
+    return LoadImageStream(infile, jpeg_options);
+}
+
+PictureInfo InputOutputProcessing::LoadImageStream(std::istream &input, const JpegDecodeOptions &jpeg_options) {
+    std::istream::int_type first = input.peek();
+    if (first == JpegCodec::MagicStart) {
+        return JpegCodec::Load(input, jpeg_options);
+    }
+    if (first == PyramidCodec::MagicStart) {
+        return PyramidCodec::Load(input, jpeg_options);
+    }
+    if (jpeg_options.scale != 1) {
+        throw InputDataException("Only JPEG and pyramid images can be scaled while decoding");
+    }
+    if (first == QoiCodec::MagicStart) {
+        return QoiCodec::Load(input);
+    }
+    if (first == PnmCodec::MagicStart) {
+        return PnmCodec::Load(input);
+    }
+    if (first == PngCodec::MagicStart) {
+        return PngCodec::Load(input);
+    }
+    if (first == TiffCodec::MagicLittle || first == TiffCodec::MagicBig) {
+        return TiffCodec::Load(input);
+    }
+    return LoadBmpStream(input);
+}
+
+void InputOutputProcessing::SaveImageFile(const std::string &file_path, const PictureInfo &picture_info,
+                                          ImageFormat format, int level, LONG tile_size) {
+    if (file_path == StdStreamPath) {
+        SaveImageStream(std::cout, picture_info, format, level, tile_size);
+        std::cout.flush();
+        return;
+    }
+    std::ofstream outfile(file_path, std::ios::binary);
+    if (!outfile.is_open()) {
+        throw InputDataException("Wrong file path");
+    }
+    SaveImageStream(outfile, picture_info, format, level, tile_size);
+}
+
+void InputOutputProcessing::SaveImageStream(std::ostream &output, const PictureInfo &picture_info,
+                                            ImageFormat format, int level, LONG tile_size) {
+    // 16-bit output needs a 48-bit or 64-bit image and a format that stores it, the rows are converted to match.
+    bool deep = IsDeepBitCount(picture_info.bmi_header.biBitCount) &&
+                (format == ImageFormat::Bmp || format == ImageFormat::Pgm || format == ImageFormat::Ppm ||
+                 format == ImageFormat::Pam);
+    if (deep != picture_info.Deep()) {
+        PictureInfo converted = picture_info;
+        converted.SetDeep(deep);
+        SaveImageStream(output, converted, format, level, tile_size);
+        return;
+    }
+    switch (format) {
+        case ImageFormat::Qoi:
+            QoiCodec::Save(output, picture_info);
+            break;
+        case ImageFormat::Pgm:
+            PnmCodec::Save(output, picture_info, PnmKind::Graymap);
+            break;
+        case ImageFormat::Ppm:
+            PnmCodec::Save(output, picture_info, PnmKind::Pixmap);
+            break;
+        case ImageFormat::Pam:
+            PnmCodec::Save(output, picture_info, PnmKind::ArbitraryMap);
+            break;
+        case ImageFormat::Png:
+            PngCodec::Save(output, picture_info, level);
+            break;
+        case ImageFormat::Tiff:
+            TiffCodec::Save(output, picture_info, tile_size);
+            break;
+        case ImageFormat::Pyramid:
+            PyramidCodec::Save(output, picture_info, tile_size);
+            break;
+        default:
+            SaveBmpStream(output, picture_info);
+    }
+}
+
+ImageFormat InputOutputProcessing::FormatFromPath(const std::string &file_path) {
+    std::string extension = std::filesystem::path(file_path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char symbol) { return std::tolower(symbol); });
+    if (extension.empty()) {
+        return ImageFormat::Bmp;
+    }
+    return FormatFromName(extension.substr(1)).value_or(ImageFormat::Bmp);
+}
+
+std::optional<ImageFormat> InputOutputProcessing::FormatFromName(const std::string &name) {
+    for (const FormatName &candidate : FormatNames) {
+        if (name == candidate.name) {
+            return candidate.format;
+        }
+    }
+    return std::nullopt;
+}
+
+PictureInfo InputOutputProcessing::CreatePicture(LONG width, LONG height, WORD bit_count, bool top_down) {
+    BmpFileHeader header{};
+    BmpInfoHeader info_header{};
+    NormalizeHeaders(header, info_header, width, top_down ? -height : height, bit_count);
+    std::vector<std::vector<Pixel>> no_pixels;
+    PictureInfo picture_info(header, info_header, no_pixels);
+    if (IsDeepBitCount(bit_count)) {
+        picture_info.deep_pixels.assign(height, std::vector<Pixel16>(width));
+    } else {
+        picture_info.pixels.assign(height, std::vector<Pixel>(width));
+    }
+    return picture_info;
+}
 
 PictureInfo InputOutputProcessing::LoadBmpFile(const std::string &file_path) {
+    if (file_path == StdStreamPath) {
+        return LoadBmpStream(std::cin);
+    }
     std::ifstream infile(file_path, std::ios::binary);
     if (!infile.is_open()) {
         throw InputDataException("Wrong file path");
     }
+    return LoadBmpStream(infile);
+}
+
+PictureInfo InputOutputProcessing::LoadBmpStream(std::istream &input) {
     BmpFileHeader header{};
     BmpInfoHeader info_header{};
 
-    infile.read(reinterpret_cast<char *>(&header), sizeof(BmpFileHeader));
-    if (header.bfType != BM) {
+    if (!input.read(reinterpret_cast<char *>(&header), sizeof(BmpFileHeader)) || header.bfType != BM) {
         throw FileHeaderException("Incorrect file format");
     }
-
-    infile.read(reinterpret_cast<char *>(&info_header), sizeof(BmpInfoHeader));
-    if (info_header.biHeight == 0 || info_header.biWidth == 0) {
+    if (!input.read(reinterpret_cast<char *>(&info_header), sizeof(BmpInfoHeader))) {
         throw FileHeaderException("Incorrect file size");
     }
+    ValidateHeaders(header, info_header);
+    if (header.bfOffBits - BmpHeadersSize > MaxHeaderGap) {
+        throw FileHeaderException("Incorrect pixel data offset");
+    }
+    // Larger info headers and colour masks are read and dropped, not seeked over.
+    std::vector<std::byte> extra(header.bfOffBits - BmpHeadersSize);
+    if (!input.read(reinterpret_cast<char *>(extra.data()), static_cast<std::streamsize>(extra.size()))) {
+        throw InputDataException("Unexpected end of file");
+    }
+    PixelFormat format = ReadPixelFormat(info_header, extra);
 
-    int padding = (4 - (info_header.biWidth) % 4) % 4;
-
-    std::vector<std::vector<Pixel>> pixels(info_header.biHeight, std::vector<Pixel>(info_header.biWidth));
-
-    for (int y = 0; y < info_header.biHeight; ++y) {
-        for (int x = 0; x < info_header.biWidth; ++x) {
-            Pixel pixel;
-            if (!infile.read(reinterpret_cast<char *>(&pixel), sizeof(Pixel))) {
-                throw std::runtime_error("Unexpected end of file");
+    size_t row_stride = RowStride(info_header.biWidth, info_header.biBitCount);
+    std::vector<std::byte> row(row_stride);
+    LONG height = std::abs(info_header.biHeight);
+    if (IsDeepBitCount(info_header.biBitCount)) {
+        std::vector<std::vector<Pixel>> no_pixels;
+        PictureInfo picture_info(header, info_header, no_pixels);
+        picture_info.deep_pixels.assign(height, std::vector<Pixel16>(info_header.biWidth));
+        for (std::vector<Pixel16> &pixels_row : picture_info.deep_pixels) {
+            if (!input.read(reinterpret_cast<char *>(row.data()), static_cast<std::streamsize>(row_stride))) {
+                throw InputDataException("Unexpected end of file");
             }
-            pixels[y][x] = pixel;
+            format.Unpack(row.data(), pixels_row);
         }
-        infile.seekg(padding, std::ios::cur);
+        return picture_info;
     }
+    std::vector<std::vector<Pixel>> pixels(height, std::vector<Pixel>(info_header.biWidth));
 
-    PictureInfo picture_info(header, info_header, pixels);
-    infile.close();
+    if (IsRle(info_header.biCompression)) {
+        RleCodec::Decode(input, info_header.biBitCount, format.palette, pixels);
+        return PictureInfo(header, info_header, pixels);
+    }
+    // Rows are stored in file order for both orientations, see PictureInfo.
+    for (LONG y = 0; y < height; ++y) {
+        if (!input.read(reinterpret_cast<char *>(row.data()), static_cast<std::streamsize>(row_stride))) {
+            throw InputDataException("Unexpected end of file");
+        }
+        format.Unpack(row.data(), pixels[y]);
+    }
 
-    return picture_info;
+    return PictureInfo(header, info_header, pixels);
 }
 
-void InputOutputProcessing::SaveBmpFile(const std::string &file_path, PictureInfo &picture_info) {
+void InputOutputProcessing::SaveBmpFile(const std::string &file_path, const PictureInfo &picture_info) {
+    if (file_path == StdStreamPath) {
+        SaveBmpStream(std::cout, picture_info);
+        std::cout.flush();
+        return;
+    }
     std::ofstream outfile(file_path, std::ios::binary);
+    if (!outfile.is_open()) {
+        throw InputDataException("Wrong file path");
+    }
+    SaveBmpStream(outfile, picture_info);
+}
 
-    int padding = (-(picture_info.bmi_header.biWidth * 3)) % 4;
-    if (padding < 0) {
-        padding += 4;
+void InputOutputProcessing::SaveBmpStream(std::ostream &output, const PictureInfo &picture_info) {
+    if (std::optional<PictureInfo> converted = MatchOutputDepth(picture_info)) {
+        SaveBmpStream(output, *converted);
+        return;
     }
-    outfile.write(reinterpret_cast<char *>(&picture_info.bmf_header), sizeof(BmpFileHeader));
-    outfile.write(reinterpret_cast<char *>(&picture_info.bmi_header), sizeof(BmpInfoHeader));
+    OutputLayout layout = PrepareOutput(picture_info);
 
-    for (std::vector<Pixel> &row : picture_info.pixels) {
-        for (Pixel &pixel : row) {
-            outfile.write(reinterpret_cast<char *>(&pixel), sizeof(Pixel));
+    output.write(reinterpret_cast<const char *>(&layout.header), sizeof(BmpFileHeader));
+    output.write(reinterpret_cast<const char *>(&layout.info_header), sizeof(BmpInfoHeader));
+    output.write(reinterpret_cast<const char *>(layout.color_table.data()),
+                 static_cast<std::streamsize>(layout.color_table.size()));
+    std::vector<std::byte> row(RowStride(layout.info_header.biWidth, layout.info_header.biBitCount), std::byte{0});
+    auto write_rows = [&layout, &row, &output](const auto &rows) {
+        for (const auto &pixels_row : rows) {
+            layout.format.Pack(pixels_row, row.data());
+            output.write(reinterpret_cast<const char *>(row.data()), static_cast<std::streamsize>(row.size()));
         }
-        for (int i = 0; i < padding; ++i) {
-            outfile.put(0);
+    };
+    if (IsRle(layout.info_header.biCompression)) {
+        output.write(reinterpret_cast<const char *>(layout.compressed.data()),
+                     static_cast<std::streamsize>(layout.compressed.size()));
+    } else if (picture_info.Deep()) {
+        write_rows(picture_info.deep_pixels);
+    } else {
+        write_rows(picture_info.pixels);
+    }
+    // A full disk or a closed pipe shows up only here, the writes above are buffered.
+    if (!output.flush()) {
+        throw InputDataException("Can't write the output");
+    }
+}
+
+bool InputOutputProcessing::CopyBmpFile(const std::string &input_path, const std::string &output_path) {
+    if (input_path == StdStreamPath || output_path == StdStreamPath) {
+        return false;
+    }
+    FileDescriptor input(open(input_path.c_str(), O_RDONLY));
+    if (input.Get() < 0) {
+        throw InputDataException("Wrong file path");
+    }
+
+    BmpFileHeader header{};
+    BmpInfoHeader info_header{};
+    if (pread(input.Get(), &header, sizeof(BmpFileHeader), 0) != sizeof(BmpFileHeader)) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    if (header.bfType != BM) {
+        return false;
+    }
+    if (pread(input.Get(), &info_header, sizeof(BmpInfoHeader), sizeof(BmpFileHeader)) != sizeof(BmpInfoHeader)) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    ValidateHeaders(header, info_header);
+    if (info_header.biCompression != BiRgb || info_header.biBitCount < TrueColorBits) {
+        return false;
+    }
+
+    struct stat input_stat {};
+    struct stat output_stat {};
+    fstat(input.Get(), &input_stat);
+    if (stat(output_path.c_str(), &output_stat) == 0 && output_stat.st_dev == input_stat.st_dev &&
+        output_stat.st_ino == input_stat.st_ino) {
+        return false;
+    }
+    size_t image_size = RowStride(info_header.biWidth, info_header.biBitCount) * std::abs(info_header.biHeight);
+    if (static_cast<size_t>(input_stat.st_size) < header.bfOffBits + image_size) {
+        throw InputDataException("Unexpected end of file");
+    }
+
+    BmpFileHeader normalized_header = header;
+    BmpInfoHeader normalized_info_header = info_header;
+    NormalizeHeaders(normalized_header, normalized_info_header, info_header.biWidth, info_header.biHeight,
+                     info_header.biBitCount);
+    bool canonical = std::memcmp(&normalized_header, &header, sizeof(BmpFileHeader)) == 0 &&
+                     std::memcmp(&normalized_info_header, &info_header, sizeof(BmpInfoHeader)) == 0 &&
+                     static_cast<size_t>(input_stat.st_size) == header.bfSize;
+
+    FileDescriptor output(open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666));
+    if (output.Get() < 0) {
+        throw InputDataException("Wrong file path");
+    }
+    if (canonical) {
+        CopyFileRange(input.Get(), 0, output.Get(), header.bfSize);
+        return true;
+    }
+    if (write(output.Get(), &normalized_header, sizeof(BmpFileHeader)) != sizeof(BmpFileHeader) ||
+        write(output.Get(), &normalized_info_header, sizeof(BmpInfoHeader)) != sizeof(BmpInfoHeader)) {
+        throw InputDataException("Wrong file path");
+    }
+    CopyFileRange(input.Get(), header.bfOffBits, output.Get(), image_size);
+    return true;
+}
+
+void InputOutputProcessing::CopyWholeFile(const std::string &input_path, const std::string &output_path) {
+    FileDescriptor input(open(input_path.c_str(), O_RDONLY));
+    struct stat input_stat {};
+    if (input.Get() < 0 || fstat(input.Get(), &input_stat) != 0) {
+        throw InputDataException("Wrong file path");
+    }
+    FileDescriptor output(open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666));
+    if (output.Get() < 0) {
+        throw InputDataException("Wrong file path");
+    }
+    if (ioctl(output.Get(), FICLONE, input.Get()) == 0) {
+        return;
+    }
+    CopyFileRange(input.Get(), 0, output.Get(), static_cast<size_t>(input_stat.st_size));
+}
+
+size_t InputOutputProcessing::ReadBmpHeaders(const std::string &file_path, BmpFileHeader &header,
+                                             BmpInfoHeader &info_header) {
+    FileDescriptor input(open(file_path.c_str(), O_RDONLY));
+    if (input.Get() < 0) {
+        throw InputDataException("Wrong file path");
+    }
+    std::byte headers[BmpHeadersSize];
+    if (pread(input.Get(), headers, BmpHeadersSize, 0) != BmpHeadersSize) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    std::memcpy(&header, headers, sizeof(BmpFileHeader));
+    std::memcpy(&info_header, headers + sizeof(BmpFileHeader), sizeof(BmpInfoHeader));
+
+    struct stat input_stat {};
+    fstat(input.Get(), &input_stat);
+    return static_cast<size_t>(input_stat.st_size);
+}
+
+BmpView InputOutputProcessing::WrapBmpMemory(std::span<const std::byte> data) {
+    if (data.size() < BmpHeadersSize) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    BmpView view{};
+    std::memcpy(&view.file_header, data.data(), sizeof(BmpFileHeader));
+    std::memcpy(&view.info_header, data.data() + sizeof(BmpFileHeader), sizeof(BmpInfoHeader));
+    ValidateHeaders(view.file_header, view.info_header);
+    if (view.file_header.bfOffBits > data.size()) {
+        throw InputDataException("Unexpected end of data");
+    }
+    view.color_table = data.subspan(BmpHeadersSize, view.file_header.bfOffBits - BmpHeadersSize);
+    ReadPixelFormat(view.info_header, view.color_table);
+
+    if (IsRle(view.info_header.biCompression)) {
+        size_t available = data.size() - view.file_header.bfOffBits;
+        size_t compressed_size = view.info_header.biSizeImage == 0 ? available : view.info_header.biSizeImage;
+        view.pixel_data = data.subspan(view.file_header.bfOffBits, std::min(available, compressed_size));
+        view.row_stride = 0;
+        return view;
+    }
+    view.row_stride = RowStride(view.info_header.biWidth, view.info_header.biBitCount);
+    size_t image_size = view.row_stride * std::abs(view.info_header.biHeight);
+    if (data.size() - view.file_header.bfOffBits < image_size) {
+        throw InputDataException("Unexpected end of data");
+    }
+    view.pixel_data = data.subspan(view.file_header.bfOffBits, image_size);
+    return view;
+}
+
+PictureInfo InputOutputProcessing::LoadBmpFromMemory(std::span<const std::byte> data) {
+    BmpView view = WrapBmpMemory(data);
+    PixelFormat format = ReadPixelFormat(view.info_header, view.color_table);
+
+    LONG height = std::abs(view.info_header.biHeight);
+    if (IsDeepBitCount(view.info_header.biBitCount)) {
+        std::vector<std::vector<Pixel>> no_pixels;
+        PictureInfo picture_info(view.file_header, view.info_header, no_pixels);
+        picture_info.deep_pixels.assign(height, std::vector<Pixel16>(view.info_header.biWidth));
+        for (LONG y = 0; y < height; ++y) {
+            format.Unpack(view.Row(y).data(), picture_info.deep_pixels[y]);
         }
+        return picture_info;
+    }
+    std::vector<std::vector<Pixel>> pixels(height, std::vector<Pixel>(view.info_header.biWidth));
+    if (IsRle(view.info_header.biCompression)) {
+        RleCodec::Decode(view.pixel_data, view.info_header.biBitCount, format.palette, pixels);
+        return PictureInfo(view.file_header, view.info_header, pixels);
+    }
+    for (LONG y = 0; y < height; ++y) {
+        format.Unpack(view.Row(y).data(), pixels[y]);
     }
+    return PictureInfo(view.file_header, view.info_header, pixels);
+}
+
+std::vector<std::byte> InputOutputProcessing::EncodeBmpToBuffer(const PictureInfo &picture_info) {
+    if (std::optional<PictureInfo> converted = MatchOutputDepth(picture_info)) {
+        return EncodeBmpToBuffer(*converted);
+    }
+    OutputLayout layout = PrepareOutput(picture_info);
 
-    outfile.close();
+    std::vector<std::byte> buffer(layout.header.bfSize, std::byte{0});
+    std::memcpy(buffer.data(), &layout.header, sizeof(BmpFileHeader));
+    std::memcpy(buffer.data() + sizeof(BmpFileHeader), &layout.info_header, sizeof(BmpInfoHeader));
+    std::copy(layout.color_table.begin(), layout.color_table.end(), buffer.begin() + BmpHeadersSize);
+    if (IsRle(layout.info_header.biCompression)) {
+        std::copy(layout.compressed.begin(), layout.compressed.end(), buffer.begin() + layout.header.bfOffBits);
+        return buffer;
+    }
+
+    size_t row_stride = RowStride(layout.info_header.biWidth, layout.info_header.biBitCount);
+    std::byte *row = buffer.data() + layout.header.bfOffBits;
+    auto pack_rows = [&layout, &row, row_stride](const auto &rows) {
+        for (const auto &pixels_row : rows) {
+            layout.format.Pack(pixels_row, row);
+            row += row_stride;
+        }
+    };
+    if (picture_info.Deep()) {
+        pack_rows(picture_info.deep_pixels);
+    } else {
+        pack_rows(picture_info.pixels);
+    }
+    return buffer;
 }
@@ -0,0 +1,653 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include "Exceptions.h"
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/JpegCodec.h"
+
+namespace {
+constexpr int BlockSide = 8;
+constexpr int BlockArea = BlockSide * BlockSide;
+constexpr int TableCount = 4;
+constexpr int MaxSampling = 2;
+constexpr int HuffmanFastBits = 9;
+constexpr int MaxCodeLength = 16;
+constexpr int MaxSymbols = 256;
+// Dequantized coefficients of 8-bit images stay well inside this range, clamping keeps broken files
+// from overflowing the integer IDCT.
+constexpr int MaxCoefficient = (1 << 12) - 1;
+constexpr int32_t MaxPrediction = 1 << 16;
+constexpr int IdctBits = 12;
+constexpr int IdctPassBits = 2;
+constexpr int SampleCenter = 128;
+constexpr int ColorBits = 16;
+constexpr WORD GrayBits = 8;
+constexpr WORD TrueColorBits = 24;
+
+constexpr int MarkerStart = 0xff;
+constexpr int MarkerSof0 = 0xc0;
+constexpr int MarkerSof1 = 0xc1;
+constexpr int MarkerSof15 = 0xcf;
+constexpr int MarkerDht = 0xc4;
+constexpr int MarkerJpg = 0xc8;
+constexpr int MarkerDac = 0xcc;
+constexpr int MarkerRst0 = 0xd0;
+constexpr int MarkerRst7 = 0xd7;
+constexpr int MarkerSoi = 0xd8;
+constexpr int MarkerEoi = 0xd9;
+constexpr int MarkerSos = 0xda;
+constexpr int MarkerDqt = 0xdb;
+constexpr int MarkerDri = 0xdd;
+constexpr int MarkerApp14 = 0xee;
+
+// Position in the block of the k-th coefficient in the file.
+constexpr BYTE ZigZag[BlockArea] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+struct HuffmanTable {
+    // Codes of up to HuffmanFastBits bits: length << 8 | symbol for every value of the next bits, 0 for longer codes.
+    std::array<uint16_t, 1 << HuffmanFastBits> fast{};
+    // Longer codes are decoded the canonical way: the largest code of every length and where its symbols start.
+    std::array<int32_t, MaxCodeLength + 1> max_code{};
+    std::array<int32_t, MaxCodeLength + 1> offset{};
+    std::array<BYTE, MaxSymbols> symbols{};
+    bool defined = false;
+};
+
+// IDCT of the first size x size coefficients into size x size samples: cosine[x][u] is
+// C(u) / 2 * cos((2x + 1) * u * pi / (2 * size)) in IdctBits fixed point and transposed[u][x] the same.
+// With fewer than 8 points the low frequencies give the averages of 8 / size pixels, that is the scaled image.
+// Rows are padded to 8 entries so that the inner loops always have 8 lanes and vectorize.
+struct IdctTable {
+    int size;
+    int32_t cosine[BlockSide][BlockSide];
+    int32_t transposed[BlockSide][BlockSide];
+};
+
+std::array<IdctTable, 4> MakeIdctTables() {
+    std::array<IdctTable, 4> tables{};
+    for (int index = 0; index < 4; ++index) {
+        IdctTable &table = tables[index];
+        table.size = BlockSide >> index;
+        for (int x = 0; x < table.size; ++x) {
+            for (int u = 0; u < table.size; ++u) {
+                double scale = u == 0 ? std::numbers::sqrt2 / 4 : 0.5;
+                double value = scale * std::cos((2 * x + 1) * u * std::numbers::pi / (2 * table.size));
+                table.cosine[x][u] = static_cast<int32_t>(std::lround(value * (1 << IdctBits)));
+                table.transposed[u][x] = table.cosine[x][u];
+            }
+        }
+    }
+    return tables;
+}
+
+const IdctTable &IdctTableForScale(int scale) {
+    static const std::array<IdctTable, 4> tables = MakeIdctTables();
+    return tables[std::countr_zero(static_cast<unsigned>(scale))];
+}
+
+int16_t Dequantize(int32_t value, uint16_t quant) {
+    return static_cast<int16_t>(std::clamp<int64_t>(int64_t{value} * quant, -MaxCoefficient, MaxCoefficient));
+}
+
+BYTE ClampSample(int32_t value) {
+    return static_cast<BYTE>(std::clamp(value, 0, static_cast<int32_t>(MaxColor)));
+}
+
+// Integer IDCT of one block, written with stride to output. Blocks without AC coefficients, most of them
+// in smooth areas, are one value.
+void InverseDct(const int16_t *coefficients, bool dc_only, const IdctTable &table, BYTE *output, size_t stride) {
+    constexpr int32_t PassRounding = 1 << (IdctBits - IdctPassBits - 1);
+    constexpr int32_t FinalRounding = 1 << (IdctBits + IdctPassBits - 1);
+    int size = table.size;
+    if (dc_only) {
+        int32_t column = (coefficients[0] * table.cosine[0][0] + PassRounding) >> (IdctBits - IdctPassBits);
+        BYTE value = ClampSample(((column * table.cosine[0][0] + FinalRounding) >> (IdctBits + IdctPassBits)) +
+                                 SampleCenter);
+        for (int y = 0; y < size; ++y) {
+            std::fill(output + y * stride, output + y * stride + size, value);
+        }
+        return;
+    }
+
+    // Columns first: every output row y of all 8 columns at once.
+    int32_t columns[BlockSide][BlockSide];
+    for (int y = 0; y < size; ++y) {
+        int32_t sums[BlockSide] = {};
+        for (int v = 0; v < size; ++v) {
+            int32_t weight = table.cosine[y][v];
+            const int16_t *row = coefficients + v * BlockSide;
+            for (int u = 0; u < BlockSide; ++u) {
+                sums[u] += weight * row[u];
+            }
+        }
+        for (int u = 0; u < BlockSide; ++u) {
+            columns[y][u] = (sums[u] + PassRounding) >> (IdctBits - IdctPassBits);
+        }
+    }
+    // Then rows: all 8 outputs of a row at once, the padding lanes are computed and thrown away.
+    for (int y = 0; y < size; ++y) {
+        int32_t sums[BlockSide] = {};
+        for (int u = 0; u < size; ++u) {
+            int32_t value = columns[y][u];
+            for (int x = 0; x < BlockSide; ++x) {
+                sums[x] += table.transposed[u][x] * value;
+            }
+        }
+        BYTE *samples = output + y * stride;
+        for (int x = 0; x < size; ++x) {
+            samples[x] = ClampSample(((sums[x] + FinalRounding) >> (IdctBits + IdctPassBits)) + SampleCenter);
+        }
+    }
+}
+
+// Bits of the entropy coded data, most significant first. Stuffed zero bytes after 0xff are dropped;
+// at a marker or at the end of the file zeros are returned, so truncated images end in gray.
+class EntropyReader {
+public:
+    explicit EntropyReader(std::streambuf *buffer) : buffer_(buffer) {
+    }
+
+    int DecodeSymbol(const HuffmanTable &table) {
+        if (count_ < MaxCodeLength) {
+            Fill();
+        }
+        uint16_t entry = table.fast[Peek(HuffmanFastBits)];
+        if (entry != 0) {
+            Consume(entry >> 8);
+            return entry & 0xff;
+        }
+        for (int length = HuffmanFastBits + 1; length <= MaxCodeLength; ++length) {
+            int32_t code = static_cast<int32_t>(Peek(length));
+            if (code <= table.max_code[length]) {
+                Consume(length);
+                return table.symbols[code + table.offset[length]];
+            }
+        }
+        throw InputDataException("Broken JPEG data");
+    }
+
+    // The signed value of the next size bits as stored in JPEG: the low half of the range is negative.
+    int32_t Receive(int size) {
+        if (size == 0) {
+            return 0;
+        }
+        if (size > MaxCodeLength - 1) {
+            throw InputDataException("Broken JPEG data");
+        }
+        if (count_ < size) {
+            Fill();
+        }
+        int32_t value = static_cast<int32_t>(Peek(size));
+        Consume(size);
+        return value < (1 << (size - 1)) ? value - (1 << size) + 1 : value;
+    }
+
+    // Skips to the restart marker that must follow and starts a new byte aligned interval.
+    void Restart() {
+        bits_ = 0;
+        count_ = 0;
+        while (marker_ < 0) {
+            int symbol = buffer_->sbumpc();
+            if (symbol == std::streambuf::traits_type::eof()) {
+                marker_ = MarkerEoi;
+            } else if (symbol == MarkerStart) {
+                int next = SkipFill();
+                marker_ = next == 0 ? -1 : next;
+            }
+        }
+        if (marker_ < MarkerRst0 || marker_ > MarkerRst7) {
+            throw InputDataException("Broken JPEG data");
+        }
+        marker_ = -1;
+    }
+
+private:
+    std::streambuf *buffer_;
+    uint64_t bits_ = 0;
+    int count_ = 0;
+    int marker_ = -1;
+
+    uint32_t Peek(int size) const {
+        return static_cast<uint32_t>(bits_ >> (64 - size));
+    }
+
+    void Consume(int size) {
+        bits_ <<= size;
+        count_ -= size;
+    }
+
+    // The byte after 0xff and any fill bytes.
+    int SkipFill() {
+        int next = buffer_->sbumpc();
+        while (next == MarkerStart) {
+            next = buffer_->sbumpc();
+        }
+        return next == std::streambuf::traits_type::eof() ? MarkerEoi : next;
+    }
+
+    void Fill() {
+        while (count_ <= 56) {
+            int byte = 0;
+            if (marker_ < 0) {
+                byte = buffer_->sbumpc();
+                if (byte == std::streambuf::traits_type::eof()) {
+                    marker_ = MarkerEoi;
+                    byte = 0;
+                } else if (byte == MarkerStart) {
+                    int next = SkipFill();
+                    if (next != 0) {
+                        marker_ = next;
+                        byte = 0;
+                    }
+                }
+            }
+            bits_ |= static_cast<uint64_t>(byte) << (56 - count_);
+            count_ += 8;
+        }
+    }
+};
+
+struct Component {
+    int id = 0;
+    int horizontal = 1;
+    int vertical = 1;
+    int quant_table = 0;
+    int dc_table = 0;
+    int ac_table = 0;
+    int32_t dc_prediction = 0;
+    // Samples of one row of MCUs, only as wide as the decoded part of the image.
+    std::vector<BYTE> plane;
+    size_t stride = 0;
+    // log2 of how many output pixels share a sample in each direction.
+    int horizontal_shift = 0;
+    int vertical_shift = 0;
+};
+
+class JpegDecoder {
+public:
+    JpegDecoder(std::istream &input, const JpegDecodeOptions &options) : input_(input), options_(options) {
+    }
+
+    PictureInfo Decode() {
+        if (ReadMarker() != MarkerSoi) {
+            throw FileHeaderException("Incorrect file format");
+        }
+        for (;;) {
+            int marker = ReadMarker();
+            if (marker == MarkerSof0 || marker == MarkerSof1) {
+                ReadFrame(ReadSegment());
+            } else if (marker > MarkerSof1 && marker <= MarkerSof15 && marker != MarkerDht && marker != MarkerJpg &&
+                       marker != MarkerDac) {
+                throw InfoHeaderException("Only baseline JPEG images are supported");
+            } else if (marker == MarkerDht) {
+                ReadHuffmanTables(ReadSegment());
+            } else if (marker == MarkerDqt) {
+                ReadQuantTables(ReadSegment());
+            } else if (marker == MarkerDri) {
+                std::vector<BYTE> segment = ReadSegment();
+                RequireSize(segment, 2);
+                restart_interval_ = segment[0] << 8 | segment[1];
+            } else if (marker == MarkerApp14) {
+                std::vector<BYTE> segment = ReadSegment();
+                // Adobe files say whether three components are YCbCr or plain RGB.
+                if (segment.size() >= 12 && std::string(segment.begin(), segment.begin() + 5) == "Adobe") {
+                    rgb_ = segment[11] == 0;
+                }
+            } else if (marker == MarkerSos) {
+                ReadScanHeader(ReadSegment());
+                return DecodeScan();
+            } else if (marker == MarkerEoi || marker == MarkerSoi) {
+                throw FileHeaderException("Incorrect file format");
+            } else {
+                ReadSegment();
+            }
+        }
+    }
+
+private:
+    std::istream &input_;
+    JpegDecodeOptions options_;
+    std::array<std::array<uint16_t, BlockArea>, TableCount> quant_tables_{};
+    std::array<bool, TableCount> quant_defined_{};
+    std::array<HuffmanTable, TableCount> dc_tables_;
+    std::array<HuffmanTable, TableCount> ac_tables_;
+    std::vector<Component> components_;
+    LONG width_ = 0;
+    LONG height_ = 0;
+    int max_horizontal_ = 1;
+    int max_vertical_ = 1;
+    int restart_interval_ = 0;
+    bool rgb_ = false;
+
+    int ReadByte() {
+        int byte = input_.get();
+        if (byte == std::istream::traits_type::eof()) {
+            throw InputDataException("Unexpected end of file");
+        }
+        return byte;
+    }
+
+    int ReadMarker() {
+        if (ReadByte() != MarkerStart) {
+            throw FileHeaderException("Incorrect file format");
+        }
+        int marker = ReadByte();
+        while (marker == MarkerStart) {
+            marker = ReadByte();
+        }
+        return marker;
+    }
+
+    std::vector<BYTE> ReadSegment() {
+        int high = ReadByte();
+        int size = (high << 8 | ReadByte()) - 2;
+        if (size < 0) {
+            throw FileHeaderException("Incorrect file format");
+        }
+        std::vector<BYTE> segment(size);
+        if (!input_.read(reinterpret_cast<char *>(segment.data()), size)) {
+            throw InputDataException("Unexpected end of file");
+        }
+        return segment;
+    }
+
+    static void RequireSize(const std::vector<BYTE> &segment, size_t size) {
+        if (segment.size() < size) {
+            throw FileHeaderException("Incorrect file format");
+        }
+    }
+
+    void ReadFrame(const std::vector<BYTE> &segment) {
+        RequireSize(segment, 6);
+        if (!components_.empty()) {
+            throw FileHeaderException("Incorrect file format");
+        }
+        if (segment[0] != 8) {
+            throw InfoHeaderException("Only 8-bit JPEG images are supported");
+        }
+        height_ = segment[1] << 8 | segment[2];
+        width_ = segment[3] << 8 | segment[4];
+        if (width_ == 0 || height_ == 0 || static_cast<uint64_t>(width_) * height_ > MaxPixels) {
+            throw FileHeaderException("Incorrect file size");
+        }
+        int count = segment[5];
+        if (count != 1 && count != 3) {
+            throw InfoHeaderException("Only gray and YCbCr JPEG images are supported");
+        }
+        RequireSize(segment, 6 + 3 * static_cast<size_t>(count));
+        for (int index = 0; index < count; ++index) {
+            const BYTE *fields = segment.data() + 6 + 3 * index;
+            Component component;
+            component.id = fields[0];
+            component.horizontal = fields[1] >> 4;
+            component.vertical = fields[1] & 0xf;
+            component.quant_table = fields[2];
+            if (component.quant_table >= TableCount) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            if (component.horizontal < 1 || component.horizontal > MaxSampling || component.vertical < 1 ||
+                component.vertical > MaxSampling) {
+                throw InfoHeaderException("Only 4:4:4, 4:2:2 and 4:2:0 subsampling is supported");
+            }
+            // A single component is never interleaved, its MCU is one block whatever the factors say.
+            if (count == 1) {
+                component.horizontal = component.vertical = 1;
+            }
+            max_horizontal_ = std::max(max_horizontal_, component.horizontal);
+            max_vertical_ = std::max(max_vertical_, component.vertical);
+            components_.push_back(component);
+        }
+    }
+
+    void ReadQuantTables(const std::vector<BYTE> &segment) {
+        for (size_t position = 0; position < segment.size();) {
+            int precision = segment[position] >> 4;
+            int id = segment[position] & 0xf;
+            size_t value_size = precision == 0 ? 1 : 2;
+            if (precision > 1 || id >= TableCount) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            RequireSize(segment, position + 1 + BlockArea * value_size);
+            for (int index = 0; index < BlockArea; ++index) {
+                const BYTE *value = segment.data() + position + 1 + index * value_size;
+                quant_tables_[id][index] = static_cast<uint16_t>(value_size == 1 ? value[0] : value[0] << 8 | value[1]);
+            }
+            quant_defined_[id] = true;
+            position += 1 + BlockArea * value_size;
+        }
+    }
+
+    void ReadHuffmanTables(const std::vector<BYTE> &segment) {
+        for (size_t position = 0; position < segment.size();) {
+            int table_class = segment[position] >> 4;
+            int id = segment[position] & 0xf;
+            if (table_class > 1 || id >= TableCount) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            RequireSize(segment, position + 1 + MaxCodeLength);
+            const BYTE *counts = segment.data() + position + 1;
+            size_t total = 0;
+            for (int length = 0; length < MaxCodeLength; ++length) {
+                total += counts[length];
+            }
+            if (total > MaxSymbols) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            RequireSize(segment, position + 1 + MaxCodeLength + total);
+            BuildTable(table_class == 0 ? dc_tables_[id] : ac_tables_[id], counts, counts + MaxCodeLength);
+            position += 1 + MaxCodeLength + total;
+        }
+    }
+
+    // Canonical codes: each length takes the next codes in order, then the code is doubled for the next length.
+    static void BuildTable(HuffmanTable &table, const BYTE *counts, const BYTE *symbols) {
+        table = HuffmanTable{};
+        int32_t code = 0;
+        int index = 0;
+        for (int length = 1; length <= MaxCodeLength; ++length) {
+            int count = counts[length - 1];
+            // Checked before the codes are written: the codes of an oversubscribed length run past the fast table.
+            if (code + count > (1 << length)) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            table.offset[length] = index - code;
+            for (int ind = 0; ind < count; ++ind, ++code, ++index) {
+                table.symbols[index] = symbols[index];
+                if (length <= HuffmanFastBits) {
+                    int shift = HuffmanFastBits - length;
+                    auto first = table.fast.begin() + (code << shift);
+                    std::fill(first, first + (1 << shift), static_cast<uint16_t>(length << 8 | symbols[index]));
+                }
+            }
+            table.max_code[length] = count == 0 ? -1 : code - 1;
+            code <<= 1;
+        }
+        table.defined = true;
+    }
+
+    void ReadScanHeader(const std::vector<BYTE> &segment) {
+        if (components_.empty()) {
+            throw FileHeaderException("Incorrect file format");
+        }
+        RequireSize(segment, 1);
+        size_t count = segment[0];
+        if (count != components_.size()) {
+            throw InfoHeaderException("Only interleaved JPEG scans are supported");
+        }
+        RequireSize(segment, 4 + 2 * count);
+        for (size_t index = 0; index < count; ++index) {
+            const BYTE *fields = segment.data() + 1 + 2 * index;
+            auto component = std::find_if(components_.begin(), components_.end(),
+                                          [fields](const Component &candidate) { return candidate.id == fields[0]; });
+            if (component == components_.end()) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            component->dc_table = fields[1] >> 4;
+            component->ac_table = fields[1] & 0xf;
+            if (component->dc_table >= TableCount || component->ac_table >= TableCount ||
+                !dc_tables_[component->dc_table].defined || !ac_tables_[component->ac_table].defined ||
+                !quant_defined_[component->quant_table]) {
+                throw FileHeaderException("Incorrect file format");
+            }
+        }
+        const BYTE *selection = segment.data() + 1 + 2 * count;
+        if (selection[0] != 0 || selection[1] != BlockArea - 1 || selection[2] != 0) {
+            throw InfoHeaderException("Only baseline JPEG images are supported");
+        }
+    }
+
+    // Reads one block into coefficients (natural order, dequantized). Returns false if only DC is set.
+    static bool DecodeBlock(EntropyReader &reader, Component &component, const HuffmanTable &dc_table,
+                            const HuffmanTable &ac_table, const std::array<uint16_t, BlockArea> &quant,
+                            int16_t *coefficients) {
+        std::fill(coefficients, coefficients + BlockArea, 0);
+        component.dc_prediction = std::clamp(component.dc_prediction + reader.Receive(reader.DecodeSymbol(dc_table)),
+                                             -MaxPrediction, MaxPrediction);
+        coefficients[0] = Dequantize(component.dc_prediction, quant[0]);
+        bool has_ac = false;
+        for (int index = 1; index < BlockArea;) {
+            int symbol = reader.DecodeSymbol(ac_table);
+            int run = symbol >> 4;
+            int size = symbol & 0xf;
+            if (size == 0) {
+                if (run != 0xf) {
+                    break;
+                }
+                index += 16;
+                continue;
+            }
+            index += run;
+            if (index >= BlockArea) {
+                throw InputDataException("Broken JPEG data");
+            }
+            coefficients[ZigZag[index]] = Dequantize(reader.Receive(size), quant[index]);
+            has_ac = true;
+            ++index;
+        }
+        return has_ac;
+    }
+
+    PictureInfo DecodeScan() {
+        const IdctTable &table = IdctTableForScale(options_.scale);
+        int block_side = table.size;
+        int mcu_width = max_horizontal_ * BlockSide;
+        int mcu_height = max_vertical_ * BlockSide;
+        int mcus_x = (width_ + mcu_width - 1) / mcu_width;
+        int mcus_y = (height_ + mcu_height - 1) / mcu_height;
+
+        // Everything below is in pixels of the scaled image.
+        LONG width = (width_ + options_.scale - 1) / options_.scale;
+        LONG height = (height_ + options_.scale - 1) / options_.scale;
+        if (options_.max_width > 0) {
+            width = std::min(width, options_.max_width);
+        }
+        if (options_.max_height > 0) {
+            height = std::min(height, options_.max_height);
+        }
+        int scaled_mcu_width = max_horizontal_ * block_side;
+        int scaled_mcu_height = max_vertical_ * block_side;
+        int needed_x = std::min(mcus_x, static_cast<int>((width + scaled_mcu_width - 1) / scaled_mcu_width));
+        int needed_y = std::min(mcus_y, static_cast<int>((height + scaled_mcu_height - 1) / scaled_mcu_height));
+
+        for (Component &component : components_) {
+            component.stride = static_cast<size_t>(needed_x) * component.horizontal * block_side;
+            component.plane.assign(component.stride * component.vertical * block_side, 0);
+            component.horizontal_shift = max_horizontal_ / component.horizontal - 1;
+            component.vertical_shift = max_vertical_ / component.vertical - 1;
+            component.dc_prediction = 0;
+        }
+
+        PictureInfo picture_info = InputOutputProcessing::CreatePicture(
+            width, height, components_.size() == 1 ? GrayBits : TrueColorBits, true);
+        EntropyReader reader(input_.rdbuf());
+        alignas(32) int16_t coefficients[BlockArea];
+        int mcu_index = 0;
+        for (int mcu_y = 0; mcu_y < needed_y; ++mcu_y) {
+            for (int mcu_x = 0; mcu_x < mcus_x; ++mcu_x, ++mcu_index) {
+                if (restart_interval_ > 0 && mcu_index > 0 && mcu_index % restart_interval_ == 0) {
+                    reader.Restart();
+                    for (Component &component : components_) {
+                        component.dc_prediction = 0;
+                    }
+                }
+                for (Component &component : components_) {
+                    const HuffmanTable &dc_table = dc_tables_[component.dc_table];
+                    const HuffmanTable &ac_table = ac_tables_[component.ac_table];
+                    const std::array<uint16_t, BlockArea> &quant = quant_tables_[component.quant_table];
+                    for (int block_y = 0; block_y < component.vertical; ++block_y) {
+                        for (int block_x = 0; block_x < component.horizontal; ++block_x) {
+                            bool has_ac = DecodeBlock(reader, component, dc_table, ac_table, quant, coefficients);
+                            // Blocks right of the decoded part still have to be read, but not transformed.
+                            if (mcu_x >= needed_x) {
+                                continue;
+                            }
+                            size_t column = static_cast<size_t>(mcu_x * component.horizontal + block_x) * block_side;
+                            BYTE *output = component.plane.data() +
+                                           static_cast<size_t>(block_y) * block_side * component.stride + column;
+                            InverseDct(coefficients, !has_ac, table, output, component.stride);
+                        }
+                    }
+                }
+            }
+            LONG first_row = mcu_y * scaled_mcu_height;
+            ConvertRows(picture_info, first_row, std::min(height, first_row + scaled_mcu_height));
+        }
+        return picture_info;
+    }
+
+    // Upsamples the chroma of one MCU row by repeating samples and converts it to pixels.
+    void ConvertRows(PictureInfo &picture_info, LONG first_row, LONG end_row) const {
+        for (LONG y = first_row; y < end_row; ++y) {
+            std::vector<Pixel> &row = picture_info.pixels[y];
+            LONG local_y = y - first_row;
+            if (components_.size() == 1) {
+                const BYTE *gray = components_[0].plane.data() + local_y * components_[0].stride;
+                for (size_t x = 0; x < row.size(); ++x) {
+                    row[x] = Pixel{gray[x], gray[x], gray[x]};
+                }
+                continue;
+            }
+            const BYTE *samples[3];
+            for (size_t index = 0; index < 3; ++index) {
+                const Component &component = components_[index];
+                samples[index] = component.plane.data() + (local_y >> component.vertical_shift) * component.stride;
+            }
+            int shifts[3] = {components_[0].horizontal_shift, components_[1].horizontal_shift,
+                             components_[2].horizontal_shift};
+            for (size_t x = 0; x < row.size(); ++x) {
+                int first = samples[0][x >> shifts[0]];
+                int second = samples[1][x >> shifts[1]];
+                int third = samples[2][x >> shifts[2]];
+                if (rgb_) {
+                    row[x] = Pixel{static_cast<BYTE>(third), static_cast<BYTE>(second), static_cast<BYTE>(first)};
+                    continue;
+                }
+                // JFIF YCbCr: R = Y + 1.402 Cr, G = Y - 0.34414 Cb - 0.71414 Cr, B = Y + 1.772 Cb.
+                constexpr int32_t Half = 1 << (ColorBits - 1);
+                int32_t cb = second - SampleCenter;
+                int32_t cr = third - SampleCenter;
+                row[x] = Pixel{ClampSample(first + ((116130 * cb + Half) >> ColorBits)),
+                               ClampSample(first - ((22554 * cb + 46802 * cr - Half) >> ColorBits)),
+                               ClampSample(first + ((91881 * cr + Half) >> ColorBits))};
+            }
+        }
+    }
+};
+}  // namespace
+
+PictureInfo JpegCodec::Load(std::istream &input, const JpegDecodeOptions &options) {
+    if (options.scale < 1 || options.scale > MaxScale || (options.scale & (options.scale - 1)) != 0) {
+        throw InputDataException("JPEG images can be scaled by 1/2, 1/4 or 1/8 only");
+    }
+    return JpegDecoder(input, options).Decode();
+}
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Exceptions.h"
+#include "input_control/Checksums.h"
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/PngCodec.h"
+
+namespace {
+constexpr BYTE Signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+constexpr size_t ChunkTypeSize = 4;
+constexpr size_t HeaderChunkSize = 13;
+constexpr DWORD MaxChunkSize = 0x7fffffff;
+// Image data is written in chunks of this size.
+constexpr size_t DataChunkSize = 1 << 16;
+constexpr BYTE SampleBits = 8;
+constexpr WORD GrayBits = 8;
+constexpr WORD TrueColorBits = 24;
+
+constexpr BYTE ColorGray = 0;
+constexpr BYTE ColorRgb = 2;
+constexpr BYTE ColorGrayAlpha = 4;
+constexpr BYTE ColorRgba = 6;
+
+enum RowFilter : BYTE { FilterNone, FilterSub, FilterUp, FilterAverage, FilterPaeth, FilterCount };
+
+int Channels(BYTE color_type) {
+    switch (color_type) {
+        case ColorGray:
+            return 1;
+        case ColorGrayAlpha:
+            return 2;
+        case ColorRgb:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+DWORD ReadBigEndian(const BYTE *bytes) {
+    return DWORD{bytes[0]} << 24 | DWORD{bytes[1]} << 16 | DWORD{bytes[2]} << 8 | DWORD{bytes[3]};
+}
+
+void AppendBigEndian(std::vector<std::byte> &output, DWORD value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        output.push_back(static_cast<std::byte>(value >> shift));
+    }
+}
+
+BYTE Paeth(int left, int up, int up_left) {
+    int estimate = left + up - up_left;
+    int left_distance = std::abs(estimate - left);
+    int up_distance = std::abs(estimate - up);
+    int up_left_distance = std::abs(estimate - up_left);
+    if (left_distance <= up_distance && left_distance <= up_left_distance) {
+        return static_cast<BYTE>(left);
+    }
+    return static_cast<BYTE>(up_distance <= up_left_distance ? up : up_left);
+}
+
+// Reverses the row filter in place, previous is the already unfiltered row above (zeros for the first row).
+void Unfilter(BYTE filter, BYTE *row, const BYTE *previous, size_t size, int bpp) {
+    switch (filter) {
+        case FilterNone:
+            break;
+        case FilterSub:
+            for (size_t index = bpp; index < size; ++index) {
+                row[index] = static_cast<BYTE>(row[index] + row[index - bpp]);
+            }
+            break;
+        case FilterUp:
+            for (size_t index = 0; index < size; ++index) {
+                row[index] = static_cast<BYTE>(row[index] + previous[index]);
+            }
+            break;
+        case FilterAverage:
+            for (size_t index = 0; index < size; ++index) {
+                int left = index >= static_cast<size_t>(bpp) ? row[index - bpp] : 0;
+                row[index] = static_cast<BYTE>(row[index] + (left + previous[index]) / 2);
+            }
+            break;
+        case FilterPaeth:
+            for (size_t index = 0; index < size; ++index) {
+                bool has_left = index >= static_cast<size_t>(bpp);
+                row[index] = static_cast<BYTE>(row[index] + Paeth(has_left ? row[index - bpp] : 0, previous[index],
+                                                                  has_left ? previous[index - bpp] : 0));
+            }
+            break;
+        default:
+            throw InputDataException("Unknown PNG row filter");
+    }
+}
+
+// Applies the filter to row, previous is the row above (zeros for the first row).
+void Filter(BYTE filter, const BYTE *row, const BYTE *previous, size_t size, int bpp, BYTE *output) {
+    for (size_t index = 0; index < size; ++index) {
+        bool has_left = index >= static_cast<size_t>(bpp);
+        int left = has_left ? row[index - bpp] : 0;
+        int up_left = has_left ? previous[index - bpp] : 0;
+        int prediction = 0;
+        if (filter == FilterSub) {
+            prediction = left;
+        } else if (filter == FilterUp) {
+            prediction = previous[index];
+        } else if (filter == FilterAverage) {
+            prediction = (left + previous[index]) / 2;
+        } else if (filter == FilterPaeth) {
+            prediction = Paeth(left, previous[index], up_left);
+        }
+        output[index] = static_cast<BYTE>(row[index] - prediction);
+    }
+}
+
+// The usual heuristic: the filtered row whose bytes, taken as signed, are closest to zero compresses best.
+size_t FilteredCost(const BYTE *filtered, size_t size) {
+    size_t cost = 0;
+    for (size_t index = 0; index < size; ++index) {
+        cost += std::abs(static_cast<int>(static_cast<signed char>(filtered[index])));
+    }
+    return cost;
+}
+
+void ExpandRow(const BYTE *samples, int channels, std::vector<Pixel> &row) {
+    for (size_t x = 0; x < row.size(); ++x, samples += channels) {
+        if (channels <= 2) {
+            row[x] = Pixel{samples[0], samples[0], samples[0], channels == 2 ? samples[1] : MaxAlpha};
+        } else {
+            row[x] = Pixel{samples[2], samples[1], samples[0], channels == 4 ? samples[3] : MaxAlpha};
+        }
+    }
+}
+
+void PackRow(const std::vector<Pixel> &row, int channels, BYTE *samples) {
+    for (const Pixel &pixel : row) {
+        if (channels == 1) {
+            *samples++ = pixel.red;
+            continue;
+        }
+        *samples++ = pixel.red;
+        *samples++ = pixel.green;
+        *samples++ = pixel.blue;
+        if (channels == 4) {
+            *samples++ = pixel.alpha;
+        }
+    }
+}
+
+bool IsGrayImage(const PictureInfo &picture_info) {
+    for (const std::vector<Pixel> &row : picture_info.pixels) {
+        for (const Pixel &pixel : row) {
+            if (pixel.red != pixel.green || pixel.red != pixel.blue) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void WriteChunk(std::ostream &output, const char *type, std::span<const std::byte> data) {
+    std::vector<std::byte> chunk;
+    chunk.reserve(data.size() + 12);
+    AppendBigEndian(chunk, static_cast<DWORD>(data.size()));
+    for (size_t index = 0; index < ChunkTypeSize; ++index) {
+        chunk.push_back(static_cast<std::byte>(type[index]));
+    }
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    AppendBigEndian(chunk, Checksums::Crc32(std::span(chunk).subspan(ChunkTypeSize)));
+    output.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+}
+}  // namespace
+
+PictureInfo PngCodec::Load(std::istream &input) {
+    BYTE signature[sizeof(Signature)];
+    if (!input.read(reinterpret_cast<char *>(signature), sizeof(signature)) ||
+        !std::equal(std::begin(Signature), std::end(Signature), signature)) {
+        throw FileHeaderException("Incorrect file format");
+    }
+
+    DWORD width = 0;
+    DWORD height = 0;
+    BYTE color_type = 0;
+    std::vector<std::byte> compressed;
+    std::vector<std::byte> chunk;
+    for (bool first = true;; first = false) {
+        BYTE chunk_header[4 + ChunkTypeSize];
+        if (!input.read(reinterpret_cast<char *>(chunk_header), sizeof(chunk_header))) {
+            throw InputDataException("Unexpected end of file");
+        }
+        DWORD size = ReadBigEndian(chunk_header);
+        std::string type(reinterpret_cast<const char *>(chunk_header) + 4, ChunkTypeSize);
+        if (size > MaxChunkSize || first != (type == "IHDR")) {
+            throw FileHeaderException("Incorrect file format");
+        }
+
+        // Image data goes straight to the end of the compressed buffer, the other chunks to a scratch buffer.
+        std::vector<std::byte> &target = type == "IDAT" ? compressed : chunk;
+        size_t offset = type == "IDAT" ? compressed.size() : 0;
+        target.resize(offset + size);
+        BYTE crc_bytes[4];
+        if (!input.read(reinterpret_cast<char *>(target.data() + offset), size) ||
+            !input.read(reinterpret_cast<char *>(crc_bytes), sizeof(crc_bytes))) {
+            throw InputDataException("Unexpected end of file");
+        }
+        DWORD crc = Checksums::Crc32(std::as_bytes(std::span(type)));
+        if (Checksums::Crc32(std::span(target).subspan(offset), crc) != ReadBigEndian(crc_bytes)) {
+            throw InputDataException("Wrong PNG chunk checksum");
+        }
+
+        if (type == "IHDR") {
+            if (size != HeaderChunkSize) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            const BYTE *header = reinterpret_cast<const BYTE *>(chunk.data());
+            width = ReadBigEndian(header);
+            height = ReadBigEndian(header + 4);
+            color_type = header[9];
+            if (width == 0 || height == 0 || static_cast<uint64_t>(width) * height > MaxPixels) {
+                throw FileHeaderException("Incorrect file size");
+            }
+            if (header[8] != SampleBits || (color_type != ColorGray && color_type != ColorRgb &&
+                                            color_type != ColorGrayAlpha && color_type != ColorRgba)) {
+                throw InfoHeaderException("Only 8-bit gray, gray with alpha, RGB and RGBA images are supported");
+            }
+            if (header[10] != 0 || header[11] != 0) {
+                throw InfoHeaderException("Unsupported compression or filter method");
+            }
+            if (header[12] != 0) {
+                throw InfoHeaderException("Interlaced images are not supported");
+            }
+        } else if (type == "IEND") {
+            break;
+        } else if (type != "IDAT" && type != "PLTE" && std::isupper(static_cast<unsigned char>(type[0]))) {
+            // Unknown ancillary chunks (lowercase first letter) may be skipped, unknown critical ones may not.
+            throw InfoHeaderException("Unsupported PNG chunk");
+        }
+    }
+
+    int channels = Channels(color_type);
+    size_t row_size = static_cast<size_t>(width) * channels;
+    size_t image_size = (row_size + 1) * height;
+    std::vector<std::byte> filtered = ZlibCodec::Inflate(compressed, image_size);
+    if (filtered.size() != image_size) {
+        throw InputDataException("Unexpected end of data");
+    }
+
+    bool alpha = color_type == ColorGrayAlpha || color_type == ColorRgba;
+    WORD bit_count = alpha ? TrueColorAlphaBits : color_type == ColorGray ? GrayBits : TrueColorBits;
+    PictureInfo picture_info = InputOutputProcessing::CreatePicture(static_cast<LONG>(width),
+                                                                    static_cast<LONG>(height), bit_count, true);
+    std::vector<BYTE> zeros(row_size, 0);
+    const BYTE *previous = zeros.data();
+    BYTE *row = reinterpret_cast<BYTE *>(filtered.data());
+    for (std::vector<Pixel> &pixels_row : picture_info.pixels) {
+        Unfilter(row[0], row + 1, previous, row_size, channels);
+        ExpandRow(row + 1, channels, pixels_row);
+        previous = row + 1;
+        row += row_size + 1;
+    }
+    return picture_info;
+}
+
+void PngCodec::Save(std::ostream &output, const PictureInfo &picture_info, int level) {
+    DWORD height = static_cast<DWORD>(picture_info.pixels.size());
+    DWORD width = static_cast<DWORD>(picture_info.pixels.empty() ? 0 : picture_info.pixels[0].size());
+    BYTE color_type = ColorRgb;
+    if (picture_info.bmi_header.biBitCount == TrueColorAlphaBits) {
+        color_type = ColorRgba;
+    } else if (picture_info.bmi_header.biBitCount <= GrayBits && IsGrayImage(picture_info)) {
+        color_type = ColorGray;
+    }
+    int channels = Channels(color_type);
+    size_t row_size = static_cast<size_t>(width) * channels;
+
+    // Rows are packed and filtered one by one into the buffer that is then compressed in one go.
+    std::vector<BYTE> filtered((row_size + 1) * height);
+    std::vector<BYTE> current(row_size);
+    std::vector<BYTE> previous(row_size, 0);
+    std::array<std::vector<BYTE>, FilterCount> candidates;
+    for (std::vector<BYTE> &candidate : candidates) {
+        candidate.resize(row_size);
+    }
+    for (DWORD y = 0; y < height; ++y) {
+        PackRow(picture_info.pixels[picture_info.top_down ? y : height - 1 - y], channels, current.data());
+        BYTE best_filter = FilterNone;
+        if (level > ZlibCodec::MinLevel) {
+            size_t best_cost = SIZE_MAX;
+            for (BYTE filter = FilterNone; filter < FilterCount; ++filter) {
+                Filter(filter, current.data(), previous.data(), row_size, channels, candidates[filter].data());
+                size_t cost = FilteredCost(candidates[filter].data(), row_size);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_filter = filter;
+                }
+            }
+        } else {
+            candidates[FilterNone] = current;
+        }
+        BYTE *row = filtered.data() + y * (row_size + 1);
+        row[0] = best_filter;
+        std::memcpy(row + 1, candidates[best_filter].data(), row_size);
+        current.swap(previous);
+    }
+    std::vector<std::byte> compressed = ZlibCodec::Deflate(std::as_bytes(std::span(filtered)), level);
+
+    output.write(reinterpret_cast<const char *>(Signature), sizeof(Signature));
+    std::vector<std::byte> header;
+    AppendBigEndian(header, width);
+    AppendBigEndian(header, height);
+    for (BYTE field : {SampleBits, color_type, BYTE{0}, BYTE{0}, BYTE{0}}) {
+        header.push_back(static_cast<std::byte>(field));
+    }
+    WriteChunk(output, "IHDR", header);
+    for (size_t offset = 0; offset < compressed.size(); offset += DataChunkSize) {
+        WriteChunk(output, "IDAT",
+                   std::span(compressed).subspan(offset, std::min(DataChunkSize, compressed.size() - offset)));
+    }
+    WriteChunk(output, "IEND", {});
+    if (!output.flush()) {
+        throw InputDataException("Can't write the output");
+    }
+}
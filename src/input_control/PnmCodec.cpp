@@ -0,0 +1,255 @@
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include "Exceptions.h"
+#include "Filters.h"
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/PnmCodec.h"
+
+namespace {
+constexpr int GrayDepth = 1;
+constexpr int GrayAlphaDepth = 2;
+constexpr int RgbDepth = 3;
+constexpr int RgbaDepth = 4;
+constexpr DWORD MaxSample = 255;
+constexpr DWORD MaxDeepSample = 65535;
+constexpr WORD GrayBits = 8;
+constexpr WORD TrueColorBits = 24;
+constexpr size_t MaxTokenLength = 64;
+
+// Next header token; whitespace and comments before it are skipped, the one whitespace after it is consumed.
+std::string ReadToken(std::istream &input) {
+    std::streambuf *buffer = input.rdbuf();
+    std::streambuf::int_type symbol = buffer->sbumpc();
+    while (symbol != std::streambuf::traits_type::eof() && (std::isspace(symbol) || symbol == '#')) {
+        if (symbol == '#') {
+            while (symbol != std::streambuf::traits_type::eof() && symbol != '\n') {
+                symbol = buffer->sbumpc();
+            }
+        }
+        symbol = buffer->sbumpc();
+    }
+    std::string token;
+    while (symbol != std::streambuf::traits_type::eof() && !std::isspace(symbol) && token.size() < MaxTokenLength) {
+        token += static_cast<char>(symbol);
+        symbol = buffer->sbumpc();
+    }
+    if (token.empty()) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    return token;
+}
+
+DWORD ReadNumber(std::istream &input) {
+    std::string token = ReadToken(input);
+    DWORD number = 0;
+    for (char digit : token) {
+        if (!std::isdigit(static_cast<unsigned char>(digit)) || number > MaxPixels) {
+            throw FileHeaderException("Incorrect file format");
+        }
+        number = number * 10 + (digit - '0');
+    }
+    return number;
+}
+
+struct PnmHeader {
+    DWORD width = 0;
+    DWORD height = 0;
+    int depth = 0;
+    DWORD max_value = 0;
+};
+
+PnmHeader ReadHeader(std::istream &input) {
+    std::string magic = ReadToken(input);
+    PnmHeader header;
+    if (magic == "P5" || magic == "P6") {
+        header.depth = magic == "P5" ? GrayDepth : RgbDepth;
+        header.width = ReadNumber(input);
+        header.height = ReadNumber(input);
+        header.max_value = ReadNumber(input);
+    } else if (magic == "P7") {
+        // The tuple type only names the meaning of the samples, the depth is enough to read them.
+        for (std::string key = ReadToken(input); key != "ENDHDR"; key = ReadToken(input)) {
+            if (key == "WIDTH") {
+                header.width = ReadNumber(input);
+            } else if (key == "HEIGHT") {
+                header.height = ReadNumber(input);
+            } else if (key == "DEPTH") {
+                header.depth = static_cast<int>(ReadNumber(input));
+            } else if (key == "MAXVAL") {
+                header.max_value = ReadNumber(input);
+            } else if (key == "TUPLTYPE") {
+                ReadToken(input);
+            } else {
+                throw FileHeaderException("Incorrect file format");
+            }
+        }
+    } else {
+        throw FileHeaderException("Incorrect file format");
+    }
+
+    if (header.width == 0 || header.height == 0 || static_cast<uint64_t>(header.width) * header.height > MaxPixels) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    if (header.depth < GrayDepth || header.depth > RgbaDepth) {
+        throw InfoHeaderException("Only 1 to 4 samples per pixel are supported");
+    }
+    if (header.max_value == 0 || header.max_value > MaxDeepSample) {
+        throw InfoHeaderException("Only 8-bit and 16-bit samples are supported");
+    }
+    return header;
+}
+
+// Samples wider than a byte are stored big-endian.
+template <typename T>
+T ReadSample(const BYTE *sample) {
+    if constexpr (sizeof(T) == 1) {
+        return *sample;
+    } else {
+        return static_cast<T>(sample[0] << 8 | sample[1]);
+    }
+}
+
+template <typename T>
+void WriteSample(char *sample, T value) {
+    if constexpr (sizeof(T) == 1) {
+        *sample = static_cast<char>(value);
+    } else {
+        sample[0] = static_cast<char>(value >> 8);
+        sample[1] = static_cast<char>(value & 0xff);
+    }
+}
+
+// Samples of the file mapped to the full range of the channel, values above max_value are clipped.
+template <typename T>
+std::vector<T> SampleScale(DWORD max_value) {
+    DWORD max_sample = ChannelTraits<T>::Max;
+    std::vector<T> scale(max_sample + 1);
+    for (DWORD value = 0; value <= max_sample; ++value) {
+        scale[value] = static_cast<T>(value >= max_value ? max_sample
+                                                         : (value * max_sample + max_value / 2) / max_value);
+    }
+    return scale;
+}
+
+// Expands depth samples per pixel, stored at the end of the row memory, to pixels from the front.
+// A pixel is never written over samples that are not read yet, so no second buffer is needed.
+template <typename T>
+void ExpandRow(std::vector<BasicPixel<T> > &row, int depth, const T *scale) {
+    BYTE *bytes = reinterpret_cast<BYTE *>(row.data());
+    const BYTE *samples = bytes + (sizeof(BasicPixel<T>) - depth * sizeof(T)) * row.size();
+    for (size_t x = 0; x < row.size(); ++x, samples += depth * sizeof(T)) {
+        T red = scale[ReadSample<T>(samples)];
+        T green = depth >= RgbDepth ? scale[ReadSample<T>(samples + sizeof(T))] : red;
+        T blue = depth >= RgbDepth ? scale[ReadSample<T>(samples + 2 * sizeof(T))] : red;
+        bool has_alpha = depth == GrayAlphaDepth || depth == RgbaDepth;
+        T alpha = has_alpha ? scale[ReadSample<T>(samples + (depth - 1) * sizeof(T))] : ChannelTraits<T>::Max;
+        row[x] = BasicPixel<T>{blue, green, red, alpha};
+    }
+}
+
+template <typename T>
+void LoadRows(std::istream &input, BasicPixelMatrix<T> &rows, const PnmHeader &header) {
+    std::vector<T> scale = SampleScale<T>(header.max_value);
+    std::streamsize row_size = static_cast<std::streamsize>(header.width) * header.depth * sizeof(T);
+    for (std::vector<BasicPixel<T> > &row : rows) {
+        char *samples =
+            reinterpret_cast<char *>(row.data()) + (sizeof(BasicPixel<T>) - header.depth * sizeof(T)) * row.size();
+        if (!input.read(samples, row_size)) {
+            throw InputDataException("Unexpected end of file");
+        }
+        ExpandRow(row, header.depth, scale.data());
+    }
+}
+
+// Gray value of every pixel: gray pixels keep theirs, colour ones are converted like -gs does.
+template <typename T>
+void GrayRow(const std::vector<BasicPixel<T> > &row, std::vector<BasicPixel<T> > &scratch, std::string &output) {
+    scratch = row;
+    GrayScaleFilter().ApplyToRow(scratch.data(), static_cast<LONG>(scratch.size()));
+    for (size_t x = 0; x < row.size(); ++x) {
+        bool gray = row[x].red == row[x].green && row[x].red == row[x].blue;
+        WriteSample(output.data() + x * sizeof(T), gray ? row[x].red : scratch[x].red);
+    }
+}
+
+template <typename T>
+void SaveRows(std::ostream &output, const BasicPixelMatrix<T> &rows, bool top_down, int depth) {
+    LONG height = static_cast<LONG>(rows.size());
+    size_t width = rows.empty() ? 0 : rows[0].size();
+    std::string samples(width * depth * sizeof(T), '\0');
+    std::vector<BasicPixel<T> > scratch;
+    for (LONG y = 0; y < height; ++y) {
+        const std::vector<BasicPixel<T> > &row = rows[top_down ? y : height - 1 - y];
+        if (depth == GrayDepth) {
+            GrayRow(row, scratch, samples);
+        } else {
+            char *sample = samples.data();
+            for (size_t x = 0; x < width; ++x) {
+                WriteSample(sample, row[x].red);
+                WriteSample(sample + sizeof(T), row[x].green);
+                WriteSample(sample + 2 * sizeof(T), row[x].blue);
+                if (depth == RgbaDepth) {
+                    WriteSample(sample + 3 * sizeof(T), row[x].alpha);
+                }
+                sample += depth * sizeof(T);
+            }
+        }
+        output.write(samples.data(), static_cast<std::streamsize>(samples.size()));
+    }
+}
+}  // namespace
+
+PictureInfo PnmCodec::Load(std::istream &input) {
+    PnmHeader header = ReadHeader(input);
+
+    bool alpha = header.depth == GrayAlphaDepth || header.depth == RgbaDepth;
+    WORD bit_count = alpha ? TrueColorAlphaBits : header.depth == GrayDepth ? GrayBits : TrueColorBits;
+    // Samples above 255 make a 16-bit image, gray ones included.
+    if (header.max_value > MaxSample) {
+        bit_count = alpha ? DeepColorAlphaBits : DeepColorBits;
+    }
+    PictureInfo picture_info = InputOutputProcessing::CreatePicture(static_cast<LONG>(header.width),
+                                                                    static_cast<LONG>(header.height), bit_count, true);
+    if (picture_info.Deep()) {
+        LoadRows(input, picture_info.deep_pixels, header);
+    } else {
+        LoadRows(input, picture_info.pixels, header);
+    }
+    return picture_info;
+}
+
+void PnmCodec::Save(std::ostream &output, const PictureInfo &picture_info, PnmKind kind) {
+    bool deep = picture_info.Deep();
+    LONG height = static_cast<LONG>(deep ? picture_info.deep_pixels.size() : picture_info.pixels.size());
+    LONG width = height == 0 ? 0
+                 : deep      ? static_cast<LONG>(picture_info.deep_pixels[0].size())
+                             : static_cast<LONG>(picture_info.pixels[0].size());
+    WORD bit_count = picture_info.bmi_header.biBitCount;
+    int depth = kind == PnmKind::Graymap ? GrayDepth : RgbDepth;
+    if (kind == PnmKind::ArbitraryMap && (bit_count == TrueColorAlphaBits || bit_count == DeepColorAlphaBits)) {
+        depth = RgbaDepth;
+    }
+
+    std::string max_value = std::to_string(deep ? MaxDeepSample : MaxSample);
+    std::string size = std::to_string(width) + " " + std::to_string(height);
+    std::string header;
+    if (kind == PnmKind::ArbitraryMap) {
+        header = "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height) + "\nDEPTH " +
+                 std::to_string(depth) + "\nMAXVAL " + max_value + "\nTUPLTYPE " +
+                 (depth == RgbaDepth ? "RGB_ALPHA" : "RGB") + "\nENDHDR\n";
+    } else {
+        header = "P" + std::to_string(static_cast<int>(kind)) + "\n" + size + "\n" + max_value + "\n";
+    }
+    output.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    if (deep) {
+        SaveRows(output, picture_info.deep_pixels, picture_info.top_down, depth);
+    } else {
+        SaveRows(output, picture_info.pixels, picture_info.top_down, depth);
+    }
+    if (!output.flush()) {
+        throw InputDataException("Can't write the output");
+    }
+}
@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "Exceptions.h"
+#include "input_control/Checksums.h"
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/PyramidCodec.h"
+
+namespace {
+constexpr char Signature[] = {'T', 'P', 'Y', 'R'};
+constexpr WORD Version = 1;
+constexpr size_t HeaderSize = 32;
+constexpr size_t LevelEntrySize = 16;
+constexpr size_t TileEntrySize = 16;
+constexpr size_t ChecksumSize = 4;
+// Tiles start on cache line boundaries, so the rows of a mapped file are copied from aligned memory.
+constexpr uint64_t TileAlignment = 64;
+constexpr LONG TileSizeStep = 16;
+constexpr LONG MaxTileSize = 4096;
+constexpr size_t MaxLevels = 32;
+constexpr size_t ReadChunkSize = 1 << 16;
+
+uint64_t ReadLittleEndian(std::span<const std::byte> data, size_t offset, size_t size) {
+    uint64_t value = 0;
+    for (size_t index = 0; index < size; ++index) {
+        value |= static_cast<uint64_t>(data[offset + index]) << (8 * index);
+    }
+    return value;
+}
+
+void AppendLittleEndian(std::vector<std::byte> &output, uint64_t value, size_t size) {
+    for (size_t index = 0; index < size; ++index) {
+        output.push_back(static_cast<std::byte>(value >> (8 * index)));
+    }
+}
+
+uint64_t Align(uint64_t offset) {
+    return (offset + TileAlignment - 1) / TileAlignment * TileAlignment;
+}
+
+size_t TileCount(const PyramidLevel &level, LONG tile_size) {
+    return static_cast<size_t>(level.tiles_across) * ((level.height + tile_size - 1) / tile_size);
+}
+
+// Sizes of all levels: halved until the level fits into one tile, but no fewer than MinLevels.
+std::vector<PyramidLevel> PlanLevels(LONG width, LONG height, LONG tile_size) {
+    std::vector<PyramidLevel> levels;
+    uint32_t first_tile = 0;
+    while (levels.size() < MaxLevels) {
+        uint32_t across = static_cast<uint32_t>((width + tile_size - 1) / tile_size);
+        levels.push_back(PyramidLevel{width, height, across, first_tile});
+        first_tile += static_cast<uint32_t>(TileCount(levels.back(), tile_size));
+        if (levels.size() >= PyramidCodec::MinLevels && width <= tile_size && height <= tile_size) {
+            break;
+        }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    return levels;
+}
+
+// Every pixel of the result is the rounded mean of the 2x2 block under it, or of its part inside the image.
+std::vector<std::vector<Pixel> > Halve(const std::vector<const Pixel *> &rows, LONG width) {
+    LONG height = static_cast<LONG>(rows.size());
+    std::vector<std::vector<Pixel> > result((height + 1) / 2, std::vector<Pixel>((width + 1) / 2));
+    for (LONG y = 0; y < height; y += 2) {
+        const Pixel *top = rows[y];
+        const Pixel *bottom = y + 1 < height ? rows[y + 1] : nullptr;
+        for (LONG x = 0; x < width; x += 2) {
+            bool has_right = x + 1 < width;
+            int count = (has_right ? 2 : 1) * (bottom != nullptr ? 2 : 1);
+            auto mean = [&](BYTE Pixel::*channel) {
+                int sum = top[x].*channel + (has_right ? top[x + 1].*channel : 0);
+                if (bottom != nullptr) {
+                    sum += bottom[x].*channel + (has_right ? bottom[x + 1].*channel : 0);
+                }
+                return static_cast<BYTE>((sum + count / 2) / count);
+            };
+            result[y / 2][x / 2] = Pixel{mean(&Pixel::blue), mean(&Pixel::green), mean(&Pixel::red),
+                                         mean(&Pixel::alpha)};
+        }
+    }
+    return result;
+}
+
+PictureInfo ReadScaled(const PyramidFile &file, const JpegDecodeOptions &options) {
+    if (options.scale <= 0 || !std::has_single_bit(static_cast<unsigned>(options.scale))) {
+        throw InputDataException("Scale must be a power of two");
+    }
+    size_t level = static_cast<size_t>(std::countr_zero(static_cast<unsigned>(options.scale)));
+    if (level >= file.LevelCount()) {
+        throw InputDataException("The pyramid has no level for this scale");
+    }
+    LONG width = file.Level(level).width;
+    LONG height = file.Level(level).height;
+    if (options.max_width > 0) {
+        width = std::min(width, options.max_width);
+    }
+    if (options.max_height > 0) {
+        height = std::min(height, options.max_height);
+    }
+    return file.ReadRegion(level, 0, 0, width, height);
+}
+}  // namespace
+
+PyramidFile::PyramidFile(const std::string &file_path) {
+    mapping_.emplace(file_path);
+    data_ = mapping_->Data();
+    ReadIndex();
+}
+
+PyramidFile::PyramidFile(std::vector<std::byte> data) : memory_(std::move(data)), data_(memory_) {
+    ReadIndex();
+}
+
+void PyramidFile::ReadIndex() {
+    if (data_.size() < HeaderSize || std::memcmp(data_.data(), Signature, sizeof(Signature)) != 0) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    if (ReadLittleEndian(data_, 4, 2) != Version) {
+        throw InfoHeaderException("Unsupported pyramid version");
+    }
+    bit_count_ = static_cast<WORD>(ReadLittleEndian(data_, 6, 2));
+    if (bit_count_ != 1 && bit_count_ != 4 && bit_count_ != 8 && bit_count_ != 24 && bit_count_ != TrueColorAlphaBits) {
+        throw InfoHeaderException("Unsupported bit count");
+    }
+    uint64_t width = ReadLittleEndian(data_, 8, 4);
+    uint64_t height = ReadLittleEndian(data_, 12, 4);
+    tile_size_ = static_cast<LONG>(ReadLittleEndian(data_, 16, 2));
+    size_t level_count = ReadLittleEndian(data_, 18, 2);
+    size_t tile_count = ReadLittleEndian(data_, 20, 4);
+    uint64_t index_offset = ReadLittleEndian(data_, 24, 8);
+    if (width == 0 || height == 0 || width * height > MaxPixels) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    if (tile_size_ <= 0 || tile_size_ % TileSizeStep != 0 || level_count == 0 || level_count > MaxLevels) {
+        throw FileHeaderException("Incorrect file format");
+    }
+
+    size_t index_size = level_count * LevelEntrySize + tile_count * TileEntrySize + ChecksumSize;
+    if (index_offset > data_.size() || data_.size() - index_offset < index_size) {
+        throw InputDataException("Unexpected end of data");
+    }
+    std::span<const std::byte> index = data_.subspan(index_offset, index_size);
+    if (Checksums::Crc32(index.first(index_size - ChecksumSize)) !=
+        ReadLittleEndian(index, index_size - ChecksumSize, ChecksumSize)) {
+        throw InputDataException("Index checksum mismatch");
+    }
+
+    // The levels are fully determined by the header, the stored ones are only checked against them.
+    levels_ = PlanLevels(static_cast<LONG>(width), static_cast<LONG>(height), tile_size_);
+    levels_.resize(std::min(levels_.size(), level_count));
+    for (size_t level = 0; level < level_count; ++level) {
+        std::span<const std::byte> entry = index.subspan(level * LevelEntrySize, LevelEntrySize);
+        if (level >= levels_.size() || ReadLittleEndian(entry, 0, 4) != static_cast<uint64_t>(levels_[level].width) ||
+            ReadLittleEndian(entry, 4, 4) != static_cast<uint64_t>(levels_[level].height) ||
+            ReadLittleEndian(entry, 8, 4) != levels_[level].tiles_across ||
+            ReadLittleEndian(entry, 12, 4) != levels_[level].first_tile) {
+            throw FileHeaderException("Incorrect file format");
+        }
+    }
+    if (levels_.back().first_tile + TileCount(levels_.size() - 1) != tile_count) {
+        throw FileHeaderException("Incorrect file format");
+    }
+
+    std::span<const std::byte> entries = index.subspan(level_count * LevelEntrySize, tile_count * TileEntrySize);
+    tiles_.reserve(tile_count);
+    for (size_t level = 0; level < levels_.size(); ++level) {
+        for (size_t tile = 0; tile < TileCount(level); ++tile) {
+            std::span<const std::byte> entry = entries.subspan(tiles_.size() * TileEntrySize, TileEntrySize);
+            TileEntry tile_entry{ReadLittleEndian(entry, 0, 8), static_cast<uint32_t>(ReadLittleEndian(entry, 8, 4)),
+                                 static_cast<uint32_t>(ReadLittleEndian(entry, 12, 4))};
+            TileRect rect = Tile(level, tile);
+            if (tile_entry.size != static_cast<uint64_t>(rect.width) * rect.height * sizeof(Pixel) ||
+                tile_entry.offset > index_offset || index_offset - tile_entry.offset < tile_entry.size) {
+                throw FileHeaderException("Incorrect file format");
+            }
+            tiles_.push_back(tile_entry);
+        }
+    }
+}
+
+size_t PyramidFile::TileCount(size_t level) const {
+    return ::TileCount(levels_[level], tile_size_);
+}
+
+TileRect PyramidFile::Tile(size_t level, size_t index) const {
+    const PyramidLevel &info = levels_[level];
+    LONG x = static_cast<LONG>(index % info.tiles_across) * tile_size_;
+    LONG y = static_cast<LONG>(index / info.tiles_across) * tile_size_;
+    return TileRect{x, y, std::min(tile_size_, info.width - x), std::min(tile_size_, info.height - y)};
+}
+
+std::span<const std::byte> PyramidFile::TileData(size_t level, size_t index) const {
+    const TileEntry &entry = tiles_[levels_[level].first_tile + index];
+    std::span<const std::byte> data = data_.subspan(entry.offset, entry.size);
+    if (Checksums::Crc32(data) != entry.crc) {
+        throw InputDataException("Tile checksum mismatch");
+    }
+    return data;
+}
+
+PictureInfo PyramidFile::ReadRegion(size_t level, LONG x, LONG y, LONG width, LONG height,
+                                    const TileScheduler &scheduler) const {
+    if (level >= levels_.size() || x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        width > levels_[level].width - x || height > levels_[level].height - y) {
+        throw InputDataException("Region is outside the image");
+    }
+    PictureInfo picture_info = InputOutputProcessing::CreatePicture(width, height, bit_count_, true);
+    size_t first_column = x / tile_size_;
+    size_t first_row = y / tile_size_;
+    size_t columns = (x + width - 1) / tile_size_ - first_column + 1;
+    size_t rows = (y + height - 1) / tile_size_ - first_row + 1;
+    scheduler.Run(columns * rows, [&](size_t task) {
+        size_t index = (first_row + task / columns) * levels_[level].tiles_across + first_column + task % columns;
+        TileRect rect = Tile(level, index);
+        std::span<const std::byte> data = TileData(level, index);
+        LONG left = std::max(x, rect.x);
+        LONG right = std::min(x + width, rect.x + rect.width);
+        for (LONG row = std::max(y, rect.y); row < std::min(y + height, rect.y + rect.height); ++row) {
+            size_t source = (static_cast<size_t>(row - rect.y) * rect.width + (left - rect.x)) * sizeof(Pixel);
+            std::memcpy(picture_info.pixels[row - y].data() + (left - x), data.data() + source,
+                        (right - left) * sizeof(Pixel));
+        }
+    });
+    return picture_info;
+}
+
+PictureInfo PyramidCodec::LoadFile(const std::string &file_path, const JpegDecodeOptions &options) {
+    return ReadScaled(PyramidFile(file_path), options);
+}
+
+PictureInfo PyramidCodec::Load(std::istream &input, const JpegDecodeOptions &options) {
+    std::vector<std::byte> data;
+    std::streamsize read = 0;
+    do {
+        size_t size = data.size();
+        data.resize(size + ReadChunkSize);
+        read = input.rdbuf()->sgetn(reinterpret_cast<char *>(data.data() + size), ReadChunkSize);
+        data.resize(size + read);
+    } while (read == static_cast<std::streamsize>(ReadChunkSize));
+    return ReadScaled(PyramidFile(std::move(data)), options);
+}
+
+void PyramidCodec::Save(std::ostream &output, const PictureInfo &picture_info, LONG tile_size) {
+    if (tile_size == 0) {
+        tile_size = DefaultTileSize;
+    }
+    if (tile_size < 0 || tile_size % TileSizeStep != 0 || tile_size > MaxTileSize) {
+        throw InputDataException("Tile size must be a multiple of 16");
+    }
+    LONG height = static_cast<LONG>(picture_info.pixels.size());
+    LONG width = static_cast<LONG>(picture_info.pixels.empty() ? 0 : picture_info.pixels[0].size());
+    if (width == 0 || height == 0) {
+        throw InputDataException("Empty image");
+    }
+
+    std::vector<PyramidLevel> levels = PlanLevels(width, height, tile_size);
+    // Rows of every level from the top; level 0 is the image itself, the reduced ones are kept in reduced.
+    std::vector<std::vector<const Pixel *> > rows(levels.size());
+    std::vector<std::vector<std::vector<Pixel> > > reduced(levels.size());
+    for (LONG y = 0; y < height; ++y) {
+        rows[0].push_back(picture_info.pixels[picture_info.top_down ? y : height - 1 - y].data());
+    }
+    for (size_t level = 1; level < levels.size(); ++level) {
+        reduced[level] = Halve(rows[level - 1], levels[level - 1].width);
+        for (const std::vector<Pixel> &row : reduced[level]) {
+            rows[level].push_back(row.data());
+        }
+    }
+
+    uint64_t offset = Align(HeaderSize);
+    std::vector<std::byte> header;
+    header.insert(header.end(), reinterpret_cast<const std::byte *>(Signature),
+                  reinterpret_cast<const std::byte *>(Signature) + sizeof(Signature));
+    AppendLittleEndian(header, Version, 2);
+    AppendLittleEndian(header, picture_info.bmi_header.biBitCount, 2);
+    AppendLittleEndian(header, width, 4);
+    AppendLittleEndian(header, height, 4);
+    AppendLittleEndian(header, tile_size, 2);
+    AppendLittleEndian(header, levels.size(), 2);
+    // The layout is known in advance, so the index can go after the tiles and the file is written in one pass.
+    std::vector<TileRect> tiles;
+    uint64_t index_offset = offset;
+    for (const PyramidLevel &level : levels) {
+        for (const TileRect &rect : TileScheduler::Grid(level.width, level.height, tile_size, tile_size)) {
+            index_offset = Align(index_offset + static_cast<uint64_t>(rect.width) * rect.height * sizeof(Pixel));
+            tiles.push_back(rect);
+        }
+    }
+    AppendLittleEndian(header, tiles.size(), 4);
+    AppendLittleEndian(header, index_offset, 8);
+    header.resize(offset);
+    output.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+
+    std::vector<std::byte> index;
+    for (const PyramidLevel &level : levels) {
+        AppendLittleEndian(index, level.width, 4);
+        AppendLittleEndian(index, level.height, 4);
+        AppendLittleEndian(index, level.tiles_across, 4);
+        AppendLittleEndian(index, level.first_tile, 4);
+    }
+    std::vector<std::byte> tile;
+    const char padding[TileAlignment] = {};
+    for (size_t level = 0; level < levels.size(); ++level) {
+        for (size_t number = 0; number < TileCount(levels[level], tile_size); ++number) {
+            const TileRect &rect = tiles[levels[level].first_tile + number];
+            tile.resize(static_cast<size_t>(rect.width) * rect.height * sizeof(Pixel));
+            for (LONG row = 0; row < rect.height; ++row) {
+                std::memcpy(tile.data() + static_cast<size_t>(row) * rect.width * sizeof(Pixel),
+                            rows[level][rect.y + row] + rect.x, rect.width * sizeof(Pixel));
+            }
+            output.write(reinterpret_cast<const char *>(tile.data()), static_cast<std::streamsize>(tile.size()));
+            uint64_t end = offset + tile.size();
+            output.write(padding, static_cast<std::streamsize>(Align(end) - end));
+            AppendLittleEndian(index, offset, 8);
+            AppendLittleEndian(index, tile.size(), 4);
+            AppendLittleEndian(index, Checksums::Crc32(tile), 4);
+            offset = Align(end);
+        }
+    }
+    AppendLittleEndian(index, Checksums::Crc32(index), 4);
+    output.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(index.size()));
+    if (!output.flush()) {
+        throw InputDataException("Can't write the output");
+    }
+}
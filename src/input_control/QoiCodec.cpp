@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+#include "Exceptions.h"
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/QoiCodec.h"
+
+namespace {
+constexpr char Magic[] = {'q', 'o', 'i', 'f'};
+constexpr size_t HeaderSize = 14;
+constexpr size_t WidthOffset = 4;
+constexpr size_t HeightOffset = 8;
+constexpr size_t ChannelsOffset = 12;
+constexpr BYTE RgbChannels = 3;
+constexpr BYTE RgbaChannels = 4;
+constexpr WORD TrueColorBits = 24;
+
+constexpr BYTE OpIndex = 0x00;
+constexpr BYTE OpDiff = 0x40;
+constexpr BYTE OpLuma = 0x80;
+constexpr BYTE OpRun = 0xc0;
+constexpr BYTE OpRgb = 0xfe;
+constexpr BYTE OpRgba = 0xff;
+constexpr BYTE OpMask = 0xc0;
+constexpr BYTE PayloadMask = 0x3f;
+constexpr int MaxRun = 62;
+constexpr int DiffBias = 2;
+constexpr int LumaGreenBias = 32;
+constexpr int LumaBias = 8;
+constexpr size_t IndexSize = 64;
+constexpr char EndMarker[] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+size_t Hash(const Pixel &pixel) {
+    return (pixel.red * 3 + pixel.green * 5 + pixel.blue * 7 + pixel.alpha * 11) % IndexSize;
+}
+
+bool SameColor(const Pixel &lhs, const Pixel &rhs) {
+    return std::bit_cast<uint32_t>(lhs) == std::bit_cast<uint32_t>(rhs);
+}
+
+DWORD ReadBigEndian(const unsigned char *bytes) {
+    return DWORD{bytes[0]} << 24 | DWORD{bytes[1]} << 16 | DWORD{bytes[2]} << 8 | DWORD{bytes[3]};
+}
+
+void WriteBigEndian(DWORD value, char *bytes) {
+    for (int index = 0; index < 4; ++index) {
+        bytes[index] = static_cast<char>(value >> (24 - 8 * index));
+    }
+}
+
+// Decoder state lives between rows, because runs and the colour index continue across them.
+class QoiDecoder {
+public:
+    explicit QoiDecoder(std::istream &input) : buffer_(input.rdbuf()) {
+    }
+
+    void DecodeRow(std::vector<Pixel> &row) {
+        for (Pixel &pixel : row) {
+            if (run_ > 0) {
+                --run_;
+            } else {
+                DecodeChunk();
+            }
+            pixel = previous_;
+        }
+    }
+
+private:
+    std::streambuf *buffer_;
+    Pixel previous_{0, 0, 0, MaxAlpha};
+    Pixel index_[IndexSize] = {};
+    int run_ = 0;
+
+    BYTE Next() {
+        std::streambuf::int_type symbol = buffer_->sbumpc();
+        if (symbol == std::streambuf::traits_type::eof()) {
+            throw InputDataException("Unexpected end of file");
+        }
+        return static_cast<BYTE>(symbol);
+    }
+
+    void DecodeChunk() {
+        BYTE tag = Next();
+        if (tag == OpRgb || tag == OpRgba) {
+            previous_.red = Next();
+            previous_.green = Next();
+            previous_.blue = Next();
+            if (tag == OpRgba) {
+                previous_.alpha = Next();
+            }
+        } else if ((tag & OpMask) == OpIndex) {
+            previous_ = index_[tag & PayloadMask];
+        } else if ((tag & OpMask) == OpDiff) {
+            previous_.red = static_cast<BYTE>(previous_.red + ((tag >> 4) & 3) - DiffBias);
+            previous_.green = static_cast<BYTE>(previous_.green + ((tag >> 2) & 3) - DiffBias);
+            previous_.blue = static_cast<BYTE>(previous_.blue + (tag & 3) - DiffBias);
+        } else if ((tag & OpMask) == OpLuma) {
+            BYTE next = Next();
+            int green_diff = (tag & PayloadMask) - LumaGreenBias;
+            previous_.red = static_cast<BYTE>(previous_.red + green_diff - LumaBias + (next >> 4));
+            previous_.green = static_cast<BYTE>(previous_.green + green_diff);
+            previous_.blue = static_cast<BYTE>(previous_.blue + green_diff - LumaBias + (next & 0x0f));
+        } else {
+            // The pixel is repeated once here and run_ more times.
+            run_ = tag & PayloadMask;
+        }
+        index_[Hash(previous_)] = previous_;
+    }
+};
+
+class QoiEncoder {
+public:
+    QoiEncoder(std::ostream &output, bool alpha) : output_(output), alpha_(alpha) {
+    }
+
+    void EncodeRow(const std::vector<Pixel> &row) {
+        for (Pixel pixel : row) {
+            if (!alpha_) {
+                pixel.alpha = MaxAlpha;
+            }
+            if (SameColor(pixel, previous_)) {
+                if (++run_ == MaxRun) {
+                    FlushRun();
+                }
+                continue;
+            }
+            FlushRun();
+            EncodePixel(pixel);
+            previous_ = pixel;
+        }
+        Flush();
+    }
+
+    void Finish() {
+        FlushRun();
+        chunk_.insert(chunk_.end(), std::begin(EndMarker), std::end(EndMarker));
+        Flush();
+    }
+
+private:
+    std::ostream &output_;
+    bool alpha_;
+    std::vector<char> chunk_;
+    Pixel previous_{0, 0, 0, MaxAlpha};
+    Pixel index_[IndexSize] = {};
+    int run_ = 0;
+
+    void Put(int byte) {
+        chunk_.push_back(static_cast<char>(byte));
+    }
+
+    void Flush() {
+        output_.write(chunk_.data(), static_cast<std::streamsize>(chunk_.size()));
+        chunk_.clear();
+    }
+
+    void FlushRun() {
+        if (run_ > 0) {
+            Put(OpRun | (run_ - 1));
+            run_ = 0;
+        }
+    }
+
+    void EncodePixel(const Pixel &pixel) {
+        size_t hash = Hash(pixel);
+        if (SameColor(index_[hash], pixel)) {
+            Put(OpIndex | static_cast<int>(hash));
+            return;
+        }
+        index_[hash] = pixel;
+
+        if (pixel.alpha != previous_.alpha) {
+            Put(OpRgba);
+            Put(pixel.red);
+            Put(pixel.green);
+            Put(pixel.blue);
+            Put(pixel.alpha);
+            return;
+        }
+        int red_diff = static_cast<signed char>(pixel.red - previous_.red);
+        int green_diff = static_cast<signed char>(pixel.green - previous_.green);
+        int blue_diff = static_cast<signed char>(pixel.blue - previous_.blue);
+        int red_green = red_diff - green_diff;
+        int blue_green = blue_diff - green_diff;
+
+        if (red_diff >= -DiffBias && red_diff < DiffBias && green_diff >= -DiffBias && green_diff < DiffBias &&
+            blue_diff >= -DiffBias && blue_diff < DiffBias) {
+            Put(OpDiff | (red_diff + DiffBias) << 4 | (green_diff + DiffBias) << 2 | (blue_diff + DiffBias));
+        } else if (green_diff >= -LumaGreenBias && green_diff < LumaGreenBias && red_green >= -LumaBias &&
+                   red_green < LumaBias && blue_green >= -LumaBias && blue_green < LumaBias) {
+            Put(OpLuma | (green_diff + LumaGreenBias));
+            Put((red_green + LumaBias) << 4 | (blue_green + LumaBias));
+        } else {
+            Put(OpRgb);
+            Put(pixel.red);
+            Put(pixel.green);
+            Put(pixel.blue);
+        }
+    }
+};
+}  // namespace
+
+PictureInfo QoiCodec::Load(std::istream &input) {
+    unsigned char header[HeaderSize];
+    if (!input.read(reinterpret_cast<char *>(header), HeaderSize) ||
+        !std::equal(std::begin(Magic), std::end(Magic), header)) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    DWORD width = ReadBigEndian(header + WidthOffset);
+    DWORD height = ReadBigEndian(header + HeightOffset);
+    BYTE channels = header[ChannelsOffset];
+    if (width == 0 || height == 0 || static_cast<uint64_t>(width) * height > MaxPixels) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    if (channels != RgbChannels && channels != RgbaChannels) {
+        throw InfoHeaderException("Only 3 and 4 channel images are supported");
+    }
+
+    PictureInfo picture_info = InputOutputProcessing::CreatePicture(
+        static_cast<LONG>(width), static_cast<LONG>(height),
+        channels == RgbaChannels ? TrueColorAlphaBits : TrueColorBits, true);
+    QoiDecoder decoder(input);
+    for (std::vector<Pixel> &row : picture_info.pixels) {
+        decoder.DecodeRow(row);
+    }
+    return picture_info;
+}
+
+void QoiCodec::Save(std::ostream &output, const PictureInfo &picture_info) {
+    LONG height = static_cast<LONG>(picture_info.pixels.size());
+    LONG width = static_cast<LONG>(picture_info.pixels.empty() ? 0 : picture_info.pixels[0].size());
+    bool alpha = picture_info.bmi_header.biBitCount == TrueColorAlphaBits;
+
+    char header[HeaderSize] = {};
+    std::memcpy(header, Magic, sizeof(Magic));
+    WriteBigEndian(static_cast<DWORD>(width), header + WidthOffset);
+    WriteBigEndian(static_cast<DWORD>(height), header + HeightOffset);
+    header[ChannelsOffset] = static_cast<char>(alpha ? RgbaChannels : RgbChannels);
+    output.write(header, HeaderSize);
+
+    // QOI is always top-down, a bottom-up image is encoded starting from its last row.
+    QoiEncoder encoder(output, alpha);
+    for (LONG y = 0; y < height; ++y) {
+        encoder.EncodeRow(picture_info.pixels[picture_info.top_down ? y : height - 1 - y]);
+    }
+    encoder.Finish();
+    if (!output.flush()) {
+        throw InputDataException("Can't write the output");
+    }
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Exceptions.h"
+#include "input_control/Checksums.h"
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/MappedFile.h"
+#include "input_control/ResultCache.h"
+
+namespace {
+constexpr const char *TemporarySuffix = ".tmp";
+
+bool IsTemporary(const std::filesystem::path &path) {
+    return path.extension() == TemporarySuffix;
+}
+}  // namespace
+
+ResultCache::ResultCache(std::filesystem::path directory, uintmax_t limit)
+    : directory_(std::move(directory)), limit_(limit) {
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    if (error || !std::filesystem::is_directory(directory_)) {
+        throw InputDataException("Can't create the cache directory");
+    }
+}
+
+uint64_t ResultCache::HashFile(const std::string &input_path) {
+    MappedFile input(input_path);
+    return Checksums::Hash64(input.Data());
+}
+
+uint64_t ResultCache::Key(uint64_t input_hash, const std::string &recipe) {
+    return Checksums::Hash64(std::as_bytes(std::span(recipe)), input_hash);
+}
+
+std::filesystem::path ResultCache::EntryPath(uint64_t key) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return directory_ / name;
+}
+
+bool ResultCache::Fetch(uint64_t key, const std::string &output_path) {
+    std::filesystem::path entry = EntryPath(key);
+    std::error_code error;
+    // Marking the entry used also tells whether it is there; another process may remove it right after that,
+    // and then the copy fails and the result is made again.
+    std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), error);
+    if (!error) {
+        try {
+            InputOutputProcessing::CopyWholeFile(entry.string(), output_path);
+            ++hits_;
+            return true;
+        } catch (InputDataException &) {
+        }
+    }
+    ++misses_;
+    return false;
+}
+
+void ResultCache::Store(uint64_t key, const std::string &output_path) {
+    std::filesystem::path entry = EntryPath(key);
+    std::filesystem::path temporary = entry;
+    temporary += "." + std::to_string(getpid()) + TemporarySuffix;
+    InputOutputProcessing::CopyWholeFile(output_path, temporary.string());
+    std::error_code error;
+    std::filesystem::rename(temporary, entry, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    Evict();
+}
+
+void ResultCache::Evict() {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(directory_, error)) {
+        std::error_code file_error;
+        if (!file.is_regular_file(file_error) || IsTemporary(file.path())) {
+            continue;
+        }
+        Entry entry{file.path(), file.last_write_time(file_error), file.file_size(file_error)};
+        if (!file_error) {
+            total += entry.size;
+            entries.push_back(std::move(entry));
+        }
+    }
+    if (total <= limit_) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry &lhs, const Entry &rhs) { return lhs.used < rhs.used; });
+    for (const Entry &entry : entries) {
+        if (total <= limit_) {
+            break;
+        }
+        // An entry that another process has already removed frees its space all the same.
+        std::filesystem::remove(entry.path, error);
+        total -= entry.size;
+        ++evictions_;
+    }
+}
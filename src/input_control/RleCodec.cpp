@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <string>
+
+#include "Exceptions.h"
+#include "input_control/RleCodec.h"
+
+namespace {
+constexpr BYTE EndOfLine = 0;
+constexpr BYTE EndOfBitmap = 1;
+constexpr BYTE Delta = 2;
+constexpr size_t MaxRun = 255;
+// Shorter literal sequences can't use absolute mode and are written as runs of length one or two.
+constexpr size_t MinAbsolute = 3;
+constexpr WORD Rle8Bits = 8;
+constexpr int NibbleBits = 4;
+constexpr BYTE NibbleMask = 0x0f;
+
+class SpanReader {
+public:
+    explicit SpanReader(std::span<const std::byte> data) : data_(data) {
+    }
+
+    BYTE Next() {
+        if (position_ >= data_.size()) {
+            throw InputDataException("Unexpected end of RLE data");
+        }
+        return static_cast<BYTE>(data_[position_++]);
+    }
+
+private:
+    std::span<const std::byte> data_;
+    size_t position_ = 0;
+};
+
+class StreamReader {
+public:
+    explicit StreamReader(std::istream &input) : buffer_(input.rdbuf()) {
+    }
+
+    BYTE Next() {
+        std::streambuf::int_type symbol = buffer_->sbumpc();
+        if (symbol == std::streambuf::traits_type::eof()) {
+            throw InputDataException("Unexpected end of RLE data");
+        }
+        return static_cast<BYTE>(symbol);
+    }
+
+private:
+    std::streambuf *buffer_;
+};
+
+template <class Reader>
+void DecodeRle(Reader &reader, WORD bit_count, const std::vector<Pixel> &palette,
+               std::vector<std::vector<Pixel> > &pixels) {
+    for (std::vector<Pixel> &row : pixels) {
+        std::fill(row.begin(), row.end(), palette[0]);
+    }
+    size_t width = pixels.empty() ? 0 : pixels[0].size();
+    size_t x = 0;
+    size_t y = 0;
+
+    while (y < pixels.size()) {
+        BYTE count = reader.Next();
+        BYTE value = reader.Next();
+        std::vector<Pixel> &row = pixels[y];
+
+        if (count > 0) {
+            size_t end = std::min(width, x + count);
+            if (bit_count == Rle8Bits) {
+                std::fill(row.begin() + static_cast<std::ptrdiff_t>(std::min(x, end)),
+                          row.begin() + static_cast<std::ptrdiff_t>(end), palette[value]);
+            } else {
+                const Pixel colors[2] = {palette[value >> NibbleBits], palette[value & NibbleMask]};
+                for (size_t column = x; column < end; ++column) {
+                    row[column] = colors[(column - x) & 1];
+                }
+            }
+            x += count;
+        } else if (value == EndOfLine) {
+            x = 0;
+            ++y;
+        } else if (value == EndOfBitmap) {
+            return;
+        } else if (value == Delta) {
+            x += reader.Next();
+            y += reader.Next();
+        } else if (bit_count == Rle8Bits) {
+            for (size_t index = 0; index < value; ++index, ++x) {
+                BYTE color = reader.Next();
+                if (x < width) {
+                    row[x] = palette[color];
+                }
+            }
+            if (value % 2 != 0) {
+                reader.Next();
+            }
+        } else {
+            size_t bytes = (value + 1) / 2;
+            for (size_t index = 0; index < bytes; ++index) {
+                BYTE colors = reader.Next();
+                if (x < width) {
+                    row[x] = palette[colors >> NibbleBits];
+                }
+                if (index * 2 + 1 < value && x + 1 < width) {
+                    row[x + 1] = palette[colors & NibbleMask];
+                }
+                x += 2;
+            }
+            x -= bytes * 2 - value;
+            if (bytes % 2 != 0) {
+                reader.Next();
+            }
+        }
+    }
+}
+
+size_t RunLength(std::span<const BYTE> indices, size_t start) {
+    size_t length = 1;
+    while (start + length < indices.size() && length < MaxRun && indices[start + length] == indices[start]) {
+        ++length;
+    }
+    return length;
+}
+
+void EmitRun(std::vector<std::byte> &output, size_t length, BYTE index, WORD bit_count) {
+    output.push_back(static_cast<std::byte>(length));
+    output.push_back(static_cast<std::byte>(bit_count == Rle8Bits ? index : index << NibbleBits | index));
+}
+
+void EmitAbsolute(std::vector<std::byte> &output, std::span<const BYTE> indices, WORD bit_count) {
+    output.push_back(static_cast<std::byte>(0));
+    output.push_back(static_cast<std::byte>(indices.size()));
+    size_t bytes = 0;
+    if (bit_count == Rle8Bits) {
+        for (BYTE index : indices) {
+            output.push_back(static_cast<std::byte>(index));
+        }
+        bytes = indices.size();
+    } else {
+        for (size_t index = 0; index < indices.size(); index += 2) {
+            BYTE low = index + 1 < indices.size() ? indices[index + 1] : 0;
+            output.push_back(static_cast<std::byte>(indices[index] << NibbleBits | low));
+        }
+        bytes = (indices.size() + 1) / 2;
+    }
+    if (bytes % 2 != 0) {
+        output.push_back(static_cast<std::byte>(0));
+    }
+}
+}  // namespace
+
+void RleCodec::Decode(std::span<const std::byte> data, WORD bit_count, const std::vector<Pixel> &palette,
+                      std::vector<std::vector<Pixel> > &pixels) {
+    SpanReader reader(data);
+    DecodeRle(reader, bit_count, palette, pixels);
+}
+
+void RleCodec::Decode(std::istream &input, WORD bit_count, const std::vector<Pixel> &palette,
+                      std::vector<std::vector<Pixel> > &pixels) {
+    StreamReader reader(input);
+    DecodeRle(reader, bit_count, palette, pixels);
+}
+
+void RleCodec::EncodeRow(std::span<const BYTE> indices, WORD bit_count, std::vector<std::byte> &output) {
+    size_t x = 0;
+    while (x < indices.size()) {
+        size_t run = RunLength(indices, x);
+        if (run >= MinAbsolute) {
+            EmitRun(output, run, indices[x], bit_count);
+            x += run;
+            continue;
+        }
+
+        size_t start = x;
+        while (x < indices.size() && x - start < MaxRun && RunLength(indices, x) < MinAbsolute) {
+            x += std::min(RunLength(indices, x), MaxRun - (x - start));
+        }
+        if (x - start >= MinAbsolute) {
+            EmitAbsolute(output, indices.subspan(start, x - start), bit_count);
+            continue;
+        }
+        for (size_t position = start; position < x; position += RunLength(indices.first(x), position)) {
+            EmitRun(output, RunLength(indices.first(x), position), indices[position], bit_count);
+        }
+    }
+    output.push_back(static_cast<std::byte>(0));
+    output.push_back(static_cast<std::byte>(EndOfLine));
+}
+
+void RleCodec::EncodeEnd(std::vector<std::byte> &output) {
+    output.push_back(static_cast<std::byte>(0));
+    output.push_back(static_cast<std::byte>(EndOfBitmap));
+}
@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string_view>
+
+#include <fcntl.h>
+
+#include "Exceptions.h"
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/TiffCodec.h"
+
+namespace {
+constexpr size_t HeaderSize = 8;
+constexpr size_t EntrySize = 12;
+constexpr WORD ClassicMagic = 42;
+constexpr WORD BigTiffMagic = 43;
+constexpr uint32_t MaxValues = 1 << 24;
+constexpr uint64_t MaxFileSize = UINT32_MAX;
+// Strips are about this size, like most writers make them.
+constexpr size_t StripSize = 1 << 16;
+constexpr LONG TileSizeStep = 16;
+constexpr WORD SampleBits = 8;
+constexpr WORD GrayBits = 8;
+constexpr WORD TrueColorBits = 24;
+
+constexpr WORD TypeByte = 1;
+constexpr WORD TypeShort = 3;
+constexpr WORD TypeLong = 4;
+
+constexpr WORD TagImageWidth = 256;
+constexpr WORD TagImageLength = 257;
+constexpr WORD TagBitsPerSample = 258;
+constexpr WORD TagCompression = 259;
+constexpr WORD TagPhotometric = 262;
+constexpr WORD TagStripOffsets = 273;
+constexpr WORD TagSamplesPerPixel = 277;
+constexpr WORD TagRowsPerStrip = 278;
+constexpr WORD TagStripByteCounts = 279;
+constexpr WORD TagPlanarConfiguration = 284;
+constexpr WORD TagTileWidth = 322;
+constexpr WORD TagTileLength = 323;
+constexpr WORD TagTileOffsets = 324;
+constexpr WORD TagTileByteCounts = 325;
+constexpr WORD TagExtraSamples = 338;
+
+constexpr uint32_t WhiteIsZero = 0;
+constexpr uint32_t BlackIsZero = 1;
+constexpr uint32_t PhotometricRgb = 2;
+constexpr uint32_t UnassociatedAlpha = 2;
+
+constexpr int GrayDepth = 1;
+constexpr int GrayAlphaDepth = 2;
+constexpr int RgbDepth = 3;
+constexpr int RgbaDepth = 4;
+
+struct Entry {
+    WORD tag;
+    WORD type;
+    std::vector<uint32_t> values;
+};
+
+uint32_t Single(const std::map<WORD, std::vector<uint32_t> > &tags, WORD tag, uint32_t default_value) {
+    auto found = tags.find(tag);
+    if (found == tags.end()) {
+        return default_value;
+    }
+    if (found->second.empty()) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    return found->second[0];
+}
+
+void ExpandRow(const BYTE *samples, int depth, bool white_is_zero, Pixel *row, LONG width) {
+    BYTE invert = white_is_zero ? MaxColor : 0;
+    for (LONG x = 0; x < width; ++x, samples += depth) {
+        if (depth <= GrayAlphaDepth) {
+            BYTE gray = samples[0] ^ invert;
+            row[x] = Pixel{gray, gray, gray, depth == GrayAlphaDepth ? samples[1] : MaxAlpha};
+        } else {
+            row[x] = Pixel{samples[2], samples[1], samples[0], depth == RgbaDepth ? samples[3] : MaxAlpha};
+        }
+    }
+}
+
+void PackRow(const Pixel *row, LONG width, int depth, BYTE *samples) {
+    for (LONG x = 0; x < width; ++x) {
+        if (depth == GrayDepth) {
+            *samples++ = row[x].red;
+            continue;
+        }
+        *samples++ = row[x].red;
+        *samples++ = row[x].green;
+        *samples++ = row[x].blue;
+        if (depth == RgbaDepth) {
+            *samples++ = row[x].alpha;
+        }
+    }
+}
+
+bool IsGrayImage(const PictureInfo &picture_info) {
+    for (const std::vector<Pixel> &row : picture_info.pixels) {
+        for (const Pixel &pixel : row) {
+            if (pixel.red != pixel.green || pixel.red != pixel.blue) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void AppendLittleEndian(std::vector<BYTE> &output, uint32_t value, size_t size) {
+    for (size_t index = 0; index < size; ++index) {
+        output.push_back(static_cast<BYTE>(value >> (8 * index)));
+    }
+}
+
+// The IFD and the values that don't fit into its entries, which go right after it.
+std::vector<BYTE> EncodeDirectory(const std::vector<Entry> &entries, uint32_t offset) {
+    std::vector<BYTE> directory;
+    std::vector<BYTE> extra;
+    uint32_t extra_offset = offset + 2 + static_cast<uint32_t>(entries.size() * EntrySize) + 4;
+    AppendLittleEndian(directory, static_cast<uint32_t>(entries.size()), 2);
+    for (const Entry &entry : entries) {
+        size_t value_size = entry.type == TypeShort ? 2 : 4;
+        AppendLittleEndian(directory, entry.tag, 2);
+        AppendLittleEndian(directory, entry.type, 2);
+        AppendLittleEndian(directory, static_cast<uint32_t>(entry.values.size()), 4);
+        std::vector<BYTE> values;
+        for (uint32_t value : entry.values) {
+            AppendLittleEndian(values, value, value_size);
+        }
+        if (values.size() <= 4) {
+            values.resize(4, 0);
+            directory.insert(directory.end(), values.begin(), values.end());
+        } else {
+            AppendLittleEndian(directory, extra_offset + static_cast<uint32_t>(extra.size()), 4);
+            extra.insert(extra.end(), values.begin(), values.end());
+        }
+    }
+    AppendLittleEndian(directory, 0, 4);
+    directory.insert(directory.end(), extra.begin(), extra.end());
+    return directory;
+}
+}  // namespace
+
+TiffFile::TiffFile(const std::string &file_path) : fd_(open(file_path.c_str(), O_RDONLY)) {
+    if (fd_.Get() < 0) {
+        throw InputDataException("Wrong file path");
+    }
+    ReadDirectory();
+}
+
+TiffFile::TiffFile(std::vector<BYTE> data) : data_(std::move(data)) {
+    ReadDirectory();
+}
+
+void TiffFile::ReadAt(uint64_t offset, size_t size, void *output) const {
+    if (fd_.Get() < 0) {
+        if (offset > data_.size() || size > data_.size() - offset) {
+            throw InputDataException("Unexpected end of file");
+        }
+        std::memcpy(output, data_.data() + offset, size);
+        return;
+    }
+    char *bytes = static_cast<char *>(output);
+    while (size > 0) {
+        ssize_t done = pread(fd_.Get(), bytes, size, static_cast<off_t>(offset));
+        if (done <= 0) {
+            throw InputDataException("Unexpected end of file");
+        }
+        bytes += done;
+        offset += done;
+        size -= done;
+    }
+}
+
+void TiffFile::ReadDirectory() {
+    BYTE header[HeaderSize];
+    ReadAt(0, HeaderSize, header);
+    if (header[0] == TiffCodec::MagicLittle && header[1] == TiffCodec::MagicLittle) {
+        big_endian_ = false;
+    } else if (header[0] == TiffCodec::MagicBig && header[1] == TiffCodec::MagicBig) {
+        big_endian_ = true;
+    } else {
+        throw FileHeaderException("Incorrect file format");
+    }
+    auto read16 = [this](const BYTE *bytes) {
+        return static_cast<WORD>(big_endian_ ? bytes[0] << 8 | bytes[1] : bytes[1] << 8 | bytes[0]);
+    };
+    auto read32 = [this, &read16](const BYTE *bytes) {
+        return big_endian_ ? uint32_t{read16(bytes)} << 16 | read16(bytes + 2)
+                           : uint32_t{read16(bytes + 2)} << 16 | read16(bytes);
+    };
+    WORD magic = read16(header + 2);
+    if (magic == BigTiffMagic) {
+        throw InfoHeaderException("BigTIFF files are not supported");
+    }
+    if (magic != ClassicMagic) {
+        throw FileHeaderException("Incorrect file format");
+    }
+
+    uint32_t directory_offset = read32(header + 4);
+    BYTE count_bytes[2];
+    ReadAt(directory_offset, sizeof(count_bytes), count_bytes);
+    std::vector<BYTE> entries(read16(count_bytes) * EntrySize);
+    ReadAt(directory_offset + sizeof(count_bytes), entries.size(), entries.data());
+
+    // Only the tags the reader understands are kept, with their values as numbers.
+    std::map<WORD, std::vector<uint32_t> > tags;
+    for (size_t position = 0; position < entries.size(); position += EntrySize) {
+        const BYTE *entry = entries.data() + position;
+        WORD tag = read16(entry);
+        WORD type = read16(entry + 2);
+        uint32_t count = read32(entry + 4);
+        bool known = tag == TagImageWidth || tag == TagImageLength || tag == TagBitsPerSample ||
+                     tag == TagCompression || tag == TagPhotometric || tag == TagStripOffsets ||
+                     tag == TagSamplesPerPixel || tag == TagRowsPerStrip || tag == TagStripByteCounts ||
+                     tag == TagPlanarConfiguration || tag == TagTileWidth || tag == TagTileLength ||
+                     tag == TagTileOffsets || tag == TagTileByteCounts;
+        if (!known) {
+            continue;
+        }
+        // A known tag always carries at least one value.
+        if ((type != TypeByte && type != TypeShort && type != TypeLong) || count == 0 || count > MaxValues) {
+            throw FileHeaderException("Incorrect file format");
+        }
+        size_t value_size = type == TypeByte ? 1 : type == TypeShort ? 2 : 4;
+        std::vector<BYTE> raw(count * value_size);
+        if (raw.size() <= 4) {
+            std::memcpy(raw.data(), entry + 8, raw.size());
+        } else {
+            ReadAt(read32(entry + 8), raw.size(), raw.data());
+        }
+        std::vector<uint32_t> &values = tags[tag];
+        for (size_t index = 0; index < count; ++index) {
+            const BYTE *value = raw.data() + index * value_size;
+            values.push_back(value_size == 1 ? value[0] : value_size == 2 ? read16(value) : read32(value));
+        }
+    }
+
+    uint32_t width = Single(tags, TagImageWidth, 0);
+    uint32_t height = Single(tags, TagImageLength, 0);
+    if (width == 0 || height == 0 || static_cast<uint64_t>(width) * height > MaxPixels) {
+        throw FileHeaderException("Incorrect file size");
+    }
+    width_ = static_cast<LONG>(width);
+    height_ = static_cast<LONG>(height);
+    samples_ = static_cast<int>(Single(tags, TagSamplesPerPixel, 1));
+    if (samples_ < GrayDepth || samples_ > RgbaDepth) {
+        throw InfoHeaderException("Only 1 to 4 samples per pixel are supported");
+    }
+    std::vector<uint32_t> bits = tags.contains(TagBitsPerSample) ? tags[TagBitsPerSample] : std::vector<uint32_t>{1};
+    if (std::any_of(bits.begin(), bits.end(), [](uint32_t value) { return value != SampleBits; })) {
+        throw InfoHeaderException("Only 8-bit samples are supported");
+    }
+    if (Single(tags, TagCompression, 1) != 1) {
+        throw InfoHeaderException("Only uncompressed TIFF images are supported");
+    }
+    if (Single(tags, TagPlanarConfiguration, 1) != 1) {
+        throw InfoHeaderException("Only interleaved samples are supported");
+    }
+    uint32_t photometric = Single(tags, TagPhotometric, samples_ >= RgbDepth ? PhotometricRgb : BlackIsZero);
+    bool gray = photometric == WhiteIsZero || photometric == BlackIsZero;
+    if ((samples_ <= GrayAlphaDepth) != gray || (!gray && photometric != PhotometricRgb)) {
+        throw InfoHeaderException("Only gray and RGB TIFF images are supported");
+    }
+    white_is_zero_ = photometric == WhiteIsZero;
+
+    bool tiled = tags.contains(TagTileWidth);
+    if (tiled) {
+        tile_width_ = static_cast<LONG>(Single(tags, TagTileWidth, 0));
+        tile_height_ = static_cast<LONG>(Single(tags, TagTileLength, 0));
+        offsets_ = tags[TagTileOffsets];
+        byte_counts_ = tags[TagTileByteCounts];
+    } else {
+        tile_width_ = width_;
+        tile_height_ = static_cast<LONG>(std::min(Single(tags, TagRowsPerStrip, height), height));
+        offsets_ = tags[TagStripOffsets];
+        byte_counts_ = tags[TagStripByteCounts];
+    }
+    if (tile_width_ <= 0 || tile_height_ <= 0) {
+        throw FileHeaderException("Incorrect file format");
+    }
+    // The tile size comes from the file and may be close to the LONG limit.
+    size_t across = (static_cast<size_t>(width_) + tile_width_ - 1) / tile_width_;
+    size_t down = (static_cast<size_t>(height_) + tile_height_ - 1) / tile_height_;
+    if (offsets_.size() != across * down || byte_counts_.size() != offsets_.size()) {
+        throw FileHeaderException("Incorrect file format");
+    }
+}
+
+WORD TiffFile::BitCount() const {
+    if (samples_ == GrayAlphaDepth || samples_ == RgbaDepth) {
+        return TrueColorAlphaBits;
+    }
+    return samples_ == GrayDepth ? GrayBits : TrueColorBits;
+}
+
+TileRect TiffFile::Tile(size_t index) const {
+    size_t across = (static_cast<size_t>(width_) + tile_width_ - 1) / tile_width_;
+    LONG x = static_cast<LONG>(index % across) * tile_width_;
+    LONG y = static_cast<LONG>(index / across) * tile_height_;
+    return TileRect{x, y, std::min(tile_width_, width_ - x), std::min(tile_height_, height_ - y)};
+}
+
+void TiffFile::ReadTile(size_t index, PictureInfo &picture_info) const {
+    TileRect rect = Tile(index);
+    // Tiles are stored padded to the full tile size, strips as wide as the image; only the part up to
+    // the last used sample is needed.
+    size_t stored_row = static_cast<size_t>(tile_width_) * samples_;
+    size_t size = (rect.height - 1) * stored_row + static_cast<size_t>(rect.width) * samples_;
+    if (byte_counts_[index] < size) {
+        throw InputDataException("Unexpected end of data");
+    }
+    std::vector<BYTE> samples(size);
+    ReadAt(offsets_[index], size, samples.data());
+    for (LONG row = 0; row < rect.height; ++row) {
+        ExpandRow(samples.data() + row * stored_row, samples_, white_is_zero_,
+                  picture_info.pixels[rect.y + row].data() + rect.x, rect.width);
+    }
+}
+
+bool TiffCodec::IsTiffFile(const std::string &file_path) {
+    std::ifstream file(file_path, std::ios::binary);
+    char header[4] = {};
+    if (!file.read(header, sizeof(header))) {
+        return false;
+    }
+    return std::string_view(header, sizeof(header)) == std::string_view("II*\0", 4) ||
+           std::string_view(header, sizeof(header)) == std::string_view("MM\0*", 4);
+}
+
+PictureInfo TiffCodec::Load(std::istream &input) {
+    // The offsets in the file may point anywhere, so a stream that can't seek is read whole first.
+    std::vector<BYTE> data;
+    std::streamsize read = 0;
+    do {
+        size_t size = data.size();
+        data.resize(size + StripSize);
+        read = input.rdbuf()->sgetn(reinterpret_cast<char *>(data.data() + size), StripSize);
+        data.resize(size + read);
+    } while (read == static_cast<std::streamsize>(StripSize));
+    TiffFile file(std::move(data));
+    PictureInfo picture_info = InputOutputProcessing::CreatePicture(file.Width(), file.Height(), file.BitCount(), true);
+    for (size_t index = 0; index < file.TileCount(); ++index) {
+        file.ReadTile(index, picture_info);
+    }
+    return picture_info;
+}
+
+PictureInfo TiffCodec::LoadFile(const std::string &file_path, const TileScheduler &scheduler,
+                                const PointFilter *tile_filter) {
+    TiffFile file(file_path);
+    PictureInfo picture_info = InputOutputProcessing::CreatePicture(file.Width(), file.Height(), file.BitCount(), true);
+    // Tiles never overlap, so the workers write to different pixels of the shared image.
+    scheduler.Run(file.TileCount(), [&file, &picture_info, tile_filter](size_t index) {
+        file.ReadTile(index, picture_info);
+        if (tile_filter != nullptr) {
+            TileRect rect = file.Tile(index);
+            for (LONG row = rect.y; row < rect.y + rect.height; ++row) {
+                tile_filter->ApplyToRow(picture_info.pixels[row].data() + rect.x, rect.width);
+            }
+        }
+    });
+    return picture_info;
+}
+
+void TiffCodec::Save(std::ostream &output, const PictureInfo &picture_info, LONG tile_size) {
+    if (tile_size < 0 || tile_size % TileSizeStep != 0) {
+        throw InputDataException("Tile size must be a multiple of 16");
+    }
+    LONG height = static_cast<LONG>(picture_info.pixels.size());
+    LONG width = static_cast<LONG>(picture_info.pixels.empty() ? 0 : picture_info.pixels[0].size());
+    int depth = RgbDepth;
+    if (picture_info.bmi_header.biBitCount == TrueColorAlphaBits) {
+        depth = RgbaDepth;
+    } else if (picture_info.bmi_header.biBitCount <= GrayBits && IsGrayImage(picture_info)) {
+        depth = GrayDepth;
+    }
+
+    bool tiled = tile_size > 0;
+    LONG tile_width = tiled ? tile_size : width;
+    LONG tile_height = tiled ? tile_size
+                             : std::clamp(static_cast<LONG>(StripSize / (static_cast<size_t>(width) * depth + 1)),
+                                          LONG{1}, std::max(height, LONG{1}));
+    std::vector<TileRect> tiles = TileScheduler::Grid(width, height, tile_width, tile_height);
+    size_t stored_row = static_cast<size_t>(tile_width) * depth;
+    uint64_t data_size = 0;
+    for (const TileRect &tile : tiles) {
+        data_size += stored_row * (tiled ? tile_height : tile.height);
+    }
+    if (HeaderSize + data_size + (data_size & 1) + tiles.size() * 8 + 1024 > MaxFileSize) {
+        throw InputDataException("Image is too large for TIFF");
+    }
+    // The IFD starts on a word boundary after the pixel data.
+    uint32_t directory_offset = static_cast<uint32_t>(HeaderSize + data_size + (data_size & 1));
+
+    std::vector<BYTE> header;
+    header.push_back(TiffCodec::MagicLittle);
+    header.push_back(TiffCodec::MagicLittle);
+    AppendLittleEndian(header, ClassicMagic, 2);
+    AppendLittleEndian(header, directory_offset, 4);
+    output.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> byte_counts;
+    uint32_t offset = HeaderSize;
+    std::vector<BYTE> samples;
+    for (const TileRect &tile : tiles) {
+        LONG stored_rows = tiled ? tile_height : tile.height;
+        samples.assign(stored_row * stored_rows, 0);
+        for (LONG row = 0; row < tile.height; ++row) {
+            LONG y = tile.y + row;
+            const std::vector<Pixel> &pixels = picture_info.pixels[picture_info.top_down ? y : height - 1 - y];
+            PackRow(pixels.data() + tile.x, tile.width, depth, samples.data() + row * stored_row);
+        }
+        output.write(reinterpret_cast<const char *>(samples.data()), static_cast<std::streamsize>(samples.size()));
+        offsets.push_back(offset);
+        byte_counts.push_back(static_cast<uint32_t>(samples.size()));
+        offset += static_cast<uint32_t>(samples.size());
+    }
+    if (data_size & 1) {
+        output.put(0);
+    }
+
+    std::vector<Entry> entries = {
+        {TagImageWidth, TypeLong, {static_cast<uint32_t>(width)}},
+        {TagImageLength, TypeLong, {static_cast<uint32_t>(height)}},
+        {TagBitsPerSample, TypeShort, std::vector<uint32_t>(depth, SampleBits)},
+        {TagCompression, TypeShort, {1}},
+        {TagPhotometric, TypeShort, {depth == GrayDepth ? BlackIsZero : PhotometricRgb}},
+    };
+    if (!tiled) {
+        entries.push_back({TagStripOffsets, TypeLong, offsets});
+    }
+    entries.push_back({TagSamplesPerPixel, TypeShort, {static_cast<uint32_t>(depth)}});
+    if (!tiled) {
+        entries.push_back({TagRowsPerStrip, TypeLong, {static_cast<uint32_t>(tile_height)}});
+        entries.push_back({TagStripByteCounts, TypeLong, byte_counts});
+    }
+    entries.push_back({TagPlanarConfiguration, TypeShort, {1}});
+    if (tiled) {
+        entries.push_back({TagTileWidth, TypeLong, {static_cast<uint32_t>(tile_width)}});
+        entries.push_back({TagTileLength, TypeLong, {static_cast<uint32_t>(tile_height)}});
+        entries.push_back({TagTileOffsets, TypeLong, offsets});
+        entries.push_back({TagTileByteCounts, TypeLong, byte_counts});
+    }
+    if (depth == RgbaDepth) {
+        entries.push_back({TagExtraSamples, TypeShort, {UnassociatedAlpha}});
+    }
+    std::vector<BYTE> directory = EncodeDirectory(entries, directory_offset);
+    output.write(reinterpret_cast<const char *>(directory.data()), static_cast<std::streamsize>(directory.size()));
+    if (!output.flush()) {
+        throw InputDataException("Can't write the output");
+    }
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <fstream>
+#include <span>
+
+#include "Exceptions.h"
+#include "input_control/Checksums.h"
+#include "input_control/TileHashes.h"
+
+namespace {
+constexpr char Magic[] = {'T', 'L', 'H', '1'};
+
+template <typename T>
+void HashTiles(const BasicPixelMatrix<T> &rows, const std::vector<TileRect> &tiles, std::vector<uint64_t> &hashes) {
+    for (const TileRect &tile : tiles) {
+        uint64_t hash = 0;
+        for (LONG y = tile.y; y < tile.y + tile.height; ++y) {
+            std::span<const BasicPixel<T> > row(rows[y].data() + tile.x, tile.width);
+            hash = Checksums::Hash64(std::as_bytes(row), hash);
+        }
+        hashes.push_back(hash);
+    }
+}
+
+template <typename T>
+void Write(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool Read(std::ifstream &file, T &value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+}  // namespace
+
+TileHashes TileHashes::Compute(const PictureInfo &picture_info, uint64_t recipe, LONG tile_size) {
+    TileHashes tile_hashes;
+    tile_hashes.recipe = recipe;
+    tile_hashes.width = picture_info.bmi_header.biWidth;
+    tile_hashes.height = picture_info.bmi_header.biHeight;
+    tile_hashes.deep = picture_info.Deep();
+    tile_hashes.top_down = picture_info.top_down;
+    tile_hashes.tile_size = tile_size;
+    std::vector<TileRect> tiles = tile_hashes.Tiles();
+    tile_hashes.hashes.reserve(tiles.size());
+    if (picture_info.Deep()) {
+        HashTiles(picture_info.deep_pixels, tiles, tile_hashes.hashes);
+    } else {
+        HashTiles(picture_info.pixels, tiles, tile_hashes.hashes);
+    }
+    return tile_hashes;
+}
+
+std::vector<TileRect> TileHashes::Tiles() const {
+    return TileScheduler::Grid(width, height, tile_size, tile_size);
+}
+
+std::optional<TileHashes> TileHashes::Load(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(Magic)];
+    TileHashes tile_hashes;
+    uint64_t count = 0;
+    if (!Read(file, magic) || !std::equal(magic, magic + sizeof(Magic), Magic) || !Read(file, tile_hashes.recipe) ||
+        !Read(file, tile_hashes.width) || !Read(file, tile_hashes.height) || !Read(file, tile_hashes.deep) ||
+        !Read(file, tile_hashes.top_down) || !Read(file, tile_hashes.tile_size) || !Read(file, count)) {
+        return std::nullopt;
+    }
+    if (tile_hashes.width < 0 || tile_hashes.height < 0 || tile_hashes.tile_size <= 0 ||
+        count != tile_hashes.Tiles().size()) {
+        return std::nullopt;
+    }
+    tile_hashes.hashes.resize(count);
+    if (!file.read(reinterpret_cast<char *>(tile_hashes.hashes.data()),
+                   static_cast<std::streamsize>(count * sizeof(uint64_t)))) {
+        return std::nullopt;
+    }
+    return tile_hashes;
+}
+
+void TileHashes::Save(const std::string &path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw InputDataException("Wrong file path");
+    }
+    file.write(Magic, sizeof(Magic));
+    Write(file, recipe);
+    Write(file, width);
+    Write(file, height);
+    Write(file, deep);
+    Write(file, top_down);
+    Write(file, tile_size);
+    Write(file, static_cast<uint64_t>(hashes.size()));
+    file.write(reinterpret_cast<const char *>(hashes.data()),
+               static_cast<std::streamsize>(hashes.size() * sizeof(uint64_t)));
+}
+
+bool TileHashes::Comparable(const TileHashes &previous) const {
+    return recipe == previous.recipe && width == previous.width && height == previous.height &&
+           deep == previous.deep && top_down == previous.top_down && tile_size == previous.tile_size &&
+           hashes.size() == previous.hashes.size();
+}
+
+std::vector<size_t> TileHashes::DirtyTiles(const TileHashes &previous, LONG halo) const {
+    LONG columns = (width + tile_size - 1) / tile_size;
+    LONG rows = (height + tile_size - 1) / tile_size;
+    // A tile is dirty if a changed tile is within halo pixels of it, that is at most this many tiles away.
+    LONG reach = (halo + tile_size - 1) / tile_size;
+    std::vector<bool> dirty(hashes.size(), false);
+    for (LONG row = 0; row < rows; ++row) {
+        for (LONG column = 0; column < columns; ++column) {
+            size_t index = static_cast<size_t>(row) * columns + column;
+            if (hashes[index] == previous.hashes[index]) {
+                continue;
+            }
+            for (LONG near_row = std::max(row - reach, 0); near_row <= std::min(row + reach, rows - 1); ++near_row) {
+                for (LONG near_column = std::max(column - reach, 0);
+                     near_column <= std::min(column + reach, columns - 1); ++near_column) {
+                    dirty[static_cast<size_t>(near_row) * columns + near_column] = true;
+                }
+            }
+        }
+    }
+    std::vector<size_t> indices;
+    for (size_t index = 0; index < dirty.size(); ++index) {
+        if (dirty[index]) {
+            indices.push_back(index);
+        }
+    }
+    return indices;
+}
@@ -0,0 +1,836 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+
+#include "Exceptions.h"
+#include "PictureInfo.h"
+#include "input_control/Checksums.h"
+#include "input_control/ZlibCodec.h"
+
+namespace {
+constexpr int MaxCodeBits = 15;
+constexpr int MaxCodeLengthBits = 7;
+// Codes up to this length are decoded with one table lookup, longer ones bit by bit.
+constexpr int FastBits = 10;
+constexpr int LiteralLengthSymbols = 288;
+constexpr int UsedLiteralLengthSymbols = 286;
+constexpr int DistanceSymbols = 30;
+constexpr int CodeLengthSymbols = 19;
+constexpr int EndOfBlock = 256;
+constexpr int FirstLengthSymbol = 257;
+constexpr int LengthSymbols = 29;
+constexpr int RepeatPrevious = 16;
+constexpr int RepeatZeros = 17;
+constexpr int RepeatManyZeros = 18;
+constexpr size_t MaxStoredBlock = 65535;
+
+constexpr WORD LengthBase[LengthSymbols] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                            31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr BYTE LengthExtra[LengthSymbols] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                             2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr WORD DistanceBase[DistanceSymbols] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,
+                                                33,  49,  65,  97,  129, 193,  257,  385,  513,  769,
+                                                1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr BYTE DistanceExtra[DistanceSymbols] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr BYTE CodeLengthOrder[CodeLengthSymbols] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+constexpr BYTE ZlibMethod = 8;
+constexpr BYTE ZlibHeader = 0x78;
+constexpr BYTE ZlibPresetDictionary = 0x20;
+constexpr int ZlibCheckDivisor = 31;
+
+constexpr int MinMatch = 3;
+constexpr int MaxMatch = 258;
+constexpr int WindowSize = 1 << 15;
+constexpr int HashBits = 15;
+// Matches of minimal length that far away cost more bits than the literals they replace.
+constexpr int TooFarForMinMatch = 4096;
+constexpr size_t BlockTokens = 1 << 15;
+
+// How hard the compressor looks for matches at each level. A match shorter than lazy_length is kept only
+// if the next position has no longer one; when it is at least good_length, that second search is shorter.
+struct LevelParameters {
+    int max_chain;
+    int nice_length;
+    int good_length;
+    int lazy_length;
+};
+
+constexpr LevelParameters Levels[ZlibCodec::MaxLevel + 1] = {
+    {0, 0, 0, 0},         {4, 8, 4, 0},         {8, 16, 4, 0},         {32, 32, 4, 0},      {16, 16, 4, 4},
+    {32, 32, 8, 16},      {128, 128, 8, 16},    {256, 128, 8, 32},     {1024, 258, 32, 128}, {4096, 258, 32, 258},
+};
+
+uint32_t ReverseBits(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int bit = 0; bit < length; ++bit, code >>= 1) {
+        reversed = reversed << 1 | (code & 1);
+    }
+    return reversed;
+}
+
+// Number of equal leading bytes, up to limit, compared a word at a time.
+int MatchLength(const std::byte *lhs, const std::byte *rhs, int limit) {
+    int length = 0;
+    if constexpr (std::endian::native == std::endian::little) {
+        for (; length + static_cast<int>(sizeof(uint64_t)) <= limit; length += sizeof(uint64_t)) {
+            uint64_t lhs_word = 0;
+            uint64_t rhs_word = 0;
+            std::memcpy(&lhs_word, lhs + length, sizeof(lhs_word));
+            std::memcpy(&rhs_word, rhs + length, sizeof(rhs_word));
+            if (lhs_word != rhs_word) {
+                return length + std::countr_zero(lhs_word ^ rhs_word) / 8;
+            }
+        }
+    }
+    while (length < limit && lhs[length] == rhs[length]) {
+        ++length;
+    }
+    return length;
+}
+
+[[noreturn]] void Broken() {
+    throw InputDataException("Broken compressed data");
+}
+
+class BitReader {
+public:
+    explicit BitReader(std::span<const std::byte> data) : data_(data) {
+    }
+
+    // The next count bits without consuming them; bits past the end of the data read as zeros.
+    uint32_t Peek(int count) {
+        if (available_ < count) {
+            Refill();
+        }
+        return static_cast<uint32_t>(bits_ & ((uint64_t{1} << count) - 1));
+    }
+
+    void Consume(int count) {
+        if (available_ < count) {
+            throw InputDataException("Unexpected end of compressed data");
+        }
+        bits_ >>= count;
+        available_ -= count;
+    }
+
+    uint32_t Read(int count) {
+        uint32_t value = Peek(count);
+        Consume(count);
+        return value;
+    }
+
+    void AlignToByte() {
+        Consume(available_ % 8);
+    }
+
+    // Copies count bytes of a stored block, the reader must be aligned to a byte.
+    void CopyBytes(std::byte *output, size_t count) {
+        for (; count > 0 && available_ >= 8; --count) {
+            *output++ = static_cast<std::byte>(Read(8));
+        }
+        if (count > data_.size() - position_) {
+            throw InputDataException("Unexpected end of compressed data");
+        }
+        std::memcpy(output, data_.data() + position_, count);
+        position_ += count;
+    }
+
+private:
+    std::span<const std::byte> data_;
+    size_t position_ = 0;
+    uint64_t bits_ = 0;
+    int available_ = 0;
+
+    void Refill() {
+        while (available_ <= 56 && position_ < data_.size()) {
+            bits_ |= static_cast<uint64_t>(data_[position_++]) << available_;
+            available_ += 8;
+        }
+    }
+};
+
+class HuffmanDecoder {
+public:
+    // lengths[symbol] is the code length of the symbol, 0 if it isn't used.
+    void Build(std::span<const BYTE> lengths) {
+        counts_.fill(0);
+        for (BYTE length : lengths) {
+            ++counts_[length];
+        }
+        counts_[0] = 0;
+        int left = 1;
+        for (int length = 1; length <= MaxCodeBits; ++length) {
+            left = (left << 1) - counts_[length];
+            if (left < 0) {
+                Broken();
+            }
+        }
+
+        std::array<WORD, MaxCodeBits + 2> offsets{};
+        for (int length = 1; length <= MaxCodeBits; ++length) {
+            offsets[length + 1] = offsets[length] + counts_[length];
+        }
+        symbols_.assign(offsets[MaxCodeBits + 1], 0);
+        for (size_t symbol = 0; symbol < lengths.size(); ++symbol) {
+            if (lengths[symbol] != 0) {
+                symbols_[offsets[lengths[symbol]]++] = static_cast<WORD>(symbol);
+            }
+        }
+
+        fast_.fill(0);
+        uint32_t code = 0;
+        size_t index = 0;
+        for (int length = 1; length <= FastBits; ++length) {
+            for (int count = 0; count < counts_[length]; ++count, ++code, ++index) {
+                WORD entry = static_cast<WORD>(symbols_[index] << 4 | length);
+                for (uint32_t slot = ReverseBits(code, length); slot < fast_.size(); slot += 1 << length) {
+                    fast_[slot] = entry;
+                }
+            }
+            code <<= 1;
+        }
+    }
+
+    int Decode(BitReader &reader) const {
+        uint32_t bits = reader.Peek(MaxCodeBits);
+        WORD entry = fast_[bits & (fast_.size() - 1)];
+        if (entry != 0) {
+            reader.Consume(entry & 0x0f);
+            return entry >> 4;
+        }
+        // Canonical decoding one bit at a time for the rare long codes.
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int length = 1; length <= MaxCodeBits; ++length) {
+            code |= static_cast<int>((bits >> (length - 1)) & 1);
+            if (code - first < counts_[length]) {
+                reader.Consume(length);
+                return symbols_[index + code - first];
+            }
+            index += counts_[length];
+            first = (first + counts_[length]) << 1;
+            code <<= 1;
+        }
+        Broken();
+    }
+
+private:
+    std::array<WORD, 1 << FastBits> fast_{};
+    std::array<WORD, MaxCodeBits + 1> counts_{};
+    std::vector<WORD> symbols_;
+};
+
+class Inflater {
+public:
+    Inflater(std::span<const std::byte> data, std::byte *output, size_t max_size)
+        : reader_(data), output_(output), max_size_(max_size) {
+    }
+
+    // Returns the size of the inflated data.
+    size_t Run() {
+        bool last = false;
+        while (!last) {
+            last = reader_.Read(1) != 0;
+            uint32_t type = reader_.Read(2);
+            if (type == 0) {
+                CopyStored();
+            } else if (type == 1) {
+                BuildFixed();
+                InflateBlock();
+            } else if (type == 2) {
+                ReadDynamic();
+                InflateBlock();
+            } else {
+                Broken();
+            }
+        }
+        return size_;
+    }
+
+    BitReader &Reader() {
+        return reader_;
+    }
+
+private:
+    BitReader reader_;
+    std::byte *output_;
+    size_t max_size_;
+    size_t size_ = 0;
+    HuffmanDecoder literals_;
+    HuffmanDecoder distances_;
+
+    void CopyStored() {
+        reader_.AlignToByte();
+        uint32_t length = reader_.Read(16);
+        if ((length ^ reader_.Read(16)) != 0xffff) {
+            Broken();
+        }
+        if (length > max_size_ - size_) {
+            throw InputDataException("Decompressed data is too long");
+        }
+        reader_.CopyBytes(output_ + size_, length);
+        size_ += length;
+    }
+
+    void BuildFixed() {
+        std::array<BYTE, LiteralLengthSymbols> lengths{};
+        std::fill(lengths.begin(), lengths.begin() + 144, 8);
+        std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+        std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+        std::fill(lengths.begin() + 280, lengths.end(), 8);
+        literals_.Build(lengths);
+        std::array<BYTE, DistanceSymbols> distance_lengths{};
+        distance_lengths.fill(5);
+        distances_.Build(distance_lengths);
+    }
+
+    void ReadDynamic() {
+        size_t literal_count = reader_.Read(5) + FirstLengthSymbol;
+        size_t distance_count = reader_.Read(5) + 1;
+        size_t code_length_count = reader_.Read(4) + 4;
+        if (literal_count > UsedLiteralLengthSymbols || distance_count > DistanceSymbols) {
+            Broken();
+        }
+
+        std::array<BYTE, CodeLengthSymbols> code_lengths{};
+        for (size_t index = 0; index < code_length_count; ++index) {
+            code_lengths[CodeLengthOrder[index]] = static_cast<BYTE>(reader_.Read(3));
+        }
+        HuffmanDecoder code_length_decoder;
+        code_length_decoder.Build(code_lengths);
+
+        std::array<BYTE, UsedLiteralLengthSymbols + DistanceSymbols> lengths{};
+        size_t total = literal_count + distance_count;
+        for (size_t index = 0; index < total;) {
+            int symbol = code_length_decoder.Decode(reader_);
+            if (symbol < RepeatPrevious) {
+                lengths[index++] = static_cast<BYTE>(symbol);
+                continue;
+            }
+            BYTE value = 0;
+            size_t repeat = 0;
+            if (symbol == RepeatPrevious) {
+                if (index == 0) {
+                    Broken();
+                }
+                value = lengths[index - 1];
+                repeat = 3 + reader_.Read(2);
+            } else if (symbol == RepeatZeros) {
+                repeat = 3 + reader_.Read(3);
+            } else {
+                repeat = 11 + reader_.Read(7);
+            }
+            if (index + repeat > total) {
+                Broken();
+            }
+            std::fill_n(lengths.begin() + static_cast<std::ptrdiff_t>(index), repeat, value);
+            index += repeat;
+        }
+        if (lengths[EndOfBlock] == 0) {
+            Broken();
+        }
+        literals_.Build(std::span<const BYTE>(lengths).first(literal_count));
+        distances_.Build(std::span<const BYTE>(lengths).subspan(literal_count, distance_count));
+    }
+
+    void InflateBlock() {
+        for (;;) {
+            int symbol = literals_.Decode(reader_);
+            if (symbol < EndOfBlock) {
+                if (size_ == max_size_) {
+                    throw InputDataException("Decompressed data is too long");
+                }
+                output_[size_++] = static_cast<std::byte>(symbol);
+                continue;
+            }
+            if (symbol == EndOfBlock) {
+                return;
+            }
+            symbol -= FirstLengthSymbol;
+            if (symbol >= LengthSymbols) {
+                Broken();
+            }
+            size_t length = LengthBase[symbol] + reader_.Read(LengthExtra[symbol]);
+            int distance_symbol = distances_.Decode(reader_);
+            if (distance_symbol >= DistanceSymbols) {
+                Broken();
+            }
+            size_t distance = DistanceBase[distance_symbol] + reader_.Read(DistanceExtra[distance_symbol]);
+            if (distance > size_) {
+                Broken();
+            }
+            if (length > max_size_ - size_) {
+                throw InputDataException("Decompressed data is too long");
+            }
+            // Byte by byte, because the source may overlap the bytes being written.
+            std::byte *to = output_ + size_;
+            const std::byte *from = to - distance;
+            for (size_t index = 0; index < length; ++index) {
+                to[index] = from[index];
+            }
+            size_ += length;
+        }
+    }
+};
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<std::byte> &output) : output_(output) {
+    }
+
+    void Write(uint32_t bits, int count) {
+        bits_ |= static_cast<uint64_t>(bits) << count_;
+        count_ += count;
+        while (count_ >= 8) {
+            output_.push_back(static_cast<std::byte>(bits_));
+            bits_ >>= 8;
+            count_ -= 8;
+        }
+    }
+
+    void AlignToByte() {
+        if (count_ > 0) {
+            Write(0, 8 - count_);
+        }
+    }
+
+    // Appends whole bytes, the writer must be aligned to a byte.
+    void Append(std::span<const std::byte> bytes) {
+        output_.insert(output_.end(), bytes.begin(), bytes.end());
+    }
+
+private:
+    std::vector<std::byte> &output_;
+    uint64_t bits_ = 0;
+    int count_ = 0;
+};
+
+// Huffman code lengths for the frequencies, none longer than max_length. If the optimal code is too deep,
+// the frequencies are flattened and the code is built again.
+std::vector<BYTE> BuildLengths(std::vector<uint32_t> frequencies, int max_length) {
+    std::vector<BYTE> lengths(frequencies.size(), 0);
+    std::vector<size_t> used;
+    for (size_t symbol = 0; symbol < frequencies.size(); ++symbol) {
+        if (frequencies[symbol] != 0) {
+            used.push_back(symbol);
+        }
+    }
+    // A code needs two symbols to be complete, the unused one simply never appears.
+    for (size_t symbol = 0; used.size() < 2; ++symbol) {
+        if (frequencies[symbol] == 0) {
+            frequencies[symbol] = 1;
+            used.push_back(symbol);
+        }
+    }
+
+    for (;;) {
+        struct Node {
+            uint64_t weight;
+            int left;
+            int right;
+        };
+        std::vector<Node> nodes;
+        using Entry = std::pair<uint64_t, int>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+        for (size_t symbol : used) {
+            queue.emplace(frequencies[symbol], static_cast<int>(nodes.size()));
+            nodes.push_back({frequencies[symbol], -1, static_cast<int>(symbol)});
+        }
+        while (queue.size() > 1) {
+            Entry first = queue.top();
+            queue.pop();
+            Entry second = queue.top();
+            queue.pop();
+            queue.emplace(first.first + second.first, static_cast<int>(nodes.size()));
+            nodes.push_back({first.first + second.first, first.second, second.second});
+        }
+
+        int deepest = 0;
+        std::vector<std::pair<int, int>> stack = {{queue.top().second, 0}};
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            if (nodes[node].left < 0) {
+                lengths[nodes[node].right] = static_cast<BYTE>(depth);
+                deepest = std::max(deepest, depth);
+            } else {
+                stack.emplace_back(nodes[node].left, depth + 1);
+                stack.emplace_back(nodes[node].right, depth + 1);
+            }
+        }
+        if (deepest <= max_length) {
+            return lengths;
+        }
+        for (size_t symbol : used) {
+            frequencies[symbol] = (frequencies[symbol] + 1) / 2;
+        }
+    }
+}
+
+// Canonical codes for the lengths, bit-reversed because deflate writes them starting from the high bit.
+std::vector<uint32_t> BuildCodes(const std::vector<BYTE> &lengths) {
+    std::array<uint32_t, MaxCodeBits + 2> next{};
+    std::array<uint32_t, MaxCodeBits + 1> counts{};
+    for (BYTE length : lengths) {
+        ++counts[length];
+    }
+    counts[0] = 0;
+    for (int length = 1; length <= MaxCodeBits; ++length) {
+        next[length + 1] = (next[length] + counts[length]) << 1;
+    }
+    std::vector<uint32_t> codes(lengths.size(), 0);
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol) {
+        if (lengths[symbol] != 0) {
+            codes[symbol] = ReverseBits(next[lengths[symbol]]++, lengths[symbol]);
+        }
+    }
+    return codes;
+}
+
+int RepeatExtraBits(int code_length_symbol) {
+    switch (code_length_symbol) {
+        case RepeatPrevious:
+            return 2;
+        case RepeatZeros:
+            return 3;
+        case RepeatManyZeros:
+            return 7;
+        default:
+            return 0;
+    }
+}
+
+// A literal (distance 0, length is the byte) or a match.
+struct Token {
+    WORD length;
+    WORD distance;
+};
+
+int LengthSymbol(int length) {
+    return static_cast<int>(std::upper_bound(std::begin(LengthBase), std::end(LengthBase), length) -
+                            std::begin(LengthBase)) -
+           1;
+}
+
+int DistanceSymbol(int distance) {
+    return static_cast<int>(std::upper_bound(std::begin(DistanceBase), std::end(DistanceBase), distance) -
+                            std::begin(DistanceBase)) -
+           1;
+}
+
+class Deflater {
+public:
+    Deflater(std::span<const std::byte> data, int level, std::vector<std::byte> &output)
+        : data_(data),
+          parameters_(Levels[level]),
+          writer_(output),
+          head_(1 << HashBits, -1),
+          previous_(WindowSize, -1) {
+    }
+
+    void Run() {
+        if (parameters_.max_chain == 0) {
+            WriteStored(0, data_.size(), true);
+            writer_.AlignToByte();
+            return;
+        }
+        size_t block_start = 0;
+        size_t position = 0;
+        std::pair<int, int> match = FindMatch(position, parameters_.max_chain);
+        while (position < data_.size()) {
+            auto [length, distance] = match;
+            if (length >= MinMatch && length < parameters_.lazy_length && position + 1 < data_.size()) {
+                Insert(position);
+                int chain = length >= parameters_.good_length ? parameters_.max_chain / 4 : parameters_.max_chain;
+                // The match found one byte later is reused by the next step when it wins.
+                match = FindMatch(position + 1, std::max(chain, 1));
+                if (match.first > length) {
+                    AddLiteral(position++);
+                } else {
+                    AddMatch(length, distance);
+                    InsertRange(position + 1, position + length);
+                    position += length;
+                    match = FindMatch(position, parameters_.max_chain);
+                }
+            } else if (length >= MinMatch) {
+                AddMatch(length, distance);
+                InsertRange(position, position + length);
+                position += length;
+                match = FindMatch(position, parameters_.max_chain);
+            } else {
+                Insert(position);
+                AddLiteral(position++);
+                match = FindMatch(position, parameters_.max_chain);
+            }
+            if (tokens_.size() >= BlockTokens) {
+                WriteBlock(block_start, position, false);
+                block_start = position;
+            }
+        }
+        WriteBlock(block_start, position, true);
+        writer_.AlignToByte();
+    }
+
+private:
+    std::span<const std::byte> data_;
+    LevelParameters parameters_;
+    BitWriter writer_;
+    std::vector<int32_t> head_;
+    std::vector<int32_t> previous_;
+    std::vector<Token> tokens_;
+
+    uint32_t Hash(size_t position) const {
+        uint32_t value = static_cast<uint32_t>(data_[position]) << 16 |
+                         static_cast<uint32_t>(data_[position + 1]) << 8 | static_cast<uint32_t>(data_[position + 2]);
+        return (value * 2654435761u) >> (32 - HashBits);
+    }
+
+    void Insert(size_t position) {
+        if (position + MinMatch > data_.size()) {
+            return;
+        }
+        uint32_t hash = Hash(position);
+        previous_[position & (WindowSize - 1)] = head_[hash];
+        head_[hash] = static_cast<int32_t>(position);
+    }
+
+    void InsertRange(size_t begin, size_t end) {
+        for (size_t position = begin; position < end; ++position) {
+            Insert(position);
+        }
+    }
+
+    // The longest earlier match for the bytes at position among the last positions with the same hash.
+    std::pair<int, int> FindMatch(size_t position, int max_chain) const {
+        int limit = static_cast<int>(std::min<size_t>(MaxMatch, data_.size() - position));
+        if (limit < MinMatch) {
+            return {0, 0};
+        }
+        const std::byte *current = data_.data() + position;
+        int best_length = MinMatch - 1;
+        int best_distance = 0;
+        int32_t candidate = head_[Hash(position)];
+        for (int chain = max_chain; chain > 0 && candidate >= 0; --chain) {
+            int distance = static_cast<int>(position - candidate);
+            if (distance > WindowSize || distance <= 0) {
+                break;
+            }
+            const std::byte *match = data_.data() + candidate;
+            if (match[best_length] == current[best_length] && match[0] == current[0]) {
+                int length = MatchLength(match, current, limit);
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length >= parameters_.nice_length || length == limit) {
+                        break;
+                    }
+                }
+            }
+            int32_t next = previous_[candidate & (WindowSize - 1)];
+            if (next >= candidate) {
+                break;
+            }
+            candidate = next;
+        }
+        if (best_length < MinMatch || (best_length == MinMatch && best_distance > TooFarForMinMatch)) {
+            return {0, 0};
+        }
+        return {best_length, best_distance};
+    }
+
+    void AddLiteral(size_t position) {
+        tokens_.push_back({static_cast<WORD>(data_[position]), 0});
+    }
+
+    void AddMatch(int length, int distance) {
+        tokens_.push_back({static_cast<WORD>(length), static_cast<WORD>(distance)});
+    }
+
+    void WriteStored(size_t begin, size_t end, bool last) {
+        do {
+            size_t size = std::min(end - begin, MaxStoredBlock);
+            bool final_block = last && begin + size == end;
+            writer_.Write(final_block ? 1 : 0, 1);
+            writer_.Write(0, 2);
+            writer_.AlignToByte();
+            writer_.Write(static_cast<uint32_t>(size), 16);
+            writer_.Write(static_cast<uint32_t>(~size & 0xffff), 16);
+            writer_.Append(data_.subspan(begin, size));
+            begin += size;
+        } while (begin < end);
+    }
+
+    // Code length codes for the concatenated literal and distance code lengths, with runs shortened.
+    static std::vector<std::pair<int, int>> EncodeLengths(const std::vector<BYTE> &lengths) {
+        std::vector<std::pair<int, int>> codes;
+        for (size_t index = 0; index < lengths.size();) {
+            size_t run = 1;
+            while (index + run < lengths.size() && lengths[index + run] == lengths[index]) {
+                ++run;
+            }
+            if (lengths[index] == 0 && run >= 11) {
+                run = std::min<size_t>(run, 138);
+                codes.emplace_back(RepeatManyZeros, static_cast<int>(run - 11));
+            } else if (lengths[index] == 0 && run >= 3) {
+                codes.emplace_back(RepeatZeros, static_cast<int>(run - 3));
+            } else if (lengths[index] != 0 && run >= 4) {
+                run = std::min<size_t>(run, 7);
+                codes.emplace_back(lengths[index], 0);
+                codes.emplace_back(RepeatPrevious, static_cast<int>(run - 4));
+            } else {
+                run = 1;
+                codes.emplace_back(lengths[index], 0);
+            }
+            index += run;
+        }
+        return codes;
+    }
+
+    void WriteBlock(size_t begin, size_t end, bool last) {
+        std::vector<uint32_t> literal_frequencies(UsedLiteralLengthSymbols, 0);
+        std::vector<uint32_t> distance_frequencies(DistanceSymbols, 0);
+        for (const Token &token : tokens_) {
+            if (token.distance == 0) {
+                ++literal_frequencies[token.length];
+            } else {
+                ++literal_frequencies[FirstLengthSymbol + LengthSymbol(token.length)];
+                ++distance_frequencies[DistanceSymbol(token.distance)];
+            }
+        }
+        literal_frequencies[EndOfBlock] = 1;
+
+        std::vector<BYTE> literal_lengths = BuildLengths(literal_frequencies, MaxCodeBits);
+        std::vector<BYTE> distance_lengths = BuildLengths(distance_frequencies, MaxCodeBits);
+        size_t literal_count = UsedLiteralLengthSymbols;
+        while (literal_count > FirstLengthSymbol && literal_lengths[literal_count - 1] == 0) {
+            --literal_count;
+        }
+        size_t distance_count = DistanceSymbols;
+        while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) {
+            --distance_count;
+        }
+
+        std::vector<BYTE> all_lengths(literal_lengths.begin(), literal_lengths.begin() + literal_count);
+        all_lengths.insert(all_lengths.end(), distance_lengths.begin(), distance_lengths.begin() + distance_count);
+        std::vector<std::pair<int, int>> length_codes = EncodeLengths(all_lengths);
+        std::vector<uint32_t> code_length_frequencies(CodeLengthSymbols, 0);
+        for (auto [symbol, extra] : length_codes) {
+            ++code_length_frequencies[symbol];
+        }
+        std::vector<BYTE> code_length_lengths = BuildLengths(code_length_frequencies, MaxCodeLengthBits);
+        size_t code_length_count = CodeLengthSymbols;
+        while (code_length_count > 4 && code_length_lengths[CodeLengthOrder[code_length_count - 1]] == 0) {
+            --code_length_count;
+        }
+
+        // Incompressible data is cheaper as a stored block.
+        size_t bits = 3 + 14 + 3 * code_length_count;
+        for (auto [symbol, extra] : length_codes) {
+            bits += code_length_lengths[symbol] + RepeatExtraBits(symbol);
+        }
+        for (size_t symbol = 0; symbol < literal_frequencies.size(); ++symbol) {
+            bits += static_cast<size_t>(literal_frequencies[symbol]) * literal_lengths[symbol];
+        }
+        for (const Token &token : tokens_) {
+            if (token.distance != 0) {
+                int distance_symbol = DistanceSymbol(token.distance);
+                bits += LengthExtra[LengthSymbol(token.length)] + distance_lengths[distance_symbol] +
+                        DistanceExtra[distance_symbol];
+            }
+        }
+        if (bits > (end - begin + 5) * 8) {
+            tokens_.clear();
+            WriteStored(begin, end, last);
+            return;
+        }
+
+        writer_.Write(last ? 1 : 0, 1);
+        writer_.Write(2, 2);
+        writer_.Write(static_cast<uint32_t>(literal_count - FirstLengthSymbol), 5);
+        writer_.Write(static_cast<uint32_t>(distance_count - 1), 5);
+        writer_.Write(static_cast<uint32_t>(code_length_count - 4), 4);
+        for (size_t index = 0; index < code_length_count; ++index) {
+            writer_.Write(code_length_lengths[CodeLengthOrder[index]], 3);
+        }
+        std::vector<uint32_t> code_length_codes = BuildCodes(code_length_lengths);
+        for (auto [symbol, extra] : length_codes) {
+            writer_.Write(code_length_codes[symbol], code_length_lengths[symbol]);
+            writer_.Write(extra, RepeatExtraBits(symbol));
+        }
+
+        std::vector<uint32_t> literal_codes = BuildCodes(literal_lengths);
+        std::vector<uint32_t> distance_codes = BuildCodes(distance_lengths);
+        for (const Token &token : tokens_) {
+            if (token.distance == 0) {
+                writer_.Write(literal_codes[token.length], literal_lengths[token.length]);
+                continue;
+            }
+            int length_symbol = LengthSymbol(token.length);
+            int distance_symbol = DistanceSymbol(token.distance);
+            writer_.Write(literal_codes[FirstLengthSymbol + length_symbol],
+                          literal_lengths[FirstLengthSymbol + length_symbol]);
+            writer_.Write(token.length - LengthBase[length_symbol], LengthExtra[length_symbol]);
+            writer_.Write(distance_codes[distance_symbol], distance_lengths[distance_symbol]);
+            writer_.Write(token.distance - DistanceBase[distance_symbol], DistanceExtra[distance_symbol]);
+        }
+        writer_.Write(literal_codes[EndOfBlock], literal_lengths[EndOfBlock]);
+        tokens_.clear();
+    }
+};
+
+void AppendBigEndian(std::vector<std::byte> &output, DWORD value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        output.push_back(static_cast<std::byte>(value >> shift));
+    }
+}
+}  // namespace
+
+std::vector<std::byte> ZlibCodec::Deflate(std::span<const std::byte> data, int level) {
+    level = std::clamp(level, MinLevel, MaxLevel);
+    std::vector<std::byte> output;
+    output.reserve(data.size() / 2 + 64);
+
+    // The level field of the header is only informational: fastest, fast, default or best.
+    int level_field = level <= 1 ? 0 : level < DefaultLevel ? 1 : level == DefaultLevel ? 2 : 3;
+    int flags = level_field << 6;
+    flags += ZlibCheckDivisor - (ZlibHeader * 256 + flags) % ZlibCheckDivisor;
+    output.push_back(static_cast<std::byte>(ZlibHeader));
+    output.push_back(static_cast<std::byte>(flags));
+
+    Deflater(data, level, output).Run();
+    AppendBigEndian(output, Checksums::Adler32(data));
+    return output;
+}
+
+std::vector<std::byte> ZlibCodec::Inflate(std::span<const std::byte> data, size_t max_size) {
+    if (data.size() < 2) {
+        throw InputDataException("Unexpected end of compressed data");
+    }
+    BYTE method = static_cast<BYTE>(data[0]);
+    BYTE flags = static_cast<BYTE>(data[1]);
+    if ((method & 0x0f) != ZlibMethod || (method >> 4) > 7 || (method * 256 + flags) % ZlibCheckDivisor != 0 ||
+        (flags & ZlibPresetDictionary) != 0) {
+        Broken();
+    }
+
+    std::vector<std::byte> output(max_size);
+    Inflater inflater(data.subspan(2), output.data(), max_size);
+    output.resize(inflater.Run());
+
+    BitReader &reader = inflater.Reader();
+    reader.AlignToByte();
+    DWORD checksum = 0;
+    for (int index = 0; index < 4; ++index) {
+        checksum = checksum << 8 | reader.Read(8);
+    }
+    if (checksum != Checksums::Adler32(output)) {
+        throw InputDataException("Wrong checksum of compressed data");
+    }
+    return output;
+}
@@ -0,0 +1,371 @@
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "input_control/Input_OutputProcessing.h"
+#include "input_control/JpegCodec.h"
+#include "input_control/PyramidCodec.h"
+#include "input_control/RleCodec.h"
+#include "input_control/TiffCodec.h"
+#include "input_control/TileHashes.h"
+#include "input_control/ZlibCodec.h"
+#include "FilterGraph.h"
+#include "Filters.h"
+#include "LazyImage.h"
+#include "PictureInfo.h"
+#include "Pipeline.h"
+#include "TileScheduler.h"
+
+constexpr LONG BenchmarkWidth = 2048;
+constexpr LONG BenchmarkHeight = 2048;
+constexpr int BenchmarkRepeats = 10;
+constexpr double BytesInMegabyte = 1 << 20;
+
+// Gray image with horizontal runs of different lengths, close to what palettized assets look like.
+PictureInfo MakeGrayPicture(LONG width, LONG height, WORD bit_count) {
+    BmpFileHeader file_header{BM, 0, 0, 0, DefaultBfsize + DefaultBisize};
+    BmpInfoHeader info_header{DefaultBisize, width, height, 1, bit_count, 0, 0, 0, 0, 0, 0};
+    BYTE step = static_cast<BYTE>(MaxColor / ((1 << bit_count) - 1));
+    std::vector<std::vector<Pixel> > pixels(height, std::vector<Pixel>(width));
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
+            BYTE value = static_cast<BYTE>((x / (1 + y % 13) + y) % (1 << bit_count) * step);
+            pixels[y][x] = Pixel{value, value, value};
+        }
+    }
+    PictureInfo picture_info(file_header, info_header, pixels);
+    picture_info.Sync();
+    return picture_info;
+}
+
+// Smooth gradients with a little noise, something between a photo and a screenshot.
+PictureInfo MakeColorPicture(LONG width, LONG height) {
+    PictureInfo picture_info = InputOutputProcessing::CreatePicture(width, height, 24, false);
+    unsigned noise = 1;
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
+            noise = noise * 1103515245 + 12345;
+            BYTE jitter = static_cast<BYTE>(noise >> 29);
+            picture_info.pixels[y][x] = Pixel{static_cast<BYTE>(x / 8 + jitter), static_cast<BYTE>(y / 8),
+                                              static_cast<BYTE>((x + y) / 16 + jitter)};
+        }
+    }
+    return picture_info;
+}
+
+// Read-only stream over a string without copying it, so decoding is measured and not the copy.
+class MemoryBuffer : public std::streambuf {
+public:
+    explicit MemoryBuffer(std::string &data) {
+        setg(data.data(), data.data(), data.data() + data.size());
+    }
+};
+
+// Prints the throughput of function in megabytes of decoded pixels per second.
+void Measure(const std::string &name, size_t bytes, const std::function<void()> &function) {
+    function();
+    auto start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < BenchmarkRepeats; ++repeat) {
+        function();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::left << std::setw(24) << name << std::fixed << std::setprecision(1)
+              << static_cast<double>(bytes) * BenchmarkRepeats / BytesInMegabyte / elapsed.count() << " MB/s"
+              << std::endl;
+}
+
+void BenchmarkRle(WORD bit_count, DWORD compression, const std::string &name) {
+    PictureInfo picture_info = MakeGrayPicture(BenchmarkWidth, BenchmarkHeight, bit_count);
+    picture_info.bmi_header.biCompression = compression;
+    std::vector<std::byte> encoded = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+
+    Measure(name + " decode", decoded_size, [&encoded]() { InputOutputProcessing::LoadBmpFromMemory(encoded); });
+    Measure(name + " encode", decoded_size,
+            [&picture_info]() { InputOutputProcessing::EncodeBmpToBuffer(picture_info); });
+}
+
+// Encoded size and stream encode/decode speed of a format, the same path the command line tool takes.
+// The ratio is the size of 24-bit pixels over the encoded size.
+void BenchmarkFormat(ImageFormat format, const std::string &name, int level = ZlibCodec::DefaultLevel) {
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    std::stringstream encoded_stream;
+    InputOutputProcessing::SaveImageStream(encoded_stream, picture_info, format, level);
+    std::string encoded = encoded_stream.str();
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    size_t raw_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * 3;
+    std::cout << std::left << std::setw(24) << name + " size" << encoded.size() / 1024 << " KB, ratio " << std::fixed
+              << std::setprecision(2) << static_cast<double>(raw_size) / static_cast<double>(encoded.size())
+              << std::endl;
+
+    Measure(name + " decode", decoded_size, [&encoded]() {
+        MemoryBuffer buffer(encoded);
+        std::istream input(&buffer);
+        InputOutputProcessing::LoadImageStream(input);
+    });
+    Measure(name + " encode", decoded_size, [&picture_info, format, level]() {
+        std::stringstream output;
+        InputOutputProcessing::SaveImageStream(output, picture_info, format, level);
+    });
+}
+
+// JPEG decoding at every scale and with a crop, in megabytes of full size pixels per second so that the
+// numbers show how much work the reduced decode saves. There is no JPEG writer, so the file comes from outside.
+void BenchmarkJpeg(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    std::string encoded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    MemoryBuffer probe_buffer(encoded);
+    std::istream probe(&probe_buffer);
+    PictureInfo picture_info = JpegCodec::Load(probe);
+    size_t decoded_size = picture_info.pixels.size() * picture_info.pixels[0].size() * sizeof(Pixel);
+
+    auto measure = [&encoded, decoded_size](const std::string &name, const JpegDecodeOptions &options) {
+        Measure(name, decoded_size, [&encoded, &options]() {
+            MemoryBuffer buffer(encoded);
+            std::istream input(&buffer);
+            JpegCodec::Load(input, options);
+        });
+    };
+    for (int scale = 1; scale <= JpegCodec::MaxScale; scale *= 2) {
+        measure("JPEG decode 1/" + std::to_string(scale), JpegDecodeOptions{.scale = scale});
+    }
+    measure("JPEG decode 1/8 crop", JpegDecodeOptions{.scale = JpegCodec::MaxScale, .max_width = 64, .max_height = 64});
+}
+
+// Loading a tiled TIFF file by one thread and by one thread per core, each reading its own tiles from disk.
+void BenchmarkTiffTiles() {
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    std::string path = "benchmark_tiles.tif";
+    std::ofstream file(path, std::ios::binary);
+    TiffCodec::Save(file, picture_info, 256);
+    file.close();
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    TileScheduler single(1);
+    TileScheduler all;
+    Measure("TIFF tiles 1 thread", decoded_size, [&path, &single]() { TiffCodec::LoadFile(path, single); });
+    Measure("TIFF tiles " + std::to_string(all.Threads()) + " threads", decoded_size,
+            [&path, &all]() { TiffCodec::LoadFile(path, all); });
+    std::remove(path.c_str());
+}
+
+// Reading a pyramid file whole, a 512x512 crop and a 1/8 preview, in megabytes of full size pixels per second,
+// against decoding the same image from BMP.
+void BenchmarkPyramid() {
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    std::string path = "benchmark_pyramid.pyr";
+    std::ofstream file(path, std::ios::binary);
+    PyramidCodec::Save(file, picture_info);
+    file.close();
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    Measure("Pyramid save", decoded_size, [&picture_info]() {
+        std::stringstream output;
+        PyramidCodec::Save(output, picture_info);
+    });
+    Measure("Pyramid load", decoded_size, [&path]() { PyramidCodec::LoadFile(path); });
+    Measure("Pyramid crop 512", decoded_size,
+            [&path]() { PyramidCodec::LoadFile(path, JpegDecodeOptions{.max_width = 512, .max_height = 512}); });
+    Measure("Pyramid preview 1/8", decoded_size,
+            [&path]() { PyramidCodec::LoadFile(path, JpegDecodeOptions{.scale = 8}); });
+    std::remove(path.c_str());
+}
+
+// The same filters on 8-bit and 16-bit channels, measured by the pixels they process.
+void BenchmarkDeepFilters() {
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    PictureInfo deep = picture_info;
+    deep.SetDeep(true);
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    std::vector<std::pair<std::string, std::shared_ptr<Filter> > > filters = {
+        {"neg", std::make_shared<NegativeFilter>()},
+        {"gs", std::make_shared<GrayScaleFilter>()},
+        {"sharp", std::make_shared<SharpeningFilter>()},
+        {"blur 2", std::make_shared<GaussianBlurFilter>(2)}};
+    for (const auto &[name, filter] : filters) {
+        Measure("Filter " + name + " 8-bit", decoded_size, [&picture_info, &filter]() { filter->Apply(picture_info); });
+        Measure("Filter " + name + " 16-bit", decoded_size, [&deep, &filter]() { filter->Apply(deep); });
+    }
+}
+
+// Long chains with rounding after every stage and on float planes with one rounding at the end.
+void BenchmarkPrecision() {
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    std::vector<std::pair<std::string, Pipeline> > chains = {
+        {"edge", Pipeline::Compile({"-blur", "2", "-sharp", "-edge", "0.1"})},
+        {"long", Pipeline::Compile({"-sharp", "-blur", "1", "-sharp", "-gs", "-neg", "-blur", "1", "-pix", "4"})}};
+    for (const auto &[name, pipeline] : chains) {
+        Measure("Chain " + name + " channel", decoded_size,
+                [&picture_info, &pipeline]() { pipeline.Run(picture_info); });
+        Measure("Chain " + name + " float", decoded_size,
+                [&picture_info, &pipeline]() { pipeline.Run(picture_info, Precision::Float); });
+    }
+}
+
+// Filters on packed pixels one after another and the same chain with the layouts the pipeline picks.
+void BenchmarkLayouts() {
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    auto sharp = std::make_shared<SharpeningFilter>();
+    auto blur = std::make_shared<GaussianBlurFilter>(2);
+    auto edge = std::make_shared<EdgeDetectionFilter>(0.1);
+    std::vector<std::pair<std::string, std::vector<std::shared_ptr<Filter> > > > chains = {
+        {"sharp", {sharp}}, {"blur", {blur}}, {"edge", {edge}}, {"blur sharp edge", {blur, sharp, edge}}};
+    for (const auto &[name, filters] : chains) {
+        std::vector<std::string> args;
+        for (const auto &filter : filters) {
+            if (filter == sharp) {
+                args.insert(args.end(), {"-sharp"});
+            } else if (filter == blur) {
+                args.insert(args.end(), {"-blur", "2"});
+            } else {
+                args.insert(args.end(), {"-edge", "0.1"});
+            }
+        }
+        Pipeline pipeline = Pipeline::Compile(args);
+        Measure("Packed " + name, decoded_size, [&picture_info, &filters]() {
+            PictureInfo result = picture_info;
+            for (const auto &filter : filters) {
+                filter->Apply(result);
+            }
+        });
+        Measure("Layouts " + name, decoded_size, [&picture_info, &pipeline]() { pipeline.Run(picture_info); });
+    }
+}
+
+// Three outputs of one BMP: three decodes and chains against one decode and a graph with a shared crop.
+void BenchmarkGraph() {
+    std::vector<std::byte> encoded =
+        InputOutputProcessing::EncodeBmpToBuffer(MakeColorPicture(BenchmarkWidth, BenchmarkHeight));
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    std::vector<std::vector<std::string> > chains = {{"-crop", "1600", "1600", "-sharp"},
+                                                     {"-crop", "1600", "1600", "-gs", "-pix", "8"},
+                                                     {"-crop", "1600", "1600", "-edge", "0.1"}};
+    std::vector<Pipeline> pipelines;
+    FilterGraph graph;
+    for (const std::vector<std::string> &chain : chains) {
+        pipelines.push_back(Pipeline::Compile(chain));
+        graph.AddOutput(chain);
+    }
+    Measure("Outputs separately", decoded_size, [&encoded, &pipelines]() {
+        for (const Pipeline &pipeline : pipelines) {
+            pipeline.Run(InputOutputProcessing::LoadBmpFromMemory(encoded));
+        }
+    });
+    Measure("Outputs in a graph", decoded_size, [&encoded, &graph]() {
+        graph.Run(InputOutputProcessing::LoadBmpFromMemory(encoded), [](size_t, SharedPicture) {});
+    });
+}
+
+void BenchmarkLazy() {
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    std::vector<std::string> chain = {"-sharp", "-neg", "-gs", "-edge", "0.1", "-blur", "1"};
+    Pipeline pipeline = Pipeline::Compile(chain);
+    Measure("Chain eagerly", decoded_size, [&picture_info, &pipeline]() { pipeline.Run(picture_info); });
+    Measure("Chain lazily in strips", decoded_size,
+            [&picture_info, &chain]() { LazyImage(picture_info).Apply(chain).Get(); });
+}
+
+void BenchmarkIncremental() {
+    PictureInfo before = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    PictureInfo after = before;
+    for (LONG y = 1000; y < 1020; ++y) {
+        for (LONG x = 500; x < 520; ++x) {
+            after.pixels[y][x].red ^= 0xff;
+        }
+    }
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    Pipeline pipeline = Pipeline::Compile({"-blur", "2", "-sharp"});
+    PictureInfo previous_output = pipeline.Run(before);
+    TileHashes previous = TileHashes::Compute(before, 0);
+    Measure("Edited image in full", decoded_size, [&after, &pipeline]() { pipeline.Run(after); });
+    Measure("Edited tiles only", decoded_size, [&]() {
+        TileHashes current = TileHashes::Compute(after, 0);
+        std::vector<TileRect> tiles;
+        for (size_t index : current.DirtyTiles(previous, pipeline.Halo())) {
+            tiles.push_back(current.Tiles()[index]);
+        }
+        PictureInfo output = previous_output;
+        pipeline.ApplyToTiles(after, output, tiles, TileScheduler());
+    });
+}
+
+void BenchmarkUniformTiles() {
+    // A flag: three bands of color with a noisy emblem in the middle.
+    PictureInfo flag = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    const Pixel colors[] = {{200, 30, 40}, {255, 255, 255}, {20, 90, 180}};
+    for (LONG y = 0; y < BenchmarkHeight; ++y) {
+        for (LONG x = 0; x < BenchmarkWidth; ++x) {
+            if (std::abs(x - BenchmarkWidth / 2) > 200 || std::abs(y - BenchmarkHeight / 2) > 200) {
+                flag.pixels[y][x] = colors[y * 3 / BenchmarkHeight];
+            }
+        }
+    }
+    PictureInfo noisy = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    Pipeline pipeline = Pipeline::Compile({"-blur", "2", "-sharp"});
+    Measure("Flag whole", decoded_size, [&flag, &pipeline]() { pipeline.Run(flag); });
+    Measure("Flag in tiles", decoded_size, [&flag, &pipeline]() {
+        PictureInfo picture_info = flag;
+        pipeline.ApplyInTiles(picture_info, TileScheduler());
+    });
+    Measure("Noisy image whole", decoded_size, [&noisy, &pipeline]() { pipeline.Run(noisy); });
+    Measure("Noisy image in tiles", decoded_size, [&noisy, &pipeline]() {
+        PictureInfo picture_info = noisy;
+        pipeline.ApplyInTiles(picture_info, TileScheduler());
+    });
+}
+
+void BenchmarkLargeHalo() {
+    // A wide blur on an image that is a little more than half flat: the tiles would filter their halo many times.
+    PictureInfo picture_info = MakeColorPicture(BenchmarkWidth, BenchmarkHeight);
+    for (LONG y = 0; y < BenchmarkHeight * 55 / 100; ++y) {
+        std::fill(picture_info.pixels[y].begin(), picture_info.pixels[y].end(), Pixel{20, 90, 180});
+    }
+    size_t decoded_size = static_cast<size_t>(BenchmarkWidth) * BenchmarkHeight * sizeof(Pixel);
+    Pipeline pipeline = Pipeline::Compile(std::vector<std::string>{"-blur", "15"});
+    Measure("Blur 15 in strips", decoded_size, [&picture_info, &pipeline]() {
+        PictureInfo copy = picture_info;
+        pipeline.ApplyInStrips(copy, TileScheduler());
+    });
+    Measure("Blur 15 in tiles", decoded_size, [&picture_info, &pipeline]() {
+        PictureInfo copy = picture_info;
+        pipeline.ApplyInTiles(copy, TileScheduler());
+    });
+}
+
+int main(int argc, char **argv) {
+    BenchmarkRle(8, BiRle8, "RLE8");
+    BenchmarkRle(4, BiRle4, "RLE4");
+    BenchmarkFormat(ImageFormat::Bmp, "BMP");
+    BenchmarkFormat(ImageFormat::Qoi, "QOI");
+    for (int level : {0, 1, 3, 6, 9}) {
+        BenchmarkFormat(ImageFormat::Png, "PNG level " + std::to_string(level), level);
+    }
+    BenchmarkFormat(ImageFormat::Tiff, "TIFF");
+    BenchmarkTiffTiles();
+    BenchmarkPyramid();
+    BenchmarkDeepFilters();
+    BenchmarkPrecision();
+    BenchmarkLayouts();
+    BenchmarkGraph();
+    BenchmarkLazy();
+    BenchmarkIncremental();
+    BenchmarkUniformTiles();
+    BenchmarkLargeHalo();
+    if (argc > 1) {
+        BenchmarkJpeg(argv[1]);
+    }
+    return 0;
+}
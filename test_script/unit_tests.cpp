@@ -1,17 +1,123 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdarg>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <string>
 
+#include "input_control/BmpInspector.h"
+#include "input_control/Checksums.h"
 #include "input_control/ControlParameters.h"
 #include "input_control/Input_OutputProcessing.h"
+#include "input_control/JpegCodec.h"
+#include "input_control/PngCodec.h"
+#include "input_control/PnmCodec.h"
+#include "input_control/PyramidCodec.h"
+#include "input_control/QoiCodec.h"
+#include "input_control/ResultCache.h"
+#include "input_control/RleCodec.h"
+#include "input_control/TiffCodec.h"
+#include "input_control/TileHashes.h"
+#include "input_control/ZlibCodec.h"
 #include "Exceptions.h"
+#include "AsyncWriter.h"
+#include "FilterGraph.h"
 #include "Filters.h"
+#include "LazyImage.h"
 #include "PictureInfo.h"
+#include "Pipeline.h"
+#include "PlanarImage.h"
+#include "TileScheduler.h"
 
 constexpr int BlurTestArg = 10;
 constexpr int PixelTestArg = 10;
 constexpr int EdgeTestArg = 30;
+constexpr int ConcurrencyThreads = 8;
+constexpr int ConcurrencyImages = 32;
+
+PictureInfo MakeTestPicture(LONG width, LONG height, int seed) {
+    BmpFileHeader file_header{BM, 0, 0, 0, DefaultBfsize + DefaultBisize};
+    BmpInfoHeader info_header{DefaultBisize, width, height, 1, 24, 0, 0, 0, 0, 0, 0};
+    std::vector<std::vector<Pixel> > pixels(height, std::vector<Pixel>(width));
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
+            pixels[y][x].blue = static_cast<BYTE>((x * 7 + y * 3 + seed) % 256);
+            pixels[y][x].green = static_cast<BYTE>((x * y + seed * 11) % 256);
+            pixels[y][x].red = static_cast<BYTE>((x + y * 5 + seed * 13) % 256);
+        }
+    }
+    PictureInfo picture_info(file_header, info_header, pixels);
+    picture_info.Sync();
+    return picture_info;
+}
+
+PictureInfo MakeAlphaPicture(LONG width, LONG height, int seed) {
+    PictureInfo picture_info = MakeTestPicture(width, height, seed);
+    picture_info.bmi_header.biBitCount = TrueColorAlphaBits;
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
+            picture_info.pixels[y][x].alpha = static_cast<BYTE>((x * 31 + y * 17 + seed) % 256);
+        }
+    }
+    picture_info.Sync();
+    return picture_info;
+}
+
+bool SameAlpha(const PictureInfo &lhs, const PictureInfo &rhs) {
+    for (size_t y = 0; y < lhs.pixels.size(); ++y) {
+        for (size_t x = 0; x < lhs.pixels[y].size(); ++x) {
+            if (lhs.pixels[y][x].alpha != rhs.pixels[y][x].alpha) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::string TempPath(const std::string &name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+void WriteBytes(const std::string &path, const std::vector<std::byte> &bytes) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+std::vector<std::byte> ReadBytes(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<std::byte> result(bytes.size());
+    std::memcpy(result.data(), bytes.data(), bytes.size());
+    return result;
+}
+
+bool SamePixels(const PictureInfo &lhs, const PictureInfo &rhs) {
+    if (lhs.pixels.size() != rhs.pixels.size()) {
+        return false;
+    }
+    for (size_t y = 0; y < lhs.pixels.size(); ++y) {
+        if (lhs.pixels[y].size() != rhs.pixels[y].size()) {
+            return false;
+        }
+        for (size_t x = 0; x < lhs.pixels[y].size(); ++x) {
+            if (lhs.pixels[y][x].red != rhs.pixels[y][x].red || lhs.pixels[y][x].green != rhs.pixels[y][x].green ||
+                lhs.pixels[y][x].blue != rhs.pixels[y][x].blue) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
 
 TEST(InputOutputTests, WrongFilePath) {
     EXPECT_THROW({ PictureInfo picture_info = InputOutputProcessing::LoadBmpFile("wrong.bmp"); }, InputDataException);
@@ -231,6 +337,1732 @@ TEST(SharpeningFilterTests, JustSharp) {
     }
 }
 
+TEST(ConcurrencyTests, SharedFilterChain) {
+    std::vector<std::shared_ptr<const Filter> > chain{
+        std::make_shared<GaussianBlurFilter>(2), std::make_shared<SharpeningFilter>(),
+        std::make_shared<NegativeFilter>(), std::make_shared<EdgeDetectionFilter>(EdgeTestArg),
+        std::make_shared<PixelizeFilter>(3), std::make_shared<CropFilter>(40, 30)};
+
+    std::vector<PictureInfo> expected;
+    std::vector<PictureInfo> actual;
+    for (int i = 0; i < ConcurrencyImages; ++i) {
+        expected.push_back(MakeTestPicture(50 + i, 35 + i % 5, i));
+        actual.push_back(expected.back());
+        for (const auto &filter : chain) {
+            filter->Apply(expected.back());
+        }
+    }
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < ConcurrencyThreads; ++t) {
+        workers.emplace_back([&chain, &actual, t]() {
+            for (int i = t; i < ConcurrencyImages; i += ConcurrencyThreads) {
+                for (const auto &filter : chain) {
+                    filter->Apply(actual[i]);
+                }
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for (int i = 0; i < ConcurrencyImages; ++i) {
+        EXPECT_TRUE(SamePixels(expected[i], actual[i])) << "Изображение " << i << " не совпадает";
+    }
+}
+
+TEST(PipelineTests, InvalidSpec) {
+    EXPECT_THROW(Pipeline::Compile(std::vector<std::string>{"-blur", "string"}), InputDataException);
+    EXPECT_THROW(Pipeline::Compile(std::vector<std::string>{"-crop", "10"}), InputDataException);
+    EXPECT_THROW(Pipeline::Compile(std::vector<std::string>{"-pix", "0"}), InputDataException);
+    EXPECT_THROW(Pipeline::Compile(std::vector<std::string>{"-unknown"}), FilterException);
+}
+
+TEST(PipelineTests, Optimization) {
+    EXPECT_TRUE(Pipeline::Compile(std::vector<std::string>{"-neg", "-neg"}).Empty());
+    EXPECT_EQ(Pipeline::Compile(std::vector<std::string>{"-gs", "-neg", "-gs"}).Size(), 1);
+    Pipeline pipeline = Pipeline::Compile(std::vector<std::string>{"-crop", "30", "10", "-neg", "-crop", "20", "40"});
+    ASSERT_EQ(pipeline.Specs().size(), 2);
+    EXPECT_EQ(pipeline.Specs()[0].name, "-crop");
+    EXPECT_EQ(pipeline.Specs()[0].params, std::vector<double>({20, 10}));
+}
+
+TEST(PipelineTests, SameAsSequentialFilters) {
+    std::vector<std::string> args{"-gs", "-crop", "40", "30", "-neg", "-sharp", "-blur", "1.5", "-neg", "-edge", "40"};
+    Pipeline pipeline = Pipeline::Compile(args);
+    std::vector<std::unique_ptr<Filter> > filters;
+    filters.push_back(std::make_unique<GrayScaleFilter>());
+    filters.push_back(std::make_unique<CropFilter>(40, 30));
+    filters.push_back(std::make_unique<NegativeFilter>());
+    filters.push_back(std::make_unique<SharpeningFilter>());
+    filters.push_back(std::make_unique<GaussianBlurFilter>(1.5));
+    filters.push_back(std::make_unique<NegativeFilter>());
+    filters.push_back(std::make_unique<EdgeDetectionFilter>(40));
+
+    for (int seed = 0; seed < 3; ++seed) {
+        PictureInfo expected = MakeTestPicture(55, 47, seed);
+        for (const auto &filter : filters) {
+            filter->Apply(expected);
+        }
+        PictureInfo actual = pipeline.Run(MakeTestPicture(55, 47, seed));
+        EXPECT_EQ(actual.bmi_header.biWidth, 40);
+        EXPECT_EQ(actual.bmi_header.biHeight, 30);
+        EXPECT_TRUE(SamePixels(expected, actual));
+    }
+}
+
+TEST(InMemoryTests, EncodeDecode) {
+    for (LONG width : {1, 2, 3, 4, 17}) {
+        PictureInfo picture_info = MakeTestPicture(width, 9, static_cast<int>(width));
+        std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+        EXPECT_EQ(buffer.size(), BmpHeadersSize + InputOutputProcessing::RowStride(width, 24) * 9);
+
+        PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(buffer);
+        EXPECT_EQ(decoded.bmi_header.biWidth, width);
+        EXPECT_EQ(decoded.bmi_header.biHeight, 9);
+        EXPECT_TRUE(SamePixels(picture_info, decoded));
+    }
+}
+
+TEST(InMemoryTests, ViewDoesNotCopy) {
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(5, 4, 1));
+    BmpView view = InputOutputProcessing::WrapBmpMemory(buffer);
+    EXPECT_EQ(view.Row(0).data(), buffer.data() + BmpHeadersSize);
+    EXPECT_EQ(view.Row(3).data(), buffer.data() + BmpHeadersSize + 3 * view.row_stride);
+    EXPECT_EQ(view.Row(1).size(), 15);
+}
+
+TEST(InMemoryTests, BrokenBuffer) {
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(5, 4, 1));
+    EXPECT_THROW(InputOutputProcessing::LoadBmpFromMemory(std::span(buffer).first(buffer.size() - 1)),
+                 InputDataException);
+    EXPECT_THROW(InputOutputProcessing::LoadBmpFromMemory(std::span(buffer).first(10)), FileHeaderException);
+    buffer[0] = std::byte{'X'};
+    EXPECT_THROW(InputOutputProcessing::LoadBmpFromMemory(buffer), FileHeaderException);
+}
+
+// Stream buffer without seeking support, like a pipe.
+class ForwardOnlyBuffer : public std::streambuf {
+public:
+    explicit ForwardOnlyBuffer(std::vector<std::byte> &data) {
+        char *begin = reinterpret_cast<char *>(data.data());
+        setg(begin, begin, begin + data.size());
+    }
+};
+
+TEST(StreamTests, ForwardOnlyInput) {
+    PictureInfo picture_info = MakeTestPicture(13, 6, 4);
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    ForwardOnlyBuffer stream_buffer(buffer);
+    std::istream input(&stream_buffer);
+    PictureInfo decoded = InputOutputProcessing::LoadBmpStream(input);
+    EXPECT_TRUE(SamePixels(picture_info, decoded));
+}
+
+TEST(StreamTests, PixelDataOffset) {
+    PictureInfo picture_info = MakeTestPicture(6, 5, 2);
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    constexpr DWORD Gap = 16;
+    buffer.insert(buffer.begin() + BmpHeadersSize, Gap, std::byte{0x7f});
+    DWORD offset = BmpHeadersSize + Gap;
+    std::memcpy(buffer.data() + offsetof(BmpFileHeader, bfOffBits), &offset, sizeof(offset));
+
+    ForwardOnlyBuffer stream_buffer(buffer);
+    std::istream input(&stream_buffer);
+    EXPECT_TRUE(SamePixels(picture_info, InputOutputProcessing::LoadBmpStream(input)));
+    EXPECT_TRUE(SamePixels(picture_info, InputOutputProcessing::LoadBmpFromMemory(buffer)));
+}
+
+TEST(StreamTests, HugePixelDataOffset) {
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(6, 5, 2));
+    DWORD offset = 0xFFFFFFF0;
+    std::memcpy(buffer.data() + offsetof(BmpFileHeader, bfOffBits), &offset, sizeof(offset));
+    ForwardOnlyBuffer stream_buffer(buffer);
+    std::istream input(&stream_buffer);
+    EXPECT_THROW(InputOutputProcessing::LoadBmpStream(input), FileHeaderException);
+}
+
+TEST(StreamTests, SmallestHeight) {
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(6, 5, 2));
+    LONG height = std::numeric_limits<LONG>::min();
+    std::memcpy(buffer.data() + sizeof(BmpFileHeader) + offsetof(BmpInfoHeader, biHeight), &height, sizeof(height));
+    EXPECT_THROW(InputOutputProcessing::LoadBmpFromMemory(buffer), FileHeaderException);
+    ForwardOnlyBuffer stream_buffer(buffer);
+    std::istream input(&stream_buffer);
+    EXPECT_THROW(InputOutputProcessing::LoadBmpStream(input), FileHeaderException);
+
+    WriteBytes(TempPath("smallest_height.bmp"), buffer);
+    EXPECT_THROW(BmpInspector::InspectFile(TempPath("smallest_height.bmp")), FileHeaderException);
+    EXPECT_THROW(InputOutputProcessing::CopyBmpFile(TempPath("smallest_height.bmp"), TempPath("smallest_copy.bmp")),
+                 FileHeaderException);
+}
+
+TEST(StreamTests, FullDisk) {
+    PictureInfo picture_info = MakeTestPicture(64, 64, 3);
+    for (ImageFormat format : {ImageFormat::Bmp, ImageFormat::Qoi, ImageFormat::Ppm, ImageFormat::Png,
+                               ImageFormat::Tiff, ImageFormat::Pyramid}) {
+        EXPECT_THROW(InputOutputProcessing::SaveImageFile("/dev/full", picture_info, format), InputDataException);
+    }
+}
+
+TEST(StreamTests, SaveLoad) {
+    PictureInfo picture_info = MakeTestPicture(7, 3, 5);
+    std::stringstream stream;
+    InputOutputProcessing::SaveBmpStream(stream, picture_info);
+    std::string bytes = stream.str();
+    EXPECT_EQ(bytes.size(), BmpHeadersSize + InputOutputProcessing::RowStride(7, 24) * 3);
+    EXPECT_TRUE(SamePixels(picture_info, InputOutputProcessing::LoadBmpStream(stream)));
+
+    std::string truncated = bytes.substr(0, bytes.size() - 1);
+    std::stringstream truncated_stream(truncated);
+    EXPECT_THROW(InputOutputProcessing::LoadBmpStream(truncated_stream), InputDataException);
+}
+
+TEST(CopyTests, CanonicalFileIsCopied) {
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(9, 8, 3));
+    WriteBytes(TempPath("copy_input.bmp"), buffer);
+    EXPECT_TRUE(InputOutputProcessing::CopyBmpFile(TempPath("copy_input.bmp"), TempPath("copy_output.bmp")));
+    EXPECT_EQ(ReadBytes(TempPath("copy_output.bmp")), buffer);
+}
+
+TEST(CopyTests, HeadersAreNormalized) {
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(9, 8, 3));
+    constexpr DWORD Gap = 12;
+    buffer.insert(buffer.begin() + BmpHeadersSize, Gap, std::byte{0});
+    DWORD offset = BmpHeadersSize + Gap;
+    std::memcpy(buffer.data() + offsetof(BmpFileHeader, bfOffBits), &offset, sizeof(offset));
+    DWORD image_size = 0;
+    std::memcpy(buffer.data() + sizeof(BmpFileHeader) + offsetof(BmpInfoHeader, biSizeImage), &image_size,
+                sizeof(image_size));
+    WriteBytes(TempPath("copy_input.bmp"), buffer);
+
+    EXPECT_TRUE(InputOutputProcessing::CopyBmpFile(TempPath("copy_input.bmp"), TempPath("copy_output.bmp")));
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFile(TempPath("copy_input.bmp"));
+    EXPECT_EQ(ReadBytes(TempPath("copy_output.bmp")), InputOutputProcessing::EncodeBmpToBuffer(decoded));
+    EXPECT_FALSE(InputOutputProcessing::CopyBmpFile(TempPath("copy_input.bmp"), TempPath("copy_input.bmp")));
+}
+
+TEST(InspectionTests, HeadersOnly) {
+    std::filesystem::path directory = TempPath("inspection_test");
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "nested");
+    WriteBytes((directory / "a.bmp").string(), InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(12, 7, 1)));
+    WriteBytes((directory / "nested" / "b.BMP").string(),
+               InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(3, 5, 2)));
+    WriteBytes((directory / "broken.bmp").string(), std::vector<std::byte>(10, std::byte{'B'}));
+    WriteBytes((directory / "notes.txt").string(), std::vector<std::byte>(10, std::byte{'B'}));
+
+    BmpSummary summary = BmpInspector::InspectFile((directory / "a.bmp").string());
+    EXPECT_EQ(summary.width, 12);
+    EXPECT_EQ(summary.height, 7);
+    EXPECT_EQ(summary.bit_count, 24);
+    EXPECT_EQ(BmpInspector::ToJson(summary),
+              "{\"path\": \"" + (directory / "a.bmp").string() +
+                  "\", \"width\": 12, \"height\": 7, \"bit_count\": 24, \"compression\": \"BI_RGB\", "
+                  "\"top_down\": false, \"file_size\": 306}");
+
+    std::vector<BmpSummary> summaries = BmpInspector::InspectDirectory(directory.string());
+    ASSERT_EQ(summaries.size(), 3);
+    size_t broken = 0;
+    for (const BmpSummary &entry : summaries) {
+        if (!entry.error.empty()) {
+            ++broken;
+            EXPECT_EQ(entry.path, (directory / "broken.bmp").string());
+        }
+    }
+    EXPECT_EQ(broken, 1);
+}
+
+TEST(AlphaTests, RoundTrip) {
+    PictureInfo picture_info = MakeAlphaPicture(7, 5, 3);
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    // 32-bit images are written with a V4 header, whose alpha mask marks the fourth byte as alpha.
+    EXPECT_EQ(buffer.size(), BmpHeadersSize + 68 + 7 * 4 * 5);
+
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(buffer);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, TrueColorAlphaBits);
+    EXPECT_TRUE(SamePixels(picture_info, decoded));
+    EXPECT_TRUE(SameAlpha(picture_info, decoded));
+
+    std::stringstream stream;
+    InputOutputProcessing::SaveBmpStream(stream, decoded);
+    EXPECT_TRUE(SameAlpha(picture_info, InputOutputProcessing::LoadBmpStream(stream)));
+}
+
+TEST(AlphaTests, Bitfields) {
+    PictureInfo picture_info = MakeAlphaPicture(4, 3, 1);
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    // The masks after a 40-byte header instead of the V4 header the writer uses.
+    buffer.erase(buffer.begin() + BmpHeadersSize, buffer.begin() + BmpHeadersSize + 68);
+    std::memcpy(buffer.data() + sizeof(BmpFileHeader) + offsetof(BmpInfoHeader, biSize), &DefaultBisize,
+                sizeof(DefaultBisize));
+    const DWORD masks[] = {0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000};
+    const auto *masks_bytes = reinterpret_cast<const std::byte *>(masks);
+    buffer.insert(buffer.begin() + BmpHeadersSize, masks_bytes, masks_bytes + sizeof(masks));
+    DWORD offset = BmpHeadersSize + sizeof(masks);
+    DWORD compression = 3;
+    std::memcpy(buffer.data() + offsetof(BmpFileHeader, bfOffBits), &offset, sizeof(offset));
+    std::memcpy(buffer.data() + sizeof(BmpFileHeader) + offsetof(BmpInfoHeader, biCompression), &compression,
+                sizeof(compression));
+    EXPECT_TRUE(SameAlpha(picture_info, InputOutputProcessing::LoadBmpFromMemory(buffer)));
+
+    // XRGB: without the fourth mask the fourth byte is reserved.
+    std::vector<std::byte> xrgb = buffer;
+    xrgb.erase(xrgb.begin() + BmpHeadersSize + 12, xrgb.begin() + BmpHeadersSize + 16);
+    offset -= 4;
+    std::memcpy(xrgb.data() + offsetof(BmpFileHeader, bfOffBits), &offset, sizeof(offset));
+    PictureInfo opaque = InputOutputProcessing::LoadBmpFromMemory(xrgb);
+    EXPECT_TRUE(SamePixels(picture_info, opaque));
+    for (const std::vector<Pixel> &row : opaque.pixels) {
+        for (const Pixel &pixel : row) {
+            EXPECT_EQ(pixel.alpha, MaxAlpha);
+        }
+    }
+
+    std::swap(buffer[BmpHeadersSize + 2], buffer[BmpHeadersSize + 6]);
+    EXPECT_THROW(InputOutputProcessing::LoadBmpFromMemory(buffer), InfoHeaderException);
+}
+
+TEST(AlphaTests, ReservedByte) {
+    // A 2x2 32-bit BI_RGB file: the fourth byte of every pixel is reserved and left 0.
+    PictureInfo picture_info = MakeAlphaPicture(2, 2, 4);
+    for (std::vector<Pixel> &row : picture_info.pixels) {
+        for (Pixel &pixel : row) {
+            pixel.alpha = 0;
+        }
+    }
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    BmpFileHeader header{};
+    BmpInfoHeader info_header{};
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    std::memcpy(&info_header, buffer.data() + sizeof(header), sizeof(info_header));
+    buffer.erase(buffer.begin() + BmpHeadersSize, buffer.begin() + header.bfOffBits);
+    header.bfOffBits = BmpHeadersSize;
+    header.bfSize = static_cast<DWORD>(buffer.size());
+    info_header.biSize = DefaultBisize;
+    info_header.biCompression = 0;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    std::memcpy(buffer.data() + sizeof(header), &info_header, sizeof(info_header));
+
+    std::stringstream stream(std::string(reinterpret_cast<const char *>(buffer.data()), buffer.size()));
+    for (const PictureInfo &decoded :
+         {InputOutputProcessing::LoadBmpFromMemory(buffer), InputOutputProcessing::LoadBmpStream(stream)}) {
+        EXPECT_TRUE(SamePixels(picture_info, decoded));
+        for (const std::vector<Pixel> &row : decoded.pixels) {
+            for (const Pixel &pixel : row) {
+                EXPECT_EQ(pixel.alpha, MaxAlpha);
+            }
+        }
+        EXPECT_NE(InputOutputProcessing::ChooseBitCount(decoded), TrueColorAlphaBits);
+    }
+    // The copy keeps the source header and the reserved bytes, the encoder writes a V4 header with opaque alpha.
+    // The files differ, but both read back as the same opaque image.
+    WriteBytes(TempPath("reserved.bmp"), buffer);
+    EXPECT_TRUE(InputOutputProcessing::CopyBmpFile(TempPath("reserved.bmp"), TempPath("reserved_copy.bmp")));
+    EXPECT_EQ(ReadBytes(TempPath("reserved_copy.bmp")), buffer);
+    std::vector<std::byte> encoded =
+        InputOutputProcessing::EncodeBmpToBuffer(InputOutputProcessing::LoadBmpFromMemory(buffer));
+    EXPECT_EQ(encoded.size(), buffer.size() + 68);
+    PictureInfo copied = InputOutputProcessing::LoadBmpFile(TempPath("reserved_copy.bmp"));
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(encoded);
+    EXPECT_TRUE(SamePixels(copied, decoded));
+    EXPECT_TRUE(SameAlpha(copied, decoded));
+}
+
+TEST(AlphaTests, FiltersKeepAlpha) {
+    Pipeline pipeline = Pipeline::Compile(
+        std::vector<std::string>{"-neg", "-sharp", "-blur", "1", "-gs", "-edge", "20", "-pix", "2", "-crop", "9", "8"});
+    PictureInfo picture_info = MakeAlphaPicture(12, 10, 7);
+    PictureInfo result = pipeline.Run(picture_info);
+    // Rows are stored bottom-up, so the crop keeps the last eight of them.
+    picture_info.pixels.erase(picture_info.pixels.begin(), picture_info.pixels.begin() + 2);
+    for (std::vector<Pixel> &row : picture_info.pixels) {
+        row.resize(9);
+    }
+    EXPECT_TRUE(SameAlpha(picture_info, result));
+}
+
+TEST(BitDepthTests, GrayAndMonochrome) {
+    PictureInfo picture_info = MakeTestPicture(13, 6, 2);
+    EXPECT_EQ(InputOutputProcessing::ChooseBitCount(picture_info), 24);
+
+    GrayScaleFilter().Apply(picture_info);
+    EXPECT_EQ(InputOutputProcessing::ChooseBitCount(picture_info), 8);
+    picture_info.bmi_header.biBitCount = 8;
+    std::vector<std::byte> gray = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    EXPECT_EQ(gray.size(), BmpHeadersSize + 256 * 4 + InputOutputProcessing::RowStride(13, 8) * 6);
+    EXPECT_TRUE(SamePixels(picture_info, InputOutputProcessing::LoadBmpFromMemory(gray)));
+
+    EdgeDetectionFilter(EdgeTestArg).Apply(picture_info);
+    EXPECT_EQ(InputOutputProcessing::ChooseBitCount(picture_info), 1);
+    picture_info.bmi_header.biBitCount = 1;
+    std::vector<std::byte> monochrome = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    EXPECT_EQ(monochrome.size(), BmpHeadersSize + 2 * 4 + 4 * 6);
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(monochrome);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, 1);
+    EXPECT_TRUE(SamePixels(picture_info, decoded));
+}
+
+TEST(BitDepthTests, WidenedWhenLossy) {
+    PictureInfo picture_info = MakeTestPicture(5, 4, 1);
+    picture_info.bmi_header.biBitCount = 1;
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(buffer);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, 24);
+    EXPECT_TRUE(SamePixels(picture_info, decoded));
+}
+
+TEST(BitDepthTests, DepthOption) {
+    PictureInfo picture_info = MakeTestPicture(8, 8, 3);
+    WriteBytes(TempPath("depth_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("depth_input.bmp"),
+                                                       TempPath("depth_output.bmp"), "--depth", "auto", "-gs"});
+    control.Control();
+    PictureInfo saved = InputOutputProcessing::LoadBmpFile(TempPath("depth_output.bmp"));
+    EXPECT_EQ(saved.bmi_header.biBitCount, 8);
+    GrayScaleFilter().Apply(picture_info);
+    EXPECT_TRUE(SamePixels(picture_info, saved));
+
+    testing::internal::CaptureStderr();
+    ControlParameters wrong(std::vector<std::string>{"./image_processor", TempPath("depth_input.bmp"),
+                                                     TempPath("depth_output.bmp"), "--depth", "7"});
+    wrong.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: --depth: Invalid type of argument\n");
+}
+
+// 8-bit RLE file with a gray ramp palette around the given codes.
+std::vector<std::byte> MakeRle8File(LONG width, LONG height, const std::vector<BYTE> &codes) {
+    PictureInfo picture_info = MakeTestPicture(width, height, 0);
+    GrayScaleFilter().Apply(picture_info);
+    picture_info.bmi_header.biBitCount = 8;
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    buffer.resize(BmpHeadersSize + 256 * 4);
+    for (BYTE code : codes) {
+        buffer.push_back(static_cast<std::byte>(code));
+    }
+    BmpFileHeader file_header{};
+    BmpInfoHeader info_header{};
+    std::memcpy(&file_header, buffer.data(), sizeof(BmpFileHeader));
+    std::memcpy(&info_header, buffer.data() + sizeof(BmpFileHeader), sizeof(BmpInfoHeader));
+    file_header.bfSize = static_cast<DWORD>(buffer.size());
+    info_header.biCompression = BiRle8;
+    info_header.biSizeImage = static_cast<DWORD>(codes.size());
+    std::memcpy(buffer.data(), &file_header, sizeof(BmpFileHeader));
+    std::memcpy(buffer.data() + sizeof(BmpFileHeader), &info_header, sizeof(BmpInfoHeader));
+    return buffer;
+}
+
+TEST(RleTests, RoundTrip) {
+    PictureInfo gray = MakeTestPicture(37, 9, 4);
+    GrayScaleFilter().Apply(gray);
+    for (LONG y = 0; y < 9; ++y) {
+        std::fill(gray.pixels[y].begin() + y, gray.pixels[y].begin() + y + 20, Pixel{7, 7, 7});
+    }
+    gray.bmi_header.biBitCount = 8;
+    gray.bmi_header.biCompression = BiRle8;
+    std::vector<std::byte> rle8 = InputOutputProcessing::EncodeBmpToBuffer(gray);
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(rle8);
+    EXPECT_EQ(decoded.bmi_header.biCompression, BiRle8);
+    EXPECT_LT(rle8.size(), BmpHeadersSize + 256 * 4 + InputOutputProcessing::RowStride(37, 8) * 9);
+    EXPECT_TRUE(SamePixels(gray, decoded));
+
+    PictureInfo sixteen = MakeTestPicture(29, 7, 5);
+    for (LONG y = 0; y < 7; ++y) {
+        for (LONG x = 0; x < 29; ++x) {
+            BYTE value = static_cast<BYTE>((x / 4 + y) % 16 * 17);
+            sixteen.pixels[y][x] = Pixel{value, value, value};
+        }
+    }
+    sixteen.bmi_header.biBitCount = 4;
+    sixteen.bmi_header.biCompression = BiRle4;
+    std::vector<std::byte> rle4 = InputOutputProcessing::EncodeBmpToBuffer(sixteen);
+    decoded = InputOutputProcessing::LoadBmpFromMemory(rle4);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, 4);
+    EXPECT_EQ(decoded.bmi_header.biCompression, BiRle4);
+    EXPECT_TRUE(SamePixels(sixteen, decoded));
+
+    ForwardOnlyBuffer forward_only(rle4);
+    std::istream input(&forward_only);
+    EXPECT_TRUE(SamePixels(sixteen, InputOutputProcessing::LoadBmpStream(input)));
+}
+
+TEST(RleTests, AbsoluteAndDelta) {
+    // Row 0: run of three 10s, absolute 20 30 40 with padding. Delta from (0, 1) to (2, 2), one 50, end of bitmap.
+    std::vector<std::byte> buffer =
+        MakeRle8File(6, 3, {3, 10, 0, 3, 20, 30, 40, 0, 0, 0, 0, 2, 2, 1, 1, 50, 0, 1});
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(buffer);
+    const BYTE expected[3][6] = {{10, 10, 10, 20, 30, 40}, {0, 0, 0, 0, 0, 0}, {0, 0, 50, 0, 0, 0}};
+    for (LONG y = 0; y < 3; ++y) {
+        for (LONG x = 0; x < 6; ++x) {
+            EXPECT_EQ(decoded.pixels[y][x].red, expected[y][x]);
+        }
+    }
+
+    std::vector<std::byte> truncated = MakeRle8File(6, 3, {3, 10, 0, 3, 20});
+    EXPECT_THROW(InputOutputProcessing::LoadBmpFromMemory(truncated), InputDataException);
+
+    // A few bytes of RLE data for an image of more than MaxPixels pixels.
+    std::vector<std::byte> huge = MakeRle8File(4, 1, {0, 1});
+    LONG width = 2130706532;
+    std::memcpy(huge.data() + sizeof(BmpFileHeader) + offsetof(BmpInfoHeader, biWidth), &width, sizeof(width));
+    EXPECT_THROW(InputOutputProcessing::LoadBmpFromMemory(huge), FileHeaderException);
+    std::stringstream stream(std::string(reinterpret_cast<const char *>(huge.data()), huge.size()));
+    EXPECT_THROW(InputOutputProcessing::LoadBmpStream(stream), FileHeaderException);
+}
+
+TEST(RleTests, CompressOption) {
+    PictureInfo picture_info = MakeTestPicture(16, 16, 6);
+    WriteBytes(TempPath("rle_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("rle_input.bmp"),
+                                                       TempPath("rle_output.bmp"), "--depth", "8", "--compress",
+                                                       "rle", "-gs"});
+    control.Control();
+    PictureInfo saved = InputOutputProcessing::LoadBmpFile(TempPath("rle_output.bmp"));
+    EXPECT_EQ(saved.bmi_header.biCompression, BiRle8);
+    GrayScaleFilter().Apply(picture_info);
+    EXPECT_TRUE(SamePixels(picture_info, saved));
+
+    ControlParameters none(std::vector<std::string>{"./image_processor", TempPath("rle_output.bmp"),
+                                                    TempPath("rle_plain.bmp"), "--compress", "none"});
+    none.Control();
+    EXPECT_EQ(InputOutputProcessing::LoadBmpFile(TempPath("rle_plain.bmp")).bmi_header.biCompression, BiRgb);
+}
+
+// Same image stored top-down: rows in the opposite order and a negative height in the file.
+PictureInfo MakeTopDown(const PictureInfo &picture_info) {
+    PictureInfo top_down = picture_info;
+    std::reverse(top_down.pixels.begin(), top_down.pixels.end());
+    std::reverse(top_down.deep_pixels.begin(), top_down.deep_pixels.end());
+    top_down.top_down = true;
+    return top_down;
+}
+
+TEST(TopDownTests, LoadAndSave) {
+    PictureInfo picture_info = MakeTopDown(MakeTestPicture(11, 7, 3));
+    std::vector<std::byte> buffer = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+    BmpView view = InputOutputProcessing::WrapBmpMemory(buffer);
+    EXPECT_EQ(view.info_header.biHeight, -7);
+    EXPECT_EQ(static_cast<BYTE>(view.Row(0)[0]), picture_info.pixels[0][0].blue);
+
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(buffer);
+    EXPECT_TRUE(decoded.top_down);
+    EXPECT_EQ(decoded.bmi_header.biHeight, 7);
+    EXPECT_TRUE(SamePixels(picture_info, decoded));
+    EXPECT_EQ(InputOutputProcessing::EncodeBmpToBuffer(decoded), buffer);
+
+    ForwardOnlyBuffer stream_buffer(buffer);
+    std::istream input(&stream_buffer);
+    EXPECT_TRUE(SamePixels(picture_info, InputOutputProcessing::LoadBmpStream(input)));
+
+    WriteBytes(TempPath("top_down_input.bmp"), buffer);
+    EXPECT_TRUE(InputOutputProcessing::CopyBmpFile(TempPath("top_down_input.bmp"), TempPath("top_down_copy.bmp")));
+    EXPECT_EQ(ReadBytes(TempPath("top_down_copy.bmp")), buffer);
+}
+
+TEST(TopDownTests, RleIsWrittenBottomUp) {
+    PictureInfo picture_info = MakeTestPicture(9, 5, 1);
+    GrayScaleFilter().Apply(picture_info);
+    PictureInfo top_down = MakeTopDown(picture_info);
+    top_down.bmi_header.biBitCount = 8;
+    top_down.bmi_header.biCompression = BiRle8;
+    PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(InputOutputProcessing::EncodeBmpToBuffer(top_down));
+    EXPECT_FALSE(decoded.top_down);
+    EXPECT_TRUE(SamePixels(picture_info, decoded));
+}
+
+TEST(TopDownTests, FiltersUseLogicalRows) {
+    std::vector<std::shared_ptr<const Filter> > filters = {
+        std::make_shared<CropFilter>(6, 4), std::make_shared<PixelizeFilter>(3),
+        std::make_shared<EdgeDetectionFilter>(EdgeTestArg), std::make_shared<SharpeningFilter>(),
+        std::make_shared<GaussianBlurFilter>(1.5)};
+    for (const auto &filter : filters) {
+        PictureInfo bottom_up = MakeTestPicture(10, 8, 5);
+        PictureInfo top_down = MakeTopDown(bottom_up);
+        filter->Apply(bottom_up);
+        filter->Apply(top_down);
+        EXPECT_TRUE(top_down.top_down);
+        EXPECT_TRUE(SamePixels(MakeTopDown(bottom_up), top_down));
+    }
+}
+
+TEST(QoiTests, RoundTrip) {
+    PictureInfo picture_info = MakeTestPicture(23, 11, 7);
+    for (LONG y = 0; y < 11; ++y) {
+        std::fill(picture_info.pixels[y].begin(), picture_info.pixels[y].begin() + 15, Pixel{1, 2, 3});
+    }
+    std::stringstream stream;
+    InputOutputProcessing::SaveImageStream(stream, picture_info, ImageFormat::Qoi);
+    EXPECT_EQ(stream.str().substr(0, 4), "qoif");
+    PictureInfo decoded = InputOutputProcessing::LoadImageStream(stream);
+    EXPECT_TRUE(decoded.top_down);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, 24);
+    EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), decoded));
+
+    PictureInfo alpha = MakeTopDown(MakeAlphaPicture(17, 9, 2));
+    std::stringstream alpha_stream;
+    InputOutputProcessing::SaveImageStream(alpha_stream, alpha, ImageFormat::Qoi);
+    decoded = InputOutputProcessing::LoadImageStream(alpha_stream);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, 32);
+    EXPECT_TRUE(SamePixels(alpha, decoded));
+    EXPECT_TRUE(SameAlpha(alpha, decoded));
+}
+
+TEST(QoiTests, KnownEncoding) {
+    PictureInfo picture_info = MakeTestPicture(4, 1, 0);
+    picture_info.top_down = true;
+    picture_info.pixels[0] = {Pixel{0, 0, 0}, Pixel{0, 0, 0}, Pixel{1, 0, 0}, Pixel{40, 10, 200}};
+    std::stringstream stream;
+    QoiCodec::Save(stream, picture_info);
+    // Run of two pixels equal to the initial black one, diff (0, 0, +1), RGB, end marker.
+    const std::string expected_body = {'\xc1', '\x6b', '\xfe', '\xc8', '\x0a', '\x28', 0, 0, 0, 0, 0, 0, 0, 1};
+    EXPECT_EQ(stream.str().substr(14), expected_body);
+
+    std::string truncated = stream.str().substr(0, 16);
+    std::stringstream truncated_stream(truncated);
+    EXPECT_THROW(QoiCodec::Load(truncated_stream), InputDataException);
+}
+
+TEST(QoiTests, FormatByExtension) {
+    EXPECT_EQ(InputOutputProcessing::FormatFromPath("image.QOI"), ImageFormat::Qoi);
+    EXPECT_EQ(InputOutputProcessing::FormatFromPath("image.bmp"), ImageFormat::Bmp);
+    EXPECT_EQ(InputOutputProcessing::FormatFromPath("-"), ImageFormat::Bmp);
+
+    PictureInfo picture_info = MakeTestPicture(12, 10, 3);
+    WriteBytes(TempPath("qoi_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters to_qoi(std::vector<std::string>{"./image_processor", TempPath("qoi_input.bmp"),
+                                                      TempPath("qoi_output.qoi")});
+    to_qoi.Control();
+    ControlParameters to_bmp(std::vector<std::string>{"./image_processor", TempPath("qoi_output.qoi"),
+                                                      TempPath("qoi_output.bmp"), "-neg"});
+    to_bmp.Control();
+    PictureInfo saved = InputOutputProcessing::LoadBmpFile(TempPath("qoi_output.bmp"));
+    EXPECT_TRUE(saved.top_down);
+    NegativeFilter().Apply(picture_info);
+    EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), saved));
+}
+
+TEST(PnmTests, RoundTrip) {
+    PictureInfo picture_info = MakeAlphaPicture(19, 8, 4);
+    for (ImageFormat format : {ImageFormat::Ppm, ImageFormat::Pam}) {
+        std::stringstream stream;
+        InputOutputProcessing::SaveImageStream(stream, picture_info, format);
+        PictureInfo decoded = InputOutputProcessing::LoadImageStream(stream);
+        EXPECT_TRUE(decoded.top_down);
+        EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), decoded));
+        EXPECT_EQ(decoded.bmi_header.biBitCount, format == ImageFormat::Pam ? 32 : 24);
+    }
+
+    std::stringstream pam;
+    InputOutputProcessing::SaveImageStream(pam, picture_info, ImageFormat::Pam);
+    EXPECT_TRUE(SameAlpha(MakeTopDown(picture_info), InputOutputProcessing::LoadImageStream(pam)));
+
+    PictureInfo gray = MakeTestPicture(9, 5, 2);
+    GrayScaleFilter().Apply(gray);
+    std::stringstream pgm;
+    InputOutputProcessing::SaveImageStream(pgm, gray, ImageFormat::Pgm);
+    EXPECT_EQ(pgm.str().size(), std::string("P5\n9 5\n255\n").size() + 9 * 5);
+    PictureInfo decoded = InputOutputProcessing::LoadImageStream(pgm);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, 8);
+    EXPECT_TRUE(SamePixels(MakeTopDown(gray), decoded));
+}
+
+TEST(PnmTests, HeaderVariants) {
+    std::stringstream pixmap(std::string("P6 # comment\n2\t1\n# another\n15\n") + std::string{0, 15, 5, 15, 0, 10});
+    PictureInfo picture_info = PnmCodec::Load(pixmap);
+    EXPECT_EQ(picture_info.pixels[0][0].red, 0);
+    EXPECT_EQ(picture_info.pixels[0][0].green, 255);
+    EXPECT_EQ(picture_info.pixels[0][0].blue, 85);
+    EXPECT_EQ(picture_info.pixels[0][1].blue, 170);
+
+    std::stringstream gray_alpha(std::string("P7\nWIDTH 1\nHEIGHT 2\nDEPTH 2\nMAXVAL 255\nTUPLTYPE GRAYSCALE_ALPHA\n"
+                                             "ENDHDR\n") +
+                                 std::string{'\x10', '\x20', '\x30', '\x40'});
+    picture_info = PnmCodec::Load(gray_alpha);
+    EXPECT_EQ(picture_info.pixels[1][0].green, 0x30);
+    EXPECT_EQ(picture_info.pixels[1][0].alpha, 0x40);
+
+    std::stringstream truncated("P5\n4 4\n255\nabc");
+    EXPECT_THROW(PnmCodec::Load(truncated), InputDataException);
+    std::stringstream too_wide("P5\n4 4\n65536\n");
+    EXPECT_THROW(PnmCodec::Load(too_wide), InfoHeaderException);
+}
+
+TEST(PnmTests, FormatOption) {
+    PictureInfo picture_info = MakeTestPicture(7, 6, 1);
+    WriteBytes(TempPath("pnm_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("pnm_input.bmp"),
+                                                       TempPath("pnm_output.img"), "--format", "ppm"});
+    control.Control();
+    std::vector<std::byte> saved = ReadBytes(TempPath("pnm_output.img"));
+    EXPECT_EQ(static_cast<char>(saved[1]), '6');
+    PictureInfo decoded = InputOutputProcessing::LoadImageFile(TempPath("pnm_output.img"));
+    EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), decoded));
+
+    testing::internal::CaptureStderr();
+    ControlParameters wrong(std::vector<std::string>{"./image_processor", TempPath("pnm_input.bmp"), "-",
+                                                     "--format", "gif"});
+    wrong.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: --format: Invalid type of argument\n");
+}
+
+TEST(ZlibTests, RoundTrip) {
+    std::vector<std::byte> data;
+    for (size_t index = 0; index < 100000; ++index) {
+        // Repeated text with noise in it gives both literals and matches at every distance.
+        data.push_back(static_cast<std::byte>(index % 7 == 0 ? index * 2654435761 >> 13 : "deflate "[index % 8]));
+    }
+    for (int level = ZlibCodec::MinLevel; level <= ZlibCodec::MaxLevel; ++level) {
+        std::vector<std::byte> compressed = ZlibCodec::Deflate(data, level);
+        if (level > ZlibCodec::MinLevel) {
+            EXPECT_LT(compressed.size(), data.size() / 2);
+        }
+        EXPECT_EQ(ZlibCodec::Inflate(compressed, data.size()), data);
+    }
+    EXPECT_TRUE(ZlibCodec::Inflate(ZlibCodec::Deflate({}), 0).empty());
+}
+
+TEST(ZlibTests, Checksums) {
+    std::string check = "123456789";
+    EXPECT_EQ(Checksums::Crc32(std::as_bytes(std::span(check))), 0xCBF43926);
+    std::string wikipedia = "Wikipedia";
+    EXPECT_EQ(Checksums::Adler32(std::as_bytes(std::span(wikipedia))), 0x11E60398);
+    // Checksums of parts continue each other.
+    DWORD first = Checksums::Crc32(std::as_bytes(std::span(check).first(4)));
+    EXPECT_EQ(Checksums::Crc32(std::as_bytes(std::span(check).subspan(4)), first), 0xCBF43926);
+}
+
+TEST(ZlibTests, BrokenData) {
+    std::vector<std::byte> data(1000, std::byte{'a'});
+    std::vector<std::byte> compressed = ZlibCodec::Deflate(data);
+    EXPECT_THROW(ZlibCodec::Inflate(compressed, data.size() - 1), InputDataException);
+    EXPECT_THROW(ZlibCodec::Inflate(std::span(compressed).first(compressed.size() - 5), data.size()),
+                 InputDataException);
+    compressed.back() ^= std::byte{1};
+    EXPECT_THROW(ZlibCodec::Inflate(compressed, data.size()), InputDataException);
+}
+
+TEST(PngTests, RoundTrip) {
+    PictureInfo color = MakeTestPicture(37, 21, 3);
+    PictureInfo alpha = MakeAlphaPicture(16, 9, 5);
+    PictureInfo gray = MakeTestPicture(13, 11, 7);
+    GrayScaleFilter().Apply(gray);
+    gray.bmi_header.biBitCount = 8;
+    for (const PictureInfo *picture_info : {&color, &alpha, &gray}) {
+        for (int level : {ZlibCodec::MinLevel, ZlibCodec::DefaultLevel, ZlibCodec::MaxLevel}) {
+            std::stringstream stream;
+            InputOutputProcessing::SaveImageStream(stream, *picture_info, ImageFormat::Png, level);
+            PictureInfo decoded = InputOutputProcessing::LoadImageStream(stream);
+            EXPECT_TRUE(decoded.top_down);
+            EXPECT_EQ(decoded.bmi_header.biBitCount, picture_info->bmi_header.biBitCount);
+            EXPECT_TRUE(SamePixels(MakeTopDown(*picture_info), decoded));
+            EXPECT_TRUE(SameAlpha(MakeTopDown(*picture_info), decoded));
+        }
+    }
+
+    std::stringstream stream;
+    PngCodec::Save(stream, color);
+    std::string png = stream.str();
+    // A flipped bit in the image data breaks the CRC of its chunk.
+    png[50] ^= 1;
+    std::stringstream broken(png);
+    EXPECT_THROW(PngCodec::Load(broken), InputDataException);
+    std::stringstream truncated(stream.str().substr(0, 40));
+    EXPECT_THROW(PngCodec::Load(truncated), InputDataException);
+}
+
+TEST(PngTests, FormatByExtension) {
+    PictureInfo picture_info = MakeTestPicture(40, 30, 2);
+    WriteBytes(TempPath("png_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("png_input.bmp"),
+                                                       TempPath("png_output.png"), "--level", "9"});
+    control.Control();
+    std::vector<std::byte> saved = ReadBytes(TempPath("png_output.png"));
+    EXPECT_EQ(std::string(reinterpret_cast<const char *>(saved.data()) + 1, 3), "PNG");
+    PictureInfo decoded = InputOutputProcessing::LoadImageFile(TempPath("png_output.png"));
+    EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), decoded));
+
+    testing::internal::CaptureStderr();
+    ControlParameters wrong(std::vector<std::string>{"./image_processor", TempPath("png_input.bmp"), "-",
+                                                     "--level", "10"});
+    wrong.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: --level: Invalid type of argument\n");
+}
+
+// 16x16 baseline JPEG, 4:2:0, quality 90, a restart marker every 2 MCUs: red is 16 * x, green 16 * y, blue 128.
+std::string GradientJpeg() {
+    std::string hex =
+        "ffd8ffe000104a46494600010100000100010000ffdb0043000302020305080a0c02020304050c0c0b03030305080b0e0b030304060a"
+        "11100c0404070b0e16150f05070b0d101517120a0d1011151818140e12131416141514ffdb00430103040509141414140404050d1414"
+        "141405050b1414141414090d1414141414141414141414141414141414141414141414141414141414141414141414141414ffc00011"
+        "080010001003012200021101031101ffc4001f0000010501010101010100000000000000000102030405060708090a0bffc400b51000"
+        "02010303020403050504040000017d01020300041105122131410613516107227114328191a1082342b1c11552d1f02433627282090a"
+        "161718191a25262728292a3435363738393a434445464748494a535455565758595a636465666768696a737475767778797a83848586"
+        "8788898a92939495969798999aa2a3a4a5a6a7a8a9aab2b3b4b5b6b7b8b9bac2c3c4c5c6c7c8c9cad2d3d4d5d6d7d8d9dae1e2e3e4e5"
+        "e6e7e8e9eaf1f2f3f4f5f6f7f8f9faffc4001f0100030101010101010101010000000000000102030405060708090a0bffc400b51100"
+        "020102040403040705040400010277000102031104052131061241510761711322328108144291a1b1c109233352f0156272d10a1624"
+        "34e125f11718191a262728292a35363738393a434445464748494a535455565758595a636465666768696a737475767778797a828384"
+        "85868788898a92939495969798999aa2a3a4a5a6a7a8a9aab2b3b4b5b6b7b8b9bac2c3c4c5c6c7c8c9cad2d3d4d5d6d7d8d9dae2e3e4"
+        "e5e6e7e8e9eaf2f3f4f5f6f7f8f9faffdd00040002ffda000c03010002110311003f00f957c27f0a7a7fa37e95ecde13f853d3fd1bf4"
+        "af62f09fc29e9fe8dfa57b3784fe14f4ff0046fd2baf39e27dff007a4f86dc63f0fef8ffd9";
+    std::string bytes;
+    for (size_t index = 0; index < hex.size(); index += 2) {
+        bytes += static_cast<char>(std::stoi(hex.substr(index, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+TEST(JpegTests, Decode) {
+    std::stringstream full(GradientJpeg());
+    PictureInfo picture_info = InputOutputProcessing::LoadImageStream(full);
+    ASSERT_EQ(picture_info.bmi_header.biWidth, 16);
+    ASSERT_EQ(picture_info.bmi_header.biHeight, 16);
+    EXPECT_TRUE(picture_info.top_down);
+    for (LONG y = 0; y < 16; ++y) {
+        for (LONG x = 0; x < 16; ++x) {
+            // Subsampled chroma and quantization lose a little.
+            EXPECT_NEAR(picture_info.pixels[y][x].red, 16 * x, 24);
+            EXPECT_NEAR(picture_info.pixels[y][x].green, 16 * y, 24);
+            EXPECT_NEAR(picture_info.pixels[y][x].blue, 128, 24);
+        }
+    }
+
+    // The brightness of every pixel of a scaled image is about the average of the pixels it stands for.
+    // Colours are not checked: at 1/8 one chroma sample covers all 16x16 pixels.
+    auto luma = [](double red, double green, double blue) { return 0.299 * red + 0.587 * green + 0.114 * blue; };
+    for (int scale : {2, 4, 8}) {
+        std::stringstream input(GradientJpeg());
+        PictureInfo scaled = JpegCodec::Load(input, JpegDecodeOptions{.scale = scale});
+        ASSERT_EQ(scaled.bmi_header.biWidth, 16 / scale);
+        ASSERT_EQ(scaled.pixels.size(), 16 / scale);
+        for (LONG y = 0; y < 16 / scale; ++y) {
+            for (LONG x = 0; x < 16 / scale; ++x) {
+                const Pixel &pixel = scaled.pixels[y][x];
+                double average = luma(16 * scale * x + 8 * (scale - 1), 16 * scale * y + 8 * (scale - 1), 128);
+                EXPECT_NEAR(luma(pixel.red, pixel.green, pixel.blue), average, 8);
+            }
+        }
+    }
+
+    std::stringstream input(GradientJpeg());
+    PictureInfo cropped = JpegCodec::Load(input, JpegDecodeOptions{.scale = 2, .max_width = 5, .max_height = 3});
+    EXPECT_EQ(cropped.bmi_header.biWidth, 5);
+    EXPECT_EQ(cropped.bmi_header.biHeight, 3);
+}
+
+TEST(JpegTests, UnsupportedAndBroken) {
+    std::string progressive = GradientJpeg();
+    progressive[progressive.find("\xff\xc0") + 1] = '\xc2';
+    std::stringstream progressive_input(progressive);
+    EXPECT_THROW(JpegCodec::Load(progressive_input), InfoHeaderException);
+
+    // Two codes of length 1 use up the code space, so the four codes of length 3 do not fit.
+    std::string oversubscribed = GradientJpeg();
+    size_t counts = oversubscribed.find("\xff\xc4") + 5;
+    oversubscribed[counts] = '\x02';
+    oversubscribed[counts + 1] = '\x00';
+    oversubscribed[counts + 2] = '\x04';
+    std::stringstream oversubscribed_input(oversubscribed);
+    EXPECT_THROW(JpegCodec::Load(oversubscribed_input), FileHeaderException);
+
+    std::stringstream truncated(GradientJpeg().substr(0, 100));
+    EXPECT_THROW(JpegCodec::Load(truncated), InputDataException);
+
+    std::stringstream bmp;
+    InputOutputProcessing::SaveBmpStream(bmp, MakeTestPicture(4, 4, 1));
+    EXPECT_THROW(InputOutputProcessing::LoadImageStream(bmp, JpegDecodeOptions{.scale = 2}), InputDataException);
+}
+
+TEST(JpegTests, ScaleAndCropOptions) {
+    std::string jpeg = GradientJpeg();
+    WriteBytes(TempPath("jpeg_input.jpg"), std::vector<std::byte>(reinterpret_cast<const std::byte *>(jpeg.data()),
+                                                                  reinterpret_cast<const std::byte *>(jpeg.data()) +
+                                                                      jpeg.size()));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("jpeg_input.jpg"),
+                                                       TempPath("jpeg_output.bmp"), "--scale", "4", "-gs", "-crop",
+                                                       "3", "2"});
+    control.Control();
+    PictureInfo decoded = InputOutputProcessing::LoadImageFile(TempPath("jpeg_output.bmp"));
+    EXPECT_EQ(decoded.bmi_header.biWidth, 3);
+    EXPECT_EQ(decoded.bmi_header.biHeight, 2);
+
+    testing::internal::CaptureStderr();
+    ControlParameters wrong(std::vector<std::string>{"./image_processor", TempPath("jpeg_input.jpg"), "-",
+                                                     "--scale", "3"});
+    wrong.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: --scale: Invalid type of argument\n");
+}
+
+TEST(TiffTests, RoundTrip) {
+    PictureInfo color = MakeTestPicture(37, 21, 3);
+    PictureInfo alpha = MakeAlphaPicture(50, 33, 5);
+    PictureInfo gray = MakeTestPicture(13, 40, 7);
+    GrayScaleFilter().Apply(gray);
+    gray.bmi_header.biBitCount = 8;
+    for (const PictureInfo *picture_info : {&color, &alpha, &gray}) {
+        // Strips, tiles larger than the image and tiles cut at the right and bottom edges.
+        for (LONG tile_size : {0, 16, 64}) {
+            std::stringstream stream;
+            InputOutputProcessing::SaveImageStream(stream, *picture_info, ImageFormat::Tiff, ZlibCodec::DefaultLevel,
+                                                   tile_size);
+            PictureInfo decoded = InputOutputProcessing::LoadImageStream(stream);
+            EXPECT_TRUE(decoded.top_down);
+            EXPECT_EQ(decoded.bmi_header.biBitCount, picture_info->bmi_header.biBitCount);
+            EXPECT_TRUE(SamePixels(MakeTopDown(*picture_info), decoded));
+            EXPECT_TRUE(SameAlpha(MakeTopDown(*picture_info), decoded));
+        }
+    }
+
+    std::stringstream stream;
+    EXPECT_THROW(TiffCodec::Save(stream, color, 24), InputDataException);
+    TiffCodec::Save(stream, color, 16);
+    std::stringstream truncated(stream.str().substr(0, 200));
+    EXPECT_THROW(TiffCodec::Load(truncated), InputDataException);
+    std::string big_tiff = stream.str();
+    big_tiff[2] = 43;
+    std::stringstream broken(big_tiff);
+    EXPECT_THROW(TiffCodec::Load(broken), InfoHeaderException);
+}
+
+// Overwrites the count and the first value of a tag in the directory of a little-endian TIFF.
+void PatchTiffTag(std::string &tiff, WORD tag, uint32_t count, uint32_t value) {
+    auto read = [&tiff](size_t offset, int size) {
+        uint32_t result = 0;
+        for (int index = size - 1; index >= 0; --index) {
+            result = result << 8 | static_cast<BYTE>(tiff[offset + index]);
+        }
+        return result;
+    };
+    auto write = [&tiff](size_t offset, uint32_t data) {
+        for (int index = 0; index < 4; ++index) {
+            tiff[offset + index] = static_cast<char>(data >> (8 * index) & 0xff);
+        }
+    };
+    size_t directory = read(4, 4);
+    for (size_t entry = directory + 2; entry < directory + 2 + 12 * read(directory, 2); entry += 12) {
+        if (read(entry, 2) == tag) {
+            write(entry + 4, count);
+            write(entry + 8, value);
+        }
+    }
+}
+
+TEST(TiffTests, BrokenDirectory) {
+    constexpr WORD TagImageWidth = 256;
+    constexpr WORD TagTileWidth = 322;
+    std::stringstream stream;
+    TiffCodec::Save(stream, MakeTestPicture(37, 21, 3), 16);
+
+    std::string empty_tag = stream.str();
+    PatchTiffTag(empty_tag, TagImageWidth, 0, 37);
+    std::stringstream empty_tag_input(empty_tag);
+    EXPECT_THROW(TiffCodec::Load(empty_tag_input), FileHeaderException);
+
+    // The number of tiles across is counted without overflowing the width plus the tile width.
+    std::string wide_tiles = stream.str();
+    PatchTiffTag(wide_tiles, TagTileWidth, 1, std::numeric_limits<LONG>::max());
+    std::stringstream wide_tiles_input(wide_tiles);
+    EXPECT_THROW(TiffCodec::Load(wide_tiles_input), FileHeaderException);
+}
+
+TEST(TiffTests, ParallelTiles) {
+    PictureInfo picture_info = MakeAlphaPicture(300, 200, 9);
+    std::ofstream file(TempPath("tiff_tiles.tif"), std::ios::binary);
+    TiffCodec::Save(file, picture_info, 32);
+    file.close();
+    EXPECT_TRUE(TiffCodec::IsTiffFile(TempPath("tiff_tiles.tif")));
+    EXPECT_FALSE(TiffCodec::IsTiffFile(TempPath("missing.tif")));
+
+    TiffFile tiff(TempPath("tiff_tiles.tif"));
+    EXPECT_EQ(tiff.TileCount(), 10 * 7);
+    TileRect corner = tiff.Tile(tiff.TileCount() - 1);
+    EXPECT_EQ(corner.x, 288);
+    EXPECT_EQ(corner.y, 192);
+    EXPECT_EQ(corner.width, 12);
+    EXPECT_EQ(corner.height, 8);
+
+    PictureInfo sequential = TiffCodec::LoadFile(TempPath("tiff_tiles.tif"), TileScheduler(1));
+    PictureInfo parallel = TiffCodec::LoadFile(TempPath("tiff_tiles.tif"), TileScheduler(4));
+    EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), sequential));
+    EXPECT_TRUE(SamePixels(sequential, parallel));
+
+    // The point filter runs on every tile as soon as it is read and gives the same result as on the whole image.
+    NegativeFilter negative;
+    PictureInfo filtered = TiffCodec::LoadFile(TempPath("tiff_tiles.tif"), TileScheduler(4), &negative);
+    negative.Apply(sequential);
+    EXPECT_TRUE(SamePixels(sequential, filtered));
+}
+
+TEST(TiffTests, SchedulerRethrows) {
+    std::atomic<int> done = 0;
+    TileScheduler scheduler(4);
+    EXPECT_EQ(scheduler.Threads(), 4);
+    scheduler.Run(100, [&done](size_t) { ++done; });
+    EXPECT_EQ(done, 100);
+    EXPECT_THROW(scheduler.Run(100,
+                               [](size_t index) {
+                                   if (index == 7) {
+                                       throw InputDataException("Broken tile");
+                                   }
+                               }),
+                 InputDataException);
+    EXPECT_EQ(TileScheduler::Grid(40, 20, 16, 16).size(), 6);
+}
+
+TEST(TiffTests, TileOption) {
+    PictureInfo picture_info = MakeTestPicture(70, 50, 4);
+    WriteBytes(TempPath("tiff_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("tiff_input.bmp"),
+                                                       TempPath("tiff_output.tif"), "--tile", "32"});
+    control.Control();
+    EXPECT_EQ(TiffFile(TempPath("tiff_output.tif")).TileCount(), 3 * 2);
+
+    // A chain of point filters on a TIFF input is applied tile by tile while the file is read.
+    ControlParameters filtered(std::vector<std::string>{"./image_processor", TempPath("tiff_output.tif"),
+                                                        TempPath("tiff_filtered.bmp"), "-neg", "-gs"});
+    filtered.Control();
+    PictureInfo expected = MakeTopDown(picture_info);
+    Pipeline::Compile(std::vector<std::string>{"-neg", "-gs"}).Apply(expected);
+    EXPECT_TRUE(SamePixels(expected, InputOutputProcessing::LoadImageFile(TempPath("tiff_filtered.bmp"))));
+
+    testing::internal::CaptureStderr();
+    ControlParameters wrong(std::vector<std::string>{"./image_processor", TempPath("tiff_input.bmp"), "-",
+                                                     "--tile", "20"});
+    wrong.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: --tile: Invalid type of argument\n");
+}
+
+std::vector<std::byte> SavePyramid(const PictureInfo &picture_info, LONG tile_size) {
+    std::stringstream stream;
+    PyramidCodec::Save(stream, picture_info, tile_size);
+    std::string data = stream.str();
+    const std::byte *bytes = reinterpret_cast<const std::byte *>(data.data());
+    return std::vector<std::byte>(bytes, bytes + data.size());
+}
+
+TEST(PyramidTests, LevelsAndRegions) {
+    PictureInfo picture_info = MakeAlphaPicture(300, 201, 4);
+    PictureInfo top_down = MakeTopDown(picture_info);
+    PyramidFile file(SavePyramid(picture_info, 64));
+    EXPECT_EQ(file.Width(), 300);
+    EXPECT_EQ(file.Height(), 201);
+    EXPECT_EQ(file.BitCount(), picture_info.bmi_header.biBitCount);
+    ASSERT_EQ(file.LevelCount(), 4);
+    EXPECT_EQ(file.Level(1).width, 150);
+    EXPECT_EQ(file.Level(1).height, 101);
+    EXPECT_EQ(file.Level(3).width, 38);
+    EXPECT_EQ(file.TileCount(0), 5 * 4);
+
+    PictureInfo whole = file.ReadRegion(0, 0, 0, 300, 201);
+    EXPECT_TRUE(SamePixels(top_down, whole));
+    EXPECT_TRUE(SameAlpha(top_down, whole));
+    // The region crosses tile borders in both directions.
+    PictureInfo region = file.ReadRegion(0, 50, 60, 100, 80, TileScheduler(3));
+    for (LONG y = 0; y < 80; ++y) {
+        for (LONG x = 0; x < 100; ++x) {
+            EXPECT_EQ(region.pixels[y][x].red, top_down.pixels[60 + y][50 + x].red);
+        }
+    }
+
+    // Every pixel of a reduced level is the mean of the 2x2 block below it, the bottom row of level 1 has only one.
+    PictureInfo half = file.ReadRegion(1, 0, 0, 150, 101);
+    int sum = top_down.pixels[2][4].green + top_down.pixels[2][5].green + top_down.pixels[3][4].green +
+              top_down.pixels[3][5].green;
+    EXPECT_EQ(half.pixels[1][2].green, (sum + 2) / 4);
+    EXPECT_EQ(half.pixels[100][0].blue, (top_down.pixels[200][0].blue + top_down.pixels[200][1].blue + 1) / 2);
+    EXPECT_THROW(file.ReadRegion(1, 100, 0, 51, 10), InputDataException);
+}
+
+TEST(PyramidTests, Checksums) {
+    PictureInfo picture_info = MakeTestPicture(100, 40, 6);
+    std::vector<std::byte> data = SavePyramid(picture_info, 32);
+    PyramidFile clean(data);
+    // The second tile of level 0 starts after the first one, 32 x 32 pixels aligned to 64 bytes.
+    std::vector<std::byte> broken_tile = data;
+    broken_tile[64 + 32 * 32 * 4 + 10] ^= std::byte{1};
+    PyramidFile file(broken_tile);
+    EXPECT_NO_THROW(file.ReadRegion(0, 0, 0, 32, 32));
+    EXPECT_THROW(file.ReadRegion(0, 30, 0, 10, 10), InputDataException);
+    EXPECT_THROW(file.TileData(0, 1), InputDataException);
+
+    std::vector<std::byte> broken_index = data;
+    broken_index[broken_index.size() - 10] ^= std::byte{1};
+    EXPECT_THROW(PyramidFile{broken_index}, InputDataException);
+    std::vector<std::byte> truncated(data.begin(), data.end() - 1);
+    EXPECT_THROW(PyramidFile{truncated}, InputDataException);
+}
+
+TEST(PyramidTests, ScaleAndCrop) {
+    PictureInfo picture_info = MakeTestPicture(90, 70, 8);
+    WriteBytes(TempPath("pyramid_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters save(std::vector<std::string>{"./image_processor", TempPath("pyramid_input.bmp"),
+                                                    TempPath("pyramid.pyr"), "--tile", "32"});
+    save.Control();
+    PictureInfo loaded = InputOutputProcessing::LoadImageFile(TempPath("pyramid.pyr"));
+    EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), loaded));
+
+    ControlParameters preview(std::vector<std::string>{"./image_processor", TempPath("pyramid.pyr"),
+                                                       TempPath("pyramid_preview.bmp"), "--scale", "4", "-crop",
+                                                       "10", "5"});
+    preview.Control();
+    PictureInfo decoded = InputOutputProcessing::LoadImageFile(TempPath("pyramid_preview.bmp"));
+    EXPECT_EQ(decoded.bmi_header.biWidth, 10);
+    EXPECT_EQ(decoded.bmi_header.biHeight, 5);
+    // Pyramid regions are top-down, and the BMP writer keeps the row order.
+    EXPECT_TRUE(decoded.top_down);
+    EXPECT_TRUE(SamePixels(PyramidFile(TempPath("pyramid.pyr")).ReadRegion(2, 0, 0, 10, 5), decoded));
+}
+
+// A 16-bit picture with low bytes that an 8-bit one can't hold.
+PictureInfo MakeDeepPicture(LONG width, LONG height, int seed, bool alpha) {
+    PictureInfo picture_info = alpha ? MakeAlphaPicture(width, height, seed) : MakeTestPicture(width, height, seed);
+    picture_info.SetDeep(true);
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
+            picture_info.deep_pixels[y][x].green ^= static_cast<WORD>((x * 13 + y) & 0xff);
+        }
+    }
+    return picture_info;
+}
+
+bool SameDeepPixels(const PictureInfo &lhs, const PictureInfo &rhs) {
+    if (lhs.deep_pixels.size() != rhs.deep_pixels.size()) {
+        return false;
+    }
+    for (size_t y = 0; y < lhs.deep_pixels.size(); ++y) {
+        for (size_t x = 0; x < lhs.deep_pixels[y].size(); ++x) {
+            const Pixel16 &left = lhs.deep_pixels[y][x];
+            const Pixel16 &right = rhs.deep_pixels[y][x];
+            if (left.red != right.red || left.green != right.green || left.blue != right.blue ||
+                left.alpha != right.alpha) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Largest channel difference between two 8-bit pictures of the same size.
+int MaxDifference(const PictureInfo &lhs, const PictureInfo &rhs) {
+    int difference = 0;
+    for (size_t y = 0; y < lhs.pixels.size(); ++y) {
+        for (size_t x = 0; x < lhs.pixels[y].size(); ++x) {
+            const Pixel &left = lhs.pixels[y][x];
+            const Pixel &right = rhs.pixels[y][x];
+            difference = std::max({difference, std::abs(left.red - right.red), std::abs(left.green - right.green),
+                                   std::abs(left.blue - right.blue)});
+        }
+    }
+    return difference;
+}
+
+TEST(DeepTests, BmpRoundTrip) {
+    for (bool alpha : {false, true}) {
+        PictureInfo picture_info = MakeDeepPicture(13, 7, 3, alpha);
+        std::vector<std::byte> encoded = InputOutputProcessing::EncodeBmpToBuffer(picture_info);
+        PictureInfo decoded = InputOutputProcessing::LoadBmpFromMemory(encoded);
+        EXPECT_EQ(decoded.bmi_header.biBitCount, alpha ? DeepColorAlphaBits : DeepColorBits);
+        EXPECT_TRUE(decoded.Deep());
+        EXPECT_TRUE(SameDeepPixels(picture_info, decoded));
+
+        std::stringstream stream;
+        InputOutputProcessing::SaveBmpStream(stream, picture_info);
+        EXPECT_EQ(stream.str().size(), encoded.size());
+        EXPECT_TRUE(SameDeepPixels(picture_info, InputOutputProcessing::LoadBmpStream(stream)));
+    }
+}
+
+TEST(DeepTests, NetpbmRoundTrip) {
+    PictureInfo picture_info = MakeDeepPicture(9, 5, 4, true);
+    std::stringstream pam;
+    InputOutputProcessing::SaveImageStream(pam, picture_info, ImageFormat::Pam);
+    EXPECT_NE(pam.str().find("MAXVAL 65535"), std::string::npos);
+    PictureInfo decoded = InputOutputProcessing::LoadImageStream(pam);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, DeepColorAlphaBits);
+    EXPECT_TRUE(SameDeepPixels(MakeTopDown(picture_info), decoded));
+
+    std::stringstream ppm("P6\n2 1\n1023\n" + std::string{'\x03', '\xff', '\x00', '\x00', '\x02', '\x00',
+                                                             '\x00', '\x01', '\x01', '\xff', '\x00', '\x00'});
+    decoded = PnmCodec::Load(ppm);
+    EXPECT_EQ(decoded.bmi_header.biBitCount, DeepColorBits);
+    EXPECT_EQ(decoded.deep_pixels[0][0].red, 65535);
+    EXPECT_EQ(decoded.deep_pixels[0][0].blue, 32800);
+    EXPECT_EQ(decoded.deep_pixels[0][1].green, 32735);
+}
+
+TEST(DeepTests, NarrowedForOtherFormats) {
+    PictureInfo picture_info = MakeTestPicture(11, 6, 5);
+    PictureInfo deep = picture_info;
+    deep.SetDeep(true);
+    std::stringstream png;
+    InputOutputProcessing::SaveImageStream(png, deep, ImageFormat::Png);
+    PictureInfo decoded = InputOutputProcessing::LoadImageStream(png);
+    EXPECT_FALSE(decoded.Deep());
+    EXPECT_TRUE(SamePixels(MakeTopDown(picture_info), decoded));
+
+    deep.SetDeep(false);
+    EXPECT_EQ(deep.bmi_header.biBitCount, 24);
+    EXPECT_TRUE(SamePixels(picture_info, deep));
+}
+
+// 8-bit blur rounds between its passes, so it may differ by 2.
+TEST(DeepTests, FiltersMatchEightBits) {
+    std::vector<std::pair<std::shared_ptr<Filter>, int> > filters = {
+        {std::make_shared<NegativeFilter>(), 0},      {std::make_shared<GrayScaleFilter>(), 1},
+        {std::make_shared<SharpeningFilter>(), 1},    {std::make_shared<GaussianBlurFilter>(1.5), 2},
+        {std::make_shared<CropFilter>(10, 7), 0},     {std::make_shared<PixelizeFilter>(4), 1}};
+    for (const auto &[filter, tolerance] : filters) {
+        PictureInfo picture_info = MakeTestPicture(23, 17, 6);
+        PictureInfo deep = picture_info;
+        deep.SetDeep(true);
+        filter->Apply(picture_info);
+        filter->Apply(deep);
+        EXPECT_TRUE(deep.Deep());
+        deep.SetDeep(false);
+        ASSERT_EQ(deep.pixels.size(), picture_info.pixels.size());
+        EXPECT_LE(MaxDifference(picture_info, deep), tolerance);
+    }
+}
+
+TEST(DeepTests, DepthOption) {
+    PictureInfo picture_info = MakeTestPicture(8, 5, 7);
+    WriteBytes(TempPath("deep_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("deep_input.bmp"),
+                                                       TempPath("deep_output.bmp"), "--depth", "48", "-neg"});
+    control.Control();
+    PictureInfo decoded = InputOutputProcessing::LoadImageFile(TempPath("deep_output.bmp"));
+    EXPECT_EQ(decoded.bmi_header.biBitCount, DeepColorBits);
+    NegativeFilter().Apply(picture_info);
+    decoded.SetDeep(false);
+    EXPECT_TRUE(SamePixels(picture_info, decoded));
+}
+
+TEST(FloatTests, MatchesChannelPrecision) {
+    // Channel blur truncates its sums and float rounds once, so they may differ by the rounding of both passes.
+    std::vector<std::pair<std::vector<std::string>, int> > chains = {
+        {{"-neg"}, 0},           {{"-gs"}, 1},          {{"-sharp"}, 0},       {{"-blur", "1.5"}, 2},
+        {{"-crop", "9", "7"}, 0}, {{"-pix", "4"}, 1}, {{"-gs", "-neg"}, 1}};
+    for (const auto &[args, tolerance] : chains) {
+        Pipeline pipeline = Pipeline::Compile(args);
+        PictureInfo picture_info = MakeTopDown(MakeTestPicture(23, 17, 9));
+        PictureInfo channel = pipeline.Run(picture_info);
+        PictureInfo planar = pipeline.Run(picture_info, Precision::Float);
+        ASSERT_EQ(channel.pixels.size(), planar.pixels.size());
+        ASSERT_EQ(channel.pixels[0].size(), planar.pixels[0].size());
+        EXPECT_EQ(planar.bmi_header.biWidth, channel.bmi_header.biWidth);
+        EXPECT_LE(MaxDifference(channel, planar), tolerance) << args[0];
+    }
+}
+
+TEST(FloatTests, NoRoundingBetweenStages) {
+    PictureInfo picture_info = MakeTestPicture(16, 16, 0);
+    for (std::vector<Pixel> &row : picture_info.pixels) {
+        std::fill(row.begin(), row.end(), Pixel{100, 150, 200});
+    }
+    Pipeline pipeline = Pipeline::Compile({"-blur", "2", "-blur", "2", "-sharp", "-blur", "1"});
+    PictureInfo result = pipeline.Run(picture_info, Precision::Float);
+    EXPECT_TRUE(SamePixels(picture_info, result));
+
+    // Edges give only black and white, alpha is kept.
+    PictureInfo edges = Pipeline::Compile({"-blur", "2", "-sharp", "-edge", "0.1"})
+                            .Run(MakeAlphaPicture(20, 12, 3), Precision::Float);
+    for (const std::vector<Pixel> &row : edges.pixels) {
+        for (const Pixel &pixel : row) {
+            EXPECT_TRUE(pixel.red == 0 || pixel.red == 255);
+            EXPECT_EQ(pixel.red, pixel.blue);
+        }
+    }
+    EXPECT_TRUE(SameAlpha(MakeAlphaPicture(20, 12, 3), edges));
+
+    PictureInfo deep = MakeDeepPicture(10, 6, 2, false);
+    PictureInfo negated = Pipeline::Compile({"-neg"}).Run(deep, Precision::Float);
+    EXPECT_TRUE(negated.Deep());
+    EXPECT_EQ(negated.deep_pixels[3][4].green, 65535 - deep.deep_pixels[3][4].green);
+}
+
+TEST(FloatTests, PrecisionOption) {
+    PictureInfo picture_info = MakeTestPicture(12, 9, 4);
+    WriteBytes(TempPath("float_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{"./image_processor", TempPath("float_input.bmp"),
+                                                       TempPath("float_output.bmp"), "-neg", "--precision",
+                                                       "float", "-crop", "5", "4"});
+    control.Control();
+    PictureInfo decoded = InputOutputProcessing::LoadImageFile(TempPath("float_output.bmp"));
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-neg", "-crop", "5", "4"}).Run(picture_info), decoded));
+
+    testing::internal::CaptureStderr();
+    ControlParameters wrong(std::vector<std::string>{"./image_processor", TempPath("float_input.bmp"), "-",
+                                                     "--precision", "double"});
+    wrong.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: --precision: Invalid type of argument\n");
+}
+
+TEST(LayoutTests, ConversionsOnlyWhereNeeded) {
+    EXPECT_EQ(Pipeline::Compile({"-neg"}).Layouts(), std::vector<Layout>{Layout::Packed});
+    EXPECT_EQ(Pipeline::Compile({"-sharp", "-blur", "1", "-neg", "-sharp"}).Layouts(),
+              (std::vector<Layout>{Layout::Packed, Layout::Planar, Layout::Planar, Layout::Planar}));
+    EXPECT_EQ(Pipeline::Compile({"-blur", "1", "-edge", "0.1", "-crop", "5", "5"}).Layouts(),
+              (std::vector<Layout>{Layout::Planar, Layout::Planar, Layout::Planar}));
+}
+
+TEST(LayoutTests, PlanesGiveSameImage) {
+    std::vector<std::shared_ptr<Filter> > filters = {
+        std::make_shared<NegativeFilter>(),         std::make_shared<GrayScaleFilter>(),
+        std::make_shared<SharpeningFilter>(),       std::make_shared<EdgeDetectionFilter>(0.3),
+        std::make_shared<GaussianBlurFilter>(1.5),  std::make_shared<CropFilter>(11, 6),
+        std::make_shared<PixelizeFilter>(4)};
+    for (const auto &filter : filters) {
+        for (PictureInfo picture_info : {MakeAlphaPicture(21, 13, 5), MakeTopDown(MakeTestPicture(21, 13, 6)),
+                                         MakeDeepPicture(21, 13, 7, true)}) {
+            PlanarImage image = PlanarImage::FromPicture(picture_info);
+            filter->Apply(image);
+            PictureInfo planar = picture_info;
+            image.ToPicture(planar);
+            filter->Apply(picture_info);
+            if (picture_info.Deep()) {
+                EXPECT_TRUE(SameDeepPixels(picture_info, planar));
+            } else {
+                EXPECT_TRUE(SamePixels(picture_info, planar));
+                EXPECT_TRUE(SameAlpha(picture_info, planar));
+            }
+        }
+    }
+
+    PictureInfo picture_info = MakeTestPicture(30, 20, 8);
+    std::vector<std::string> args = {"-sharp", "-blur", "1.5", "-gs", "-pix", "3", "-edge", "0.2", "-neg"};
+    PictureInfo expected = picture_info;
+    for (const FilterSpec &spec : Pipeline::Parse(args)) {
+        Pipeline::Compile(std::vector<FilterSpec>{spec}).Apply(expected);
+    }
+    EXPECT_TRUE(SamePixels(expected, Pipeline::Compile(args).Run(picture_info)));
+}
+
+TEST(GraphTests, SharedPrefixesRunOnce) {
+    FilterGraph graph;
+    std::vector<std::vector<std::string> > chains = {{"-crop", "20", "10", "-sharp"},
+                                                     {"-crop", "20", "10", "-sharp", "-gs"},
+                                                     {"-neg", "-crop", "20", "10", "-edge", "0.1"},
+                                                     {"-crop", "20", "10", "-sharp"},
+                                                     {"-crop", "20", "10"}};
+    for (const std::vector<std::string> &chain : chains) {
+        graph.AddOutput(chain);
+    }
+    EXPECT_EQ(graph.Outputs(), chains.size());
+    // The crop moves before -neg, then crop, sharp, gs, neg and edge are applied once each.
+    EXPECT_EQ(graph.Stages(), 5);
+    EXPECT_EQ(graph.SharedPrefix(), Pipeline::Parse({"-crop", "20", "10"}));
+
+    PictureInfo picture_info = MakeTestPicture(31, 17, 4);
+    std::vector<int> calls(chains.size());
+    graph.Run(picture_info, [&](size_t output, SharedPicture picture) {
+        ++calls[output];
+        EXPECT_TRUE(SamePixels(Pipeline::Compile(chains[output]).Run(picture_info), picture.Get()));
+    });
+    EXPECT_EQ(calls, std::vector<int>(chains.size(), 1));
+}
+
+TEST(GraphTests, FloatOutputsMatchSingleChains) {
+    std::vector<std::vector<std::string> > chains = {{"-blur", "1.3", "-sharp"},
+                                                     {"-blur", "1.3", "-gs"},
+                                                     {"-blur", "1.3", "-sharp", "-neg"},
+                                                     {"-blur", "1.3"},
+                                                     {"-crop", "20", "10", "-edge", "0.1"}};
+    FilterGraph graph;
+    for (const std::vector<std::string> &chain : chains) {
+        graph.AddOutput(chain);
+    }
+    for (const PictureInfo &picture_info : {MakeTestPicture(40, 30, 3), MakeDeepPicture(40, 30, 5, true)}) {
+        std::vector<int> calls(chains.size());
+        graph.Run(
+            picture_info,
+            [&](size_t output, SharedPicture picture) {
+                ++calls[output];
+                PictureInfo single = Pipeline::Compile(chains[output]).Run(picture_info, Precision::Float);
+                EXPECT_EQ(picture.Get().Deep(), single.Deep());
+                EXPECT_TRUE(single.Deep() ? SameDeepPixels(single, picture.Get()) : SamePixels(single, picture.Get()))
+                    << output;
+            },
+            Precision::Float);
+        EXPECT_EQ(calls, std::vector<int>(chains.size(), 1));
+    }
+}
+
+TEST(GraphTests, CopyOnWrite) {
+    SharedPicture picture(MakeTestPicture(4, 3, 1));
+    const PictureInfo *original = &picture.Get();
+    EXPECT_EQ(&picture.Mutable(), original);
+    SharedPicture branch = picture;
+    EXPECT_EQ(&branch.Get(), original);
+    branch.Mutable().pixels[0][0].red = 7;
+    EXPECT_NE(&branch.Get(), original);
+    EXPECT_EQ(&picture.Mutable(), original);
+
+    // A chain without branches hands the same image from the source to the output.
+    FilterGraph graph;
+    graph.AddOutput(std::vector<std::string>{"-neg", "-gs"});
+    PictureInfo input = MakeTestPicture(8, 8, 2);
+    const Pixel *source_pixels = input.pixels[0].data();
+    graph.Run(std::move(input), [&](size_t, SharedPicture result) {
+        EXPECT_EQ(result.Mutable().bmi_header.biWidth, 8);
+        EXPECT_EQ(result.Get().pixels[0].data(), source_pixels);
+    });
+}
+
+TEST(GraphTests, OutputOption) {
+    PictureInfo picture_info = MakeTestPicture(16, 12, 5);
+    WriteBytes(TempPath("graph_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{
+        "./image_processor", TempPath("graph_input.bmp"), TempPath("graph_sharp.bmp"), "-crop", "10", "8", "-sharp",
+        "--output", TempPath("graph_gray.qoi"), "-crop", "10", "8", "-gs", "--output", TempPath("graph_copy.bmp"),
+        "--depth", "32"});
+    control.Control();
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-crop", "10", "8", "-sharp"}).Run(picture_info),
+                           InputOutputProcessing::LoadImageFile(TempPath("graph_sharp.bmp"))));
+    EXPECT_TRUE(SamePixels(MakeTopDown(Pipeline::Compile({"-crop", "10", "8", "-gs"}).Run(picture_info)),
+                           InputOutputProcessing::LoadImageFile(TempPath("graph_gray.qoi"))));
+    PictureInfo copy = InputOutputProcessing::LoadImageFile(TempPath("graph_copy.bmp"));
+    EXPECT_EQ(copy.bmi_header.biBitCount, TrueColorAlphaBits);
+    EXPECT_TRUE(SamePixels(picture_info, copy));
+
+    testing::internal::CaptureStderr();
+    ControlParameters missing(std::vector<std::string>{"./image_processor", TempPath("graph_input.bmp"), "-",
+                                                       "-gs", "--output"});
+    missing.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: --output: Missing value\n");
+}
+
+TEST(GraphTests, AsyncWriterKeepsOrderAndErrors) {
+    std::vector<int> done;
+    AsyncWriter writer;
+    for (int index = 0; index < 5; ++index) {
+        writer.Submit([&done, index]() { done.push_back(index); });
+    }
+    writer.Wait();
+    EXPECT_EQ(done, std::vector<int>({0, 1, 2, 3, 4}));
+
+    writer.Submit([]() { throw InputDataException("Write failed"); });
+    writer.Submit([&done]() { done.push_back(5); });
+    EXPECT_THROW(writer.Wait(), InputDataException);
+    EXPECT_EQ(done.size(), 6);
+    writer.Wait();
+}
+
+TEST(GraphTests, SaveSnapshots) {
+    PictureInfo picture_info = MakeTestPicture(16, 12, 6);
+    WriteBytes(TempPath("save_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    ControlParameters control(std::vector<std::string>{
+        "./image_processor", TempPath("save_input.bmp"), TempPath("save_result.bmp"), "-crop", "10", "8", "-save",
+        TempPath("save_crop.bmp"), "-blur", "1", "-save", TempPath("save_blur.bmp"), "-neg"});
+    control.Control();
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-crop", "10", "8"}).Run(picture_info),
+                           InputOutputProcessing::LoadImageFile(TempPath("save_crop.bmp"))));
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-crop", "10", "8", "-blur", "1"}).Run(picture_info),
+                           InputOutputProcessing::LoadImageFile(TempPath("save_blur.bmp"))));
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-crop", "10", "8", "-blur", "1", "-neg"}).Run(picture_info),
+                           InputOutputProcessing::LoadImageFile(TempPath("save_result.bmp"))));
+
+    // In float precision the chain goes on from the unrounded image, as it does without -save.
+    ControlParameters in_float(std::vector<std::string>{"./image_processor", TempPath("save_input.bmp"),
+                                                        TempPath("save_float.bmp"), "--precision", "float", "-blur",
+                                                        "1.3", "-save", TempPath("save_float_blur.bmp"), "-sharp"});
+    in_float.Control();
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-blur", "1.3", "-sharp"}).Run(picture_info, Precision::Float),
+                           InputOutputProcessing::LoadImageFile(TempPath("save_float.bmp"))));
+    Pipeline blur = Pipeline::Compile(std::vector<std::string>{"-blur", "1.3"});
+    EXPECT_TRUE(SamePixels(blur.Run(picture_info, Precision::Float),
+                           InputOutputProcessing::LoadImageFile(TempPath("save_float_blur.bmp"))));
+
+    testing::internal::CaptureStderr();
+    ControlParameters missing(std::vector<std::string>{"./image_processor", TempPath("save_input.bmp"), "-",
+                                                       "-gs", "-save"});
+    missing.Control();
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "InputDataError: -save: Missing value\n");
+}
+
+TEST(LazyTests, StripsGiveSameImage) {
+    const std::vector<std::vector<std::string> > chains = {
+        {"-sharp", "-edge", "0.2"}, {"-blur", "2", "-neg", "-sharp"}, {"-gs", "-sharp", "-pix", "5", "-blur", "1"},
+        {"-sharp", "-crop", "25", "50", "-sharp", "-neg"}};
+    for (bool top_down : {false, true}) {
+        PictureInfo picture_info = MakeTestPicture(30, 70, 7);
+        if (top_down) {
+            picture_info = MakeTopDown(picture_info);
+        }
+        PictureInfo deep = MakeDeepPicture(30, 70, 8, true);
+        for (const std::vector<std::string> &chain : chains) {
+            Pipeline pipeline = Pipeline::Compile(chain);
+            PictureInfo in_strips = picture_info;
+            pipeline.ApplyInStrips(in_strips, TileScheduler(3), 9);
+            EXPECT_TRUE(SamePixels(pipeline.Run(picture_info), in_strips)) << chain.front();
+            PictureInfo deep_in_strips = deep;
+            pipeline.ApplyInStrips(deep_in_strips, TileScheduler(2), 16);
+            EXPECT_TRUE(SameDeepPixels(pipeline.Run(deep), deep_in_strips)) << chain.front();
+        }
+    }
+    EXPECT_EQ(Pipeline::Compile({"-neg", "-blur", "2", "-sharp"}).Halo(), 7);
+    EXPECT_EQ(Pipeline::Compile({"-sharp", "-pix", "4"}).Halo(), WholeImage);
+}
+
+TEST(LazyTests, RunsWhenRead) {
+    PictureInfo picture_info = MakeTestPicture(40, 30, 9);
+    LazyImage source(picture_info);
+    LazyImage cropped = source.Apply({"-crop", "30", "20"});
+    LazyImage result = cropped.Apply(std::vector<std::string>{"-neg", "-gs"}).Apply(FilterSpec{"-blur", {1}});
+    EXPECT_EQ(result.Pending(), 4);
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-crop", "30", "20", "-neg", "-gs", "-blur", "1"}).Run(picture_info),
+                           result.Get()));
+    EXPECT_EQ(result.Pending(), 0);
+    EXPECT_EQ(cropped.Pending(), 1);
+
+    LazyImage sharpened = result.Apply(std::vector<std::string>{"-sharp"});
+    EXPECT_EQ(sharpened.Pending(), 1);
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-sharp"}).Run(result.Get()), sharpened.Get()));
+    EXPECT_TRUE(SamePixels(picture_info, source.Get()));
+
+    EXPECT_THROW(source.Apply({"-blur", "0"}), InputDataException);
+    EXPECT_THROW(source.Apply(std::vector<std::string>{"-pix"}), InputDataException);
+}
+
+TEST(CacheTests, Hash64) {
+    std::string text = "The quick brown fox jumps over the lazy dog";
+    std::span<const std::byte> bytes = std::as_bytes(std::span(text));
+    EXPECT_EQ(Checksums::Hash64(bytes), Checksums::Hash64(bytes));
+    EXPECT_NE(Checksums::Hash64(bytes), Checksums::Hash64(bytes.first(bytes.size() - 1)));
+    EXPECT_NE(Checksums::Hash64(bytes), Checksums::Hash64(bytes, 1));
+    EXPECT_NE(Checksums::Hash64({}), Checksums::Hash64(bytes.first(1)));
+    std::string changed = text;
+    changed[3] = '_';
+    EXPECT_NE(Checksums::Hash64(bytes), Checksums::Hash64(std::as_bytes(std::span(changed))));
+}
+
+std::string RunWithProfile(const std::vector<std::string> &args) {
+    testing::internal::CaptureStderr();
+    ControlParameters control(args);
+    control.Control();
+    return testing::internal::GetCapturedStderr();
+}
+
+TEST(CacheTests, RepeatedJobs) {
+    std::string cache = TempPath("result_cache");
+    std::filesystem::remove_all(cache);
+    PictureInfo picture_info = MakeTestPicture(20, 14, 10);
+    WriteBytes(TempPath("cache_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    std::vector<std::string> args = {"./image_processor", TempPath("cache_input.bmp"), TempPath("cache_first.png"),
+                                     "-gs", "-blur", "1", "--cache", cache, "--profile"};
+    EXPECT_NE(RunWithProfile(args).find("\"cache_hits\": 0, \"cache_misses\": 1"), std::string::npos);
+
+    args[2] = TempPath("cache_second.png");
+    args[3] = "-neg";
+    args.insert(args.begin() + 4, {"-neg", "-gs"});
+    EXPECT_NE(RunWithProfile(args).find("\"cache_hits\": 1, \"cache_misses\": 0"), std::string::npos);
+    EXPECT_EQ(ReadBytes(TempPath("cache_first.png")), ReadBytes(TempPath("cache_second.png")));
+
+    // Other options and another input are other jobs.
+    args.push_back("--level");
+    args.push_back("1");
+    EXPECT_NE(RunWithProfile(args).find("\"cache_misses\": 1"), std::string::npos);
+    WriteBytes(TempPath("cache_input.bmp"), InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(20, 14, 11)));
+    EXPECT_NE(RunWithProfile(args).find("\"cache_misses\": 1"), std::string::npos);
+
+    // Outputs of one run are looked up one by one.
+    std::vector<std::string> outputs = {"./image_processor", TempPath("cache_input.bmp"), TempPath("cache_third.png"),
+                                        "-gs", "-blur", "1", "--level", "1", "--output",
+                                        TempPath("cache_fourth.bmp"), "-sharp", "--cache", cache, "--profile"};
+    EXPECT_NE(RunWithProfile(outputs).find("\"cache_hits\": 1, \"cache_misses\": 1"), std::string::npos);
+    EXPECT_NE(RunWithProfile(outputs).find("\"cache_hits\": 2, \"cache_misses\": 0"), std::string::npos);
+    EXPECT_TRUE(SamePixels(Pipeline::Compile({"-sharp"}).Run(MakeTestPicture(20, 14, 11)),
+                           InputOutputProcessing::LoadImageFile(TempPath("cache_fourth.bmp"))));
+}
+
+TEST(CacheTests, RunOptionsKeepCopy) {
+    std::string cache = TempPath("copy_cache");
+    std::filesystem::remove_all(cache);
+    std::vector<std::byte> input = InputOutputProcessing::EncodeBmpToBuffer(MakeTestPicture(20, 14, 12));
+    WriteBytes(TempPath("copy_cache_input.bmp"), input);
+    // A run without filters copies the file without decoding it, so nothing is loaded or filtered.
+    std::vector<std::string> args = {"./image_processor", TempPath("copy_cache_input.bmp"),
+                                     TempPath("copy_cache_output.bmp"), "--cache", cache, "--profile"};
+    std::string profile = RunWithProfile(args);
+    EXPECT_NE(profile.find("\"load_ms\": 0.000, \"filters_ms\": 0.000"), std::string::npos) << profile;
+    EXPECT_NE(profile.find("\"cache_hits\": 0, \"cache_misses\": 1"), std::string::npos) << profile;
+    EXPECT_EQ(ReadBytes(TempPath("copy_cache_output.bmp")), input);
+
+    args[2] = TempPath("copy_cache_second.bmp");
+    EXPECT_NE(RunWithProfile(args).find("\"cache_hits\": 1, \"cache_misses\": 0"), std::string::npos);
+    EXPECT_EQ(ReadBytes(TempPath("copy_cache_second.bmp")), input);
+
+    // Tile hashes left by an incremental run don't stand for an output written by the copy or by the cache.
+    for (bool cached : {false, true}) {
+        std::filesystem::remove_all(cache);
+        args[2] = TempPath(cached ? "copy_cache_second.bmp" : "copy_cache_output.bmp");
+        if (cached) {
+            RunWithProfile(args);
+        }
+        WriteBytes(args[2] + TileHashesSuffix, std::vector<std::byte>(16, std::byte{1}));
+        RunWithProfile(args);
+        EXPECT_FALSE(std::filesystem::exists(args[2] + TileHashesSuffix));
+    }
+}
+
+TEST(CacheTests, EvictsLeastRecentlyUsed) {
+    std::string directory = TempPath("lru_cache");
+    std::filesystem::remove_all(directory);
+    ResultCache cache(directory, 2500);
+    WriteBytes(TempPath("lru_entry"), std::vector<std::byte>(1000, std::byte{7}));
+    cache.Store(1, TempPath("lru_entry"));
+    cache.Store(2, TempPath("lru_entry"));
+    // Entries are ordered by their times, which may be coarse, so they are set far apart.
+    auto now = std::filesystem::file_time_type::clock::now();
+    std::filesystem::path entries(directory);
+    std::filesystem::last_write_time(entries / "0000000000000001", now - std::chrono::hours(2));
+    std::filesystem::last_write_time(entries / "0000000000000002", now - std::chrono::hours(1));
+    EXPECT_TRUE(cache.Fetch(1, TempPath("lru_output")));
+    cache.Store(3, TempPath("lru_entry"));
+    EXPECT_EQ(cache.Evictions(), 1);
+    EXPECT_TRUE(cache.Fetch(1, TempPath("lru_output")));
+    EXPECT_FALSE(cache.Fetch(2, TempPath("lru_output")));
+    EXPECT_TRUE(cache.Fetch(3, TempPath("lru_output")));
+    EXPECT_EQ(ReadBytes(TempPath("lru_output")), std::vector<std::byte>(1000, std::byte{7}));
+    EXPECT_EQ(cache.Hits(), 3);
+    EXPECT_EQ(cache.Misses(), 1);
+}
+
+// Paints a small square of the image, as an editor would.
+void Retouch(PictureInfo &picture_info, LONG x, LONG y) {
+    for (LONG row = y; row < y + 3; ++row) {
+        for (LONG column = x; column < x + 3; ++column) {
+            if (picture_info.Deep()) {
+                picture_info.deep_pixels[row][column].green ^= 0x5555;
+            } else {
+                picture_info.pixels[row][column].green ^= 0x55;
+            }
+        }
+    }
+}
+
+TEST(IncrementalTests, PatchedTilesMatchFullRun) {
+    Pipeline pipeline = Pipeline::Compile({"-sharp", "-blur", "1", "-neg", "-edge", "0.3"});
+    for (bool deep : {false, true}) {
+        PictureInfo before = deep ? MakeDeepPicture(150, 100, 12, false) : MakeTopDown(MakeTestPicture(150, 100, 12));
+        PictureInfo after = before;
+        Retouch(after, 70, 40);
+        Retouch(after, 146, 97);
+        TileHashes previous = TileHashes::Compute(before, 1, 16);
+        TileHashes current = TileHashes::Compute(after, 1, 16);
+        ASSERT_TRUE(current.Comparable(previous));
+        std::vector<size_t> dirty = current.DirtyTiles(previous, pipeline.Halo());
+        EXPECT_LT(dirty.size(), current.hashes.size() / 4);
+        std::vector<TileRect> tiles;
+        for (size_t index : dirty) {
+            tiles.push_back(current.Tiles()[index]);
+        }
+        PictureInfo output = pipeline.Run(before);
+        pipeline.ApplyToTiles(after, output, tiles, TileScheduler(2));
+        PictureInfo expected = pipeline.Run(after);
+        EXPECT_TRUE(deep ? SameDeepPixels(expected, output) : SamePixels(expected, output));
+    }
+    EXPECT_FALSE(TileHashes::Compute(MakeTestPicture(10, 10, 1), 1).Comparable(
+        TileHashes::Compute(MakeTestPicture(10, 10, 1), 2)));
+    PictureInfo picture_info = MakeTestPicture(10, 10, 1);
+    Pipeline pixelize = Pipeline::Compile(std::vector<std::string>{"-pix", "2"});
+    EXPECT_THROW(pixelize.ApplyToTiles(picture_info, picture_info, {}, TileScheduler(1)), FilterException);
+}
+
+TEST(IncrementalTests, IncrementalOption) {
+    PictureInfo picture_info = MakeTestPicture(200, 150, 13);
+    std::string input = TempPath("incremental_input.bmp");
+    std::string output = TempPath("incremental_output.png");
+    std::filesystem::remove(output + TileHashesSuffix);
+    WriteBytes(input, InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    std::vector<std::string> args = {"./image_processor", input, output, "-blur", "2", "-sharp", "--incremental",
+                                     "--profile"};
+    EXPECT_NE(RunWithProfile(args).find("\"tiles\": 12, \"recomputed_tiles\": 12"), std::string::npos);
+    EXPECT_NE(RunWithProfile(args).find("\"recomputed_tiles\": 0"), std::string::npos);
+
+    Retouch(picture_info, 10, 10);
+    WriteBytes(input, InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+    EXPECT_NE(RunWithProfile(args).find("\"recomputed_tiles\": 4}"), std::string::npos);
+    EXPECT_TRUE(SamePixels(MakeTopDown(Pipeline::Compile({"-blur", "2", "-sharp"}).Run(picture_info)),
+                           InputOutputProcessing::LoadImageFile(output)));
+
+    // Other filters can't reuse the output, and neither can chains that need the whole image.
+    args[4] = "1";
+    EXPECT_NE(RunWithProfile(args).find("\"recomputed_tiles\": 12"), std::string::npos);
+    args.insert(args.begin() + 3, {"-pix", "3"});
+    EXPECT_NE(RunWithProfile(args).find("\"tiles\": 0"), std::string::npos);
+    EXPECT_TRUE(SamePixels(MakeTopDown(Pipeline::Compile({"-pix", "3", "-blur", "1", "-sharp"}).Run(picture_info)),
+                           InputOutputProcessing::LoadImageFile(output)));
+}
+
+TEST(IncrementalTests, OtherWritesDropHashes) {
+    PictureInfo first = MakeTestPicture(200, 150, 16);
+    PictureInfo second = first;
+    Retouch(second, 100, 80);
+    PictureInfo third = second;
+    Retouch(third, 20, 120);
+    std::string input = TempPath("stale_input.bmp");
+    std::string output = TempPath("stale_output.png");
+    std::string cache = TempPath("stale_cache");
+    auto run = [&input](const PictureInfo &picture_info, std::vector<std::string> args) {
+        WriteBytes(input, InputOutputProcessing::EncodeBmpToBuffer(picture_info));
+        return RunWithProfile(args);
+    };
+
+    // A run without --incremental writes the output the hashes of the first input don't stand for.
+    std::filesystem::remove(output + TileHashesSuffix);
+    std::vector<std::string> args = {"./image_processor", input, output, "-blur", "1", "--incremental", "--profile"};
+    run(first, args);
+    run(second, std::vector<std::string>{"./image_processor", input, output, "-blur", "1"});
+    EXPECT_NE(run(first, args).find("\"recomputed_tiles\": 12"), std::string::npos);
+    EXPECT_TRUE(SamePixels(MakeTopDown(Pipeline::Compile(std::vector<std::string>{"-blur", "1"}).Run(first)),
+                           InputOutputProcessing::LoadImageFile(output)));
+
+    // Neither do they stand for an output fetched from the cache.
+    std::filesystem::remove(output + TileHashesSuffix);
+    std::filesystem::remove_all(cache);
+    args.insert(args.end(), {"--cache", cache});
+    for (const PictureInfo *picture_info : {&first, &second, &first, &third}) {
+        run(*picture_info, args);
+    }
+    EXPECT_TRUE(SamePixels(MakeTopDown(Pipeline::Compile(std::vector<std::string>{"-blur", "1"}).Run(third)),
+                           InputOutputProcessing::LoadImageFile(output)));
+}
+
+// Bands of three colors with a small noisy patch, like a flag with a logo.
+PictureInfo MakeFlatPicture(LONG width, LONG height) {
+    PictureInfo picture_info = MakeTestPicture(width, height, 14);
+    const Pixel colors[] = {{200, 30, 40, 255}, {255, 255, 255, 255}, {20, 90, 180, 255}};
+    for (LONG y = 0; y < height; ++y) {
+        for (LONG x = 0; x < width; ++x) {
+            bool patch = x >= width / 3 && x < width / 3 + 20 && y >= height / 2 && y < height / 2 + 15;
+            if (!patch) {
+                picture_info.pixels[y][x] = colors[y * 3 / height];
+            }
+        }
+    }
+    return picture_info;
+}
+
+TEST(UniformTileTests, SameAsWholeImage) {
+    const std::vector<std::vector<std::string> > chains = {
+        {"-blur", "1.5"}, {"-sharp"}, {"-edge", "0.2"}, {"-neg", "-gs"}, {"-blur", "1", "-sharp", "-edge", "0.1"},
+        {"-crop", "150", "100", "-pix", "4"}};
+    PictureInfo flat = MakeFlatPicture(300, 200);
+    PictureInfo deep = flat;
+    deep.SetDeep(true);
+    for (const std::vector<std::string> &chain : chains) {
+        Pipeline pipeline = Pipeline::Compile(chain);
+        for (const PictureInfo &picture_info : {flat, MakeTopDown(flat), MakeTestPicture(100, 70, 15)}) {
+            PictureInfo in_tiles = picture_info;
+            pipeline.ApplyInTiles(in_tiles, TileScheduler(2), 16);
+            EXPECT_TRUE(SamePixels(pipeline.Run(picture_info), in_tiles)) << chain.front();
+        }
+        PictureInfo deep_in_tiles = deep;
+        pipeline.ApplyInTiles(deep_in_tiles, TileScheduler(2), 16);
+        EXPECT_TRUE(SameDeepPixels(pipeline.Run(deep), deep_in_tiles)) << chain.front();
+    }
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();